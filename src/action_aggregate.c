@@ -0,0 +1,334 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "action_aggregate.h"
+
+#include "arena.h"
+#include "common.h"
+#include "expressions.h"
+#include "writer.h"
+
+/** @brief Initial number of the histogram's buckets, must be a power of 2 */
+#define AGGR_TABLE_SIZE 64
+
+/**
+ * @brief Key of the -group-by histogram.
+ */
+enum aggr_key {
+    AGGR_KEY_EXT,     /**< extension of the file name */
+    AGGR_KEY_DIR,     /**< directory containing the file */
+    AGGR_KEY_DEPTH,   /**< depth in the tree */
+    AGGR_KEY_UID      /**< user ID of the owner */
+};
+
+/**
+ * @brief Counter of -count and -sum-size actions.
+ */
+struct aggr_counter {
+    unsigned long long value;   /**< number of files or sum of their sizes */
+};
+
+/**
+ * @brief Key of the histogram with the number of files.
+ */
+struct aggr_bucket {
+    uint64_t hash;              /**< hash of the key */
+    unsigned long long count;   /**< number of the files with the key */
+    size_t len;                 /**< length of the key */
+    char key[];                 /**< the key (NUL-terminated) */
+};
+
+/**
+ * @brief Histogram of -group-by action, open addressing hash table of the keys.
+ *
+ * The table and the keys are allocated from the query's arena, so nothing is freed separately.
+ */
+struct aggr_table {
+    struct arena *arena;            /**< arena to allocate the buckets from */
+    enum aggr_key key;              /**< key of the histogram */
+    unsigned int size;              /**< number of the slots in the buckets array (power of 2) */
+    unsigned int used;              /**< number of the used slots */
+    struct aggr_bucket **buckets;   /**< the slots */
+};
+
+int
+expr_action_count_compile(struct arena *arena, const char *UNUSED(arg), void **data, enum expr_need *UNUSED(need))
+{
+    *data = arena_calloc(arena, sizeof(struct aggr_counter));
+
+    return *data ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * -count action: count the file
+ */
+enum expr_result
+expr_action_count_clb(const struct rfind_entry *UNUSED(file), FILE *UNUSED(stream), const char *UNUSED(arg), void *data)
+{
+    ((struct aggr_counter *)data)->value++;
+
+    return EXPR_TRUE;
+}
+
+/**
+ * -sum-size action: add the file's size
+ */
+enum expr_result
+expr_action_sum_size_clb(const struct rfind_entry *file, FILE *UNUSED(stream), const char *UNUSED(arg), void *data)
+{
+    ((struct aggr_counter *)data)->value += file->st->st_size;
+
+    return EXPR_TRUE;
+}
+
+int
+expr_action_count_report(FILE *stream, void *data)
+{
+    fprintf(stream, "%llu\n", ((struct aggr_counter *)data)->value);
+
+    return EXIT_SUCCESS;
+}
+
+int
+expr_action_group_by_compile(struct arena *arena, const char *arg, void **data, enum expr_need *need)
+{
+    struct aggr_table *table;
+    enum aggr_key key;
+
+    if (!strcmp(arg, "ext")) {
+        key = AGGR_KEY_EXT;
+    } else if (!strcmp(arg, "dir")) {
+        key = AGGR_KEY_DIR;
+    } else if (!strcmp(arg, "depth")) {
+        key = AGGR_KEY_DEPTH;
+    } else if (!strcmp(arg, "uid")) {
+        key = AGGR_KEY_UID;
+    } else {
+        LOG("invalid -group-by key \"%s\".", arg);
+        return EXIT_FAILURE;
+    }
+
+    table = arena_calloc(arena, sizeof *table);
+    if (!table) {
+        return EXIT_FAILURE;
+    }
+    table->buckets = arena_calloc(arena, AGGR_TABLE_SIZE * sizeof *table->buckets);
+    if (!table->buckets) {
+        return EXIT_FAILURE;
+    }
+    table->arena = arena;
+    table->key = key;
+    table->size = AGGR_TABLE_SIZE;
+
+    *need = (key == AGGR_KEY_UID) ? EXPR_NEED_STAT : EXPR_NEED_TYPE;
+    *data = table;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief FNV-1a hash of the key.
+ */
+static uint64_t
+aggr_hash(const char *key, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Double the number of the histogram's slots.
+ *
+ * @param[in] table Histogram to grow.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+aggr_table_grow(struct aggr_table *table)
+{
+    struct aggr_bucket **buckets;
+    unsigned int size = table->size * 2, i, j;
+
+    /* the previous array stays in the arena, the geometric growth keeps the waste below the half */
+    buckets = arena_calloc(table->arena, size * sizeof *buckets);
+    if (!buckets) {
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < table->size; i++) {
+        if (!table->buckets[i]) {
+            continue;
+        }
+        for (j = table->buckets[i]->hash & (size - 1); buckets[j]; j = (j + 1) & (size - 1)) {}
+        buckets[j] = table->buckets[i];
+    }
+    table->buckets = buckets;
+    table->size = size;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Count the file with the key into the histogram.
+ *
+ * @param[in] table Histogram to update.
+ * @param[in] key Key of the file.
+ * @param[in] len Length of the @p key.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+aggr_table_add(struct aggr_table *table, const char *key, size_t len)
+{
+    uint64_t hash = aggr_hash(key, len);
+    struct aggr_bucket *b;
+    unsigned int i;
+
+    for (i = hash & (table->size - 1); (b = table->buckets[i]); i = (i + 1) & (table->size - 1)) {
+        if ((b->hash == hash) && (b->len == len) && !memcmp(b->key, key, len)) {
+            b->count++;
+            return EXIT_SUCCESS;
+        }
+    }
+
+    /* new key */
+    b = arena_alloc(table->arena, sizeof *b + len + 1);
+    if (!b) {
+        return EXIT_FAILURE;
+    }
+    b->hash = hash;
+    b->count = 1;
+    b->len = len;
+    memcpy(b->key, key, len);
+    b->key[len] = '\0';
+    table->buckets[i] = b;
+
+    /* keep the load factor below 3/4 */
+    if (++table->used * 4 > table->size * 3) {
+        return aggr_table_grow(table);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * -group-by action: count the file in the histogram
+ */
+enum expr_result
+expr_action_group_by_clb(const struct rfind_entry *file, FILE *UNUSED(stream), const char *UNUSED(arg), void *data)
+{
+    struct aggr_table *table = data;
+    const char *key = "";
+    char buf[24];
+    size_t len = 0;
+
+    switch (table->key) {
+    case AGGR_KEY_EXT:
+        key = strrchr(file->name, '.');
+        if (key && (key != file->name)) {
+            key++;
+            len = strlen(key);
+        }
+        break;
+    case AGGR_KEY_DIR:
+        /* dirname(3) of the path, without modifying it */
+        key = file->path;
+        len = strlen(key);
+        while ((len > 1) && (key[len - 1] == '/')) {
+            len--;
+        }
+        while (len && (key[len - 1] != '/')) {
+            len--;
+        }
+        while ((len > 1) && (key[len - 1] == '/')) {
+            len--;
+        }
+        if (!len) {
+            key = ".";
+            len = 1;
+        }
+        break;
+    case AGGR_KEY_DEPTH:
+        key = writer_uint_str(&buf[sizeof buf], file->depth, 10);
+        len = &buf[sizeof buf] - key;
+        break;
+    case AGGR_KEY_UID:
+        key = writer_uint_str(&buf[sizeof buf], file->st->st_uid, 10);
+        len = &buf[sizeof buf] - key;
+        break;
+    }
+
+    if (aggr_table_add(table, key ? key : "", len)) {
+        return EXPR_FALSE;
+    }
+    return EXPR_TRUE;
+}
+
+/**
+ * @brief Compare the histogram's buckets by the key as strings for qsort().
+ */
+static int
+aggr_bucket_cmp(const void *a, const void *b)
+{
+    const struct aggr_bucket *b1 = *(const struct aggr_bucket **)a, *b2 = *(const struct aggr_bucket **)b;
+
+    return strcmp(b1->key, b2->key);
+}
+
+/**
+ * @brief Compare the histogram's buckets by the key as (non-negative) numbers for qsort().
+ */
+static int
+aggr_bucket_cmp_num(const void *a, const void *b)
+{
+    const struct aggr_bucket *b1 = *(const struct aggr_bucket **)a, *b2 = *(const struct aggr_bucket **)b;
+
+    if (b1->len != b2->len) {
+        return (b1->len > b2->len) - (b1->len < b2->len);
+    }
+    return memcmp(b1->key, b2->key, b1->len);
+}
+
+int
+expr_action_group_by_report(FILE *stream, void *data)
+{
+    struct aggr_table *table = data;
+    struct aggr_bucket **sorted;
+    unsigned int i, count = 0;
+
+    if (!table->used) {
+        return EXIT_SUCCESS;
+    }
+
+    sorted = malloc(table->used * sizeof *sorted);
+    if (!sorted) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < table->size; i++) {
+        if (table->buckets[i]) {
+            sorted[count++] = table->buckets[i];
+        }
+    }
+    qsort(sorted, count, sizeof *sorted,
+            (table->key == AGGR_KEY_DEPTH || table->key == AGGR_KEY_UID) ? aggr_bucket_cmp_num : aggr_bucket_cmp);
+
+    for (i = 0; i < count; i++) {
+        fprintf(stream, "%llu %s\n", sorted[i]->count, sorted[i]->key);
+    }
+
+    free(sorted);
+    return EXIT_SUCCESS;
+}
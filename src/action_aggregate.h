@@ -0,0 +1,79 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _ACTION_AGGREGATE_H
+#define _ACTION_AGGREGATE_H
+
+#include <stdio.h>
+
+#include "arena.h"
+#include "expressions.h"
+
+/**
+ * @brief help string for -count
+ */
+#define expr_action_count_help \
+    "    -count\n" \
+    "            Count the files and print the number on exit instead of printing\n" \
+    "            the files.\n"
+
+/**
+ * @brief help string for -sum-size
+ */
+#define expr_action_sum_size_help \
+    "    -sum-size\n" \
+    "            Sum the sizes (in bytes) of the files and print the total on exit.\n"
+
+/**
+ * @brief help string for -group-by
+ */
+#define expr_action_group_by_help \
+    "    -group-by KEY\n" \
+    "            Count the files per KEY and print the histogram (the count and the\n" \
+    "            key on each line, sorted by the key) on exit. The KEY is one of:\n" \
+    "              ext    extension of the file name (empty for no extension)\n" \
+    "              dir    directory containing the file\n" \
+    "              depth  depth in the tree\n" \
+    "              uid    user ID of the file's owner\n"
+
+/**
+ * @brief expr_action_compile_clb implementation for -count and -sum-size actions.
+ */
+int expr_action_count_compile(struct arena *arena, const char *arg, void **data, enum expr_need *need);
+
+/**
+ * @brief expr_action_clb implementation for -count action.
+ */
+enum expr_result expr_action_count_clb(const struct rfind_entry *file, FILE *stream, const char *arg, void *data);
+
+/**
+ * @brief expr_action_clb implementation for -sum-size action.
+ */
+enum expr_result expr_action_sum_size_clb(const struct rfind_entry *file, FILE *stream, const char *arg, void *data);
+
+/**
+ * @brief expr_action_report_clb implementation for -count and -sum-size actions.
+ */
+int expr_action_count_report(FILE *stream, void *data);
+
+/**
+ * @brief expr_action_compile_clb implementation for -group-by action.
+ *
+ * The key is checked and the empty histogram is prepared.
+ */
+int expr_action_group_by_compile(struct arena *arena, const char *arg, void **data, enum expr_need *need);
+
+/**
+ * @brief expr_action_clb implementation for -group-by action.
+ */
+enum expr_result expr_action_group_by_clb(const struct rfind_entry *file, FILE *stream, const char *arg, void *data);
+
+/**
+ * @brief expr_action_report_clb implementation for -group-by action.
+ */
+int expr_action_group_by_report(FILE *stream, void *data);
+
+#endif /* _ACTION_AGGREGATE_H */
@@ -0,0 +1,266 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _GNU_SOURCE /* F_DUPFD_CLOEXEC, unlinkat() */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "action_delete.h"
+
+#include "common.h"
+#include "expressions.h"
+
+/**
+ * @brief Queue the job to be run by the workers.
+ *
+ * @param[in] del The deleter, the lock is held.
+ * @param[in] job Job ready to be run.
+ */
+static void
+delete_queue(struct deleter *del, struct delete_job *job)
+{
+    job->next = NULL;
+    *del->tail = job;
+    del->tail = &job->next;
+    pthread_cond_signal(&del->work);
+}
+
+/**
+ * @brief Account the finished job in its directory and free it.
+ *
+ * @param[in] del The deleter, the lock is held.
+ * @param[in] job The finished job.
+ */
+static void
+delete_job_done(struct deleter *del, struct delete_job *job)
+{
+    struct delete_dir *dir = job->dir;
+
+    if (dir && !--dir->pending) {
+        /* all the files are deleted, the directory can go */
+        if (dir->rmdir) {
+            delete_queue(del, dir->rmdir);
+            dir->rmdir = NULL;
+        }
+        if (!dir->held) {
+            free(dir);
+        }
+    }
+    free(job);
+    del->jobs--;
+    pthread_cond_broadcast(&del->room);
+}
+
+/**
+ * @brief Worker thread: run the queued jobs.
+ *
+ * @param[in] arg The deleter.
+ * @return NULL
+ */
+static void *
+delete_worker(void *arg)
+{
+    struct deleter *del = arg;
+    struct delete_job *job;
+    int err;
+
+    pthread_mutex_lock(&del->lock);
+    while (1) {
+        if (!(job = del->head)) {
+            if (del->stop) {
+                break;
+            }
+            pthread_cond_wait(&del->work, &del->lock);
+            continue;
+        }
+        del->head = job->next;
+        if (!del->head) {
+            del->tail = &del->head;
+        }
+        pthread_mutex_unlock(&del->lock);
+
+        /* relatively to the directory, a symlink is removed itself and a replaced directory is not entered */
+        err = (unlinkat(job->dirfd, job->name, job->flags) == -1) ? errno : 0;
+        if (job->dirfd != AT_FDCWD) {
+            close(job->dirfd);
+        }
+        if (err) {
+            LOG("unable to delete %s (%s).", job->path, strerror(err));
+        }
+
+        pthread_mutex_lock(&del->lock);
+        if (err) {
+            del->failed = 1;
+        }
+        delete_job_done(del, job);
+    }
+    pthread_mutex_unlock(&del->lock);
+
+    return NULL;
+}
+
+int
+delete_start(struct deleter *del)
+{
+    sigset_t set, orig;
+
+    memset(del, 0, sizeof *del);
+    del->tail = &del->head;
+    del->dirfd = AT_FDCWD;
+    pthread_mutex_init(&del->lock, NULL);
+    pthread_cond_init(&del->work, NULL);
+    pthread_cond_init(&del->room, NULL);
+
+    /* the signals are delivered to the application's threads */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &orig);
+    for (; del->threads_count < DELETE_THREADS; del->threads_count++) {
+        if (pthread_create(&del->threads[del->threads_count], NULL, delete_worker, del)) {
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &orig, NULL);
+
+    if (!del->threads_count) {
+        LOG("unable to start the delete threads.");
+        delete_stop(del);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int
+delete_stop(struct deleter *del)
+{
+    int ret;
+
+    pthread_mutex_lock(&del->lock);
+    while (del->jobs && del->threads_count) {
+        pthread_cond_wait(&del->room, &del->lock);
+    }
+    del->stop = 1;
+    pthread_cond_broadcast(&del->work);
+    pthread_mutex_unlock(&del->lock);
+    for (unsigned int i = 0; i < del->threads_count; i++) {
+        pthread_join(del->threads[i], NULL);
+    }
+    del->threads_count = 0;
+    ret = del->failed ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    pthread_cond_destroy(&del->room);
+    pthread_cond_destroy(&del->work);
+    pthread_mutex_destroy(&del->lock);
+
+    return ret;
+}
+
+struct delete_dir *
+delete_dir_new(void)
+{
+    struct delete_dir *dir;
+
+    dir = calloc(1, sizeof *dir);
+    if (!dir) {
+        LOG("%s", strerror(errno));
+        return NULL;
+    }
+    dir->held = 1;
+
+    return dir;
+}
+
+void
+delete_dir_release(struct deleter *del, struct delete_dir *dir)
+{
+    if (!dir) {
+        return;
+    }
+
+    pthread_mutex_lock(&del->lock);
+    if (dir->pending) {
+        /* freed by the last deletion of its files */
+        dir->held = 0;
+    } else {
+        free(dir);
+    }
+    pthread_mutex_unlock(&del->lock);
+}
+
+void
+delete_dir_wait(struct deleter *del, struct delete_dir *dir)
+{
+    pthread_mutex_lock(&del->lock);
+    while (dir->pending) {
+        pthread_cond_wait(&del->room, &del->lock);
+    }
+    pthread_mutex_unlock(&del->lock);
+}
+
+void
+delete_bind(struct deleter *del, struct delete_dir *dir, int dirfd, struct delete_dir *self)
+{
+    del->dir = dir;
+    del->dirfd = dirfd;
+    del->self = self;
+}
+
+enum expr_result
+expr_action_delete_clb(const struct rfind_entry *file, FILE *UNUSED(stream), const char *UNUSED(arg), void *data)
+{
+    struct deleter *del = data;
+    struct delete_job *job;
+    size_t len = strlen(file->path);
+
+    if (!file->depth && !strcmp(file->path, ".")) {
+        /* the current directory cannot be removed, skip it as find(1) does */
+        return EXPR_TRUE;
+    }
+
+    job = malloc(sizeof *job + len + 1);
+    if (!job) {
+        LOG("%s", strerror(errno));
+        return EXPR_FALSE;
+    }
+    memcpy(job->path, file->path, len + 1);
+    job->name = file->depth ? &job->path[file->name - file->path] : job->path;
+    job->flags = S_ISDIR(file->st->st_mode) ? AT_REMOVEDIR : 0;
+    job->dir = del->dir;
+    job->dirfd = file->depth ? fcntl(del->dirfd, F_DUPFD_CLOEXEC, 0) : AT_FDCWD;
+    if (job->dirfd == -1) {
+        LOG("unable to delete %s (%s).", file->path, strerror(errno));
+        free(job);
+        pthread_mutex_lock(&del->lock);
+        del->failed = 1;
+        pthread_mutex_unlock(&del->lock);
+        return EXPR_FALSE;
+    }
+
+    pthread_mutex_lock(&del->lock);
+    while (del->jobs >= DELETE_JOBS_MAX) {
+        pthread_cond_wait(&del->room, &del->lock);
+    }
+    del->jobs++;
+    if (job->dir) {
+        job->dir->pending++;
+    }
+    if (del->self && del->self->pending && !del->self->rmdir) {
+        /* the directory is deleted after the files in it */
+        del->self->rmdir = job;
+    } else {
+        delete_queue(del, job);
+    }
+    pthread_mutex_unlock(&del->lock);
+
+    return EXPR_TRUE;
+}
@@ -0,0 +1,141 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _ACTION_DELETE_H
+#define _ACTION_DELETE_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "expressions.h"
+#include "rfind.h"
+
+/** @brief Number of the threads deleting the files */
+#define DELETE_THREADS 8
+
+/** @brief Maximum number of the unfinished deletions (each holds a descriptor), the scan waits above it */
+#define DELETE_JOBS_MAX 256
+
+/**
+ * @brief help string for -delete
+ */
+#define expr_action_delete_help \
+    "    -delete\n" \
+    "            Delete the file. The directories are evaluated after the files\n" \
+    "            in them (as with -depth of find(1)). The files are deleted\n" \
+    "            relatively to their directory by a pool of threads, so the\n" \
+    "            symbolic links are never followed. True when the deletion was\n" \
+    "            queued, the failures are reported and change the exit status.\n" \
+    "            Cannot be combined with -L.\n"
+
+/**
+ * @brief Directory with the files being deleted.
+ *
+ * The record is created by the scan for each traversed directory and held until the directory is
+ * evaluated (after its files). It is freed when it is not held and none of its files' deletions is pending.
+ */
+struct delete_dir {
+    unsigned int pending;         /**< number of the unfinished deletions of the files in the directory */
+    int held;                     /**< flag the scan still refers to the record */
+    struct delete_job *rmdir;     /**< deletion of the directory itself waiting for the files in it */
+};
+
+/**
+ * @brief Deletion of a single file.
+ */
+struct delete_job {
+    struct delete_job *next;      /**< next job in the queue */
+    struct delete_dir *dir;       /**< directory of the file (its pending deletions), NULL for the starting paths */
+    int dirfd;                    /**< descriptor of the file's directory owned by the job, AT_FDCWD for the starting paths */
+    int flags;                    /**< flags of unlinkat() */
+    const char *name;             /**< name of the file relative to the dirfd (in the path) */
+    char path[];                  /**< path of the file for the messages */
+};
+
+/**
+ * @brief Pool of the threads deleting the files (-delete), the action's data.
+ *
+ * The scan binds the directory of the evaluated files, see delete_bind(). The action queues the
+ * deletion of the file with a duplicated descriptor of its directory, the deletion of a directory
+ * is queued when all the deletions of its files are finished. The subtrees are deleted
+ * concurrently with the traversal of their siblings.
+ */
+struct deleter {
+    pthread_mutex_t lock;         /**< lock of the queue and the directories' pending counters */
+    pthread_cond_t work;          /**< signal for the workers that a job was queued */
+    pthread_cond_t room;          /**< signal for the scan that a job was finished */
+    struct delete_job *head;      /**< queue of the jobs ready to be run */
+    struct delete_job **tail;     /**< link to append the next job to */
+    unsigned int jobs;            /**< number of the unfinished jobs (queued, running and waiting for the files) */
+    int failed;                   /**< flag some deletion failed */
+    int stop;                     /**< flag for the workers to terminate */
+    unsigned int threads_count;   /**< number of the running workers */
+    pthread_t threads[DELETE_THREADS]; /**< the workers */
+
+    struct delete_dir *dir;       /**< directory of the evaluated file, NULL for the starting paths */
+    int dirfd;                    /**< descriptor of the dir, AT_FDCWD for the starting paths */
+    struct delete_dir *self;      /**< the evaluated file's own record when it is a traversed directory, NULL otherwise */
+};
+
+/**
+ * @brief Start the worker threads.
+ *
+ * @param[in] del Deleter to start.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int delete_start(struct deleter *del);
+
+/**
+ * @brief Wait for all the deletions and stop the worker threads.
+ *
+ * @param[in] del Deleter to stop, all the directory records are released.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE if any deletion failed.
+ */
+int delete_stop(struct deleter *del);
+
+/**
+ * @brief Create the held record of the traversed directory.
+ *
+ * @return The new record, NULL on error.
+ */
+struct delete_dir *delete_dir_new(void);
+
+/**
+ * @brief Release the scan's hold of the directory record.
+ *
+ * @param[in] del The deleter.
+ * @param[in] dir Record to release, NULL is accepted.
+ */
+void delete_dir_release(struct deleter *del, struct delete_dir *dir);
+
+/**
+ * @brief Wait until all the deletions of the files in the directory are finished.
+ *
+ * @param[in] del The deleter.
+ * @param[in] dir The directory record.
+ */
+void delete_dir_wait(struct deleter *del, struct delete_dir *dir);
+
+/**
+ * @brief Set the directory of the file to be evaluated.
+ *
+ * @param[in] del The deleter.
+ * @param[in] dir Record of the file's directory, NULL for the starting paths.
+ * @param[in] dirfd Descriptor of the file's directory, AT_FDCWD for the starting paths.
+ * @param[in] self Record of the file itself if it is a directory evaluated after its files, NULL otherwise.
+ */
+void delete_bind(struct deleter *del, struct delete_dir *dir, int dirfd, struct delete_dir *self);
+
+/**
+ * @brief expr_action_clb implementation for -delete action.
+ *
+ * The action's data is the query's deleter.
+ */
+enum expr_result expr_action_delete_clb(const struct rfind_entry *file, FILE *stream, const char *arg, void *data);
+
+#endif /* _ACTION_DELETE_H */
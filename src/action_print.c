@@ -12,14 +12,19 @@
 
 #include "common.h"
 #include "expressions.h"
+#include "record.h"
 
 /**
- * -print action: print filepath with newline
+ * -print action: print filepath with newline, or the file's record when bound to the records output
  */
 enum expr_result
-expr_action_print_clb(const char *filepath, const char *UNUSED(arg))
+expr_action_print_clb(const struct rfind_entry *file, FILE *stream, const char *UNUSED(arg), void *data)
 {
-    fprintf(stdout, "%s\n", filepath);
+    if (data) {
+        record_print(data, file);
+    } else {
+        fprintf(stream, "%s\n", file->path);
+    }
 
     return EXPR_TRUE;
 }
@@ -28,9 +33,9 @@ expr_action_print_clb(const char *filepath, const char *UNUSED(arg))
  * -print0 action: print filepath without newline
  */
 enum expr_result
-expr_action_print0_clb(const char *filepath, const char *UNUSED(arg))
+expr_action_print0_clb(const struct rfind_entry *file, FILE *stream, const char *UNUSED(arg), void *UNUSED(data))
 {
-    fprintf(stdout, "%s%c", filepath, 0);
+    fprintf(stream, "%s%c", file->path, 0);
 
     return EXPR_TRUE;
 }
@@ -20,7 +20,7 @@
 /**
  * @brief expr_action_clb implementation for -print action.
  */
-enum expr_result expr_action_print_clb(const char *filepath, const char *arg);
+enum expr_result expr_action_print_clb(const struct rfind_entry *file, FILE *stream, const char *arg, void *data);
 
 /**
  * @brief help string for -print0
@@ -33,6 +33,6 @@ enum expr_result expr_action_print_clb(const char *filepath, const char *arg);
 /**
  * @brief expr_action_clb implementation for -print0 action.
  */
-enum expr_result expr_action_print0_clb(const char *filepath, const char *arg);
+enum expr_result expr_action_print0_clb(const struct rfind_entry *file, FILE *stream, const char *arg, void *data);
 
 #endif /* _ACTION_PRINT_H */
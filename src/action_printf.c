@@ -0,0 +1,751 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _GNU_SOURCE /* getpwuid_r(), getgrgid_r(), readlink(), localtime_r() */
+#include <errno.h>
+#include <grp.h>
+#include <limits.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "action_printf.h"
+
+#include "arena.h"
+#include "common.h"
+#include "expressions.h"
+#include "writer.h"
+
+/**
+ * @brief Types of the -printf emit operations.
+ */
+enum printf_op_type {
+    PRINTF_LITERAL,     /**< literal text (with the escapes already processed) */
+    PRINTF_STOP,        /**< \c - stop printing and flush the output */
+    PRINTF_PATH,        /**< %p */
+    PRINTF_NAME,        /**< %f */
+    PRINTF_DIR,         /**< %h */
+    PRINTF_RELPATH,     /**< %P */
+    PRINTF_ROOT,        /**< %H */
+    PRINTF_DEPTH,       /**< %d */
+    PRINTF_TYPE,        /**< %y */
+    PRINTF_TYPE_FOLLOW, /**< %Y */
+    PRINTF_LINK,        /**< %l */
+    PRINTF_INODE,       /**< %i */
+    /* the following operations need the complete stat information */
+    PRINTF_SIZE,        /**< %s */
+    PRINTF_KBLOCKS,     /**< %k */
+    PRINTF_BLOCKS,      /**< %b */
+    PRINTF_MODE,        /**< %m */
+    PRINTF_MODE_SYMB,   /**< %M */
+    PRINTF_USER,        /**< %u */
+    PRINTF_UID,         /**< %U */
+    PRINTF_GROUP,       /**< %g */
+    PRINTF_GID,         /**< %G */
+    PRINTF_NLINK,       /**< %n */
+    PRINTF_DEV,         /**< %D */
+    PRINTF_TIME         /**< %a, %c, %t, %Ak, %Ck, %Tk */
+};
+
+/**
+ * @brief Single emit operation of the compiled -printf format.
+ */
+struct printf_op {
+    enum printf_op_type type;  /**< type of the operation */
+    const char *str;           /**< literal text (PRINTF_LITERAL) */
+    size_t len;                /**< length of the literal text */
+    int width;                 /**< minimal field width, 0 for none */
+    int precision;             /**< maximal length of the string fields, -1 for none */
+    int left;                  /**< flag to left-justify the field ('-' flag) */
+    int plus;                  /**< flag to print the sign of the depth ('+' flag), other flags are ignored as in GNU find */
+    char time;                 /**< PRINTF_TIME: which time - 'A' (access), 'C' (status change) or 'T' (modification) */
+    char conv;                 /**< PRINTF_TIME: time conversion character, '\0' for the ctime(3) like format */
+};
+
+/**
+ * @brief Compiled -printf format.
+ */
+struct printf_prog {
+    unsigned int count;        /**< number of the operations */
+    struct printf_op *ops;     /**< emit operations */
+
+    uid_t uid;                 /**< cached user ID */
+    char user[64];             /**< name of the cached uid, empty if no user is cached */
+    gid_t gid;                 /**< cached group ID */
+    char group[64];            /**< name of the cached gid, empty if no group is cached */
+};
+
+/**
+ * @brief Write the field according to the operation's width and precision.
+ *
+ * @param[in] out Output buffer.
+ * @param[in] op Operation being processed.
+ * @param[in] str Value of the field.
+ * @param[in] len Length of the @p str.
+ * @param[in] numeric Flag if the value is a number (the precision does not apply).
+ */
+static void
+printf_field(struct writer *out, const struct printf_op *op, const char *str, size_t len, int numeric)
+{
+    int pad;
+
+    if (!numeric && (op->precision >= 0) && (len > (size_t)op->precision)) {
+        len = op->precision;
+    }
+    pad = op->width - (int)len;
+
+    if (pad > 0 && !op->left) {
+        writer_pad(out, ' ', pad);
+    }
+    writer_put(out, str, len);
+    if (pad > 0 && op->left) {
+        writer_pad(out, ' ', pad);
+    }
+}
+
+/**
+ * @brief Write the unsigned number field.
+ *
+ * @param[in] out Output buffer.
+ * @param[in] op Operation being processed.
+ * @param[in] num Number to write.
+ * @param[in] base Base of the number (8 or 10).
+ * @param[in] sign Flag to write the sign if requested by the op's flags.
+ */
+static void
+printf_number(struct writer *out, const struct printf_op *op, unsigned long long num, unsigned int base, int sign)
+{
+    char buf[24], *start;
+
+    start = writer_uint_str(&buf[sizeof buf], num, base);
+    if (sign && op->plus) {
+        *(--start) = '+';
+    }
+    printf_field(out, op, start, &buf[sizeof buf] - start, 1);
+}
+
+/**
+ * @brief Write the number with the fixed number of digits (with leading zeros or spaces).
+ *
+ * @param[in] buf Buffer to write to.
+ * @param[in] num Number to write.
+ * @param[in] digits Number of the digits, the number is not truncated.
+ * @param[in] pad Padding character.
+ * @return Number of the written characters.
+ */
+static size_t
+printf_digits(char *buf, long long num, unsigned int digits, char pad)
+{
+    char tmp[24], *start;
+    size_t len = 0, n;
+
+    if (num < 0) {
+        buf[len++] = '-';
+        num = -num;
+    }
+    start = writer_uint_str(&tmp[sizeof tmp], num, 10);
+    n = &tmp[sizeof tmp] - start;
+    for (; n < digits; digits--) {
+        buf[len++] = pad;
+    }
+    memcpy(&buf[len], start, n);
+
+    return len + n;
+}
+
+/**
+ * @brief Write the single time conversion.
+ *
+ * The numeric conversions are formatted directly, the locale-dependent ones via strftime(3). As in GNU find,
+ * the seconds are followed by the fractional part.
+ *
+ * @param[in] buf Buffer to write to (at least 128 characters).
+ * @param[in] conv Conversion character, '\0' for the ctime(3) like format.
+ * @param[in] ts Time to write.
+ * @param[in] tm Broken-down @p ts in the local time.
+ * @return Number of the written characters.
+ */
+static size_t
+printf_time_conv(char *buf, char conv, const struct timespec *ts, const struct tm *tm)
+{
+    char fmt[3] = {'%', conv, '\0'};
+    size_t len = 0;
+
+    switch (conv) {
+    case '\0':
+        /* Sun Oct 17 13:18:50.2678143230 2021 */
+        len = printf_time_conv(buf, 'a', ts, tm);
+        buf[len++] = ' ';
+        len += printf_time_conv(&buf[len], 'b', ts, tm);
+        buf[len++] = ' ';
+        len += printf_time_conv(&buf[len], 'e', ts, tm);
+        buf[len++] = ' ';
+        len += printf_time_conv(&buf[len], 'T', ts, tm);
+        buf[len++] = ' ';
+        len += printf_time_conv(&buf[len], 'Y', ts, tm);
+        return len;
+    case '@':
+        len = printf_digits(buf, ts->tv_sec, 1, '0');
+        buf[len++] = '.';
+        len += printf_digits(&buf[len], ts->tv_nsec, 9, '0');
+        buf[len++] = '0';
+        return len;
+    case '+':
+        len = printf_time_conv(buf, 'F', ts, tm);
+        buf[len++] = '+';
+        return len + printf_time_conv(&buf[len], 'T', ts, tm);
+    case 'F':
+        len = printf_time_conv(buf, 'Y', ts, tm);
+        buf[len++] = '-';
+        len += printf_time_conv(&buf[len], 'm', ts, tm);
+        buf[len++] = '-';
+        return len + printf_time_conv(&buf[len], 'd', ts, tm);
+    case 'D':
+        len = printf_time_conv(buf, 'm', ts, tm);
+        buf[len++] = '/';
+        len += printf_time_conv(&buf[len], 'd', ts, tm);
+        buf[len++] = '/';
+        return len + printf_time_conv(&buf[len], 'y', ts, tm);
+    case 'T':
+    case 'X':
+        len = printf_time_conv(buf, 'H', ts, tm);
+        buf[len++] = ':';
+        len += printf_time_conv(&buf[len], 'M', ts, tm);
+        buf[len++] = ':';
+        return len + printf_time_conv(&buf[len], 'S', ts, tm);
+    case 'R':
+        len = printf_time_conv(buf, 'H', ts, tm);
+        buf[len++] = ':';
+        return len + printf_time_conv(&buf[len], 'M', ts, tm);
+    case 'S':
+        len = printf_digits(buf, tm->tm_sec, 2, '0');
+        buf[len++] = '.';
+        len += printf_digits(&buf[len], ts->tv_nsec, 9, '0');
+        buf[len++] = '0';
+        return len;
+    case 'Y':
+        return printf_digits(buf, tm->tm_year + 1900LL, 1, '0');
+    case 'y':
+        return printf_digits(buf, (tm->tm_year + 1900) % 100, 2, '0');
+    case 'm':
+        return printf_digits(buf, tm->tm_mon + 1, 2, '0');
+    case 'd':
+        return printf_digits(buf, tm->tm_mday, 2, '0');
+    case 'e':
+        return printf_digits(buf, tm->tm_mday, 2, ' ');
+    case 'j':
+        return printf_digits(buf, tm->tm_yday + 1, 3, '0');
+    case 'H':
+        return printf_digits(buf, tm->tm_hour, 2, '0');
+    case 'k':
+        return printf_digits(buf, tm->tm_hour, 2, ' ');
+    case 'I':
+        return printf_digits(buf, tm->tm_hour % 12 ? tm->tm_hour % 12 : 12, 2, '0');
+    case 'l':
+        return printf_digits(buf, tm->tm_hour % 12 ? tm->tm_hour % 12 : 12, 2, ' ');
+    case 'M':
+        return printf_digits(buf, tm->tm_min, 2, '0');
+    case 's':
+        return printf_digits(buf, ts->tv_sec, 1, '0');
+    default:
+        /* names and other locale-dependent conversions */
+        return strftime(buf, 128, fmt, tm);
+    }
+}
+
+/**
+ * @brief Write the time field.
+ *
+ * @param[in] out Output buffer.
+ * @param[in] op Operation being processed.
+ * @param[in] st File information.
+ */
+static void
+printf_time(struct writer *out, const struct printf_op *op, const struct stat *st)
+{
+    char buf[256];
+    const struct timespec *ts;
+    struct tm tm;
+    size_t len;
+
+    switch (op->time) {
+    case 'A':
+        ts = &st->st_atim;
+        break;
+    case 'C':
+        ts = &st->st_ctim;
+        break;
+    default:
+        ts = &st->st_mtim;
+        break;
+    }
+
+    if ((op->conv != '@') && (op->conv != 's') && !localtime_r(&ts->tv_sec, &tm)) {
+        memset(&tm, 0, sizeof tm);
+    }
+    len = printf_time_conv(buf, op->conv, ts, &tm);
+    printf_field(out, op, buf, len, 0);
+}
+
+/**
+ * @brief Get length of the path without the trailing slashes (the root directory is kept).
+ *
+ * @param[in] path Path to process.
+ * @param[in] len Length of the @p path.
+ * @return Length of the path without trailing slashes.
+ */
+static size_t
+printf_path_strip(const char *path, size_t len)
+{
+    while ((len > 1) && (path[len - 1] == '/')) {
+        len--;
+    }
+
+    return len;
+}
+
+/**
+ * @brief Get the file type letter (for %y and %Y).
+ *
+ * @param[in] mode File mode.
+ * @return Letter of the file type.
+ */
+static char
+printf_type(mode_t mode)
+{
+    switch (mode & S_IFMT) {
+    case S_IFREG:
+        return 'f';
+    case S_IFDIR:
+        return 'd';
+    case S_IFLNK:
+        return 'l';
+    case S_IFCHR:
+        return 'c';
+    case S_IFBLK:
+        return 'b';
+    case S_IFIFO:
+        return 'p';
+    case S_IFSOCK:
+        return 's';
+    default:
+        return 'U';
+    }
+}
+
+/**
+ * @brief Write the symbolic permissions (for %M) as ls(1) does.
+ *
+ * @param[in] out Output buffer.
+ * @param[in] op Operation being processed.
+ * @param[in] mode File mode.
+ */
+static void
+printf_mode_symb(struct writer *out, const struct printf_op *op, mode_t mode)
+{
+    char buf[10];
+
+    buf[0] = printf_type(mode);
+    if (buf[0] == 'f') {
+        buf[0] = '-';
+    } else if (buf[0] == 'U') {
+        buf[0] = '?';
+    }
+    buf[1] = (mode & S_IRUSR) ? 'r' : '-';
+    buf[2] = (mode & S_IWUSR) ? 'w' : '-';
+    buf[3] = (mode & S_ISUID) ? ((mode & S_IXUSR) ? 's' : 'S') : ((mode & S_IXUSR) ? 'x' : '-');
+    buf[4] = (mode & S_IRGRP) ? 'r' : '-';
+    buf[5] = (mode & S_IWGRP) ? 'w' : '-';
+    buf[6] = (mode & S_ISGID) ? ((mode & S_IXGRP) ? 's' : 'S') : ((mode & S_IXGRP) ? 'x' : '-');
+    buf[7] = (mode & S_IROTH) ? 'r' : '-';
+    buf[8] = (mode & S_IWOTH) ? 'w' : '-';
+    buf[9] = (mode & S_ISVTX) ? ((mode & S_IXOTH) ? 't' : 'T') : ((mode & S_IXOTH) ? 'x' : '-');
+
+    printf_field(out, op, buf, sizeof buf, 0);
+}
+
+/**
+ * @brief Write the user name (for %u), the last found name is cached.
+ *
+ * @param[in] out Output buffer.
+ * @param[in] op Operation being processed.
+ * @param[in] prog Compiled format with the cache.
+ * @param[in] uid User ID.
+ */
+static void
+printf_user(struct writer *out, const struct printf_op *op, struct printf_prog *prog, uid_t uid)
+{
+    struct passwd pwd, *result = NULL;
+    char buf[1024];
+
+    if (!prog->user[0] || (prog->uid != uid)) {
+        if (getpwuid_r(uid, &pwd, buf, sizeof buf, &result) || !result || (strlen(pwd.pw_name) >= sizeof prog->user)) {
+            printf_number(out, op, uid, 10, 0);
+            return;
+        }
+        strcpy(prog->user, pwd.pw_name);
+        prog->uid = uid;
+    }
+    printf_field(out, op, prog->user, strlen(prog->user), 0);
+}
+
+/**
+ * @brief Write the group name (for %g), the last found name is cached.
+ *
+ * @param[in] out Output buffer.
+ * @param[in] op Operation being processed.
+ * @param[in] prog Compiled format with the cache.
+ * @param[in] gid Group ID.
+ */
+static void
+printf_group(struct writer *out, const struct printf_op *op, struct printf_prog *prog, gid_t gid)
+{
+    struct group grp, *result = NULL;
+    char buf[1024];
+
+    if (!prog->group[0] || (prog->gid != gid)) {
+        if (getgrgid_r(gid, &grp, buf, sizeof buf, &result) || !result || (strlen(grp.gr_name) >= sizeof prog->group)) {
+            printf_number(out, op, gid, 10, 0);
+            return;
+        }
+        strcpy(prog->group, grp.gr_name);
+        prog->gid = gid;
+    }
+    printf_field(out, op, prog->group, strlen(prog->group), 0);
+}
+
+/**
+ * @brief Process the escape sequence in the format.
+ *
+ * @param[in] fmt Format, pointing to the character after the backslash, moved behind the escape sequence.
+ * @param[out] c The character represented by the escape sequence.
+ * @return 1 for the \c escape (stop printing).
+ * @return 0 otherwise.
+ */
+static int
+printf_escape(const char **fmt, char *c)
+{
+    const char *p = *fmt;
+    unsigned int value, i;
+
+    switch (*p) {
+    case 'a':
+        *c = '\a';
+        break;
+    case 'b':
+        *c = '\b';
+        break;
+    case 'c':
+        *fmt = p + 1;
+        return 1;
+    case 'f':
+        *c = '\f';
+        break;
+    case 'n':
+        *c = '\n';
+        break;
+    case 'r':
+        *c = '\r';
+        break;
+    case 't':
+        *c = '\t';
+        break;
+    case 'v':
+        *c = '\v';
+        break;
+    case '\\':
+        *c = '\\';
+        break;
+    case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7':
+        for (value = 0, i = 0; i < 3 && p[i] >= '0' && p[i] <= '7'; i++) {
+            value = value * 8 + (p[i] - '0');
+        }
+        *c = (char)value;
+        *fmt = p + i;
+        return 0;
+    default:
+        /* keep the backslash, the character is processed as a normal character */
+        LOG("warning: unrecognized escape `\\%c'", *p);
+        *c = '\\';
+        return 0;
+    }
+
+    *fmt = p + 1;
+    return 0;
+}
+
+/**
+ * @brief Get the operation type of the directive conversion character.
+ *
+ * @param[in] conv Conversion character.
+ * @param[out] type Operation type.
+ * @return 1 if the conversion character is known.
+ * @return 0 for unknown conversion.
+ */
+static int
+printf_directive(char conv, enum printf_op_type *type)
+{
+    static const struct {
+        char conv;
+        enum printf_op_type type;
+    } directives[] = {
+        {'p', PRINTF_PATH}, {'f', PRINTF_NAME}, {'h', PRINTF_DIR}, {'P', PRINTF_RELPATH},
+        {'H', PRINTF_ROOT}, {'d', PRINTF_DEPTH}, {'y', PRINTF_TYPE}, {'Y', PRINTF_TYPE_FOLLOW},
+        {'l', PRINTF_LINK}, {'i', PRINTF_INODE}, {'s', PRINTF_SIZE}, {'k', PRINTF_KBLOCKS},
+        {'b', PRINTF_BLOCKS}, {'m', PRINTF_MODE}, {'M', PRINTF_MODE_SYMB}, {'u', PRINTF_USER},
+        {'U', PRINTF_UID}, {'g', PRINTF_GROUP}, {'G', PRINTF_GID}, {'n', PRINTF_NLINK},
+        {'D', PRINTF_DEV}
+    };
+
+    for (unsigned int i = 0; i < sizeof directives / sizeof *directives; i++) {
+        if (directives[i].conv == conv) {
+            *type = directives[i].type;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int
+expr_action_printf_compile(struct arena *arena, const char *arg, void **data, enum expr_need *need)
+{
+    struct printf_prog *prog;
+    struct printf_op *op = NULL;
+    const char *p = arg, *start;
+    char *text;
+    size_t len = strlen(arg);
+    int known;
+    char c;
+
+    /* every operation consumes at least one character of the format, the literals are never longer than the format */
+    prog = arena_calloc(arena, sizeof *prog);
+    if (!prog || !(prog->ops = arena_calloc(arena, (len + 1) * sizeof *prog->ops)) || !(text = arena_alloc(arena, len + 1))) {
+        return EXIT_FAILURE;
+    }
+    *need = EXPR_NEED_TYPE;
+
+    while (*p) {
+        if ((*p != '%') || (p[1] == '%')) {
+            /* literal text, merged with the preceding literal */
+            if (*p == '\\') {
+                p++;
+                if (printf_escape(&p, &c)) {
+                    prog->ops[prog->count++].type = PRINTF_STOP;
+                    op = NULL;
+                    continue;
+                }
+            } else {
+                c = *p;
+                p += (*p == '%') ? 2 : 1;
+            }
+            if (!op || (op->type != PRINTF_LITERAL)) {
+                op = &prog->ops[prog->count++];
+                op->type = PRINTF_LITERAL;
+                op->str = text;
+                op->len = 0;
+            }
+            *(text++) = c;
+            op->len++;
+            continue;
+        }
+
+        /* directive %[flags][width][.precision]conversion */
+        start = p++;
+        op = &prog->ops[prog->count++];
+        op->precision = -1;
+        for (; *p && strchr("-+ #0", *p); p++) {
+            if (*p == '-') {
+                op->left = 1;
+            } else if (*p == '+') {
+                op->plus = 1;
+            }
+        }
+        for (; *p >= '0' && *p <= '9'; p++) {
+            op->width = op->width * 10 + (*p - '0');
+        }
+        if (*p == '.') {
+            for (op->precision = 0, p++; *p >= '0' && *p <= '9'; p++) {
+                op->precision = op->precision * 10 + (*p - '0');
+            }
+        }
+
+        known = 0;
+        if (!*p) {
+            LOG("error: %% at end of format string.");
+            return EXIT_FAILURE;
+        } else if (*p == 'a' || *p == 'c' || *p == 't') {
+            op->type = PRINTF_TIME;
+            op->time = (*p == 'a') ? 'A' : ((*p == 'c') ? 'C' : 'T');
+            op->conv = '\0';
+            known = 1;
+        } else if (*p == 'A' || *p == 'C' || *p == 'T') {
+            if (!p[1]) {
+                LOG("warning: format directive `%%%c' should be followed by another character", *p);
+            } else {
+                op->type = PRINTF_TIME;
+                op->time = *p++;
+                op->conv = *p;
+                known = 1;
+            }
+        } else if (printf_directive(*p, &op->type)) {
+            known = 1;
+        } else {
+            LOG("warning: unrecognized format directive `%%%c'", *p);
+        }
+        p++;
+
+        if (!known) {
+            /* unrecognized directive is printed as it is */
+            memset(op, 0, sizeof *op);
+            op->type = PRINTF_LITERAL;
+            op->str = start;
+            op->len = p - start;
+            op = NULL;
+            continue;
+        }
+        if (op->type >= PRINTF_SIZE) {
+            *need = EXPR_NEED_STAT;
+        }
+    }
+
+    *data = prog;
+    return EXIT_SUCCESS;
+}
+
+enum expr_result
+expr_action_printf_clb(const struct rfind_entry *file, FILE *stream, const char *UNUSED(arg), void *data)
+{
+    struct printf_prog *prog = data;
+    const struct printf_op *op;
+    const struct stat *st = file->st;
+    struct writer out;
+    struct stat target;
+    const char *str;
+    char buf[PATH_MAX];
+    ssize_t r;
+    size_t len;
+
+    writer_init(&out, stream);
+    for (unsigned int i = 0; i < prog->count; i++) {
+        op = &prog->ops[i];
+        switch (op->type) {
+        case PRINTF_LITERAL:
+            writer_put(&out, op->str, op->len);
+            break;
+        case PRINTF_STOP:
+            i = prog->count;
+            break;
+        case PRINTF_PATH:
+            printf_field(&out, op, file->path, strlen(file->path), 0);
+            break;
+        case PRINTF_NAME:
+            if (file->depth) {
+                printf_field(&out, op, file->name, strlen(file->name), 0);
+                break;
+            }
+            /* the starting path's last component including a single trailing slash */
+            len = printf_path_strip(file->path, strlen(file->path));
+            for (str = &file->path[len]; (str > file->path) && (str[-1] != '/'); str--) {}
+            if (str == &file->path[len]) {
+                /* the root directory */
+                str--;
+            }
+            printf_field(&out, op, str, &file->path[len] - str + (file->path[len] == '/' ? 1 : 0), 0);
+            break;
+        case PRINTF_DIR:
+            len = printf_path_strip(file->path, strlen(file->path));
+            while (len && (file->path[len - 1] != '/')) {
+                len--;
+            }
+            if (!len) {
+                printf_field(&out, op, ".", 1, 0);
+            } else {
+                printf_field(&out, op, file->path, len - 1, 0);
+            }
+            break;
+        case PRINTF_RELPATH:
+            str = &file->path[file->root_len];
+            if (*str == '/') {
+                str++;
+            }
+            printf_field(&out, op, str, strlen(str), 0);
+            break;
+        case PRINTF_ROOT:
+            printf_field(&out, op, file->path, file->root_len, 0);
+            break;
+        case PRINTF_DEPTH:
+            printf_number(&out, op, file->depth, 10, 1);
+            break;
+        case PRINTF_TYPE:
+        case PRINTF_TYPE_FOLLOW:
+            buf[0] = printf_type(st->st_mode);
+            if ((op->type == PRINTF_TYPE_FOLLOW) && S_ISLNK(st->st_mode)) {
+                if (!stat(file->path, &target)) {
+                    buf[0] = printf_type(target.st_mode);
+                } else {
+                    buf[0] = (errno == ELOOP) ? 'L' : ((errno == ENOENT) ? 'N' : '?');
+                }
+            }
+            printf_field(&out, op, buf, 1, 0);
+            break;
+        case PRINTF_LINK:
+            len = 0;
+            if (S_ISLNK(st->st_mode) && ((r = readlink(file->path, buf, sizeof buf)) > 0)) {
+                len = r;
+            }
+            printf_field(&out, op, buf, len, 0);
+            break;
+        case PRINTF_INODE:
+            printf_number(&out, op, st->st_ino, 10, 0);
+            break;
+        case PRINTF_SIZE:
+            printf_number(&out, op, st->st_size, 10, 0);
+            break;
+        case PRINTF_KBLOCKS:
+            printf_number(&out, op, (st->st_blocks + 1) / 2, 10, 0);
+            break;
+        case PRINTF_BLOCKS:
+            printf_number(&out, op, st->st_blocks, 10, 0);
+            break;
+        case PRINTF_MODE:
+            printf_number(&out, op, st->st_mode & 07777, 8, 0);
+            break;
+        case PRINTF_MODE_SYMB:
+            printf_mode_symb(&out, op, st->st_mode);
+            break;
+        case PRINTF_USER:
+            printf_user(&out, op, prog, st->st_uid);
+            break;
+        case PRINTF_UID:
+            printf_number(&out, op, st->st_uid, 10, 0);
+            break;
+        case PRINTF_GROUP:
+            printf_group(&out, op, prog, st->st_gid);
+            break;
+        case PRINTF_GID:
+            printf_number(&out, op, st->st_gid, 10, 0);
+            break;
+        case PRINTF_NLINK:
+            printf_number(&out, op, st->st_nlink, 10, 0);
+            break;
+        case PRINTF_DEV:
+            printf_number(&out, op, st->st_dev, 10, 0);
+            break;
+        case PRINTF_TIME:
+            printf_time(&out, op, st);
+            break;
+        }
+    }
+    writer_flush(&out);
+
+    return EXPR_TRUE;
+}
@@ -0,0 +1,51 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _ACTION_PRINTF_H
+#define _ACTION_PRINTF_H
+
+#include "arena.h"
+#include "expressions.h"
+
+/**
+ * @brief help string for -printf
+ */
+#define expr_action_printf_help \
+    "    -printf FORMAT\n" \
+    "            Print FORMAT on the standard output, interpreting '\\' escapes\n" \
+    "            (\\n, \\t, \\0, \\NNN, ...) and '%' directives. Unlike -print, no\n" \
+    "            newline is added. The directives may specify the field width and\n" \
+    "            precision (e.g. %-10s, %.3p):\n" \
+    "              %p  file name             %f  name without directories\n" \
+    "              %h  leading directories   %P  path without starting point\n" \
+    "              %H  starting point        %d  depth in the tree\n" \
+    "              %s  size in bytes         %k  disk usage in KiB\n" \
+    "              %b  disk usage in blocks  %D  device number\n" \
+    "              %m  octal permissions     %M  symbolic permissions\n" \
+    "              %u  user name             %U  user ID\n" \
+    "              %g  group name            %G  group ID\n" \
+    "              %i  inode number          %n  number of hard links\n" \
+    "              %y  file type             %Y  type following symlinks\n" \
+    "              %l  symbolic link target  %%  literal %\n" \
+    "              %a %c %t  access, status change and modification time\n" \
+    "              %Ak %Ck %Tk  the times formatted according to k, which is @\n" \
+    "                  (seconds since epoch) or a strftime(3) conversion\n" \
+    "                  (e.g. %T+, %TY, %TT)\n"
+
+/**
+ * @brief expr_action_compile_clb implementation for -printf action.
+ *
+ * The format is parsed into a list of emit operations and the needed file information
+ * is derived from the used directives.
+ */
+int expr_action_printf_compile(struct arena *arena, const char *arg, void **data, enum expr_need *need);
+
+/**
+ * @brief expr_action_clb implementation for -printf action.
+ */
+enum expr_result expr_action_printf_clb(const struct rfind_entry *file, FILE *stream, const char *arg, void *data);
+
+#endif /* _ACTION_PRINTF_H */
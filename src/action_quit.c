@@ -0,0 +1,23 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+
+#include "action_quit.h"
+
+#include "common.h"
+#include "expressions.h"
+
+/**
+ * -quit action: mark the query to stop the scan
+ */
+enum expr_result
+expr_action_quit_clb(const struct rfind_entry *UNUSED(file), FILE *UNUSED(stream), const char *UNUSED(arg), void *data)
+{
+    *(int *)data = 1;
+
+    return EXPR_TRUE;
+}
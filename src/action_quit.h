@@ -0,0 +1,28 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _ACTION_QUIT_H
+#define _ACTION_QUIT_H
+
+#include "expressions.h"
+
+/**
+ * @brief help string for -quit
+ */
+#define expr_action_quit_help \
+    "    -quit\n" \
+    "            Stop the traversal after the current file. The actions preceding\n" \
+    "            -quit are done, the opened directories are closed and the results\n" \
+    "            of the aggregating actions are printed.\n"
+
+/**
+ * @brief expr_action_clb implementation for -quit action.
+ *
+ * The action's data is the query's flag checked by the scan after evaluating the file.
+ */
+enum expr_result expr_action_quit_clb(const struct rfind_entry *file, FILE *stream, const char *arg, void *data);
+
+#endif /* _ACTION_QUIT_H */
@@ -0,0 +1,19 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _ALLOC_DEBUG_H
+#define _ALLOC_DEBUG_H
+
+/**
+ * @brief Get the number of the heap allocations (malloc(), calloc() and realloc() calls) so far.
+ *
+ * Available only in the debug builds of the rfind(1) executable, which wraps the glibc's allocator.
+ *
+ * @return Number of the allocations.
+ */
+unsigned long alloc_debug_count(void);
+
+#endif /* _ALLOC_DEBUG_H */
@@ -0,0 +1,162 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#include "common.h"
+
+/** @brief Alignment of the allocated memory, suitable for any type */
+#define ARENA_ALIGN 16
+
+/** @brief Size of the block's header, keeping the data aligned */
+#define ARENA_HEADER_SIZE ((sizeof(struct arena_block) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+void
+arena_init(struct arena *arena, size_t block_size)
+{
+    arena->blocks = NULL;
+    arena->unused = NULL;
+    arena->block_size = block_size;
+}
+
+/**
+ * @brief Make a new current block with at least @p size of free memory.
+ *
+ * The released blocks are reused if possible.
+ *
+ * @param[in] arena Arena to extend.
+ * @param[in] size Required size of the free memory.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+arena_block_new(struct arena *arena, size_t size)
+{
+    struct arena_block *b, **prev;
+
+    for (prev = &arena->unused; *prev; prev = &(*prev)->next) {
+        if ((*prev)->size >= size) {
+            break;
+        }
+    }
+    if (*prev) {
+        /* reuse the released block */
+        b = *prev;
+        *prev = b->next;
+    } else {
+        if (size < arena->block_size) {
+            size = arena->block_size;
+        }
+        b = malloc(ARENA_HEADER_SIZE + size);
+        if (!b) {
+            LOG("%s", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        b->size = size;
+        b->data = (char *)b + ARENA_HEADER_SIZE;
+    }
+
+    b->used = 0;
+    b->next = arena->blocks;
+    arena->blocks = b;
+
+    return EXIT_SUCCESS;
+}
+
+void *
+arena_alloc(struct arena *arena, size_t size)
+{
+    struct arena_block *b = arena->blocks;
+    void *mem;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (!b || b->used + size > b->size) {
+        if (arena_block_new(arena, size)) {
+            return NULL;
+        }
+        b = arena->blocks;
+    }
+
+    mem = &b->data[b->used];
+    b->used += size;
+
+    return mem;
+}
+
+void *
+arena_calloc(struct arena *arena, size_t size)
+{
+    void *mem;
+
+    mem = arena_alloc(arena, size);
+    if (mem) {
+        memset(mem, 0, size);
+    }
+
+    return mem;
+}
+
+char *
+arena_strndup(struct arena *arena, const char *str, size_t len)
+{
+    char *dup;
+
+    dup = arena_alloc(arena, len + 1);
+    if (dup) {
+        memcpy(dup, str, len);
+        dup[len] = '\0';
+    }
+
+    return dup;
+}
+
+struct arena_mark
+arena_mark(const struct arena *arena)
+{
+    struct arena_mark mark;
+
+    mark.block = arena->blocks;
+    mark.used = arena->blocks ? arena->blocks->used : 0;
+
+    return mark;
+}
+
+void
+arena_release(struct arena *arena, struct arena_mark mark)
+{
+    struct arena_block *b;
+
+    /* keep the blocks allocated after the mark for reuse */
+    while (arena->blocks != mark.block) {
+        b = arena->blocks;
+        arena->blocks = b->next;
+        b->next = arena->unused;
+        arena->unused = b;
+    }
+    if (arena->blocks) {
+        arena->blocks->used = mark.used;
+    }
+}
+
+void
+arena_free(struct arena *arena)
+{
+    struct arena_block *b;
+
+    while ((b = arena->blocks)) {
+        arena->blocks = b->next;
+        free(b);
+    }
+    while ((b = arena->unused)) {
+        arena->unused = b->next;
+        free(b);
+    }
+}
@@ -0,0 +1,106 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+/**
+ * @brief Block of memory in the arena.
+ */
+struct arena_block {
+    struct arena_block *next;   /**< previously used block (or the next free block) */
+    size_t size;                /**< size of the data */
+    size_t used;                /**< used part of the data */
+    char *data;                 /**< the memory, following the header */
+};
+
+/**
+ * @brief Region (arena) allocator.
+ *
+ * The memory is allocated by bumping the pointer in the current block, it is never freed
+ * separately. The whole arena is freed at once by arena_free() or the memory allocated after
+ * the arena_mark() is released at once by arena_release(). The released blocks are kept for the
+ * following allocations, so the arena used as a stack does not allocate in the steady state.
+ */
+struct arena {
+    struct arena_block *blocks; /**< stack of the used blocks, the current one is the first */
+    struct arena_block *unused; /**< list of the released blocks kept for reuse */
+    size_t block_size;          /**< default size of the blocks */
+};
+
+/**
+ * @brief Position in the arena to release the memory allocated after it.
+ */
+struct arena_mark {
+    struct arena_block *block;  /**< the current block at the time of getting the mark */
+    size_t used;                /**< used part of the block at the time of getting the mark */
+};
+
+/**
+ * @brief Initiate the arena.
+ *
+ * @param[in] arena Arena to initiate.
+ * @param[in] block_size Default size of the blocks, the bigger allocations get their own block.
+ */
+void arena_init(struct arena *arena, size_t block_size);
+
+/**
+ * @brief Allocate memory (aligned for any type) from the arena.
+ *
+ * @param[in] arena Arena to allocate from.
+ * @param[in] size Size of the memory to allocate.
+ * @return Pointer to the allocated memory.
+ * @return NULL in case of failure.
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+ * @brief Allocate zeroed memory from the arena.
+ *
+ * @param[in] arena Arena to allocate from.
+ * @param[in] size Size of the memory to allocate.
+ * @return Pointer to the allocated memory.
+ * @return NULL in case of failure.
+ */
+void *arena_calloc(struct arena *arena, size_t size);
+
+/**
+ * @brief Duplicate the string into the arena.
+ *
+ * @param[in] arena Arena to allocate from.
+ * @param[in] str String to duplicate.
+ * @param[in] len Length of the @p str to duplicate, the copy is NULL-terminated.
+ * @return Pointer to the copy.
+ * @return NULL in case of failure.
+ */
+char *arena_strndup(struct arena *arena, const char *str, size_t len);
+
+/**
+ * @brief Get the current position in the arena.
+ *
+ * @param[in] arena Arena to mark.
+ * @return The mark for arena_release().
+ */
+struct arena_mark arena_mark(const struct arena *arena);
+
+/**
+ * @brief Release all the memory allocated after getting the @p mark.
+ *
+ * @param[in] arena Arena to release.
+ * @param[in] mark Position in the arena from arena_mark().
+ */
+void arena_release(struct arena *arena, struct arena_mark mark);
+
+/**
+ * @brief Free all the memory of the arena.
+ *
+ * @param[in] arena Arena to free, it can be used again (as after arena_init()).
+ */
+void arena_free(struct arena *arena);
+
+#endif /* _ARENA_H */
@@ -0,0 +1,340 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _POSIX_C_SOURCE 200809L /* fileno(), fsync(), ftruncate() */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+#include "common.h"
+#include "snapshot.h"
+
+/** @brief Version of the checkpoint file format */
+#define CHECKPOINT_VERSION 1
+
+/**
+ * @brief Write the length-prefixed string (the paths can contain any character but NUL).
+ *
+ * @param[in] f Stream to write to.
+ * @param[in] str String to write.
+ */
+static void
+checkpoint_put_str(FILE *f, const char *str)
+{
+    size_t len = strlen(str);
+
+    fprintf(f, "%zu ", len);
+    fwrite(str, 1, len, f);
+    fputc('\n', f);
+}
+
+/**
+ * @brief Read the string written by checkpoint_put_str().
+ *
+ * @param[in] f Stream to read from.
+ * @param[out] str Read string to be freed by the caller, NULL on error.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+checkpoint_get_str(FILE *f, char **str)
+{
+    size_t len;
+
+    *str = NULL;
+    if ((fscanf(f, "%zu", &len) != 1) || (fgetc(f) != ' ')) {
+        return EXIT_FAILURE;
+    }
+
+    *str = malloc(len + 1);
+    if (!*str) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    } else if ((fread(*str, 1, len, f) != len) || (fgetc(f) != '\n')) {
+        free(*str);
+        *str = NULL;
+        return EXIT_FAILURE;
+    }
+    (*str)[len] = '\0';
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Load the checkpoint to resume.
+ *
+ * @param[in] checkpoint Checkpoint context with the starting paths.
+ * @param[in] in_path Path of the checkpoint.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+checkpoint_load(struct checkpoint *checkpoint, const char *in_path)
+{
+    FILE *f;
+    unsigned int version, count, i;
+    char *path;
+    int differ = 0, ret = EXIT_FAILURE;
+
+    f = fopen(in_path, "r");
+    if (!f) {
+        LOG("unable to open checkpoint %s (%s).", in_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if ((fscanf(f, "rfind-checkpoint %u paths %u", &version, &count) != 2) || (version != CHECKPOINT_VERSION) ||
+            (fgetc(f) != '\n')) {
+        goto invalid;
+    }
+    for (i = 0; i < count; i++) {
+        if (checkpoint_get_str(f, &path)) {
+            goto invalid;
+        }
+        differ |= !checkpoint->paths[i] || strcmp(checkpoint->paths[i], path);
+        free(path);
+        if (differ) {
+            break;
+        }
+    }
+    if (differ || checkpoint->paths[count]) {
+        LOG("checkpoint %s was written for different starting paths.", in_path);
+        goto cleanup;
+    }
+    if ((fscanf(f, "matches %u offset %lld last", &checkpoint->matches, &checkpoint->offset) != 2) ||
+            (fgetc(f) != ' ') || checkpoint_get_str(f, &checkpoint->resume)) {
+        goto invalid;
+    }
+    ret = EXIT_SUCCESS;
+    goto cleanup;
+
+invalid:
+    LOG("invalid checkpoint %s.", in_path);
+cleanup:
+    fclose(f);
+    return ret;
+}
+
+/**
+ * @brief Drop the output written after the resumed checkpoint.
+ *
+ * @param[in] checkpoint Loaded checkpoint context.
+ * @param[in] in_path Path of the checkpoint for the messages.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+checkpoint_restore(struct checkpoint *checkpoint, const char *in_path)
+{
+    struct stat st;
+    int fd = fileno(checkpoint->stream);
+
+    if (!checkpoint->seekable || (checkpoint->offset < 0)) {
+        /* the output position is not known, the files after the checkpoint can be printed twice */
+        return EXIT_SUCCESS;
+    }
+
+    if (fstat(fd, &st) == -1) {
+        LOG("unable to restore the output (%s).", strerror(errno));
+        return EXIT_FAILURE;
+    } else if (st.st_size < checkpoint->offset) {
+        LOG("output is shorter than recorded in checkpoint %s (append the resumed output to it).", in_path);
+        return EXIT_FAILURE;
+    } else if ((ftruncate(fd, checkpoint->offset) == -1) || (lseek(fd, checkpoint->offset, SEEK_SET) == -1)) {
+        LOG("unable to restore the output (%s).", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Set the time of the next checkpoint.
+ *
+ * @param[in] checkpoint Checkpoint context.
+ * @param[in] now Current monotonic time.
+ */
+static void
+checkpoint_schedule(struct checkpoint *checkpoint, const struct timespec *now)
+{
+    checkpoint->next.tv_sec = now->tv_sec + checkpoint->interval / 1000000000ULL;
+    checkpoint->next.tv_nsec = now->tv_nsec + checkpoint->interval % 1000000000ULL;
+    if (checkpoint->next.tv_nsec >= 1000000000L) {
+        checkpoint->next.tv_sec++;
+        checkpoint->next.tv_nsec -= 1000000000L;
+    }
+}
+
+int
+checkpoint_open(const char *out_path, unsigned long long interval, const char *in_path, const char **paths,
+        FILE *stream, struct checkpoint **checkpoint)
+{
+    struct checkpoint *c;
+    struct timespec now;
+    struct stat st;
+
+    c = calloc(1, sizeof *c);
+    if (!c) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    *checkpoint = c;
+    c->paths = paths;
+    c->stream = stream;
+    c->seekable = !fstat(fileno(stream), &st) && S_ISREG(st.st_mode);
+    c->offset = -1;
+
+    if (in_path && (checkpoint_load(c, in_path) || checkpoint_restore(c, in_path))) {
+        return EXIT_FAILURE;
+    }
+
+    if (out_path) {
+        c->out_path = out_path;
+        c->out_tmp = malloc(strlen(out_path) + 24);
+        if (!c->out_tmp) {
+            LOG("%s", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        sprintf(c->out_tmp, "%s.%ld.tmp", out_path, (long)getpid());
+        c->interval = interval ? interval : CHECKPOINT_INTERVAL_DEFAULT;
+        c->countdown = CHECKPOINT_CHECK_FILES;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        checkpoint_schedule(c, &now);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int
+checkpoint_skip(struct checkpoint *checkpoint, const char *path, int *descend)
+{
+    size_t len;
+    int cmp;
+
+    if (!checkpoint->resume) {
+        return 0;
+    }
+
+    cmp = snapshot_path_cmp(path, checkpoint->resume);
+    if (cmp > 0) {
+        /* the first file not evaluated before, all the following files come after it */
+        free(checkpoint->resume);
+        checkpoint->resume = NULL;
+        return 0;
+    } else if (cmp < 0) {
+        /* only the directories on the resumed path have files left */
+        len = strlen(path);
+        if (strncmp(path, checkpoint->resume, len) ||
+                ((checkpoint->resume[len] != '/') && (!len || (path[len - 1] != '/')))) {
+            *descend = 0;
+        }
+    }
+
+    return 1;
+}
+
+int
+checkpoint_tick(struct checkpoint *checkpoint, const char *path, unsigned int matches)
+{
+    struct timespec now;
+
+    if (!checkpoint->out_path || --checkpoint->countdown) {
+        return EXIT_SUCCESS;
+    }
+    checkpoint->countdown = CHECKPOINT_CHECK_FILES;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec < checkpoint->next.tv_sec) ||
+            ((now.tv_sec == checkpoint->next.tv_sec) && (now.tv_nsec < checkpoint->next.tv_nsec))) {
+        return EXIT_SUCCESS;
+    }
+    checkpoint_schedule(checkpoint, &now);
+
+    return checkpoint_save(checkpoint, path, matches);
+}
+
+int
+checkpoint_save(struct checkpoint *checkpoint, const char *path, unsigned int matches)
+{
+    FILE *f;
+    long long offset = -1;
+    unsigned int count;
+    int fd;
+
+    if (!checkpoint->out_path) {
+        return EXIT_SUCCESS;
+    } else if (checkpoint->resume) {
+        /* the resumed position was not reached yet */
+        path = checkpoint->resume;
+        matches = checkpoint->matches;
+    }
+
+    /* the output up to the file is written before the checkpoint refers to it */
+    if (fflush(checkpoint->stream)) {
+        LOG("unable to write the output (%s).", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (checkpoint->seekable) {
+        fsync(fileno(checkpoint->stream));
+        offset = lseek(fileno(checkpoint->stream), 0, SEEK_CUR);
+    }
+
+    fd = open(checkpoint->out_tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if ((fd == -1) || !(f = fdopen(fd, "w"))) {
+        LOG("unable to write checkpoint %s (%s).", checkpoint->out_path, strerror(errno));
+        if (fd != -1) {
+            close(fd);
+            unlink(checkpoint->out_tmp);
+        }
+        return EXIT_FAILURE;
+    }
+
+    for (count = 0; checkpoint->paths[count]; count++) {}
+    fprintf(f, "rfind-checkpoint %d\npaths %u\n", CHECKPOINT_VERSION, count);
+    for (unsigned int i = 0; i < count; i++) {
+        checkpoint_put_str(f, checkpoint->paths[i]);
+    }
+    fprintf(f, "matches %u\noffset %lld\nlast ", matches, offset);
+    checkpoint_put_str(f, path);
+
+    if ((fflush(f) == EOF) | (fsync(fileno(f)) == -1) | fclose(f)) {
+        LOG("unable to write checkpoint %s (%s).", checkpoint->out_path, strerror(errno));
+        unlink(checkpoint->out_tmp);
+        return EXIT_FAILURE;
+    } else if (rename(checkpoint->out_tmp, checkpoint->out_path) == -1) {
+        LOG("unable to write checkpoint %s (%s).", checkpoint->out_path, strerror(errno));
+        unlink(checkpoint->out_tmp);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void
+checkpoint_finish(struct checkpoint *checkpoint)
+{
+    if (checkpoint->out_path && (unlink(checkpoint->out_path) == -1) && (errno != ENOENT)) {
+        LOG("unable to remove checkpoint %s (%s).", checkpoint->out_path, strerror(errno));
+    }
+}
+
+void
+checkpoint_free(struct checkpoint *checkpoint)
+{
+    if (!checkpoint) {
+        return;
+    }
+
+    free(checkpoint->out_tmp);
+    free(checkpoint->resume);
+    free(checkpoint);
+}
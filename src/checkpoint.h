@@ -0,0 +1,111 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <stdio.h>
+#include <time.h>
+
+/** @brief Default time between the checkpoints in nanoseconds (--checkpoint-interval) */
+#define CHECKPOINT_INTERVAL_DEFAULT (60 * 1000000000ULL)
+
+/** @brief Number of the evaluated files between the checks of the clock */
+#define CHECKPOINT_CHECK_FILES 256
+
+/**
+ * @brief Checkpoint of the traversal (--checkpoint) and the resumed traversal (--resume).
+ *
+ * The directories are traversed in the order of the names (see snapshot_path_cmp()), so the whole frontier
+ * of the traversal - the stack of the pending directories and the position in each of them - is given by
+ * the path of the last evaluated file. The resumed traversal skips the files up to this path and enters
+ * only the directories on it. The checkpoint also records the position in the output, the output written
+ * after the checkpoint is truncated when resuming, so no match is duplicated or dropped.
+ *
+ * The checkpoint is written into a temporary file renamed over the previous checkpoint, so the checkpoint
+ * file is always complete.
+ */
+struct checkpoint {
+    const char *out_path;         /**< path of the written checkpoint, NULL if only resuming */
+    char *out_tmp;                /**< path of the temporary file renamed to out_path */
+    unsigned long long interval;  /**< time between the checkpoints in nanoseconds */
+    struct timespec next;         /**< monotonic time of the next checkpoint */
+    unsigned int countdown;       /**< number of the evaluated files until the clock is checked */
+    const char **paths;           /**< starting paths of the traversal recorded in the checkpoint */
+    FILE *stream;                 /**< output stream whose position is recorded */
+    int seekable;                 /**< flag the output is a regular file, which can be truncated */
+
+    char *resume;                 /**< last evaluated path of the resumed traversal, NULL when passed */
+    unsigned int matches;         /**< number of the matching files counted by the resumed traversal (--limit) */
+    long long offset;             /**< position of the resumed output, -1 if not known */
+};
+
+/**
+ * @brief Prepare the checkpoints and load the checkpoint to resume.
+ *
+ * When resuming, the output is truncated to the position recorded in the checkpoint.
+ *
+ * @param[in] out_path Path of the checkpoint to write, NULL to not write the checkpoints.
+ * @param[in] interval Time between the checkpoints in nanoseconds, 0 for default.
+ * @param[in] in_path Path of the checkpoint to resume, NULL to start the traversal from the beginning.
+ * @param[in] paths NULL-terminated list of the starting paths, must be the same as the resumed ones.
+ * @param[in] stream Output stream of the traversal.
+ * @param[out] checkpoint Created checkpoint context to be freed by checkpoint_free() (even on error).
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int checkpoint_open(const char *out_path, unsigned long long interval, const char *in_path, const char **paths,
+        FILE *stream, struct checkpoint **checkpoint);
+
+/**
+ * @brief Check if the file was already evaluated by the resumed traversal.
+ *
+ * @param[in] checkpoint Checkpoint context.
+ * @param[in] path Path of the file in the traversal.
+ * @param[in,out] descend Flag to descend into the file, cleared if no file below was left to evaluate.
+ * @return non-zero if the file is not evaluated again.
+ */
+int checkpoint_skip(struct checkpoint *checkpoint, const char *path, int *descend);
+
+/**
+ * @brief Write the checkpoint if its time came, called after evaluating each file.
+ *
+ * The clock is checked once per CHECKPOINT_CHECK_FILES files.
+ *
+ * @param[in] checkpoint Checkpoint context.
+ * @param[in] path Path of the last evaluated file.
+ * @param[in] matches Number of the matching files counted by the traversal.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int checkpoint_tick(struct checkpoint *checkpoint, const char *path, unsigned int matches);
+
+/**
+ * @brief Write the checkpoint after the file.
+ *
+ * @param[in] checkpoint Checkpoint context.
+ * @param[in] path Path of the last evaluated file, empty if no file was evaluated yet.
+ * @param[in] matches Number of the matching files counted by the traversal.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int checkpoint_save(struct checkpoint *checkpoint, const char *path, unsigned int matches);
+
+/**
+ * @brief Remove the written checkpoint, the traversal is finished.
+ *
+ * @param[in] checkpoint Checkpoint context.
+ */
+void checkpoint_finish(struct checkpoint *checkpoint);
+
+/**
+ * @brief Free the checkpoint context.
+ *
+ * @param[in] checkpoint Checkpoint context to free, NULL is accepted.
+ */
+void checkpoint_free(struct checkpoint *checkpoint);
+
+#endif /* _CHECKPOINT_H */
@@ -5,34 +5,383 @@
  */
 
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "cmdline.h"
 #include "common.h"
 #include "expressions.h"
+#include "record.h"
+#include "shard.h"
 
 /**
- * @brief handle global find's options --help and --version.
+ * @brief Get value of the long option, either in form --option=VALUE or --option VALUE.
+ *
+ * @param[in] argc Number of command line arguments
+ * @param[in] argv Command line arguments
+ * @param[in,out] argpos Current index in the @p argv, moved in case the value is the next argument.
+ * @param[in] name Name of the option (without leading '--').
+ * @param[in] optional Flag if the value is optional, in such a case only the --option=VALUE form is accepted.
+ * @param[out] value Pointer to the value, NULL if there is no (optional) value.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE in case of missing mandatory value.
+ */
+static int
+long_option_value(int argc, char *argv[], int *argpos, const char *name, int optional, const char **value)
+{
+    const char *arg = &argv[*argpos][2 + strlen(name)];
+
+    if (arg[0] == '=') {
+        *value = &arg[1];
+    } else if (optional) {
+        *value = NULL;
+    } else if (*argpos + 1 < argc) {
+        (*argpos)++;
+        *value = argv[*argpos];
+    } else {
+        LOG("missing value for --%s option.", name);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Check if the command line argument is the given long option (with or without a value).
+ *
+ * @param[in] arg Command line argument, without leading '--'.
+ * @param[in] name Name of the long option.
+ * @return non-zero if the @p arg is the @p name option.
+ */
+static int
+long_option_match(const char *arg, const char *name)
+{
+    size_t len = strlen(name);
+
+    return !strncmp(arg, name, len) && (arg[len] == '\0' || arg[len] == '=');
+}
+
+/**
+ * @brief Get a positive number value of the long option, see long_option_value().
+ *
+ * @param[in] argc Number of command line arguments
+ * @param[in] argv Command line arguments
+ * @param[in,out] argpos Current index in the @p argv, moved in case the value is the next argument.
+ * @param[in] name Name of the option (without leading '--').
+ * @param[out] value Parsed value of the option.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+long_option_number(int argc, char *argv[], int *argpos, const char *name, unsigned int *value)
+{
+    const char *str;
+    char *end;
+    unsigned long num;
+
+    if (long_option_value(argc, argv, argpos, name, 0, &str)) {
+        return EXIT_FAILURE;
+    }
+
+    errno = 0;
+    num = strtoul(str, &end, 10);
+    if (!isdigit(str[0]) || *end || errno || !num || num > UINT_MAX) {
+        LOG("invalid value \"%s\" of --%s option.", str, name);
+        return EXIT_FAILURE;
+    }
+    *value = num;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Get a positive duration value of the long option, see long_option_value().
+ *
+ * The duration is a (decimal) number followed by an optional unit: us, ms, s (default), m or h.
+ *
+ * @param[in] argc Number of command line arguments
+ * @param[in] argv Command line arguments
+ * @param[in,out] argpos Current index in the @p argv, moved in case the value is the next argument.
+ * @param[in] name Name of the option (without leading '--').
+ * @param[out] value Parsed value of the option in nanoseconds.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+long_option_duration(int argc, char *argv[], int *argpos, const char *name, unsigned long long *value)
+{
+    static const struct {
+        const char *unit;
+        double nsec;
+    } units[] = {{"", 1e9}, {"us", 1e3}, {"ms", 1e6}, {"s", 1e9}, {"m", 60e9}, {"h", 3600e9}};
+    const char *str;
+    char *end;
+    double num;
+
+    if (long_option_value(argc, argv, argpos, name, 0, &str)) {
+        return EXIT_FAILURE;
+    }
+
+    errno = 0;
+    num = strtod(str, &end);
+    if (isdigit(str[0]) && !errno) {
+        for (unsigned int i = 0; i < sizeof units / sizeof *units; i++) {
+            if (!strcmp(end, units[i].unit)) {
+                num *= units[i].nsec;
+                if ((num >= 1) && (num < (double)ULLONG_MAX)) {
+                    *value = num;
+                    return EXIT_SUCCESS;
+                }
+                break;
+            }
+        }
+    }
+
+    LOG("invalid value \"%s\" of --%s option.", str, name);
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief handle global find's options, which are the long options starting with '--'.
  *
  * While other command line arguments are divided into groups which cannot mix,
- * these options can appear anywhere.
+ * these options can appear anywhere. The --help and --version options terminate
+ * the processing.
  *
- * @param[in] arg Command line argument to process, without leading '--'.
+ * @param[in] argc Number of command line arguments
+ * @param[in] argv Command line arguments
+ * @param[in,out] argpos Current index in the @p argv, moved in case the option's value is the next argument.
+ * @param[in,out] options Options storage to be filled.
  * @return EXIT_SUCCESS
- * @return EXIT_FAILURE for unknown argument
+ * @return EXIT_FAILURE for unknown argument or when the processing is supposed to terminate.
  */
 static int
-global_options(const char *arg)
+global_options(int argc, char *argv[], int *argpos, struct find_options *options)
 {
-    if (!strcmp(arg, "help")) {
-        fprintf(stdout, "Usage: " FIND_ID " [-H] [-L] [-P] [path...] [expression]\n");
+    const char *arg = &argv[*argpos][2];
+    const char *value;
+
+    if (long_option_match(arg, "profile-expr")) {
+        options->profile = 1;
+        return long_option_value(argc, argv, argpos, "profile-expr", 1, &options->profile_out);
+    } else if (long_option_match(arg, "profile-use")) {
+        return long_option_value(argc, argv, argpos, "profile-use", 0, &options->profile_use);
+    } else if (long_option_match(arg, "fd-budget")) {
+        return long_option_number(argc, argv, argpos, "fd-budget", &options->fd_budget);
+    } else if (long_option_match(arg, "stat-order")) {
+        if (long_option_value(argc, argv, argpos, "stat-order", 0, &value)) {
+            return EXIT_FAILURE;
+        } else if (!strcmp(value, "readdir")) {
+            options->stat_order = FIND_STAT_ORDER_READDIR;
+        } else if (!strcmp(value, "inode")) {
+            options->stat_order = FIND_STAT_ORDER_INODE;
+        } else {
+            LOG("invalid value \"%s\" of --stat-order option.", value);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    } else if (long_option_match(arg, "query-file")) {
+        return long_option_value(argc, argv, argpos, "query-file", 0, &options->query_file);
+    } else if (long_option_match(arg, "prefetch")) {
+        return long_option_number(argc, argv, argpos, "prefetch", &options->prefetch);
+    } else if (long_option_match(arg, "stat-threads")) {
+        return long_option_number(argc, argv, argpos, "stat-threads", &options->stat_threads);
+    } else if (long_option_match(arg, "device-threads")) {
+        return long_option_number(argc, argv, argpos, "device-threads", &options->device_threads);
+    } else if (long_option_match(arg, "link-cache")) {
+        return long_option_number(argc, argv, argpos, "link-cache", &options->link_cache);
+    } else if (long_option_match(arg, "snapshot-out")) {
+        return long_option_value(argc, argv, argpos, "snapshot-out", 0, &options->snapshot_out);
+    } else if (long_option_match(arg, "diff-against")) {
+        return long_option_value(argc, argv, argpos, "diff-against", 0, &options->diff_against);
+    } else if (long_option_match(arg, "checkpoint-interval")) {
+        return long_option_duration(argc, argv, argpos, "checkpoint-interval", &options->checkpoint_interval);
+    } else if (long_option_match(arg, "checkpoint")) {
+        return long_option_value(argc, argv, argpos, "checkpoint", 0, &options->checkpoint);
+    } else if (long_option_match(arg, "resume")) {
+        return long_option_value(argc, argv, argpos, "resume", 0, &options->resume);
+    } else if (long_option_match(arg, "estimate")) {
+        return long_option_number(argc, argv, argpos, "estimate", &options->estimate);
+    } else if (long_option_match(arg, "shard-output")) {
+        if (long_option_value(argc, argv, argpos, "shard-output", 0, &options->shard_output)) {
+            return EXIT_FAILURE;
+        }
+        return shard_pattern_check(options->shard_output);
+    } else if (long_option_match(arg, "shard-key")) {
+        if (long_option_value(argc, argv, argpos, "shard-key", 0, &value)) {
+            return EXIT_FAILURE;
+        } else if (!strcmp(value, "round-robin")) {
+            options->shard_key = FIND_SHARD_KEY_ROUNDROBIN;
+        } else if (!strcmp(value, "path")) {
+            options->shard_key = FIND_SHARD_KEY_PATH;
+        } else if (!strcmp(value, "dir")) {
+            options->shard_key = FIND_SHARD_KEY_DIR;
+        } else if (!strcmp(value, "inode")) {
+            options->shard_key = FIND_SHARD_KEY_INODE;
+        } else {
+            LOG("invalid value \"%s\" of --shard-key option.", value);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    } else if (long_option_match(arg, "shard")) {
+        return long_option_number(argc, argv, argpos, "shard", &options->shard);
+    } else if (long_option_match(arg, "errors-rate")) {
+        return long_option_number(argc, argv, argpos, "errors-rate", &options->errors_rate);
+    } else if (long_option_match(arg, "errors")) {
+        if (long_option_value(argc, argv, argpos, "errors", 0, &value)) {
+            return EXIT_FAILURE;
+        } else if (!strcmp(value, "full")) {
+            options->errors = FIND_ERRORS_FULL;
+        } else if (!strcmp(value, "summary")) {
+            options->errors = FIND_ERRORS_SUMMARY;
+        } else if (!strcmp(value, "json")) {
+            options->errors = FIND_ERRORS_JSON;
+        } else {
+            LOG("invalid value \"%s\" of --errors option.", value);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    } else if (long_option_match(arg, "limit")) {
+        return long_option_number(argc, argv, argpos, "limit", &options->limit);
+    } else if (long_option_match(arg, "deadline")) {
+        return long_option_duration(argc, argv, argpos, "deadline", &options->deadline);
+    } else if (long_option_match(arg, "max-iops")) {
+        return long_option_number(argc, argv, argpos, "max-iops", &options->max_iops);
+    } else if (long_option_match(arg, "max-stat-rate")) {
+        return long_option_number(argc, argv, argpos, "max-stat-rate", &options->max_stat_rate);
+    } else if (long_option_match(arg, "throttle-latency")) {
+        return long_option_duration(argc, argv, argpos, "throttle-latency", &options->throttle_latency);
+    } else if (!strcmp(arg, "respect-ignore")) {
+        options->respect_ignore = 1;
+        return EXIT_SUCCESS;
+    } else if (long_option_match(arg, "output-fields")) {
+        if (long_option_value(argc, argv, argpos, "output-fields", 0, &value)) {
+            return EXIT_FAILURE;
+        }
+        return record_fields_parse(value, &options->output_fields);
+    } else if (long_option_match(arg, "output")) {
+        if (long_option_value(argc, argv, argpos, "output", 0, &value)) {
+            return EXIT_FAILURE;
+        } else if (!strcmp(value, "text")) {
+            options->output = FIND_OUTPUT_TEXT;
+        } else if (!strcmp(value, "ndjson")) {
+            options->output = FIND_OUTPUT_NDJSON;
+        } else if (!strcmp(value, "binary")) {
+            options->output = FIND_OUTPUT_BINARY;
+        } else {
+            LOG("invalid value \"%s\" of --output option.", value);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    } else if (!strcmp(arg, "help")) {
+        fprintf(stdout, "Usage: " FIND_ID " [-H] [-L] [-P] [--OPTION...] [path...] [expression]\n");
         fprintf(stdout, "\nOPTIONS (the last wins):\n");
         fprintf(stdout, "  -P    Never follow symbolic links. This is the default behavior.\n");
         fprintf(stdout, "  -L    Follow symbolic links.\n");
         fprintf(stdout, "  -H    Follow symbolic link only of the provided paths.\n\n");
 
+        fprintf(stdout, "LONG OPTIONS (can appear anywhere):\n");
+        fprintf(stdout, "  --fd-budget N\n"
+            "        Keep at most N directories open during the traversal. Deeper directories\n"
+            "        are read into memory and closed. The default is half of the open files\n"
+            "        limit.\n");
+        fprintf(stdout, "  --stat-order readdir|inode\n"
+            "        Order of getting the files information in a directory. The inode order\n"
+            "        reads the whole directory first and lowers the disk seeks on rotational\n"
+            "        and network disks. The order of the results is not affected.\n");
+        fprintf(stdout, "  --prefetch N\n"
+            "        Open and read up to N directories ahead of the traversal in background\n"
+            "        threads. The order of the results is not affected.\n");
+        fprintf(stdout, "  --stat-threads N\n"
+            "        Get the files information with N threads (at most 64). Directories are\n"
+            "        read in chunks of entries stat'ed in parallel. The order of the results\n"
+            "        is not affected.\n");
+        fprintf(stdout, "  --device-threads N\n"
+            "        Traverse the paths on different devices concurrently, each device\n"
+            "        with its own N threads (at most 4) opening, reading and stat'ing its\n"
+            "        directories ahead. The results of the devices are interleaved.\n");
+        fprintf(stdout, "  --link-cache MIB\n"
+            "        With -L, keep up to MIB megabytes of the subtrees reached through\n"
+            "        symbolic links and replay them when the same directory is reached\n"
+            "        again instead of reading it. The results are the same.\n");
+        fprintf(stdout, "  --query-file FILE\n"
+            "        Evaluate all the queries from FILE in a single traversal instead of the\n"
+            "        expression. Each line of FILE is an output file (- for the standard\n"
+            "        output) followed by the query's expression.\n");
+        fprintf(stdout, "  --snapshot-out FILE\n"
+            "        Write the manifest (path, mode, size, mtime and inode) of the matching\n"
+            "        files into FILE. There is no default -print, the files are printed\n"
+            "        only by the expression's own actions. The directories are traversed\n"
+            "        in the order of the names.\n");
+        fprintf(stdout, "  --diff-against FILE\n"
+            "        Compare the matching files with the manifest FILE written by a previous\n"
+            "        --snapshot-out and print the added (A), removed (D) and changed (M)\n"
+            "        files. There is no default -print, the expression's own actions are\n"
+            "        executed as usual.\n");
+        fprintf(stdout, "  --checkpoint FILE\n"
+            "        Record the position of the traversal and of the output into FILE\n"
+            "        periodically and when stopped by --deadline. The directories are\n"
+            "        traversed in the order of the names. FILE is removed when the\n"
+            "        traversal finishes.\n");
+        fprintf(stdout, "  --checkpoint-interval DURATION\n"
+            "        Time between the checkpoints, 1 minute by default.\n");
+        fprintf(stdout, "  --resume FILE\n"
+            "        Continue the traversal recorded by --checkpoint into FILE with the same\n"
+            "        paths and expression. The output appended to the previous one (>>) is\n"
+            "        truncated to the recorded position first.\n");
+        fprintf(stdout, "  --estimate N\n"
+            "        Instead of the traversal, estimate the number and total size of the\n"
+            "        files matching the expression (without actions) by N random probes\n"
+            "        down the tree (or the probes done until --deadline) and print them\n"
+            "        with their 95%% confidence intervals.\n");
+        fprintf(stdout, "  --shard N --shard-output PATTERN [--shard-key KEY]\n"
+            "        Distribute the output of the matching files into N files (or FIFOs)\n"
+            "        named by PATTERN with %%d replaced by the shard's number (from 0) and\n"
+            "        %%%% by %%. KEY is round-robin (default), path, dir or inode, the files\n"
+            "        with the same path hash, directory or inode go to the same shard.\n");
+        fprintf(stdout, "  --errors full|summary|json\n"
+            "        Report of the files and directories that cannot be read. The full\n"
+            "        report prints a message per error, the summary prints the number of\n"
+            "        the errors per error code and directory at the end, json prints a JSON\n"
+            "        object per error. The exit status is 1 on any error.\n");
+        fprintf(stdout, "  --errors-rate N\n"
+            "        Print at most N error messages per second, the rest is counted in the\n"
+            "        summary printed at the end.\n");
+        fprintf(stdout, "  --limit N\n"
+            "        Stop the traversal after N matching files.\n");
+        fprintf(stdout, "  --deadline DURATION\n"
+            "        Stop the traversal when the DURATION (a number followed by us, ms, s, m\n"
+            "        or h, seconds by default) elapses and keep the results found so far.\n");
+        fprintf(stdout, "  --max-iops N\n"
+            "        Do at most N stats and directory opens per second.\n");
+        fprintf(stdout, "  --max-stat-rate N\n"
+            "        Do at most N stats per second.\n");
+        fprintf(stdout, "  --throttle-latency DURATION\n"
+            "        Adapt the rate of the stats and directory opens to keep the average\n"
+            "        stat latency below DURATION, up to the --max-iops rate if specified.\n");
+        fprintf(stdout, "  --respect-ignore\n"
+            "        Skip the files and directories ignored by the rules of .gitignore and\n"
+            "        .ignore files found in the traversed directories.\n");
+        fprintf(stdout, "  --output text|ndjson|binary\n"
+            "        Format of the -print action. The ndjson format prints a JSON object\n"
+            "        per file, the binary format prints length-prefixed records described\n"
+            "        in rfind_record.h. Both carry the path and the --output-fields.\n");
+        fprintf(stdout, "  --output-fields FIELD[,FIELD...]\n"
+            "        Fields of the ndjson and binary records: mode, size, mtime, atime,\n"
+            "        ctime, ino, dev, nlink, uid, gid, blocks, depth. The default is\n"
+            "        mode,size,mtime.\n");
+        fprintf(stdout, "  --profile-expr[=FILE]\n"
+            "        Count evaluations, true results and time of each expression record\n"
+            "        and print the annotated expression tree on exit. Optionally store the\n"
+            "        profile into FILE.\n");
+        fprintf(stdout, "  --profile-use FILE\n"
+            "        Order operands of -a and -o according to the selectivity and cost\n"
+            "        measured in the profile FILE.\n\n");
+
         fprintf(stdout, "Default path is the current directory.\n");
         fprintf(stdout, "Default expression is -print, expression may consist of:\n    operators, tests, and actions.\n");
 
@@ -44,42 +393,45 @@ global_options(const char *arg)
 
         fprintf(stdout, "\nTESTS:\n");
         for (unsigned int i = 0; i < EXPR_TEST_COUNT; i++) {
-            fprintf(stdout, expr_tests[i].help);
+            fputs(expr_tests[i].help, stdout);
         }
 
         fprintf(stdout, "\nACTIONS:\n");
         for (unsigned int i = 0; i < EXPR_ACT_COUNT; i++) {
-            fprintf(stdout, expr_actions[i].help);
+            fputs(expr_actions[i].help, stdout);
         }
     } else if (!strcmp(arg, "version")) {
         fprintf(stdout, "Radek's find re-implementation 1.0.0\nCopyright (C) 2021 Radek Krejci\n");
     } else {
         LOG("unknown option --%s", arg);
-        return EXIT_FAILURE;
     }
 
-    return EXIT_SUCCESS;
+    /* --help, --version and unknown options terminate the processing */
+    return EXIT_FAILURE;
 }
 
 int
-parse_options(int argc, char *argv[], int *argpos, int *options_p)
+parse_options(int argc, char *argv[], int *argpos, struct find_options *options)
 {
-    assert(options_p);
+    assert(options);
 
-    *options_p = EXPR_FOLLOW_NO_SYMLINKS;
+    memset(options, 0, sizeof *options);
+    options->symlinks = EXPR_FOLLOW_NO_SYMLINKS;
 
     for (; *argpos < argc && argv[*argpos][0] == '-'; (*argpos)++) {
         if (argv[*argpos][1] == '-') {
-            global_options(&argv[*argpos][2]);
-            return EXIT_FAILURE;
+            if (global_options(argc, argv, argpos, options)) {
+                return EXIT_FAILURE;
+            }
+            continue;
         }
 
         if (!strcmp(&argv[*argpos][1], "L")) {
-            *options_p = EXPR_FOLLOW_SYMLINKS;
+            options->symlinks = EXPR_FOLLOW_SYMLINKS;
         } else if (!strcmp(&argv[*argpos][1], "H")) {
-            *options_p = EXPR_FOLLOW_EXPLICIT_SYMLINKS;
+            options->symlinks = EXPR_FOLLOW_EXPLICIT_SYMLINKS;
         } else if (!strcmp(&argv[*argpos][1], "P")) {
-            *options_p = EXPR_FOLLOW_NO_SYMLINKS;
+            options->symlinks = EXPR_FOLLOW_NO_SYMLINKS;
         } else {
             break;
         }
@@ -140,14 +492,14 @@ parse_paths(int argc, char *argv[], int *argpos, const char ***paths_p)
 static void
 expr_list_insert(struct expr *expr_new, struct expr **expressions)
 {
-    static struct expr *expr_last = NULL;
+    struct expr *expr_last;
 
+    /* the list is short, so just find its end instead of keeping (non-reentrant) pointer to the last item */
     if (!(*expressions)) {
-        *expressions = expr_last = expr_new;
+        *expressions = expr_new;
     } else {
-        assert(expr_last);
+        for (expr_last = *expressions; expr_last->next; expr_last = expr_last->next) {}
         expr_last->next = expr_new;
-        expr_last = expr_new;
     }
 }
 
@@ -174,7 +526,7 @@ op_stack_pop(enum expr_operator *op_stack, unsigned int *count)
  */
 static int
 op_stack_push(enum expr_operator op, enum expr_operator **op_stack, unsigned int *size, unsigned int *count,
-        struct expr **expressions)
+        struct arena *arena, struct expr **expressions)
 {
 #define STACK_STEP 8
     /* first, we have to pop the operators with higher or the same priority,
@@ -190,11 +542,11 @@ op_stack_push(enum expr_operator op, enum expr_operator **op_stack, unsigned int
                     break;
                 }
                 /* make the expression record from the popped operator */
-                struct expr *expr_new = expr_new_group(op_prev, NULL, NULL);
+                struct expr *expr_new = expr_new_group(arena, op_prev, NULL, NULL);
                 expr_list_insert(expr_new, expressions);
             } else if (op_prev >= op) {
                 /* make the expression record from the popped operator */
-                struct expr *expr_new = expr_new_group(op_prev, NULL, NULL);
+                struct expr *expr_new = expr_new_group(arena, op_prev, NULL, NULL);
                 expr_list_insert(expr_new, expressions);
             } else {
                 /* put the operator back */
@@ -226,7 +578,7 @@ op_stack_push(enum expr_operator op, enum expr_operator **op_stack, unsigned int
 }
 
 static int
-op_stack_clean(enum expr_operator **op_stack, unsigned int *count, struct expr **expressions)
+op_stack_clean(enum expr_operator **op_stack, unsigned int *count, struct arena *arena, struct expr **expressions)
 {
     while (*count) {
         enum expr_operator op;
@@ -234,7 +586,7 @@ op_stack_clean(enum expr_operator **op_stack, unsigned int *count, struct expr *
 
         (*count)--;
         op = (*op_stack)[*count];
-        expr_new = expr_new_group(op, NULL, NULL);
+        expr_new = expr_new_group(arena, op, NULL, NULL);
         if (!expr_new) {
             free(*op_stack);
             return EXIT_FAILURE;
@@ -248,7 +600,8 @@ op_stack_clean(enum expr_operator **op_stack, unsigned int *count, struct expr *
 }
 
 int
-parse_expressions(int argc, char *argv[], int *argpos, struct expr **expressions_p)
+parse_expressions(int argc, char *argv[], int *argpos, struct find_options *options, struct arena *arena,
+        struct expr **expressions_p)
 {
     struct expr *expressions = NULL;
     enum expr_operator *op_stack = NULL;
@@ -266,20 +619,22 @@ parse_expressions(int argc, char *argv[], int *argpos, struct expr **expressions
         switch(argv[*argpos][0]) {
         case '-':
             if (argv[*argpos][1] == '-') {
-                global_options(&argv[*argpos][2]);
-                goto parsing_error;
+                if (global_options(argc, argv, argpos, options)) {
+                    goto parsing_error;
+                }
+                continue;
             }
 
             /* operators are inserted into the stack and popped and inserted into the postfix
              * list later after all the operands are processed */
             if (!strcmp(&argv[*argpos][1], "not")) {
-                op_stack_push(EXPR_OP_NOT, &op_stack, &size, &count, &expressions);
+                op_stack_push(EXPR_OP_NOT, &op_stack, &size, &count, arena, &expressions);
                 continue;
             } else if (!strcmp(&argv[*argpos][1], "a") || !strcmp(&argv[*argpos][1], "and")) {
-                op_stack_push(EXPR_OP_AND, &op_stack, &size, &count, &expressions);
+                op_stack_push(EXPR_OP_AND, &op_stack, &size, &count, arena, &expressions);
                 continue;
             } else if (!strcmp(&argv[*argpos][1], "o") || !strcmp(&argv[*argpos][1], "or")) {
-                op_stack_push(EXPR_OP_OR, &op_stack, &size, &count, &expressions);
+                op_stack_push(EXPR_OP_OR, &op_stack, &size, &count, arena, &expressions);
                 continue;
             }
 
@@ -287,7 +642,7 @@ parse_expressions(int argc, char *argv[], int *argpos, struct expr **expressions
             for (unsigned int i = 0; i < EXPR_TEST_COUNT; i++) {
                 if (!strcmp(&argv[*argpos][1], expr_tests[i].id)) {
                     /* match */
-                    expr_new = expr_new_test(&expr_tests[i], argc > (*argpos) + 1 ? argv[(*argpos) + 1] : NULL);
+                    expr_new = expr_new_test(arena, &expr_tests[i], argc > (*argpos) + 1 ? argv[(*argpos) + 1] : NULL);
                     if (!expr_new) {
                         goto parsing_error;
                     }
@@ -301,7 +656,7 @@ parse_expressions(int argc, char *argv[], int *argpos, struct expr **expressions
             for (unsigned int i = 0; i < EXPR_ACT_COUNT; i++) {
                 if (!strcmp(&argv[*argpos][1], expr_actions[i].id)) {
                     /* match */
-                    expr_new = expr_new_action(&expr_actions[i], argc > (*argpos) + 1 ? argv[(*argpos) + 1] : NULL);
+                    expr_new = expr_new_action(arena, &expr_actions[i], argc > (*argpos) + 1 ? argv[(*argpos) + 1] : NULL);
                     if (!expr_new) {
                         goto parsing_error;
                     }
@@ -320,21 +675,21 @@ parse_expressions(int argc, char *argv[], int *argpos, struct expr **expressions
                 LOG("invalid expression %s", argv[*argpos]);
                 goto parsing_error;
             }
-            op_stack_push(EXPR_OP_NOT, &op_stack, &size, &count, &expressions);
+            op_stack_push(EXPR_OP_NOT, &op_stack, &size, &count, arena, &expressions);
             continue;
         case '(':
             if (argv[*argpos][1]) {
                 LOG("invalid expression %s", argv[*argpos]);
                 goto parsing_error;
             }
-            op_stack_push(EXPR_OP_LBR, &op_stack, &size, &count, &expressions);
+            op_stack_push(EXPR_OP_LBR, &op_stack, &size, &count, arena, &expressions);
             continue;
         case ')':
             if (argv[*argpos][1]) {
                 LOG("invalid expression %s", argv[*argpos]);
                 goto parsing_error;
             }
-            op_stack_push(EXPR_OP_RBR, &op_stack, &size, &count, &expressions);
+            op_stack_push(EXPR_OP_RBR, &op_stack, &size, &count, arena, &expressions);
             continue;
 
         /* TODO: support , (comma) operator in expression */
@@ -352,7 +707,7 @@ insert_expr:
     }
 
     /* cleanup the rest of the operators stack */
-    if (op_stack_clean(&op_stack, &count, &expressions)) {
+    if (op_stack_clean(&op_stack, &count, arena, &expressions)) {
         goto parsing_error;
     }
 
@@ -361,8 +716,14 @@ insert_expr:
      */
 
     if (!expressions) {
+        if (options->noprint || options->query_file || options->snapshot_out || options->diff_against ||
+                options->estimate) {
+            /* no expression, everything matches (the queries from the query file are separated) */
+            *expressions_p = NULL;
+            return EXIT_SUCCESS;
+        }
         /* Add a default action, which is -print */
-        expressions = expr_new_action(&expr_actions[EXPR_ACT_PRINT], NULL);
+        expressions = expr_new_action(arena, &expr_actions[EXPR_ACT_PRINT], NULL);
         if (!expressions) {
             return EXIT_FAILURE;
         }
@@ -382,9 +743,10 @@ insert_expr:
             }
             e_list = e_grp;
         }
-        if (!has_action) {
+        if (!has_action && !options->noprint && !options->query_file && !options->snapshot_out &&
+                !options->diff_against && !options->estimate) {
             /* default action is -print */
-            expressions = expr_new_group(EXPR_OP_AND, expressions, expr_new_action(&expr_actions[EXPR_ACT_PRINT], NULL));
+            expressions = expr_new_group(arena, EXPR_OP_AND, expressions, expr_new_action(arena, &expr_actions[EXPR_ACT_PRINT], NULL));
         }
     }
 
@@ -392,11 +754,82 @@ insert_expr:
     return EXIT_SUCCESS;
 
 parsing_error:
-    /* cleanup */
+    /* cleanup, the expression records are freed with the arena */
     free(op_stack);
-    for (struct expr *e = expressions; e; e = expressions) {
-        expressions = e->next;
-        free(e);
+    return EXIT_FAILURE;
+}
+
+int
+parse_string(const char *str, int *argc_p, char ***argv_p)
+{
+    char **args = NULL, *arg = NULL;
+    int count = 0;
+    size_t len;
+    char quote;
+
+    assert(str);
+    assert(argc_p);
+    assert(argv_p);
+
+    while (1) {
+        /* skip whitespaces between the arguments */
+        while (*str == ' ' || *str == '\t' || *str == '\n') {
+            str++;
+        }
+
+        void *x = realloc(args, (count + 1) * sizeof *args);
+        if (!x) {
+            LOG("%s", strerror(errno));
+            goto error;
+        }
+        args = x;
+        args[count] = NULL;
+        if (!*str) {
+            break;
+        }
+
+        /* the argument cannot be longer than the rest of the string */
+        arg = malloc(strlen(str) + 1);
+        if (!arg) {
+            LOG("%s", strerror(errno));
+            goto error;
+        }
+        for (len = 0, quote = 0; *str && (quote || (*str != ' ' && *str != '\t' && *str != '\n')); str++) {
+            if (quote == '\'' && *str != '\'') {
+                /* no escaping inside single quotes */
+                arg[len++] = *str;
+            } else if (*str == '\\' && str[1] && (!quote || str[1] == '"' || str[1] == '\\')) {
+                arg[len++] = *(++str);
+            } else if (*str == '\'' || *str == '"') {
+                if (!quote) {
+                    quote = *str;
+                } else if (quote == *str) {
+                    quote = 0;
+                } else {
+                    arg[len++] = *str;
+                }
+            } else {
+                arg[len++] = *str;
+            }
+        }
+        if (quote) {
+            LOG("unterminated quotation (%c) in the arguments string.", quote);
+            goto error;
+        }
+        arg[len] = '\0';
+        args[count++] = arg;
+        arg = NULL;
+    }
+
+    *argc_p = count;
+    *argv_p = args;
+    return EXIT_SUCCESS;
+
+error:
+    free(arg);
+    for (int i = 0; i < count; i++) {
+        free(args[i]);
     }
+    free(args);
     return EXIT_FAILURE;
 }
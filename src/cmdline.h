@@ -7,19 +7,89 @@
 #ifndef _CMDLINE_H
 #define _CMDLINE_H
 
+#include "arena.h"
 #include "expressions.h"
 
+/**
+ * @brief Order of getting the files information in a directory (--stat-order)
+ */
+#define FIND_STAT_ORDER_READDIR 0 /**< the order of readdir() */
+#define FIND_STAT_ORDER_INODE 1   /**< the order of inode numbers, the whole directory is read first */
+
+/**
+ * @brief Distribution of the matching files into the shards (--shard-key)
+ */
+#define FIND_SHARD_KEY_ROUNDROBIN 0 /**< the shards take the matching files in turns */
+#define FIND_SHARD_KEY_PATH 1     /**< hash of the file's path */
+#define FIND_SHARD_KEY_DIR 2      /**< hash of the path of the file's directory, the files of a directory stay together */
+#define FIND_SHARD_KEY_INODE 3    /**< hash of the file's inode, the hard links stay together */
+
+/**
+ * @brief Output format of the -print action (--output)
+ */
+#define FIND_OUTPUT_TEXT 0        /**< path followed by newline */
+#define FIND_OUTPUT_NDJSON 1      /**< JSON object per line */
+#define FIND_OUTPUT_BINARY 2      /**< length-prefixed binary records, see rfind_record.h */
+
+/**
+ * @brief Format of the traversal errors (--errors)
+ */
+#define FIND_ERRORS_FULL 0        /**< a message per error */
+#define FIND_ERRORS_SUMMARY 1     /**< the numbers of errors per errno and directory at the end */
+#define FIND_ERRORS_JSON 2        /**< JSON object per error */
+
+/**
+ * @brief Options affecting the whole find's run.
+ *
+ * Besides the -H, -L and -P options, the structure stores the long (--XXX) options,
+ * which can appear anywhere on the command line.
+ */
+struct find_options {
+    int symlinks;             /**< symbolic links handling, one of the EXPR_FOLLOW_* values */
+    int noprint;              /**< flag to not add the default -print action (library usage) */
+    int stat_order;           /**< order of getting the files information, one of the FIND_STAT_ORDER_* values */
+    unsigned int fd_budget;   /**< maximum number of the directories opened at once (--fd-budget), 0 for default */
+    int respect_ignore;       /**< flag to skip the files ignored by .gitignore and .ignore files (--respect-ignore) */
+    const char *query_file;   /**< file with the queries evaluated in a single traversal (--query-file) */
+    int output;               /**< output format of -print, one of the FIND_OUTPUT_* values (--output) */
+    unsigned int output_fields; /**< RFIND_FIELD_* flags printed in the records (--output-fields), 0 for default */
+    unsigned int limit;       /**< number of the matching files to stop the scan after (--limit), 0 for no limit */
+    unsigned long long deadline; /**< time budget of the scan in nanoseconds (--deadline), 0 for no deadline */
+    unsigned int max_iops;    /**< maximum rate of the stats and directory opens per second (--max-iops), 0 for no limit */
+    unsigned int max_stat_rate; /**< maximum rate of the stats per second (--max-stat-rate), 0 for no limit */
+    unsigned long long throttle_latency; /**< stat latency in nanoseconds to adapt the I/O rate to (--throttle-latency) */
+    unsigned int prefetch;    /**< number of the directories opened and listed ahead (--prefetch), 0 to disable */
+    unsigned int stat_threads; /**< number of the threads getting the files information (--stat-threads), 0 or 1 to disable */
+    unsigned int device_threads; /**< number of the prefetch threads per device (--device-threads), 0 to disable */
+    unsigned int link_cache;  /**< size of the cached symlinked subtrees in MiB (--link-cache), 0 to disable */
+    const char *snapshot_out; /**< manifest of the matching files to write (--snapshot-out) */
+    const char *diff_against; /**< manifest to compare the matching files with (--diff-against) */
+    const char *checkpoint;   /**< file where to record the traversal's position periodically (--checkpoint) */
+    unsigned long long checkpoint_interval; /**< time between the checkpoints in nanoseconds (--checkpoint-interval) */
+    const char *resume;       /**< checkpoint of the interrupted traversal to continue (--resume) */
+    unsigned int estimate;    /**< number of the random probes estimating the results (--estimate), 0 for the traversal */
+    unsigned int shard;       /**< number of the files the output is distributed into (--shard), 0 for the standard output */
+    const char *shard_output; /**< path pattern of the shards' files (--shard-output) */
+    int shard_key;            /**< distribution of the files into the shards, one of the FIND_SHARD_KEY_* values */
+    int errors;               /**< format of the traversal errors, one of the FIND_ERRORS_* values (--errors) */
+    unsigned int errors_rate; /**< maximum number of the error messages per second (--errors-rate), 0 for no limit */
+
+    int profile;              /**< flag to profile the expression evaluation (--profile-expr) */
+    const char *profile_out;  /**< file where to store the expression profile (--profile-expr=FILE) */
+    const char *profile_use;  /**< profile used to order the operands (--profile-use=FILE) */
+};
+
 /**
  * @brief Parse and store find's symbolic links option -L, -H and -P
  *
  * @param[in] argc Number of command line arguments
  * @param[in] argv Command line arguments
  * @param[in,out] argpos Current index in the @p argv
- * @param[out] options_p Pointer to options storage to be filled.
+ * @param[out] options Options storage to be filled.
  * @return EXIT_SUCCESS
  * @return EXIT_FAILURE
  */
-int parse_options(int argc, char *argv[], int *argpos, int *options_p);
+int parse_options(int argc, char *argv[], int *argpos, struct find_options *options);
 
 /**
  * @brief Parse and store find's paths list provided via command line
@@ -40,11 +110,29 @@ int parse_paths(int argc, char *argv[], int *argpos, const char ***paths_p);
  * @param[in] argc Number of command line arguments
  * @param[in] argv Command line arguments
  * @param[in,out] argpos Current index in the @p argv
- * @param[out] expressions_p Pointer to storage for the created paths array.
- * Caller is supposed to free it with expr_free()
+ * @param[in,out] options Options storage to be filled with the long options found among the expressions.
+ * @param[in] arena Arena to allocate the expression records from.
+ * @param[out] expressions_p Pointer to storage for the created evaluation tree.
+ * The tree is freed together with the @p arena (also in case of failure).
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int parse_expressions(int argc, char *argv[], int *argpos, struct find_options *options, struct arena *arena,
+        struct expr **expressions_p);
+
+/**
+ * @brief Split the string into arguments as the shell would do.
+ *
+ * The arguments are separated by whitespaces, the single and double quotes and
+ * backslash escaping are supported.
+ *
+ * @param[in] str String to split.
+ * @param[out] argc_p Number of the created arguments.
+ * @param[out] argv_p NULL-terminated array of the created arguments. Caller is supposed to free
+ * the array as well as each of the arguments with free().
  * @return EXIT_SUCCESS
  * @return EXIT_FAILURE
  */
-int parse_expressions(int argc, char *argv[], int *argpos, struct expr **expressions_p);
+int parse_string(const char *str, int *argc_p, char ***argv_p);
 
 #endif /* _CMDLINE_H */
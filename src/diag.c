@@ -0,0 +1,488 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _POSIX_C_SOURCE 200809L /* clock_gettime(), fileno() */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "diag.h"
+
+#include "cmdline.h"
+#include "common.h"
+#include "record.h"
+
+/** @brief Initial number of the buckets of the groups' hash table */
+#define DIAG_BUCKETS 256
+
+/**
+ * @brief Names of the errors expected in the traversal.
+ */
+static const struct {
+    int err;
+    const char *name;
+} diag_errnos[] = {
+    {EACCES, "EACCES"},
+    {EPERM, "EPERM"},
+    {ENOENT, "ENOENT"},
+    {ENOTDIR, "ENOTDIR"},
+    {ELOOP, "ELOOP"},
+    {EIO, "EIO"},
+    {ENAMETOOLONG, "ENAMETOOLONG"},
+    {EMFILE, "EMFILE"},
+    {ENFILE, "ENFILE"},
+    {ENOMEM, "ENOMEM"},
+    {ESTALE, "ESTALE"},
+    {EOVERFLOW, "EOVERFLOW"},
+};
+
+/** @brief Names of the failed operations as printed in the JSON messages */
+static const char *diag_ops[] = {"stat", "open", "loop"};
+
+void
+diag_init(struct diag *diag, int mode, unsigned int rate)
+{
+    memset(diag, 0, sizeof *diag);
+    diag->mode = mode;
+    diag->rate = rate;
+    diag->tty = isatty(fileno(stderr));
+    writer_init(&diag->w, stderr);
+}
+
+/**
+ * @brief Get the current monotonic time in nanoseconds.
+ */
+static uint64_t
+diag_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * @brief Write the NUL-terminated string.
+ */
+static void
+diag_puts(struct writer *w, const char *str)
+{
+    writer_put(w, str, strlen(str));
+}
+
+/**
+ * @brief Write the symbolic name of the errno (its number if unknown).
+ */
+static void
+diag_errno_name(struct writer *w, int err)
+{
+    for (unsigned int i = 0; i < sizeof diag_errnos / sizeof *diag_errnos; i++) {
+        if (diag_errnos[i].err == err) {
+            writer_put(w, diag_errnos[i].name, strlen(diag_errnos[i].name));
+            return;
+        }
+    }
+    diag_puts(w, "errno ");
+    writer_uint(w, err);
+}
+
+/**
+ * @brief Write the number with the thousands separators.
+ */
+static void
+diag_count(struct writer *w, unsigned long count)
+{
+    char buf[32], *end = buf + sizeof buf, *num;
+    size_t len;
+
+    num = writer_uint_str(end, count, 10);
+    len = end - num;
+    writer_put(w, num, (len - 1) % 3 + 1);
+    for (size_t i = (len - 1) % 3 + 1; i < len; i += 3) {
+        writer_putc(w, ',');
+        writer_put(w, &num[i], 3);
+    }
+}
+
+/**
+ * @brief Hash the group's key (FNV-1a).
+ */
+static unsigned int
+diag_hash(int err, const char *dir, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL ^ (unsigned int)err;
+
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)dir[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    return (unsigned int)(h ^ (h >> 32));
+}
+
+/**
+ * @brief Find the group of the errno and directory.
+ */
+static struct diag_group *
+diag_group_find(const struct diag *diag, int err, const char *dir, size_t len)
+{
+    struct diag_group *g;
+
+    if (!diag->groups_size) {
+        return NULL;
+    }
+    for (g = diag->groups[diag_hash(err, dir, len) % diag->groups_size]; g; g = g->next) {
+        if ((g->err == err) && (g->len == len) && !memcmp(g->dir, dir, len)) {
+            return g;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Double the groups' hash table when it gets full.
+ *
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+diag_groups_grow(struct diag *diag)
+{
+    struct diag_group **groups, *g;
+    unsigned int size = diag->groups_size ? diag->groups_size * 2 : DIAG_BUCKETS, b;
+
+    groups = calloc(size, sizeof *groups);
+    if (!groups) {
+        return EXIT_FAILURE;
+    }
+    for (unsigned int i = 0; i < diag->groups_size; i++) {
+        while ((g = diag->groups[i])) {
+            diag->groups[i] = g->next;
+            b = diag_hash(g->err, g->dir, g->len) % size;
+            g->next = groups[b];
+            groups[b] = g;
+        }
+    }
+    free(diag->groups);
+    diag->groups = groups;
+    diag->groups_size = size;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Count the error in its group.
+ *
+ * The group is the directory of the failed file (the path's parent), the groups over DIAG_GROUPS_MAX
+ * share the group of the errno with the empty directory. The failed allocation leaves the error uncounted
+ * in the groups, it is still counted in the diag's errors.
+ */
+static void
+diag_group_add(struct diag *diag, const char *path, int err)
+{
+    struct diag_group *g;
+    const char *slash = strrchr(path, '/');
+    const char *dir = path;
+    size_t len;
+    unsigned int b;
+
+    if (!slash) {
+        dir = ".";
+        len = 1;
+    } else if (slash == path) {
+        len = 1;
+    } else {
+        len = slash - path;
+    }
+    if ((diag->groups_count >= DIAG_GROUPS_MAX) && !diag_group_find(diag, err, dir, len)) {
+        len = 0;
+    }
+
+    if ((g = diag_group_find(diag, err, dir, len))) {
+        g->count++;
+        return;
+    }
+
+    if ((diag->groups_count >= diag->groups_size) && diag_groups_grow(diag)) {
+        return;
+    }
+    g = malloc(sizeof *g + len + 1);
+    if (!g) {
+        return;
+    }
+    g->err = err;
+    g->count = 1;
+    g->len = len;
+    memcpy(g->dir, dir, len);
+    g->dir[len] = '\0';
+    b = diag_hash(err, dir, len) % diag->groups_size;
+    g->next = diag->groups[b];
+    diag->groups[b] = g;
+    diag->groups_count++;
+}
+
+/**
+ * @brief Count the error and decide whether its message is printed.
+ *
+ * @return non-zero if the message is supposed to be printed.
+ */
+static int
+diag_account(struct diag *diag, const char *path, int err, uint64_t now)
+{
+    diag->errors++;
+    diag_group_add(diag, path, err);
+
+    if (diag->mode == FIND_ERRORS_SUMMARY) {
+        return 0;
+    } else if (diag->rate) {
+        if (now - diag->window >= 1000000000ULL) {
+            diag->window = now;
+            diag->window_count = 0;
+        }
+        if (diag->window_count == diag->rate) {
+            diag->suppressed++;
+            return 0;
+        }
+        diag->window_count++;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Flush the printed message if it is supposed to be seen now.
+ */
+static void
+diag_printed(struct diag *diag, uint64_t now)
+{
+    if (diag->tty || (now - diag->flushed >= DIAG_FLUSH_INTERVAL)) {
+        writer_flush(&diag->w);
+        diag->flushed = now;
+    }
+}
+
+/**
+ * @brief Start the JSON message of the error.
+ */
+static void
+diag_json_start(struct diag *diag, enum diag_op op, const char *path)
+{
+    diag_puts(&diag->w, "{\"error\":\"");
+    writer_put(&diag->w, diag_ops[op], strlen(diag_ops[op]));
+    diag_puts(&diag->w, "\",");
+    record_json_member(&diag->w, "path", path, strlen(path));
+}
+
+/**
+ * @brief Finish the JSON message with the errno's name and description.
+ */
+static void
+diag_json_errno(struct diag *diag, int err)
+{
+    const char *msg = strerror(err);
+
+    diag_puts(&diag->w, ",\"errno\":\"");
+    diag_errno_name(&diag->w, err);
+    diag_puts(&diag->w, "\",");
+    record_json_member(&diag->w, "message", msg, strlen(msg));
+}
+
+void
+diag_error(struct diag *diag, enum diag_op op, const char *path, int err)
+{
+    uint64_t now = diag_now();
+    const char *msg;
+
+    if (!diag_account(diag, path, err, now)) {
+        return;
+    }
+
+    if (diag->mode == FIND_ERRORS_JSON) {
+        diag_json_start(diag, op, path);
+        diag_json_errno(diag, err);
+        diag_puts(&diag->w, "}\n");
+    } else {
+        msg = strerror(err);
+        if (op == DIAG_OPEN) {
+            diag_puts(&diag->w, FIND_ID ": unable to open directory ");
+            writer_put(&diag->w, path, strlen(path));
+        } else {
+            diag_puts(&diag->w, FIND_ID ": unable to get file ");
+            writer_put(&diag->w, path, strlen(path));
+            diag_puts(&diag->w, " information");
+        }
+        diag_puts(&diag->w, " (");
+        writer_put(&diag->w, msg, strlen(msg));
+        diag_puts(&diag->w, ").\n");
+    }
+    diag_printed(diag, now);
+}
+
+void
+diag_loop(struct diag *diag, const char *path, size_t ancestor_len)
+{
+    uint64_t now = diag_now();
+
+    if (!diag_account(diag, path, ELOOP, now)) {
+        return;
+    }
+
+    if (diag->mode == FIND_ERRORS_JSON) {
+        diag_json_start(diag, DIAG_LOOP, path);
+        writer_putc(&diag->w, ',');
+        record_json_member(&diag->w, "ancestor", path, ancestor_len);
+        diag_json_errno(diag, ELOOP);
+        diag_puts(&diag->w, "}\n");
+    } else {
+        diag_puts(&diag->w, FIND_ID ": File system loop detected; '");
+        writer_put(&diag->w, path, strlen(path));
+        diag_puts(&diag->w, "' is part of the same file system loop as '");
+        writer_put(&diag->w, path, ancestor_len);
+        diag_puts(&diag->w, "'.\n");
+    }
+    diag_printed(diag, now);
+}
+
+/**
+ * @brief Order the groups by the errno and directory.
+ */
+static int
+diag_group_cmp(const void *a, const void *b)
+{
+    const struct diag_group *ga = *(const struct diag_group **)a, *gb = *(const struct diag_group **)b;
+
+    if (ga->err != gb->err) {
+        return (ga->err > gb->err) - (ga->err < gb->err);
+    }
+    return strcmp(ga->dir, gb->dir);
+}
+
+/**
+ * @brief Move the errors of the subdirectories' groups into the group of their topmost ancestor directory.
+ */
+static void
+diag_groups_fold(struct diag *diag, struct diag_group **list, unsigned int count)
+{
+    struct diag_group *g, *ancestor;
+
+    for (unsigned int i = 0; i < count; i++) {
+        g = list[i];
+        ancestor = NULL;
+        for (size_t len = 0; !ancestor && (len < g->len); len++) {
+            if (g->dir[len] == '/') {
+                /* the directory up to the slash, the root directory for the leading slash */
+                ancestor = diag_group_find(diag, g->err, g->dir, len ? len : 1);
+            }
+        }
+        if (ancestor && (ancestor != g)) {
+            ancestor->count += g->count;
+            g->count = 0;
+        }
+    }
+}
+
+/**
+ * @brief Print the line of the summary.
+ */
+static void
+diag_summary_group(struct diag *diag, const struct diag_group *g)
+{
+    const char *msg = strerror(g->err);
+
+    if (diag->mode == FIND_ERRORS_JSON) {
+        diag_puts(&diag->w, "{\"skipped\":");
+        writer_uint(&diag->w, g->count);
+        if (g->len) {
+            writer_putc(&diag->w, ',');
+            record_json_member(&diag->w, "dir", g->dir, g->len);
+        }
+        diag_json_errno(diag, g->err);
+        diag_puts(&diag->w, "}\n");
+        return;
+    }
+
+    diag_puts(&diag->w, FIND_ID ": skipped ");
+    diag_count(&diag->w, g->count);
+    diag_puts(&diag->w, g->count == 1 ? " entry " : " entries ");
+    if (g->len) {
+        diag_puts(&diag->w, "under ");
+        writer_put(&diag->w, g->dir, g->len);
+    } else {
+        diag_puts(&diag->w, "in other directories");
+    }
+    diag_puts(&diag->w, ": ");
+    writer_put(&diag->w, msg, strlen(msg));
+    diag_puts(&diag->w, " (");
+    diag_errno_name(&diag->w, g->err);
+    diag_puts(&diag->w, ").\n");
+}
+
+void
+diag_report(struct diag *diag)
+{
+    struct diag_group **list, *g;
+    unsigned int count = 0;
+
+    if (!diag->errors || ((diag->mode != FIND_ERRORS_SUMMARY) && !diag->suppressed)) {
+        writer_flush(&diag->w);
+        return;
+    }
+
+    if (diag->suppressed) {
+        if (diag->mode == FIND_ERRORS_JSON) {
+            diag_puts(&diag->w, "{\"suppressed\":");
+            writer_uint(&diag->w, diag->suppressed);
+            diag_puts(&diag->w, "}\n");
+        } else {
+            diag_puts(&diag->w, FIND_ID ": ");
+            diag_count(&diag->w, diag->suppressed);
+            diag_puts(&diag->w, " error messages suppressed by --errors-rate.\n");
+        }
+    }
+
+    list = malloc(diag->groups_count * sizeof *list);
+    if (!list) {
+        writer_flush(&diag->w);
+        LOG("%s", strerror(errno));
+        return;
+    }
+    for (unsigned int i = 0; i < diag->groups_size; i++) {
+        for (g = diag->groups[i]; g; g = g->next) {
+            list[count++] = g;
+        }
+    }
+    qsort(list, count, sizeof *list, diag_group_cmp);
+    diag_groups_fold(diag, list, count);
+    for (unsigned int i = 0; i < count; i++) {
+        if (list[i]->count) {
+            diag_summary_group(diag, list[i]);
+        }
+    }
+    free(list);
+    writer_flush(&diag->w);
+}
+
+void
+diag_clean(struct diag *diag)
+{
+    struct diag_group *g;
+
+    writer_flush(&diag->w);
+    for (unsigned int i = 0; i < diag->groups_size; i++) {
+        while ((g = diag->groups[i])) {
+            diag->groups[i] = g->next;
+            free(g);
+        }
+    }
+    free(diag->groups);
+    diag->groups = NULL;
+    diag->groups_size = diag->groups_count = 0;
+}
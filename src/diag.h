@@ -0,0 +1,107 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _DIAG_H
+#define _DIAG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "writer.h"
+
+/** @brief Time between the flushes of the buffered messages in nanoseconds */
+#define DIAG_FLUSH_INTERVAL 1000000000ULL
+
+/** @brief Maximum number of the groups of the errors, the errors of other directories are counted together */
+#define DIAG_GROUPS_MAX 65536
+
+/**
+ * @brief Failed operation of the traversal.
+ */
+enum diag_op {
+    DIAG_STAT = 0,            /**< getting the file information */
+    DIAG_OPEN,                /**< opening the directory */
+    DIAG_LOOP                 /**< the directory is a part of a file system loop */
+};
+
+/**
+ * @brief Errors with the same errno in the same directory.
+ */
+struct diag_group {
+    struct diag_group *next;  /**< next group in the hash table's bucket */
+    int err;                  /**< errno of the errors */
+    unsigned long count;      /**< number of the errors */
+    size_t len;               /**< length of the dir */
+    char dir[];               /**< directory of the failed files, empty for the errors over DIAG_GROUPS_MAX */
+};
+
+/**
+ * @brief Diagnostics of the traversal errors (the files skipped by the scan) (--errors, --errors-rate).
+ *
+ * The messages are collected in a buffer written to stderr when full and at least once per DIAG_FLUSH_INTERVAL
+ * (after each message when stderr is a terminal). Each error is also counted in the group of its errno and
+ * directory, the groups are printed as the summary (with the groups of the subdirectories counted in their
+ * ancestor's group) in the summary mode or when some messages were dropped by the rate limit.
+ */
+struct diag {
+    int mode;                 /**< format of the messages, one of the FIND_ERRORS_* values */
+    unsigned int rate;        /**< maximum number of the messages per second, 0 for no limit */
+    int tty;                  /**< flag stderr is a terminal */
+    struct writer w;          /**< buffered stderr */
+    uint64_t flushed;         /**< monotonic time of the last flush in nanoseconds */
+    uint64_t window;          /**< start of the current second of the rate limit in nanoseconds */
+    unsigned int window_count; /**< number of the messages in the current second */
+
+    unsigned long errors;     /**< number of the reported errors */
+    unsigned long suppressed; /**< number of the messages dropped by the rate limit */
+    struct diag_group **groups; /**< hash table of the groups */
+    unsigned int groups_size; /**< number of the buckets of the groups */
+    unsigned int groups_count; /**< number of the groups */
+};
+
+/**
+ * @brief Initiate the diagnostics.
+ *
+ * @param[out] diag Diagnostics to initiate.
+ * @param[in] mode Format of the messages, one of the FIND_ERRORS_* values.
+ * @param[in] rate Maximum number of the messages per second, 0 for no limit.
+ */
+void diag_init(struct diag *diag, int mode, unsigned int rate);
+
+/**
+ * @brief Report the failed operation on the file.
+ *
+ * @param[in] diag The diagnostics.
+ * @param[in] op The failed operation (DIAG_STAT or DIAG_OPEN).
+ * @param[in] path Path of the file.
+ * @param[in] err errno of the failure.
+ */
+void diag_error(struct diag *diag, enum diag_op op, const char *path, int err);
+
+/**
+ * @brief Report the directory being a part of a file system loop.
+ *
+ * @param[in] diag The diagnostics.
+ * @param[in] path Path of the directory.
+ * @param[in] ancestor_len Length of the path's prefix, which is the path of the same directory.
+ */
+void diag_loop(struct diag *diag, const char *path, size_t ancestor_len);
+
+/**
+ * @brief Print the summary (if requested or if any message was dropped) and flush the messages.
+ *
+ * @param[in] diag The diagnostics.
+ */
+void diag_report(struct diag *diag);
+
+/**
+ * @brief Flush the messages and free the groups.
+ *
+ * @param[in] diag The diagnostics.
+ */
+void diag_clean(struct diag *diag);
+
+#endif /* _DIAG_H */
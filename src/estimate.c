@@ -0,0 +1,178 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _POSIX_C_SOURCE 200809L /* clock_gettime() */
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "estimate.h"
+
+#include "arena.h"
+#include "common.h"
+
+/** @brief Size of the arena blocks for the directory records and the names */
+#define ESTIMATE_ARENA_BLOCK 16384
+
+int
+estimate_open(unsigned int probes, struct estimate **estimate)
+{
+    struct estimate *e;
+    struct timespec now;
+
+    e = calloc(1, sizeof *e);
+    if (!e) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    e->probes_max = probes;
+    arena_init(&e->arena, ESTIMATE_ARENA_BLOCK);
+
+    /* xorshift state must not be zero */
+    clock_gettime(CLOCK_REALTIME, &now);
+    e->random = ((uint64_t)now.tv_sec << 32) ^ (uint64_t)now.tv_nsec ^ ((uint64_t)getpid() << 16) ^ 1;
+
+    *estimate = e;
+    return EXIT_SUCCESS;
+}
+
+struct estimate_dir *
+estimate_dir_new(struct estimate *estimate, struct estimate_dir *parent, dev_t dev, ino_t inode)
+{
+    struct estimate_dir *dir;
+
+    dir = arena_calloc(&estimate->arena, sizeof *dir);
+    if (!dir) {
+        LOG("%s", strerror(errno));
+        return NULL;
+    }
+    dir->parent = parent;
+    dir->dev = dev;
+    dir->inode = inode;
+    dir->next = estimate->dirs;
+    estimate->dirs = dir;
+    if (parent) {
+        estimate->dirs_count++;
+    }
+
+    return dir;
+}
+
+int
+estimate_dir_loop(const struct estimate_dir *dir, dev_t dev, ino_t inode)
+{
+    /* the root is not a directory */
+    for (; dir && dir->parent; dir = dir->parent) {
+        if ((dir->dev == dev) && (dir->inode == inode)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int
+estimate_dir_add(struct estimate *estimate, struct estimate_dir *dir, const char *name)
+{
+    void *x;
+
+    if (dir->subs_count == dir->subs_size) {
+        x = realloc(dir->subs, (dir->subs_size ? 2 * dir->subs_size : 16) * sizeof *dir->subs);
+        if (!x) {
+            LOG("%s", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        dir->subs = x;
+        dir->subs_size = dir->subs_size ? 2 * dir->subs_size : 16;
+    }
+
+    dir->subs[dir->subs_count].name = arena_strndup(&estimate->arena, name, strlen(name));
+    if (!dir->subs[dir->subs_count].name) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    dir->subs[dir->subs_count++].dir = NULL;
+
+    return EXIT_SUCCESS;
+}
+
+unsigned int
+estimate_pick(struct estimate *estimate, const struct estimate_dir *dir)
+{
+    uint64_t x = estimate->random;
+
+    /* xorshift64*, the upper bits are mapped to the range without division */
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    estimate->random = x;
+    x *= 0x2545f4914f6cdd1dULL;
+
+    return (unsigned int)(((x >> 32) * dir->subs_count) >> 32);
+}
+
+void
+estimate_add(struct estimate *estimate, double count, double size)
+{
+    estimate->probes++;
+    estimate->count_sum += count;
+    estimate->count_sq += count * count;
+    estimate->size_sum += size;
+    estimate->size_sq += size * size;
+}
+
+/**
+ * @brief Get the half-width of the confidence interval of the mean.
+ *
+ * @param[in] n Number of the probes.
+ * @param[in] sum Sum of the probes' values.
+ * @param[in] sq Sum of the squares of the probes' values.
+ * @return The half-width, infinity for less than 2 probes.
+ */
+static double
+estimate_interval(unsigned int n, double sum, double sq)
+{
+    double var;
+
+    if (n < 2) {
+        return INFINITY;
+    }
+
+    /* sample variance, the rounding errors must not make it negative */
+    var = (sq - sum * sum / n) / (n - 1);
+    return (var > 0) ? ESTIMATE_Z * sqrt(var / n) : 0;
+}
+
+void
+estimate_report(const struct estimate *estimate, FILE *stream)
+{
+    unsigned int n = estimate->probes;
+
+    fprintf(stream, "probes %u\ndirectories %lu\n", n, estimate->dirs_count);
+    fprintf(stream, "matches %.0f +- %.0f\n", n ? estimate->count_sum / n : 0,
+            estimate_interval(n, estimate->count_sum, estimate->count_sq));
+    fprintf(stream, "size %.0f +- %.0f\n", n ? estimate->size_sum / n : 0,
+            estimate_interval(n, estimate->size_sum, estimate->size_sq));
+}
+
+void
+estimate_free(struct estimate *estimate)
+{
+    if (!estimate) {
+        return;
+    }
+
+    for (struct estimate_dir *dir = estimate->dirs; dir; dir = dir->next) {
+        free(dir->subs);
+    }
+    arena_free(&estimate->arena);
+    free(estimate);
+}
@@ -0,0 +1,141 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _ESTIMATE_H
+#define _ESTIMATE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "arena.h"
+
+/** @brief Quantile of the normal distribution for the reported 95% confidence intervals */
+#define ESTIMATE_Z 1.96
+
+/**
+ * @brief Subdirectory of the read directory.
+ */
+struct estimate_sub {
+    const char *name;             /**< name of the subdirectory, the path for the starting paths */
+    struct estimate_dir *dir;     /**< the subdirectory when it was read by a probe, NULL otherwise */
+};
+
+/**
+ * @brief Directory read by the probes (its files evaluated), shared by all the probes passing through it.
+ */
+struct estimate_dir {
+    struct estimate_dir *parent;  /**< parent directory, NULL for the starting paths (the root) */
+    struct estimate_dir *next;    /**< next read directory, to free them */
+    dev_t dev;                    /**< device of the directory, to detect the file system loops */
+    ino_t inode;                  /**< inode of the directory, to detect the file system loops */
+    double count;                 /**< number of the matching files in the directory */
+    double size;                  /**< total size of the matching files in the directory */
+    struct estimate_sub *subs;    /**< the subdirectories the probes continue to */
+    unsigned int subs_count;      /**< number of the subs */
+    unsigned int subs_size;       /**< allocated size of the subs */
+};
+
+/**
+ * @brief Estimate of the number and total size of the matching files (--estimate).
+ *
+ * Each probe (Knuth's estimator) walks from the starting paths down to a directory without subdirectories,
+ * entering a random subdirectory at each level. The matching files in each directory on the way are weighted
+ * by the product of the numbers of subdirectories above it, so the probe's result is an unbiased estimate
+ * of the whole tree's totals. The reported value is the mean of the probes with the confidence interval
+ * given by their variance. The directories read by a probe are kept, so the upper levels are read once
+ * for all the probes.
+ */
+struct estimate {
+    unsigned int probes_max;      /**< number of the probes to do */
+    unsigned int probes;          /**< number of the finished probes */
+    struct estimate_dir *root;    /**< the starting paths, NULL before the first probe */
+    struct estimate_dir *dirs;    /**< list of all the read directories */
+    unsigned long dirs_count;     /**< number of the read directories (not counting the root) */
+    double count_sum;             /**< sum of the probes' counts */
+    double count_sq;              /**< sum of the squares of the probes' counts */
+    double size_sum;              /**< sum of the probes' sizes */
+    double size_sq;               /**< sum of the squares of the probes' sizes */
+    uint64_t random;              /**< state of the random generator */
+    struct arena arena;           /**< arena of the directories and the names */
+};
+
+/**
+ * @brief Create the estimate.
+ *
+ * @param[in] probes Number of the probes to do.
+ * @param[out] estimate Created estimate to be freed by estimate_free().
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int estimate_open(unsigned int probes, struct estimate **estimate);
+
+/**
+ * @brief Create the record of the directory being read.
+ *
+ * @param[in] estimate The estimate.
+ * @param[in] parent Parent directory, NULL for the root.
+ * @param[in] dev Device of the directory.
+ * @param[in] inode Inode of the directory.
+ * @return The new directory record, NULL on error.
+ */
+struct estimate_dir *estimate_dir_new(struct estimate *estimate, struct estimate_dir *parent, dev_t dev, ino_t inode);
+
+/**
+ * @brief Check if the subdirectory is the directory or any of its ancestors (a file system loop).
+ *
+ * @param[in] dir The directory.
+ * @param[in] dev Device of the subdirectory.
+ * @param[in] inode Inode of the subdirectory.
+ * @return non-zero if the loop is detected.
+ */
+int estimate_dir_loop(const struct estimate_dir *dir, dev_t dev, ino_t inode);
+
+/**
+ * @brief Add the subdirectory the probes can continue to.
+ *
+ * @param[in] estimate The estimate.
+ * @param[in] dir The directory being read.
+ * @param[in] name Name of the subdirectory.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int estimate_dir_add(struct estimate *estimate, struct estimate_dir *dir, const char *name);
+
+/**
+ * @brief Pick the random subdirectory.
+ *
+ * @param[in] estimate The estimate.
+ * @param[in] dir Directory with some subdirectories.
+ * @return Index of the subdirectory in the dir's subs.
+ */
+unsigned int estimate_pick(struct estimate *estimate, const struct estimate_dir *dir);
+
+/**
+ * @brief Account the finished probe.
+ *
+ * @param[in] estimate The estimate.
+ * @param[in] count The probe's estimate of the number of the matching files.
+ * @param[in] size The probe's estimate of the total size of the matching files.
+ */
+void estimate_add(struct estimate *estimate, double count, double size);
+
+/**
+ * @brief Print the estimated values with their confidence intervals.
+ *
+ * @param[in] estimate The estimate.
+ * @param[in] stream Output stream.
+ */
+void estimate_report(const struct estimate *estimate, FILE *stream);
+
+/**
+ * @brief Free the estimate.
+ *
+ * @param[in] estimate Estimate to free, NULL is accepted.
+ */
+void estimate_free(struct estimate *estimate);
+
+#endif /* _ESTIMATE_H */
@@ -4,19 +4,27 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#define _POSIX_C_SOURCE 199309L /* clock_gettime() */
+#include <assert.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "expressions.h"
 
 #include "common.h"
 
-#include "test_name.h"
 #include "test_empty.h"
+#include "test_name.h"
+#include "test_path.h"
 
+#include "action_aggregate.h"
+#include "action_delete.h"
 #include "action_print.h"
+#include "action_printf.h"
+#include "action_quit.h"
 
 /**
  * @brief Filled list of information about test modules.
@@ -24,9 +32,16 @@
  * ADD NEW MODULES HERE
  */
 struct expr_test expr_tests[EXPR_TEST_COUNT] = {
-    {.id = "empty", .help = expr_test_empty_help, .test = expr_test_empty_clb, .arg = EXPR_ARG_NO},
-    {.id = "iname", .help = expr_test_iname_help, .test = expr_test_iname_clb, .arg = EXPR_ARG_MAND},
-    {.id = "name", .help = expr_test_name_help, .test = expr_test_name_clb, .arg = EXPR_ARG_MAND},
+    {.id = "empty", .help = expr_test_empty_help, .test = expr_test_empty_clb, .batch = expr_test_empty_batch,
+        .arg = EXPR_ARG_NO, .need = EXPR_NEED_STAT},
+    {.id = "iname", .help = expr_test_iname_help, .test = expr_test_iname_clb, .batch = expr_test_iname_batch,
+        .arg = EXPR_ARG_MAND, .need = EXPR_NEED_TYPE},
+    {.id = "ipath", .help = expr_test_ipath_help, .test = expr_test_path_clb, .compile = expr_test_ipath_compile,
+        .subtree = expr_test_path_subtree, .arg = EXPR_ARG_MAND, .need = EXPR_NEED_TYPE},
+    {.id = "name", .help = expr_test_name_help, .test = expr_test_name_clb, .batch = expr_test_name_batch,
+        .arg = EXPR_ARG_MAND, .need = EXPR_NEED_TYPE},
+    {.id = "path", .help = expr_test_path_help, .test = expr_test_path_clb, .compile = expr_test_path_compile,
+        .subtree = expr_test_path_subtree, .arg = EXPR_ARG_MAND, .need = EXPR_NEED_TYPE},
 };
 
 /**
@@ -35,22 +50,32 @@ struct expr_test expr_tests[EXPR_TEST_COUNT] = {
  * ADD NEW MODULES HERE
  */
 struct expr_action expr_actions[EXPR_ACT_COUNT] = {
-    {.id = "print0", .help = expr_action_print0_help, .action = expr_action_print0_clb, .arg = EXPR_ARG_NO},
-    {.id = "print", .help = expr_action_print_help, .action = expr_action_print_clb, .arg = EXPR_ARG_NO},
+    {.id = "print0", .help = expr_action_print0_help, .action = expr_action_print0_clb, .arg = EXPR_ARG_NO, .need = EXPR_NEED_TYPE},
+    {.id = "print", .help = expr_action_print_help, .action = expr_action_print_clb, .arg = EXPR_ARG_NO, .need = EXPR_NEED_TYPE},
+    {.id = "printf", .help = expr_action_printf_help, .action = expr_action_printf_clb, .compile = expr_action_printf_compile,
+        .arg = EXPR_ARG_MAND},
+    {.id = "count", .help = expr_action_count_help, .action = expr_action_count_clb, .compile = expr_action_count_compile,
+        .report = expr_action_count_report, .arg = EXPR_ARG_NO, .need = EXPR_NEED_TYPE},
+    {.id = "sum-size", .help = expr_action_sum_size_help, .action = expr_action_sum_size_clb, .compile = expr_action_count_compile,
+        .report = expr_action_count_report, .arg = EXPR_ARG_NO, .need = EXPR_NEED_STAT},
+    {.id = "group-by", .help = expr_action_group_by_help, .action = expr_action_group_by_clb, .compile = expr_action_group_by_compile,
+        .report = expr_action_group_by_report, .arg = EXPR_ARG_MAND},
+    {.id = "quit", .help = expr_action_quit_help, .action = expr_action_quit_clb, .arg = EXPR_ARG_NO, .need = EXPR_NEED_TYPE},
+    {.id = "delete", .help = expr_action_delete_help, .action = expr_action_delete_clb, .arg = EXPR_ARG_NO, .need = EXPR_NEED_TYPE},
 };
 
 /**
  * @brief Common code for other expr_new_* functions
+ * @param[in] arena Arena to allocate the record from.
  * @param[in] type Type of the expression record.
  */
 static struct expr *
-expr_new(enum expr_type type)
+expr_new(struct arena *arena, enum expr_type type)
 {
     struct expr *e;
 
-    e = calloc(1, sizeof *e);
+    e = arena_calloc(arena, sizeof *e);
     if (!e) {
-        LOG("%s", strerror(errno));
         return NULL;
     }
     e->type = type;
@@ -58,11 +83,11 @@ expr_new(enum expr_type type)
 }
 
 struct expr *
-expr_new_group(enum expr_operator op, struct expr *e1, struct expr *e2)
+expr_new_group(struct arena *arena, enum expr_operator op, struct expr *e1, struct expr *e2)
 {
     struct expr *e;
 
-    if (!(e = expr_new(EXPR_GROUP))) {
+    if (!(e = expr_new(arena, EXPR_GROUP))) {
         return NULL;
     }
     e->op = op;
@@ -73,67 +98,299 @@ expr_new_group(enum expr_operator op, struct expr *e1, struct expr *e2)
 }
 
 struct expr *
-expr_new_test(const struct expr_test *info, const char *arg)
+expr_new_test(struct arena *arena, const struct expr_test *info, const char *arg)
 {
     struct expr *e;
+    void *data = NULL;
 
-    if (!(e = expr_new(EXPR_TEST))) {
-        return NULL;
-    }
-    e->test = info->test;
+    /* check the argument before allocating the record, the arena does not free it separately */
     if (info->arg == EXPR_ARG_MAND) {
         if (!arg || arg[0] == '-' || arg[0] == '!' || arg[0] == '(' || arg[0] == ')') {
             LOG("missing argument for -%s test.", info->id);
-            free(e);
             return NULL;
         }
-        e->test_arg = arg;
-    } else if (info->arg == EXPR_ARG_OPT && arg && arg[0] != '-' && arg[0] != '!' && arg[0] != '(' && arg[0] != ')') {
-        e->test_arg = arg;
     } else if (info->arg == EXPR_ARG_NO && arg && arg[0] != '-' && arg[0] != '!' && arg[0] != '(' && arg[0] != ')') {
         LOG("invalid argument for -%s test.", info->id);
-        free(e);
         return NULL;
     }
 
+    if (info->compile && info->compile(arena, arg, &data)) {
+        return NULL;
+    }
+
+    if (!(e = expr_new(arena, EXPR_TEST))) {
+        return NULL;
+    }
+    e->test = info->test;
+    e->test_data = data;
+    e->test_subtree = info->subtree;
+    e->test_batch = info->batch;
+    e->id = info->id;
+    e->need = info->need;
+    if (info->arg == EXPR_ARG_MAND) {
+        e->test_arg = arg;
+    } else if (info->arg == EXPR_ARG_OPT && arg && arg[0] != '-' && arg[0] != '!' && arg[0] != '(' && arg[0] != ')') {
+        e->test_arg = arg;
+    }
+
     return e;
 }
 
 struct expr *
-expr_new_action(const struct expr_action *info, const char *arg)
+expr_new_action(struct arena *arena, const struct expr_action *info, const char *arg)
 {
     struct expr *e;
+    void *data = NULL;
+    enum expr_need need = info->need;
 
-    if (!(e = expr_new(EXPR_ACT))) {
-        return NULL;
-    }
-    e->action = info->action;
+    /* check the argument before allocating the record, the arena does not free it separately */
     if (info->arg == EXPR_ARG_MAND) {
-        if (!arg || arg[0] == '-' || arg[0] == '!' || arg[0] == '(' || arg[0] == ')') {
+        /* the compiled arguments (formats) can be any string */
+        if (!arg || (!info->compile && (arg[0] == '-' || arg[0] == '!' || arg[0] == '(' || arg[0] == ')'))) {
             LOG("missing argument for -%s action.", info->id);
-            free(e);
             return NULL;
         }
-        e->action_arg = arg;
-    } else if (info->arg == EXPR_ARG_OPT && arg && arg[0] != '-' && arg[0] != '!' && arg[0] != '(' && arg[0] != ')') {
-        e->action_arg = arg;
     } else if (info->arg == EXPR_ARG_NO && arg && arg[0] != '-' && arg[0] != '!' && arg[0] != '(' && arg[0] != ')') {
         LOG("invalid argument for -%s action.", info->id);
-        free(e);
         return NULL;
     }
 
+    if (info->compile && info->compile(arena, arg, &data, &need)) {
+        return NULL;
+    }
+
+    if (!(e = expr_new(arena, EXPR_ACT))) {
+        return NULL;
+    }
+    e->action = info->action;
+    e->action_data = data;
+    e->action_stream = stdout;
+    e->action_report = info->report;
+    e->id = info->id;
+    e->need = need;
+    if (info->arg == EXPR_ARG_MAND) {
+        e->action_arg = arg;
+    } else if (info->arg == EXPR_ARG_OPT && arg && arg[0] != '-' && arg[0] != '!' && arg[0] != '(' && arg[0] != ')') {
+        e->action_arg = arg;
+    }
+
     return e;
 }
 
-enum expr_result
-expr_eval(const char *filepath, const char *name, struct stat *st, struct expr *expr)
+enum expr_need
+expr_need(const struct expr *expr)
+{
+    enum expr_need n1, n2;
+
+    if (!expr) {
+        return EXPR_NEED_TYPE;
+    } else if (expr->type != EXPR_GROUP) {
+        return expr->need;
+    }
+
+    n1 = expr_need(expr->expr1);
+    n2 = expr_need(expr->expr2);
+    return n1 > n2 ? n1 : n2;
+}
+
+int
+expr_report(const struct expr *expr)
+{
+    if (!expr) {
+        return EXIT_SUCCESS;
+    } else if (expr->type == EXPR_GROUP) {
+        return (expr_report(expr->expr1) || expr_report(expr->expr2)) ? EXIT_FAILURE : EXIT_SUCCESS;
+    } else if ((expr->type == EXPR_ACT) && expr->action_report) {
+        return expr->action_report(expr->action_stream, expr->action_data);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Check if the evaluation tree contains any action.
+ */
+static int
+expr_has_action(const struct expr *e)
+{
+    if (!e) {
+        return 0;
+    } else if (e->type == EXPR_GROUP) {
+        return expr_has_action(e->expr1) || expr_has_action(e->expr2);
+    }
+
+    return e->type == EXPR_ACT;
+}
+
+/**
+ * @brief Get the results of the evaluation tree known for all the files in the subtree to be traversed.
+ *
+ * @param[in] e Evaluation tree.
+ * @param[out] never Flag the tree is false for all the files without executing any action.
+ * @param[out] always Flag the tree is true for all the files without executing any action.
+ */
+static void
+expr_subtree(const struct expr *e, int *never, int *always)
+{
+    enum expr_subtree s;
+    int n1, a1, n2, a2;
+
+    *never = *always = 0;
+    if (!e) {
+        return;
+    }
+
+    switch (e->type) {
+    case EXPR_GROUP:
+        expr_subtree(e->expr1, &n1, &a1);
+        if (e->op == EXPR_OP_NOT) {
+            *never = a1;
+            *always = n1;
+            break;
+        }
+        expr_subtree(e->expr2, &n2, &a2);
+        /* the second operand is evaluated only after the first one, which must not execute any action */
+        if (e->op == EXPR_OP_AND) {
+            *never = n1 || (n2 && !expr_has_action(e->expr1));
+            *always = a1 && a2;
+        } else if (e->op == EXPR_OP_OR) {
+            *never = n1 && n2;
+            *always = a1 || (a2 && !expr_has_action(e->expr1));
+        }
+        break;
+    case EXPR_TEST:
+        s = e->test_subtree ? e->test_subtree(e->test_data) : EXPR_SUBTREE_UNKNOWN;
+        *never = (s == EXPR_SUBTREE_FALSE);
+        *always = (s == EXPR_SUBTREE_TRUE);
+        break;
+    case EXPR_ACT:
+        break;
+    }
+}
+
+int
+expr_prune(const struct expr *expr)
+{
+    int never, always;
+
+    expr_subtree(expr, &never, &always);
+    return never;
+}
+
+/**
+ * @brief Check if the evaluation trees (without actions) give the same result for any file.
+ */
+static int
+expr_equal(const struct expr *e1, const struct expr *e2)
+{
+    if (!e1 || !e2) {
+        return e1 == e2;
+    } else if (e1->type != e2->type) {
+        return 0;
+    }
+
+    switch (e1->type) {
+    case EXPR_GROUP:
+        return (e1->op == e2->op) && expr_equal(e1->expr1, e2->expr1) && expr_equal(e1->expr2, e2->expr2);
+    case EXPR_TEST:
+        return (e1->test == e2->test) && ((e1->test_arg == e2->test_arg) ||
+                (e1->test_arg && e2->test_arg && !strcmp(e1->test_arg, e2->test_arg)));
+    case EXPR_ACT:
+        break;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Collect the records of the evaluation tree without actions (candidates for the memos).
+ *
+ * @param[in] e Evaluation tree.
+ * @param[in,out] nodes Array of the collected records, NULL to only count them.
+ * @param[in,out] count Number of the collected records.
+ */
+static void
+expr_memo_collect(struct expr *e, struct expr **nodes, unsigned int *count)
+{
+    if (!e) {
+        return;
+    } else if (!expr_has_action(e)) {
+        if (nodes) {
+            nodes[*count] = e;
+        }
+        (*count)++;
+    }
+    if (e->type == EXPR_GROUP) {
+        expr_memo_collect(e->expr1, nodes, count);
+        expr_memo_collect(e->expr2, nodes, count);
+    }
+}
+
+int
+expr_memoize(struct arena *arena, struct expr **trees, unsigned int count, const unsigned long *generation)
+{
+    struct expr **nodes;
+    struct expr_memo *memo;
+    unsigned int nodes_count = 0, i, j;
+
+    for (i = 0; i < count; i++) {
+        expr_memo_collect(trees[i], NULL, &nodes_count);
+    }
+    if (nodes_count < 2) {
+        return EXIT_SUCCESS;
+    }
+    nodes = malloc(nodes_count * sizeof *nodes);
+    if (!nodes) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    nodes_count = 0;
+    for (i = 0; i < count; i++) {
+        expr_memo_collect(trees[i], nodes, &nodes_count);
+    }
+
+    for (i = 0; i < nodes_count; i++) {
+        if (nodes[i]->memo) {
+            /* already shared with a previous record */
+            continue;
+        }
+        memo = NULL;
+        for (j = i + 1; j < nodes_count; j++) {
+            if (nodes[j]->memo || !expr_equal(nodes[i], nodes[j])) {
+                continue;
+            }
+            if (!memo) {
+                memo = arena_calloc(arena, sizeof *memo);
+                if (!memo) {
+                    free(nodes);
+                    return EXIT_FAILURE;
+                }
+                memo->generation = generation;
+                nodes[i]->memo = memo;
+            }
+            nodes[j]->memo = memo;
+        }
+    }
+
+    free(nodes);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Evaluate a single expression record, the subexpressions are evaluated via expr_eval().
+ *
+ * @param[in] file The file being processed.
+ * @param[in] expr The expression record to evaluate.
+ * @return EXPR_FALSE or EXPR_TRUE according to the result of evaluating expression on the file.
+ */
+static enum expr_result
+expr_eval_node(const struct rfind_entry *file, struct expr *expr)
 {
     enum expr_result r1, r2;
 
     switch(expr->type) {
     case EXPR_GROUP:
-        r1 = expr_eval(filepath, name, st, expr->expr1);
+        r1 = expr_eval(file, expr->expr1);
         if (expr->op == EXPR_OP_NOT) {
             return r1 ? EXPR_FALSE : EXPR_TRUE;
         } else {
@@ -142,7 +399,7 @@ expr_eval(const char *filepath, const char *name, struct stat *st, struct expr *
             } else if (expr->op == EXPR_OP_OR && r1) {
                 return r1;
             }
-            r2 = expr_eval(filepath, name, st, expr->expr2);
+            r2 = expr_eval(file, expr->expr2);
             if (expr->op == EXPR_OP_AND) {
                 return r1 && r2;
             } else if (expr->op == EXPR_OP_OR) {
@@ -151,24 +408,146 @@ expr_eval(const char *filepath, const char *name, struct stat *st, struct expr *
         }
         break;
     case EXPR_TEST:
-        return expr->test(filepath, name, st, expr->action_arg);
+        return expr->test(file->path, file->name, file->st, expr->test_arg, expr->test_data);
     case EXPR_ACT:
-        return expr->action(filepath, expr->action_arg);
+        return expr->action(file, expr->action_stream, expr->action_arg, expr->action_data);
     }
 
     return EXPR_FALSE;
 }
 
-void
-expr_free(struct expr *e)
+enum expr_result
+expr_eval(const struct rfind_entry *file, struct expr *expr)
 {
-    if (!e) {
-        return;
+    struct timespec start, end;
+    struct expr_memo *memo = expr->memo;
+    enum expr_result r;
+
+    if (!memo && !expr->stats) {
+        return expr_eval_node(file, expr);
+    } else if (memo && (memo->valid == *memo->generation)) {
+        /* already evaluated on this file by an equal record */
+        return memo->result;
     }
 
-    if (e->type == EXPR_GROUP) {
-        expr_free(e->expr1);
-        expr_free(e->expr2);
+    if (!expr->stats) {
+        r = expr_eval_node(file, expr);
+    } else {
+        /* profiled evaluation */
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        r = expr_eval_node(file, expr);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        expr->stats->calls++;
+        if (r) {
+            expr->stats->trues++;
+        }
+        expr->stats->nsec += (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+    }
+
+    if (memo) {
+        memo->valid = *memo->generation;
+        memo->result = r;
+    }
+    return r;
+}
+
+struct expr *
+expr_batch_guard(struct expr *expr, struct expr **rest)
+{
+    *rest = NULL;
+    if (!expr) {
+        return NULL;
+    } else if (!expr_has_action(expr)) {
+        return expr;
+    } else if ((expr->type == EXPR_GROUP) && (expr->op == EXPR_OP_AND) && !expr_has_action(expr->expr1)) {
+        *rest = expr->expr2;
+        return expr->expr1;
+    }
+
+    return NULL;
+}
+
+char *
+expr_batch_path(const struct expr_batch *batch, unsigned int i)
+{
+    char *buf = batch->path;
+    size_t len = batch->dir_len;
+
+    memcpy(buf, batch->dir, len);
+    if (!len || (buf[len - 1] != '/')) {
+        buf[len++] = '/';
+    }
+    memcpy(&buf[len], batch->names[i], batch->name_lens[i] + 1);
+
+    return buf;
+}
+
+/**
+ * @brief Call the single file test callback on each selected file of the batch (test without the batch callback).
+ *
+ * @param[in] batch The files being tested.
+ * @param[in] expr The test's record.
+ * @param[in,out] sel Selection bitmap of the files to test.
+ */
+static void
+expr_test_batch_adapter(const struct expr_batch *batch, struct expr *expr, uint64_t *sel)
+{
+    uint64_t word;
+    unsigned int i;
+
+    for (unsigned int w = 0; w < EXPR_BATCH_WORDS; w++) {
+        for (word = sel[w]; word; word &= word - 1) {
+            i = w * 64 + __builtin_ctzll(word);
+            if (!expr->test(expr_batch_path(batch, i), batch->names[i], batch->st[i], expr->test_arg,
+                    expr->test_data)) {
+                EXPR_BATCH_CLR(sel, i);
+            }
+        }
+    }
+}
+
+void
+expr_eval_batch(const struct expr_batch *batch, struct expr *expr, uint64_t *sel)
+{
+    uint64_t sel2[EXPR_BATCH_WORDS];
+    unsigned int w;
+
+    switch (expr->type) {
+    case EXPR_GROUP:
+        if (expr->op == EXPR_OP_AND) {
+            /* the second operand only on the files where the first one is true */
+            expr_eval_batch(batch, expr->expr1, sel);
+            expr_eval_batch(batch, expr->expr2, sel);
+        } else if (expr->op == EXPR_OP_OR) {
+            /* the second operand only on the files where the first one is false */
+            memcpy(sel2, sel, sizeof sel2);
+            expr_eval_batch(batch, expr->expr1, sel2);
+            for (w = 0; w < EXPR_BATCH_WORDS; w++) {
+                sel[w] &= ~sel2[w];
+            }
+            expr_eval_batch(batch, expr->expr2, sel);
+            for (w = 0; w < EXPR_BATCH_WORDS; w++) {
+                sel[w] |= sel2[w];
+            }
+        } else if (expr->op == EXPR_OP_NOT) {
+            memcpy(sel2, sel, sizeof sel2);
+            expr_eval_batch(batch, expr->expr1, sel2);
+            for (w = 0; w < EXPR_BATCH_WORDS; w++) {
+                sel[w] &= ~sel2[w];
+            }
+        }
+        break;
+    case EXPR_TEST:
+        if (expr->test_batch) {
+            expr->test_batch(batch, expr->test_arg, expr->test_data, sel);
+        } else {
+            expr_test_batch_adapter(batch, expr, sel);
+        }
+        break;
+    case EXPR_ACT:
+        /* not a part of the guard */
+        assert(0);
+        break;
     }
-    free(e);
 }
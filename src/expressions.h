@@ -7,10 +7,15 @@
 #ifndef _EXPRESSIONS_H
 #define _EXPRESSIONS_H
 
+#include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "rfind.h"
+
 #define EXPR_FOLLOW_NO_SYMLINKS 0x0        /**< do not follow symlinks at all, default behavior */
 #define EXPR_FOLLOW_EXPLICIT_SYMLINKS 0x1  /**< follow symlinks only in case of explcitly provided paths */
 #define EXPR_FOLLOW_SYMLINKS 0x3           /**< follow all symlinks, option -L */
@@ -52,6 +57,14 @@ enum expr_arg {
     EXPR_ARG_NO     /**< no argument expected */
 };
 
+/**
+ * @brief File information needed by the tests and actions
+ */
+enum expr_need {
+    EXPR_NEED_TYPE = 0,  /**< only the file type and inode number (available from the directory listing) */
+    EXPR_NEED_STAT       /**< complete stat information */
+};
+
 /**
  * @brief Callback for executing find tests
  *
@@ -59,11 +72,98 @@ enum expr_arg {
  * @param[in] name Name of the file being tested
  * @param[in] st File information
  * @param[in] arg Argument of the test, can be NULL in case there is no argument on command line
+ * @param[in] data Data prepared by the test's expr_test_compile_clb, NULL if there is no such callback
  *
  * @return EXPR_FALSE for false result
  * @return EXPR_TRUE for true result
  */
-typedef enum expr_result (*expr_test_clb)(const char *filepath, const char *name, const struct stat *st, const char *arg);
+typedef enum expr_result (*expr_test_clb)(const char *filepath, const char *name, const struct stat *st, const char *arg,
+        void *data);
+
+/** @brief Maximum number of the files evaluated at once by expr_eval_batch() */
+#define EXPR_BATCH_MAX 1024
+
+/** @brief Number of the words of the batch's selection bitmap */
+#define EXPR_BATCH_WORDS (EXPR_BATCH_MAX / 64)
+
+/** @brief Check if the file @p I is selected in the selection bitmap @p SEL */
+#define EXPR_BATCH_ISSET(SEL, I) ((SEL)[(I) / 64] & (1ULL << ((I) % 64)))
+
+/** @brief Select the file @p I in the selection bitmap @p SEL */
+#define EXPR_BATCH_SET(SEL, I) ((SEL)[(I) / 64] |= (1ULL << ((I) % 64)))
+
+/** @brief Deselect the file @p I in the selection bitmap @p SEL */
+#define EXPR_BATCH_CLR(SEL, I) ((SEL)[(I) / 64] &= ~(1ULL << ((I) % 64)))
+
+/**
+ * @brief Files of a single directory evaluated at once (structure of arrays), see expr_eval_batch().
+ *
+ * The selection bitmaps passed with the batch have EXPR_BATCH_WORDS words, the bits over the count are zero.
+ */
+struct expr_batch {
+    unsigned int count;                       /**< number of the files */
+    const char *dir;                          /**< path of the files' directory (not NUL-terminated) */
+    size_t dir_len;                           /**< length of the dir */
+    size_t name_max;                          /**< length of the longest name */
+    const char *names[EXPR_BATCH_MAX];        /**< names of the files */
+    size_t name_lens[EXPR_BATCH_MAX];         /**< lengths of the names */
+    unsigned char types[EXPR_BATCH_MAX];      /**< file types from the directory entries (DT_*) */
+    mode_t modes[EXPR_BATCH_MAX];             /**< st_mode of the files */
+    off_t sizes[EXPR_BATCH_MAX];              /**< st_size of the files */
+    const struct stat *st[EXPR_BATCH_MAX];    /**< complete information about the files */
+    char *path;                               /**< buffer of path_size bytes for the files' paths, see expr_batch_path() */
+    size_t path_size;                         /**< size of the path buffer, at least dir_len + name_max + 2 */
+};
+
+/**
+ * @brief Get the path of the batch's file.
+ *
+ * @param[in] batch The files.
+ * @param[in] i Index of the file.
+ * @return The batch's path buffer with the path, it is overwritten by the next call.
+ */
+char *expr_batch_path(const struct expr_batch *batch, unsigned int i);
+
+/**
+ * @brief Callback for executing find tests on the batch of files.
+ *
+ * @param[in] batch The files being tested.
+ * @param[in] arg Argument of the test, can be NULL in case there is no argument on command line
+ * @param[in] data Data prepared by the test's expr_test_compile_clb, NULL if there is no such callback
+ * @param[in,out] sel Selection bitmap of the files to test, the bits of the files with the false result are cleared.
+ */
+typedef void (*expr_test_batch_clb)(const struct expr_batch *batch, const char *arg, void *data, uint64_t *sel);
+
+/**
+ * @brief Callback for compiling the test's argument, called once when creating the expression record.
+ *
+ * @param[in] arena Arena to allocate the compiled data from (the arena of the evaluation tree).
+ * @param[in] arg Argument of the test, can be NULL in case there is no argument on command line
+ * @param[out] data Compiled data passed to the test callback.
+ *
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+typedef int (*expr_test_compile_clb)(struct arena *arena, const char *arg, void **data);
+
+/**
+ * @brief Result of the test known for all the files in a subtree before the subtree is traversed.
+ */
+enum expr_subtree {
+    EXPR_SUBTREE_UNKNOWN = 0,  /**< the test must be evaluated on each file */
+    EXPR_SUBTREE_FALSE,        /**< the test is false for all the files in the subtree */
+    EXPR_SUBTREE_TRUE          /**< the test is true for all the files in the subtree */
+};
+
+/**
+ * @brief Callback for getting the test's result for all the files in the subtree to be traversed.
+ *
+ * The subtree is given by the test's data, which are updated by the traversal (see struct path_pattern).
+ *
+ * @param[in] data Data prepared by the test's expr_test_compile_clb.
+ * @return The test's result for the subtree.
+ */
+typedef enum expr_subtree (*expr_test_subtree_clb)(const void *data);
 
 /**
  * @brief List of available test module indexes in expr_tests.
@@ -73,7 +173,9 @@ typedef enum expr_result (*expr_test_clb)(const char *filepath, const char *name
 enum expr_test_id {
     EXPR_TEST_EMPTY = 0,   /**< -empty */
     EXPR_TEST_INAME,       /**< -iname */
+    EXPR_TEST_IPATH,       /**< -ipath */
     EXPR_TEST_NAME,        /**< -name */
+    EXPR_TEST_PATH,        /**< -path */
 
     EXPR_TEST_COUNT        /**< total number of available tests */
 };
@@ -85,7 +187,11 @@ struct expr_test {
     const char *id;        /**< identifier - name of the command line option */
     const char *help;      /**< help string */
     expr_test_clb test;    /**< test callback */
+    expr_test_compile_clb compile; /**< optional callback to compile the test's argument */
+    expr_test_subtree_clb subtree; /**< optional callback to get the test's result for a whole subtree */
+    expr_test_batch_clb batch; /**< optional callback to test a batch of files, the test callback is used otherwise */
     enum expr_arg arg;     /**< hint about the test's argument presence */
+    enum expr_need need;   /**< file information needed by the test */
 };
 
 /**
@@ -94,15 +200,41 @@ struct expr_test {
 extern struct expr_test expr_tests[EXPR_TEST_COUNT];
 
 /**
- * @brief Callback for executing find tests
+ * @brief Callback for compiling the action's argument, called once when creating the expression record.
  *
- * @param[in] filepath Path of the file being processed
- * @param[in] arg Argument of the test, can be NULL in case there is no argument on command line
+ * @param[in] arena Arena to allocate the compiled data from (the arena of the evaluation tree).
+ * @param[in] arg Argument of the action, can be NULL in case there is no argument on command line
+ * @param[out] data Compiled data passed to the action callback.
+ * @param[out] need File information needed by the action with the given argument.
+ *
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+typedef int (*expr_action_compile_clb)(struct arena *arena, const char *arg, void **data, enum expr_need *need);
+
+/**
+ * @brief Callback for executing find actions
+ *
+ * @param[in] file The file being processed
+ * @param[in] stream Stream the action writes its output to (the standard output unless redirected by the query)
+ * @param[in] arg Argument of the action, can be NULL in case there is no argument on command line
+ * @param[in] data Data prepared by the action's expr_action_compile_clb, NULL if there is no such callback
  *
  * @return EXPR_FALSE when the action fails
  * @return EXPR_TRUE when the action succeeds
  */
-typedef enum expr_result (*expr_action_clb)(const char *filepath, const char *arg);
+typedef enum expr_result (*expr_action_clb)(const struct rfind_entry *file, FILE *stream, const char *arg, void *data);
+
+/**
+ * @brief Callback for printing the action's result at the end of the run (aggregating actions).
+ *
+ * @param[in] stream Stream the action writes its output to.
+ * @param[in] data Data prepared by the action's expr_action_compile_clb.
+ *
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+typedef int (*expr_action_report_clb)(FILE *stream, void *data);
 
 /**
  * @brief List of available action module indexes in expr_actions.
@@ -112,6 +244,12 @@ typedef enum expr_result (*expr_action_clb)(const char *filepath, const char *ar
 enum expr_action_id {
     EXPR_ACT_PRINT0 = 0,  /**< -print0 */
     EXPR_ACT_PRINT,       /**< -print */
+    EXPR_ACT_PRINTF,      /**< -printf */
+    EXPR_ACT_AGGR_COUNT,  /**< -count */
+    EXPR_ACT_SUM_SIZE,    /**< -sum-size */
+    EXPR_ACT_GROUP_BY,    /**< -group-by */
+    EXPR_ACT_QUIT,        /**< -quit */
+    EXPR_ACT_DELETE,      /**< -delete */
 
     EXPR_ACT_COUNT        /**< total number of available tests */
 };
@@ -123,7 +261,10 @@ struct expr_action {
     const char *id;           /**< identifier - name of the command line option */
     const char *help;         /**< help string */
     expr_action_clb action;   /**< action callback */
+    expr_action_compile_clb compile; /**< optional callback to compile the action's argument */
+    expr_action_report_clb report; /**< optional callback to print the action's result at the end */
     enum expr_arg arg;        /**< hint about the action's argument presence */
+    enum expr_need need;      /**< file information needed by the action (if there is no compile callback) */
 };
 
 /**
@@ -131,6 +272,24 @@ struct expr_action {
  */
 extern struct expr_action expr_actions[EXPR_ACT_COUNT];
 
+/**
+ * @brief Profiling counters of a single expression record (--profile-expr).
+ */
+struct expr_stats {
+    unsigned long long calls;        /**< number of evaluations of the record */
+    unsigned long long trues;        /**< number of evaluations with EXPR_TRUE result */
+    unsigned long long nsec;         /**< cumulative evaluation time (including subexpressions) in nanoseconds */
+};
+
+/**
+ * @brief Result of the expression shared by the equal expression records, see expr_memoize().
+ */
+struct expr_memo {
+    const unsigned long *generation; /**< generation of the currently evaluated file */
+    unsigned long valid;             /**< generation of the file the result belongs to */
+    enum expr_result result;         /**< the stored result */
+};
+
 /**
  * @brief Expression record
  */
@@ -146,59 +305,134 @@ struct expr {
         struct {
             expr_test_clb test;      /**< test callback */
             const char *test_arg;    /**< test's argument */
+            void *test_data;         /**< test's compiled argument */
+            expr_test_subtree_clb test_subtree; /**< test's callback to get the result for a whole subtree */
+            expr_test_batch_clb test_batch; /**< test's callback for a batch of files, NULL to use the test callback */
         };                           /**< members for EXPR_TEST type */
         struct {
             expr_action_clb action;  /**< action callback */
             const char *action_arg;  /**< action's argument */
+            void *action_data;       /**< action's compiled argument */
+            FILE *action_stream;     /**< stream of the action's output */
+            expr_action_report_clb action_report; /**< action's callback to print the result at the end */
         };                           /**< members for EXPR_ACT type */
     };
 
+    const char *id;                  /**< identifier of the test/action module (NULL for EXPR_GROUP) */
+    enum expr_need need;             /**< file information needed by the test/action */
+    struct expr_stats *stats;        /**< profiling counters, NULL if the profiling is not enabled */
+    struct expr_memo *memo;          /**< result shared with the equal records, NULL if there is no such record */
+
     struct expr *next;               /**< aux pointer to the next expression in the postfix list */
 };
 
 /**
  * @brief Create new expression record for the given operator.
+ * @param[in] arena Arena to allocate the record from, the records are freed with the arena.
  * @param[in] op Operator of the expression record.
  * @param[in] e1 First operand (if available, NULL is accepted)
  * @param[in] e2 Second operand (if applicable and available, NULL is accepted)
  * @return NULL in case of failure.
  * @return pointer to the created expression record.
  */
-struct expr *expr_new_group(enum expr_operator op, struct expr *e1, struct expr *e2);
+struct expr *expr_new_group(struct arena *arena, enum expr_operator op, struct expr *e1, struct expr *e2);
 
 /**
  * @brief Create new expression record for the test terminal.
+ * @param[in] arena Arena to allocate the record from, the records are freed with the arena.
  * @param[in] info Information about the test module
  * @param[in] arg Argument of the test, is checked according to the information in @p info
  * @return NULL in case of failure.
  * @return pointer to the created expression record.
  */
-struct expr *expr_new_test(const struct expr_test *info, const char *arg);
+struct expr *expr_new_test(struct arena *arena, const struct expr_test *info, const char *arg);
 
 /**
  * @brief Create new expression record for the action terminal.
+ * @param[in] arena Arena to allocate the record from, the records are freed with the arena.
  * @param[in] info Information about the action module
  * @param[in] arg Argument of the action, is checked according to the information in @p info
  * @return NULL in case of failure.
  * @return pointer to the created expression record.
  */
-struct expr *expr_new_action(const struct expr_action *info, const char *arg);
+struct expr *expr_new_action(struct arena *arena, const struct expr_action *info, const char *arg);
+
+/**
+ * @brief Get the file information needed to evaluate the expression evaluation tree.
+ *
+ * @param[in] expr The evaluation tree of the expression.
+ * @return The file information needed by the most demanding test or action.
+ */
+enum expr_need expr_need(const struct expr *expr);
+
+/**
+ * @brief Check if the subtree to be traversed can be skipped.
+ *
+ * The subtree can be skipped if the expression is false for all its files without executing
+ * any action, according to the tests' expr_test_subtree_clb.
+ *
+ * @param[in] expr The evaluation tree of the expression.
+ * @return non-zero if the subtree can be skipped.
+ */
+int expr_prune(const struct expr *expr);
+
+/**
+ * @brief Print the results of the aggregating actions in the evaluation tree.
+ *
+ * @param[in] expr The evaluation tree of the expression.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int expr_report(const struct expr *expr);
+
+/**
+ * @brief Share the results of the equal subexpressions (without actions) of the evaluation trees.
+ *
+ * The equal subexpressions of several trees (or a single tree) get a common memo, so the
+ * subexpression is evaluated only once per file. The caller is supposed to increase the
+ * @p generation before evaluating the trees on the next file.
+ *
+ * @param[in] arena Arena of the evaluation trees to allocate the memos from.
+ * @param[in] trees Evaluation trees.
+ * @param[in] count Number of the @p trees.
+ * @param[in] generation Counter of the evaluated files, it must not be 0 while evaluating.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int expr_memoize(struct arena *arena, struct expr **trees, unsigned int count, const unsigned long *generation);
 
 /**
- * @brief Evaluate the expression evaluation tree on the file of given attributes.
+ * @brief Evaluate the expression evaluation tree on the file.
  *
- * @param[in] filepath Path of the file being processed.
- * @param[in] name The name (basename) of the file being processed.
- * @param[in] st The stat information.
+ * @param[in] file The file being processed.
  * @param[in] expr The evaluation tree of the expression.
  * @return EXPR_FALSE or EXPR_TRUE according to the result of evaluating expression on the file.
  */
-enum expr_result expr_eval(const char *filepath, const char *name, struct stat *st, struct expr *expr);
+enum expr_result expr_eval(const struct rfind_entry *file, struct expr *expr);
 
 /**
- * @brief Free the expressions evaluation tree.
- * @param[in] e Root of the evaluation tree to be freed.
+ * @brief Get the part of the expression which can be evaluated by expr_eval_batch().
+ *
+ * The guard is the expression itself if it has no action, or the first operand without actions of
+ * the top -a operator. The expression is false for the files where the guard is false, the rest
+ * is evaluated on the other files via expr_eval() (its result is the expression's result).
+ *
+ * @param[in] expr The evaluation tree of the expression.
+ * @param[out] rest The rest of the expression to evaluate on the files where the guard is true, NULL if none.
+ * @return The guard, NULL if there is no such part.
+ */
+struct expr *expr_batch_guard(struct expr *expr, struct expr **rest);
+
+/**
+ * @brief Evaluate the expression (without actions) on the batch of files.
+ *
+ * The operators combine the selection bitmaps of their operands, the tests without the batch callback
+ * are called on each selected file. The profiling counters and memos are not updated.
+ *
+ * @param[in] batch The files being processed.
+ * @param[in] expr The evaluation tree of the expression, see expr_batch_guard().
+ * @param[in,out] sel Selection bitmap of the files to evaluate, the bits of the files with the false result are cleared.
  */
-void expr_free(struct expr *e);
+void expr_eval_batch(const struct expr_batch *batch, struct expr *expr, uint64_t *sel);
 
 #endif /* _EXPRESSIONS_H  */
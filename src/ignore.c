@@ -0,0 +1,363 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _POSIX_C_SOURCE 200809L /* openat() */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ignore.h"
+
+#include "arena.h"
+#include "common.h"
+
+/**
+ * @brief Read the whole file into the arena.
+ *
+ * @param[in] arena Arena to allocate the content from.
+ * @param[in] dirfd Directory containing the file.
+ * @param[in] name Name of the file.
+ * @param[out] len Length of the content.
+ * @return Content of the file (not NUL-terminated), NULL on error.
+ */
+static char *
+ignore_read(struct arena *arena, int dirfd, const char *name, size_t *len)
+{
+    struct stat st;
+    char *data = NULL;
+    ssize_t r;
+    int fd;
+
+    fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        goto error;
+    }
+
+    data = arena_alloc(arena, st.st_size + 1);
+    if (!data) {
+        goto error;
+    }
+    for (*len = 0; *len < (size_t)st.st_size; *len += r) {
+        r = read(fd, &data[*len], st.st_size - *len);
+        if (r == -1) {
+            goto error;
+        } else if (!r) {
+            /* truncated in the meantime */
+            break;
+        }
+    }
+
+    close(fd);
+    return data;
+
+error:
+    LOG("unable to read ignore file %s (%s).", name, strerror(errno));
+    if (fd != -1) {
+        close(fd);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Check if the pattern contains any wildcard (or escape) character.
+ */
+static int
+ignore_has_wildcard(const char *pattern, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (strchr("*?[\\", pattern[i])) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Compile the line of the ignore file into the rule.
+ *
+ * @param[in] line The line (without the newline).
+ * @param[in] len Length of the line.
+ * @param[out] rule Rule to fill.
+ * @return non-zero if the line contains a rule, zero for empty and comment lines.
+ */
+static int
+ignore_rule_compile(const char *line, size_t len, struct ignore_rule *rule)
+{
+    memset(rule, 0, sizeof *rule);
+
+    if (len && (line[len - 1] == '\r')) {
+        len--;
+    }
+    if (!len || (line[0] == '#')) {
+        return 0;
+    }
+
+    /* trailing spaces are ignored unless escaped */
+    while (len && (line[len - 1] == ' ') && !((len > 1) && (line[len - 2] == '\\'))) {
+        len--;
+    }
+
+    if (line[0] == '!') {
+        rule->flags |= IGNORE_NEGATE;
+        line++;
+        len--;
+    }
+    if (len && (line[len - 1] == '/')) {
+        rule->flags |= IGNORE_DIRONLY;
+        len--;
+    }
+    if (memchr(line, '/', len)) {
+        /* a slash at the beginning or in the middle anchors the pattern to the ignore file's directory */
+        rule->flags |= IGNORE_ANCHORED;
+        if (line[0] == '/') {
+            line++;
+            len--;
+        }
+    }
+    if (!len) {
+        return 0;
+    }
+
+    rule->pattern = line;
+    rule->len = len;
+    if (!ignore_has_wildcard(line, len)) {
+        rule->kind = IGNORE_LITERAL;
+    } else if (!(rule->flags & IGNORE_ANCHORED) && (line[0] == '*') && !ignore_has_wildcard(&line[1], len - 1)) {
+        rule->kind = IGNORE_SUFFIX;
+        rule->pattern++;
+        rule->len--;
+    } else {
+        rule->kind = IGNORE_GLOB;
+    }
+
+    return 1;
+}
+
+int
+ignore_rules_load(struct arena *arena, int dirfd, const char *name, struct ignore_rules **rules)
+{
+    struct ignore_rules *r = *rules;
+    struct ignore_rule *x;
+    const char *line, *end;
+    char *data;
+    size_t len;
+    unsigned int count = 0;
+
+    data = ignore_read(arena, dirfd, name, &len);
+    if (!data) {
+        return EXIT_SUCCESS;
+    }
+
+    /* the lines are the upper bound of the rules */
+    for (size_t i = 0; i < len; i++) {
+        count += (data[i] == '\n') ? 1 : 0;
+    }
+    count++;
+
+    if (!r) {
+        r = arena_calloc(arena, sizeof *r);
+        if (!r) {
+            return EXIT_FAILURE;
+        }
+        *rules = r;
+    }
+    x = arena_alloc(arena, (r->count + count) * sizeof *x);
+    if (!x) {
+        return EXIT_FAILURE;
+    }
+    if (r->count) {
+        memcpy(x, r->rules, r->count * sizeof *x);
+    }
+    r->rules = x;
+
+    for (line = data; line < &data[len]; line = end + 1) {
+        end = memchr(line, '\n', &data[len] - line);
+        if (!end) {
+            end = &data[len];
+        }
+        if (ignore_rule_compile(line, end - line, &r->rules[r->count])) {
+            r->count++;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Match the bracket expression ([...]) against the character.
+ *
+ * @param[in,out] p Pattern starting after the '[', moved behind the closing ']'.
+ * @param[in] pend End of the pattern.
+ * @param[in] c Character to match.
+ * @return 1 on match, 0 on mismatch, -1 for unterminated bracket expression.
+ */
+static int
+ignore_glob_bracket(const char **p, const char *pend, char c)
+{
+    const char *s = *p;
+    int negate = 0, match = 0;
+    char lo, hi;
+
+    if ((s < pend) && ((*s == '!') || (*s == '^'))) {
+        negate = 1;
+        s++;
+    }
+    /* the ']' right after the opening bracket is a literal */
+    for (int first = 1; s < pend && (first || *s != ']'); first = 0) {
+        lo = *s++;
+        if ((lo == '\\') && (s < pend)) {
+            lo = *s++;
+        }
+        hi = lo;
+        if ((s + 1 < pend) && (*s == '-') && (s[1] != ']')) {
+            hi = s[1];
+            s += 2;
+            if ((hi == '\\') && (s < pend)) {
+                hi = *s++;
+            }
+        }
+        if ((lo <= c) && (c <= hi)) {
+            match = 1;
+        }
+    }
+    if (s == pend) {
+        return -1;
+    }
+
+    *p = s + 1;
+    return match != negate;
+}
+
+/**
+ * @brief Match the string against the glob pattern with the gitignore(5) semantics.
+ *
+ * The wildcards do not match '/', except the "**" as a whole path component.
+ *
+ * @param[in] p Pattern.
+ * @param[in] pend End of the pattern.
+ * @param[in] s String to match.
+ * @return non-zero on match.
+ */
+static int
+ignore_glob(const char *p, const char *pend, const char *s)
+{
+    const char *start = p;
+    int r;
+
+    while (p < pend) {
+        switch (*p) {
+        case '*':
+            if ((p + 1 < pend) && (p[1] == '*') && ((p == start) || (p[-1] == '/')) &&
+                    ((p + 2 == pend) || (p[2] == '/'))) {
+                if (p + 2 == pend) {
+                    /* trailing "**" matches everything */
+                    return 1;
+                }
+                /* "**\/" matches zero or more directories */
+                for (p += 3; ; s++) {
+                    if (ignore_glob(p, pend, s)) {
+                        return 1;
+                    }
+                    s = strchr(s, '/');
+                    if (!s) {
+                        return 0;
+                    }
+                }
+            }
+            while ((p < pend) && (*p == '*')) {
+                p++;
+            }
+            if (p == pend) {
+                return !strchr(s, '/');
+            }
+            for ( ; ; s++) {
+                if (ignore_glob(p, pend, s)) {
+                    return 1;
+                }
+                if (!*s || (*s == '/')) {
+                    return 0;
+                }
+            }
+        case '?':
+            if (!*s || (*s == '/')) {
+                return 0;
+            }
+            break;
+        case '[':
+            if (!*s || (*s == '/')) {
+                return 0;
+            }
+            p++;
+            r = ignore_glob_bracket(&p, pend, *s);
+            if (r == -1) {
+                /* not a bracket expression, literal '[' */
+                p--;
+                if (*s != '[') {
+                    return 0;
+                }
+                break;
+            } else if (!r) {
+                return 0;
+            }
+            s++;
+            continue;
+        case '\\':
+            if (p + 1 < pend) {
+                p++;
+            }
+            /* fall through */
+        default:
+            if (*p != *s) {
+                return 0;
+            }
+            break;
+        }
+        p++;
+        s++;
+    }
+
+    return !*s;
+}
+
+enum ignore_result
+ignore_match(const struct ignore_rules *rules, const char *path, const char *name, int isdir)
+{
+    const struct ignore_rule *rule;
+    const char *str;
+    size_t len;
+    int match;
+
+    /* the last matching rule wins */
+    for (unsigned int i = rules->count; i > 0; i--) {
+        rule = &rules->rules[i - 1];
+        if ((rule->flags & IGNORE_DIRONLY) && !isdir) {
+            continue;
+        }
+
+        str = (rule->flags & IGNORE_ANCHORED) ? path : name;
+        switch (rule->kind) {
+        case IGNORE_LITERAL:
+            match = !strncmp(str, rule->pattern, rule->len) && !str[rule->len];
+            break;
+        case IGNORE_SUFFIX:
+            len = strlen(str);
+            match = (len >= rule->len) && !memcmp(&str[len - rule->len], rule->pattern, rule->len);
+            break;
+        default:
+            match = ignore_glob(rule->pattern, &rule->pattern[rule->len], str);
+            break;
+        }
+        if (match) {
+            return (rule->flags & IGNORE_NEGATE) ? IGNORE_INCLUDE : IGNORE_EXCLUDE;
+        }
+    }
+
+    return IGNORE_NONE;
+}
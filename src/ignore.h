@@ -0,0 +1,80 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _IGNORE_H
+#define _IGNORE_H
+
+#include <stddef.h>
+
+#include "arena.h"
+
+/**
+ * @brief Flags of the ignore rule
+ */
+#define IGNORE_NEGATE 0x01     /**< the rule starts with '!', matching file is not ignored */
+#define IGNORE_DIRONLY 0x02    /**< the rule ends with '/', only directories match */
+#define IGNORE_ANCHORED 0x04   /**< the rule contains '/', the path relative to the ignore file's directory is matched */
+
+/**
+ * @brief Kind of the rule's pattern matching.
+ */
+enum ignore_kind {
+    IGNORE_LITERAL,   /**< pattern without wildcards, compared as a string */
+    IGNORE_SUFFIX,    /**< '*' followed by a literal (e.g. *.o), the name's suffix is compared */
+    IGNORE_GLOB       /**< generic pattern with wildcards */
+};
+
+/**
+ * @brief Single compiled line of the ignore file.
+ */
+struct ignore_rule {
+    const char *pattern;    /**< pattern (without the '!', the leading and trailing '/'), the suffix for IGNORE_SUFFIX */
+    size_t len;             /**< length of the pattern */
+    enum ignore_kind kind;  /**< how to match the pattern */
+    int flags;              /**< IGNORE_* flags */
+};
+
+/**
+ * @brief Rules of the ignore files in a single directory.
+ */
+struct ignore_rules {
+    unsigned int count;         /**< number of the rules */
+    struct ignore_rule *rules;  /**< the rules in the order of the files and lines, the last matching rule wins */
+};
+
+/**
+ * @brief Result of matching the file against the ignore rules.
+ */
+enum ignore_result {
+    IGNORE_NONE = 0,  /**< no rule matches */
+    IGNORE_EXCLUDE,   /**< the file is ignored */
+    IGNORE_INCLUDE    /**< negated rule matches, the file is not ignored */
+};
+
+/**
+ * @brief Read and compile the ignore file (gitignore(5) syntax) into the rules.
+ *
+ * @param[in] arena Arena to allocate the rules from.
+ * @param[in] dirfd Directory containing the ignore file.
+ * @param[in] name Name of the ignore file.
+ * @param[in,out] rules Rules to extend by the rules of the file (the file's rules win), created if NULL.
+ * @return EXIT_SUCCESS (also for an inaccessible file, which is reported and skipped)
+ * @return EXIT_FAILURE
+ */
+int ignore_rules_load(struct arena *arena, int dirfd, const char *name, struct ignore_rules **rules);
+
+/**
+ * @brief Match the file against the rules of a single directory.
+ *
+ * @param[in] rules Rules to match.
+ * @param[in] path Path of the file relative to the directory of the rules.
+ * @param[in] name Name of the file (suffix of the @p path).
+ * @param[in] isdir Flag if the file is a directory.
+ * @return Result of the last matching rule.
+ */
+enum ignore_result ignore_match(const struct ignore_rules *rules, const char *path, const char *name, int isdir);
+
+#endif /* _IGNORE_H */
@@ -0,0 +1,264 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <errno.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "linkcache.h"
+
+#include "common.h"
+
+/** @brief Initial size of the subtree's data */
+#define LINKCACHE_DATA_SIZE 4096
+
+int
+linkcache_open(size_t cap, struct linkcache **cache)
+{
+    *cache = calloc(1, sizeof **cache);
+    if (!*cache) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    (*cache)->cap = cap;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Get the hash table's bucket of the directory.
+ */
+static unsigned int
+linkcache_bucket(dev_t dev, ino_t ino)
+{
+    return (unsigned int)((((unsigned long long)dev * 0x9e3779b97f4a7c15ULL) ^ (unsigned long long)ino) %
+            LINKCACHE_BUCKETS);
+}
+
+/**
+ * @brief Get the memory taken by the subtree.
+ */
+static size_t
+linkcache_tree_size(const struct linkcache_tree *tree)
+{
+    return sizeof *tree + tree->size + tree->dirs_size * sizeof *tree->dirs;
+}
+
+/**
+ * @brief Free the subtree, it must not be in the cache.
+ */
+static void
+linkcache_tree_free(struct linkcache_tree *tree)
+{
+    if (!tree) {
+        return;
+    }
+
+    free(tree->data);
+    free(tree->dirs);
+    free(tree);
+}
+
+/**
+ * @brief Unlink the subtree from the LRU list.
+ */
+static void
+linkcache_lru_unlink(struct linkcache *cache, struct linkcache_tree *tree)
+{
+    if (tree->prev) {
+        tree->prev->next = tree->next;
+    } else {
+        cache->head = tree->next;
+    }
+    if (tree->next) {
+        tree->next->prev = tree->prev;
+    } else {
+        cache->tail = tree->prev;
+    }
+    tree->prev = tree->next = NULL;
+}
+
+/**
+ * @brief Insert the subtree at the head of the LRU list (the most recently used).
+ */
+static void
+linkcache_lru_push(struct linkcache *cache, struct linkcache_tree *tree)
+{
+    tree->next = cache->head;
+    if (cache->head) {
+        cache->head->prev = tree;
+    } else {
+        cache->tail = tree;
+    }
+    cache->head = tree;
+}
+
+/**
+ * @brief Remove the least recently used subtree from the cache.
+ */
+static void
+linkcache_evict(struct linkcache *cache)
+{
+    struct linkcache_tree *tree = cache->tail, **link;
+
+    for (link = &cache->buckets[linkcache_bucket(tree->dev, tree->ino)]; *link != tree; link = &(*link)->hnext) {}
+    *link = tree->hnext;
+    linkcache_lru_unlink(cache, tree);
+    cache->used -= linkcache_tree_size(tree);
+    linkcache_tree_free(tree);
+}
+
+const struct linkcache_tree *
+linkcache_find(struct linkcache *cache, dev_t dev, ino_t ino)
+{
+    struct linkcache_tree *tree;
+
+    for (tree = cache->buckets[linkcache_bucket(dev, ino)]; tree; tree = tree->hnext) {
+        if ((tree->dev == dev) && (tree->ino == ino)) {
+            linkcache_lru_unlink(cache, tree);
+            linkcache_lru_push(cache, tree);
+            return tree;
+        }
+    }
+
+    return NULL;
+}
+
+int
+linkcache_tree_has_dir(const struct linkcache_tree *tree, dev_t dev, ino_t ino)
+{
+    for (unsigned int i = 0; i < tree->dirs_count; i++) {
+        if ((tree->dirs[i].dev == dev) && (tree->dirs[i].ino == ino)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get size of the entry with the path of the given length, including the alignment.
+ */
+static size_t
+linkcache_entry_size(size_t len)
+{
+    size_t size = sizeof(struct linkcache_entry) + len + 1;
+
+    return (size + alignof(struct linkcache_entry) - 1) & ~(alignof(struct linkcache_entry) - 1);
+}
+
+const struct linkcache_entry *
+linkcache_entry_next(const struct linkcache_tree *tree, const struct linkcache_entry *e)
+{
+    size_t offset = e ? (size_t)((const char *)e - tree->data) + linkcache_entry_size(e->len) : 0;
+
+    return (offset < tree->len) ? (const struct linkcache_entry *)&tree->data[offset] : NULL;
+}
+
+int
+linkcache_record_start(struct linkcache *cache, dev_t dev, ino_t ino)
+{
+    cache->recording = calloc(1, sizeof *cache->recording);
+    if (!cache->recording) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    cache->recording->dev = dev;
+    cache->recording->ino = ino;
+
+    return EXIT_SUCCESS;
+}
+
+void
+linkcache_record_add(struct linkcache *cache, const char *path, size_t name, unsigned int depth,
+        const struct stat *st)
+{
+    struct linkcache_tree *tree = cache->recording;
+    struct linkcache_entry *e;
+    size_t len = strlen(path), size = linkcache_entry_size(len), new_size;
+    void *x;
+
+    if (!tree) {
+        /* dropped */
+        return;
+    }
+
+    if (tree->len + size > tree->size) {
+        for (new_size = tree->size ? tree->size * 2 : LINKCACHE_DATA_SIZE; new_size < tree->len + size; new_size *= 2) {}
+        if ((sizeof *tree + new_size + tree->dirs_size * sizeof *tree->dirs > cache->cap) ||
+                !(x = realloc(tree->data, new_size))) {
+            goto drop;
+        }
+        tree->data = x;
+        tree->size = new_size;
+    }
+    if (S_ISDIR(st->st_mode) && (tree->dirs_count == tree->dirs_size)) {
+        new_size = tree->dirs_size ? tree->dirs_size * 2 : 16;
+        if ((sizeof *tree + tree->size + new_size * sizeof *tree->dirs > cache->cap) ||
+                !(x = realloc(tree->dirs, new_size * sizeof *tree->dirs))) {
+            goto drop;
+        }
+        tree->dirs = x;
+        tree->dirs_size = new_size;
+    }
+
+    e = (struct linkcache_entry *)&tree->data[tree->len];
+    e->st = *st;
+    e->depth = depth;
+    e->name = name;
+    e->len = len;
+    memcpy(e->path, path, len + 1);
+    tree->len += size;
+    if (S_ISDIR(st->st_mode)) {
+        tree->dirs[tree->dirs_count].dev = st->st_dev;
+        tree->dirs[tree->dirs_count++].ino = st->st_ino;
+    }
+    return;
+
+drop:
+    /* the subtree does not fit into the cache */
+    linkcache_tree_free(tree);
+    cache->recording = NULL;
+}
+
+void
+linkcache_record_finish(struct linkcache *cache, int complete)
+{
+    struct linkcache_tree *tree = cache->recording;
+    size_t size;
+
+    cache->recording = NULL;
+    if (!tree) {
+        return;
+    } else if (!complete) {
+        linkcache_tree_free(tree);
+        return;
+    }
+
+    size = linkcache_tree_size(tree);
+    while (cache->tail && (cache->used + size > cache->cap)) {
+        linkcache_evict(cache);
+    }
+    tree->hnext = cache->buckets[linkcache_bucket(tree->dev, tree->ino)];
+    cache->buckets[linkcache_bucket(tree->dev, tree->ino)] = tree;
+    linkcache_lru_push(cache, tree);
+    cache->used += size;
+}
+
+void
+linkcache_free(struct linkcache *cache)
+{
+    if (!cache) {
+        return;
+    }
+
+    while (cache->tail) {
+        linkcache_evict(cache);
+    }
+    linkcache_tree_free(cache->recording);
+    free(cache);
+}
@@ -0,0 +1,151 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _LINKCACHE_H
+#define _LINKCACHE_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/** @brief Number of the buckets of the cached subtrees' hash table */
+#define LINKCACHE_BUCKETS 1024
+
+/**
+ * @brief File of the cached subtree.
+ *
+ * The entries are stored one after another in the tree's data, aligned as the structure.
+ */
+struct linkcache_entry {
+    struct stat st;               /**< information about the file */
+    unsigned int depth;           /**< depth of the file below the subtree's directory, from 1 */
+    size_t name;                  /**< offset of the file's name in the path */
+    size_t len;                   /**< length of the path */
+    char path[];                  /**< path of the file relative to the subtree's directory (NUL-terminated) */
+};
+
+/**
+ * @brief Directory of the cached subtree, to detect the file system loops when the subtree is replayed.
+ */
+struct linkcache_dir {
+    dev_t dev;                    /**< device of the directory */
+    ino_t ino;                    /**< inode of the directory */
+};
+
+/**
+ * @brief Subtree of the directory (all the files below it in the order of the traversal).
+ */
+struct linkcache_tree {
+    struct linkcache_tree *hnext; /**< next tree in the hash table's bucket */
+    struct linkcache_tree *prev;  /**< more recently used tree */
+    struct linkcache_tree *next;  /**< less recently used tree */
+    dev_t dev;                    /**< device of the subtree's directory */
+    ino_t ino;                    /**< inode of the subtree's directory */
+    char *data;                   /**< the files (struct linkcache_entry) */
+    size_t len;                   /**< used size of the data */
+    size_t size;                  /**< allocated size of the data */
+    struct linkcache_dir *dirs;   /**< the directories of the subtree */
+    unsigned int dirs_count;      /**< number of the dirs */
+    unsigned int dirs_size;       /**< allocated size of the dirs */
+};
+
+/**
+ * @brief Cache of the subtrees reached through the symbolic links (-L --link-cache).
+ *
+ * The subtree of a directory reached through a symbolic link is recorded while it is traversed, a later
+ * visit of the same directory (through another link or directly) replays the recorded files instead of
+ * reading the file system. The size of the cached subtrees is limited, the least recently used subtrees
+ * are evicted to make room for a new one. Only a single subtree is recorded at once.
+ */
+struct linkcache {
+    size_t cap;                   /**< maximum size of the cached subtrees in bytes */
+    size_t used;                  /**< size of the cached subtrees in bytes */
+    struct linkcache_tree *buckets[LINKCACHE_BUCKETS]; /**< hash table of the cached subtrees */
+    struct linkcache_tree *head;  /**< the most recently used subtree */
+    struct linkcache_tree *tail;  /**< the least recently used subtree, evicted first */
+    struct linkcache_tree *recording; /**< subtree being recorded, NULL if none */
+};
+
+/**
+ * @brief Create the cache.
+ *
+ * @param[in] cap Maximum size of the cached subtrees in bytes.
+ * @param[out] cache Created cache to be freed by linkcache_free().
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int linkcache_open(size_t cap, struct linkcache **cache);
+
+/**
+ * @brief Find the cached subtree of the directory, it becomes the most recently used one.
+ *
+ * @param[in] cache The cache.
+ * @param[in] dev Device of the directory.
+ * @param[in] ino Inode of the directory.
+ * @return The subtree, NULL if not cached.
+ */
+const struct linkcache_tree *linkcache_find(struct linkcache *cache, dev_t dev, ino_t ino);
+
+/**
+ * @brief Check if the directory is in the cached subtree.
+ *
+ * @param[in] tree The subtree.
+ * @param[in] dev Device of the directory.
+ * @param[in] ino Inode of the directory.
+ * @return non-zero if the directory is found.
+ */
+int linkcache_tree_has_dir(const struct linkcache_tree *tree, dev_t dev, ino_t ino);
+
+/**
+ * @brief Iterate over the files of the cached subtree.
+ *
+ * @param[in] tree The subtree.
+ * @param[in] e Previous file, NULL to get the first one.
+ * @return The next file, NULL at the end.
+ */
+const struct linkcache_entry *linkcache_entry_next(const struct linkcache_tree *tree, const struct linkcache_entry *e);
+
+/**
+ * @brief Start recording the subtree of the directory.
+ *
+ * @param[in] cache The cache, no subtree can be being recorded.
+ * @param[in] dev Device of the directory.
+ * @param[in] ino Inode of the directory.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int linkcache_record_start(struct linkcache *cache, dev_t dev, ino_t ino);
+
+/**
+ * @brief Add the file into the recorded subtree.
+ *
+ * The subtree bigger than the cache (or the failed allocation) stops the recording, the subtree is not cached.
+ *
+ * @param[in] cache The cache.
+ * @param[in] path Path of the file relative to the subtree's directory.
+ * @param[in] name Offset of the file's name in the @p path.
+ * @param[in] depth Depth of the file below the subtree's directory.
+ * @param[in] st Information about the file.
+ */
+void linkcache_record_add(struct linkcache *cache, const char *path, size_t name, unsigned int depth,
+        const struct stat *st);
+
+/**
+ * @brief Finish the recorded subtree.
+ *
+ * @param[in] cache The cache.
+ * @param[in] complete Flag the subtree was traversed completely (with no error), otherwise it is dropped.
+ */
+void linkcache_record_finish(struct linkcache *cache, int complete);
+
+/**
+ * @brief Free the cache.
+ *
+ * @param[in] cache Cache to free, NULL is accepted.
+ */
+void linkcache_free(struct linkcache *cache);
+
+#endif /* _LINKCACHE_H */
@@ -0,0 +1,348 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _GNU_SOURCE /* fdopendir(), openat() */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "prefetch.h"
+
+#include "common.h"
+
+/** @brief Initial size of the job's listing */
+#define PREFETCH_LISTING_SIZE 4096
+
+/**
+ * @brief Get size of the listing entry with the name of the given length, including the alignment.
+ */
+static size_t
+prefetch_entry_size(size_t len)
+{
+    size_t size = sizeof(struct prefetch_entry) + len + 1;
+
+    return (size + alignof(struct prefetch_entry) - 1) & ~(alignof(struct prefetch_entry) - 1);
+}
+
+/**
+ * @brief Append the directory entry to the job's listing.
+ *
+ * @param[in] job Job to extend.
+ * @param[in] file The directory entry.
+ * @return 0 on success
+ * @return errno value in case of failure.
+ */
+static int
+prefetch_entry_add(struct prefetch_job *job, const struct dirent *file)
+{
+    struct prefetch_entry *e;
+    size_t len = strlen(file->d_name), size = prefetch_entry_size(len), new_size;
+    char *x;
+
+    if (job->len + size > job->size) {
+        for (new_size = job->size ? job->size * 2 : PREFETCH_LISTING_SIZE; new_size < job->len + size; new_size *= 2) {}
+        x = realloc(job->listing, new_size);
+        if (!x) {
+            return errno;
+        }
+        job->listing = x;
+        job->size = new_size;
+    }
+
+    e = (struct prefetch_entry *)&job->listing[job->len];
+    e->ino = file->d_ino;
+    e->type = file->d_type;
+    e->len = len;
+    memcpy(e->name, file->d_name, len + 1);
+    job->len += size;
+
+    return 0;
+}
+
+/**
+ * @brief Get the information about the entries of the job's listing (when requested by the job's stat_flags).
+ *
+ * The failure of the allocation is not an error, the entries are then stat'ed by the owner.
+ *
+ * @param[in] job Job with the complete listing.
+ */
+static void
+prefetch_job_stat(struct prefetch_job *job)
+{
+    const struct prefetch_entry *e = NULL;
+    unsigned int count = 0, i = 0;
+    int follow = !(job->stat_flags & AT_SYMLINK_NOFOLLOW);
+
+    while ((e = prefetch_entry_next(job, e))) {
+        count++;
+    }
+    if (!count || !(job->stats = malloc(count * sizeof *job->stats))) {
+        return;
+    }
+
+    while ((e = prefetch_entry_next(job, e))) {
+        /* the same files as scan_lazy_stat() leaves to be stat'ed */
+        if (job->lazy && (e->type != DT_UNKNOWN) && (e->type != DT_DIR) && ((e->type != DT_LNK) || !follow)) {
+            job->stats[i].err = -1;
+        } else if (fstatat(dirfd(job->dir), e->name, &job->stats[i].st, job->stat_flags) == -1) {
+            job->stats[i].err = errno;
+        } else {
+            job->stats[i].err = 0;
+        }
+        i++;
+    }
+}
+
+/**
+ * @brief Open and list the job's directory.
+ *
+ * @param[in] job Job to process, the lock is not held.
+ */
+static void
+prefetch_job_run(struct prefetch_job *job)
+{
+    struct dirent *file;
+    int fd;
+
+    fd = openat(job->parent_fd, job->name, job->flags);
+    close(job->parent_fd);
+    job->parent_fd = -1;
+    if (fd == -1) {
+        job->err = errno;
+        return;
+    }
+    job->dir = fdopendir(fd);
+    if (!job->dir) {
+        job->err = errno;
+        close(fd);
+        return;
+    }
+
+    errno = 0;
+    while ((file = readdir(job->dir))) {
+        if (!strcmp(".", file->d_name) || !strcmp("..", file->d_name)) {
+            continue;
+        }
+        if ((job->err = prefetch_entry_add(job, file))) {
+            break;
+        }
+    }
+    if (!job->err && errno) {
+        job->err = errno;
+    }
+    if (job->err) {
+        closedir(job->dir);
+        job->dir = NULL;
+    } else if (job->stat_flags != -1) {
+        prefetch_job_stat(job);
+    }
+}
+
+/**
+ * @brief Worker thread: process the pending jobs in the window at the queue's head.
+ *
+ * @param[in] arg The prefetch context.
+ * @return NULL
+ */
+static void *
+prefetch_worker(void *arg)
+{
+    struct prefetch *p = arg;
+    struct prefetch_job *job;
+    unsigned int i;
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop) {
+        for (i = 0, job = p->head; job && (i < p->window); i++, job = job->next) {
+            if (job->state == PREFETCH_PENDING) {
+                break;
+            }
+        }
+        if (!job || (i == p->window)) {
+            pthread_cond_wait(&p->work, &p->lock);
+            continue;
+        }
+
+        job->state = PREFETCH_RUNNING;
+        pthread_mutex_unlock(&p->lock);
+        prefetch_job_run(job);
+        pthread_mutex_lock(&p->lock);
+
+        if (job->dropped) {
+            prefetch_job_free(job);
+        } else {
+            job->state = PREFETCH_DONE;
+            if (p->waiting) {
+                pthread_cond_signal(&p->done);
+            }
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+int
+prefetch_start(struct prefetch *p, unsigned int window, unsigned int threads)
+{
+    sigset_t set, orig;
+    unsigned int count;
+
+    memset(p, 0, sizeof *p);
+    p->window = window;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+
+    /* the signals are delivered to the application's threads */
+    count = threads ? threads : window;
+    if (count > PREFETCH_THREADS_MAX) {
+        count = PREFETCH_THREADS_MAX;
+    }
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &orig);
+    for (; p->threads_count < count; p->threads_count++) {
+        if (pthread_create(&p->threads[p->threads_count], NULL, prefetch_worker, p)) {
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &orig, NULL);
+
+    if (!p->threads_count) {
+        LOG("unable to start the prefetch threads.");
+        prefetch_stop(p);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void
+prefetch_stop(struct prefetch *p)
+{
+    struct prefetch_job *job;
+
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    for (unsigned int i = 0; i < p->threads_count; i++) {
+        pthread_join(p->threads[i], NULL);
+    }
+    p->threads_count = 0;
+
+    /* no worker is running, all the jobs can be freed */
+    while ((job = p->head)) {
+        p->head = job->next;
+        prefetch_job_free(job);
+    }
+    pthread_cond_destroy(&p->done);
+    pthread_cond_destroy(&p->work);
+    pthread_mutex_destroy(&p->lock);
+}
+
+struct prefetch_job *
+prefetch_job_new(int parent_fd, const char *name, int flags, void *level, unsigned int index)
+{
+    struct prefetch_job *job;
+    size_t len = strlen(name);
+
+    job = calloc(1, sizeof *job + len + 1);
+    if (!job) {
+        return NULL;
+    }
+    job->parent_fd = fcntl(parent_fd, F_DUPFD_CLOEXEC, 0);
+    if (job->parent_fd == -1) {
+        free(job);
+        return NULL;
+    }
+    memcpy(job->name, name, len + 1);
+    job->flags = flags;
+    job->stat_flags = -1;
+    job->level = level;
+    job->index = index;
+
+    return job;
+}
+
+const struct prefetch_entry *
+prefetch_entry_next(const struct prefetch_job *job, const struct prefetch_entry *e)
+{
+    size_t offset = e ? (size_t)((const char *)e - job->listing) + prefetch_entry_size(e->len) : 0;
+
+    return (offset < job->len) ? (const struct prefetch_entry *)&job->listing[offset] : NULL;
+}
+
+void
+prefetch_job_drop(struct prefetch_job *job)
+{
+    if (job->state == PREFETCH_RUNNING) {
+        job->dropped = 1;
+    } else {
+        prefetch_job_free(job);
+    }
+}
+
+void
+prefetch_job_free(struct prefetch_job *job)
+{
+    if (!job) {
+        return;
+    }
+
+    if (job->parent_fd != -1) {
+        close(job->parent_fd);
+    }
+    if (job->dir) {
+        closedir(job->dir);
+    }
+    free(job->listing);
+    free(job->stats);
+    free(job);
+}
+
+struct prefetch_job *
+prefetch_take(struct prefetch *p, const void *level, unsigned int index)
+{
+    struct prefetch_job *job;
+
+    pthread_mutex_lock(&p->lock);
+
+    /* the skipped directories */
+    while ((job = p->head) && (job->level == level) && (job->index < index)) {
+        p->head = job->next;
+        prefetch_job_drop(job);
+    }
+
+    if (job && (job->level == level) && (job->index == index)) {
+        p->head = job->next;
+        p->waiting = 1;
+        while (job->state == PREFETCH_RUNNING) {
+            pthread_cond_wait(&p->done, &p->lock);
+        }
+        p->waiting = 0;
+        if (job->state == PREFETCH_PENDING) {
+            /* not started yet, the caller opens the directory sooner itself */
+            prefetch_job_free(job);
+            job = NULL;
+        }
+        /* the window moved */
+        pthread_cond_signal(&p->work);
+    } else {
+        job = NULL;
+    }
+
+    pthread_mutex_unlock(&p->lock);
+
+    return job;
+}
@@ -0,0 +1,164 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PREFETCH_H
+#define _PREFETCH_H
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/** @brief Maximum number of the prefetch threads, the lookahead window can be bigger */
+#define PREFETCH_THREADS_MAX 4
+
+/**
+ * @brief State of the prefetch job.
+ */
+enum prefetch_state {
+    PREFETCH_PENDING = 0,     /**< waiting for a worker */
+    PREFETCH_RUNNING,         /**< the directory is being opened and listed */
+    PREFETCH_DONE             /**< the result is ready */
+};
+
+/**
+ * @brief Entry of the prefetched directory listing.
+ *
+ * The entries are stored one after another in the job's listing, aligned as the structure.
+ */
+struct prefetch_entry {
+    ino_t ino;                /**< inode number from the directory entry */
+    unsigned char type;       /**< file type from the directory entry (DT_*) */
+    size_t len;               /**< length of the name */
+    char name[];              /**< name of the file (NUL-terminated) */
+};
+
+/**
+ * @brief Information about the prefetched directory entry, see prefetch_job's stats.
+ */
+struct prefetch_stat {
+    int err;                  /**< errno of the failed stat, 0 if the st is valid, -1 if the entry was not stat'ed */
+    struct stat st;           /**< information about the file */
+};
+
+/**
+ * @brief Directory to be opened and listed ahead of the scan.
+ *
+ * The job is owned by the queue until it is taken by prefetch_take(), the identification
+ * of the directory (level and index) is up to the owner.
+ */
+struct prefetch_job {
+    struct prefetch_job *next;    /**< next job in the order the directories are expected to be used */
+    void *level;                  /**< owner's identification of the parent directory */
+    unsigned int index;           /**< position of the directory in the parent directory, for the owner */
+    void *entry;                  /**< owner's data of the directory, e.g. to queue it again when dropped */
+    int parent_fd;                /**< descriptor of the parent directory owned by the job, -1 when closed */
+    int flags;                    /**< flags to open the directory */
+    int stat_flags;               /**< flags to stat the entries (fstatat()), -1 to not stat them */
+    int lazy;                     /**< flag to not stat the entries whose type is enough, see scan_lazy_stat() */
+
+    enum prefetch_state state;    /**< state of the job */
+    int dropped;                  /**< flag the job was dropped while running, the worker frees it */
+    DIR *dir;                     /**< opened directory, its listing was read until the end */
+    int err;                      /**< errno of the failed open or read, 0 on success */
+    char *listing;                /**< the directory entries (struct prefetch_entry), without . and .. */
+    size_t len;                   /**< used size of the listing */
+    size_t size;                  /**< allocated size of the listing */
+    struct prefetch_stat *stats;  /**< information about the listing's entries in their order, NULL if not stat'ed */
+
+    char name[];                  /**< name of the directory in the parent directory */
+};
+
+/**
+ * @brief Pool of the threads opening and listing the directories from the ordered queue of jobs.
+ *
+ * The workers process only the first window jobs of the queue, so the number of the prefetched
+ * directories (and their descriptors) is bounded. The owner keeps the queue in the order the
+ * directories will be used and modifies it only with the lock held.
+ */
+struct prefetch {
+    pthread_mutex_t lock;         /**< lock of the queue and the jobs' states */
+    pthread_cond_t work;          /**< signal for the workers that the queue changed */
+    pthread_cond_t done;          /**< signal for the owner that a job was finished */
+    struct prefetch_job *head;    /**< queue of the jobs */
+    unsigned int window;          /**< number of the jobs from the queue's head processed ahead */
+    int stop;                     /**< flag for the workers to terminate */
+    int waiting;                  /**< flag the owner waits for a running job */
+
+    unsigned int threads_count;   /**< number of the running workers */
+    pthread_t threads[PREFETCH_THREADS_MAX]; /**< the workers */
+};
+
+/**
+ * @brief Initiate the prefetch queue and start the workers.
+ *
+ * @param[out] p Prefetch context to initiate.
+ * @param[in] window Number of the directories to prefetch ahead.
+ * @param[in] threads Number of the workers (at most PREFETCH_THREADS_MAX), 0 for one per directory of the window.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int prefetch_start(struct prefetch *p, unsigned int window, unsigned int threads);
+
+/**
+ * @brief Stop the workers and drop all the jobs.
+ *
+ * @param[in] p Prefetch context to stop.
+ */
+void prefetch_stop(struct prefetch *p);
+
+/**
+ * @brief Create a new job, the caller is supposed to insert it into the queue.
+ *
+ * @param[in] parent_fd Descriptor of the parent directory, it is duplicated for the job.
+ * @param[in] name Name of the directory to prefetch.
+ * @param[in] flags Flags to open the directory.
+ * @param[in] level Owner's identification of the parent directory.
+ * @param[in] index Position of the directory in the parent directory.
+ * @return The created job.
+ * @return NULL in case of failure (out of memory or descriptors), the directory is just not prefetched.
+ */
+struct prefetch_job *prefetch_job_new(int parent_fd, const char *name, int flags, void *level, unsigned int index);
+
+/**
+ * @brief Iterate over the listing of the finished job.
+ *
+ * @param[in] job Job with the listing.
+ * @param[in] e Previous entry, NULL to get the first one.
+ * @return The next entry of the listing, NULL at the end.
+ */
+const struct prefetch_entry *prefetch_entry_next(const struct prefetch_job *job, const struct prefetch_entry *e);
+
+/**
+ * @brief Drop a job unlinked from the queue, the lock must be held.
+ *
+ * The running job is freed by its worker when it is finished.
+ *
+ * @param[in] job Job to drop.
+ */
+void prefetch_job_drop(struct prefetch_job *job);
+
+/**
+ * @brief Free the job taken from the queue by prefetch_take().
+ *
+ * @param[in] job Job to free, the directory is closed unless the caller took it.
+ */
+void prefetch_job_free(struct prefetch_job *job);
+
+/**
+ * @brief Take the job of the directory from the queue's head, waiting for it if it is running.
+ *
+ * The jobs of the same level with lower index are dropped, the directories were skipped.
+ *
+ * @param[in] p Prefetch context.
+ * @param[in] level Owner's identification of the parent directory.
+ * @param[in] index Position of the directory in the parent directory.
+ * @return The finished job to be freed by prefetch_job_free().
+ * @return NULL if the directory was not prefetched.
+ */
+struct prefetch_job *prefetch_take(struct prefetch *p, const void *level, unsigned int index);
+
+#endif /* _PREFETCH_H */
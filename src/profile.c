@@ -0,0 +1,354 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _GNU_SOURCE /* getline() */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+
+#include "arena.h"
+#include "common.h"
+#include "expressions.h"
+
+/**
+ * @brief Header line of the profile file
+ */
+#define PROFILE_HEADER "# " FIND_ID " expression profile v1"
+
+/**
+ * @brief Record of the loaded profile file
+ */
+struct profile_rec {
+    char *key;                 /**< identification of the test/action, see expr_label() */
+    unsigned long long calls;  /**< number of evaluations */
+    unsigned long long trues;  /**< number of true results */
+    unsigned long long nsec;   /**< cumulative evaluation time */
+};
+
+/**
+ * @brief Estimated properties of a subexpression.
+ */
+struct profile_estimate {
+    double cost;   /**< expected time (in nanoseconds) of a single evaluation */
+    double ptrue;  /**< probability of the true result */
+    int known;     /**< flag if all the tests in the subexpression were found in the profile */
+    int action;    /**< flag if the subexpression contains an action */
+};
+
+/**
+ * @brief Get the printable label of the expression record.
+ *
+ * @param[in] e Expression record.
+ * @param[out] buf Buffer for the label.
+ * @param[in] size Size of the @p buf.
+ * @return The @p buf
+ */
+static char *
+expr_label(const struct expr *e, char *buf, size_t size)
+{
+    switch (e->type) {
+    case EXPR_GROUP:
+        snprintf(buf, size, "%s", e->op == EXPR_OP_AND ? "-a" : (e->op == EXPR_OP_OR ? "-o" : "!"));
+        break;
+    case EXPR_TEST:
+        snprintf(buf, size, "-%s%s%s", e->id, e->test_arg ? " " : "", e->test_arg ? e->test_arg : "");
+        break;
+    case EXPR_ACT:
+        snprintf(buf, size, "-%s%s%s", e->id, e->action_arg ? " " : "", e->action_arg ? e->action_arg : "");
+        break;
+    }
+
+    return buf;
+}
+
+int
+expr_profile_init(struct arena *arena, struct expr *e)
+{
+    if (!e) {
+        return EXIT_SUCCESS;
+    }
+
+    e->stats = arena_calloc(arena, sizeof *e->stats);
+    if (!e->stats) {
+        return EXIT_FAILURE;
+    }
+
+    if (e->type == EXPR_GROUP) {
+        if (expr_profile_init(arena, e->expr1) || expr_profile_init(arena, e->expr2)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Recursive part of expr_profile_print()
+ *
+ * @param[in] out Output stream.
+ * @param[in] e Expression record to print.
+ * @param[in] level Nesting level for indentation.
+ */
+static void
+expr_profile_print_r(FILE *out, const struct expr *e, unsigned int level)
+{
+    char label[256];
+    const struct expr_stats *s = e->stats;
+
+    fprintf(out, "%*s%-*s calls %llu, true %5.1f%%, total %.3f ms, %llu ns/call\n",
+            level * 2, "", (int)(level * 2 > 40 ? 0 : 40 - level * 2), expr_label(e, label, sizeof label),
+            s->calls, s->calls ? 100.0 * s->trues / s->calls : 0.0, s->nsec / 1000000.0,
+            s->calls ? s->nsec / s->calls : 0);
+
+    if (e->type == EXPR_GROUP) {
+        expr_profile_print_r(out, e->expr1, level + 1);
+        if (e->expr2) {
+            expr_profile_print_r(out, e->expr2, level + 1);
+        }
+    }
+}
+
+void
+expr_profile_print(FILE *out, const struct expr *e)
+{
+    if (!e || !e->stats) {
+        return;
+    }
+
+    fprintf(out, FIND_ID ": expression profile:\n");
+    expr_profile_print_r(out, e, 0);
+}
+
+/**
+ * @brief Recursive part of expr_profile_save()
+ *
+ * @param[in] out Output stream.
+ * @param[in] e Expression record to store.
+ */
+static void
+expr_profile_save_r(FILE *out, const struct expr *e)
+{
+    char label[256];
+
+    if (e->type == EXPR_GROUP) {
+        expr_profile_save_r(out, e->expr1);
+        if (e->expr2) {
+            expr_profile_save_r(out, e->expr2);
+        }
+        return;
+    }
+
+    fprintf(out, "%llu %llu %llu %s\n", e->stats->calls, e->stats->trues, e->stats->nsec,
+            expr_label(e, label, sizeof label));
+}
+
+int
+expr_profile_save(const char *filepath, const struct expr *e)
+{
+    FILE *out;
+
+    if (!e || !e->stats) {
+        /* no expression (e.g. only --snapshot-out), nothing was profiled */
+        return EXIT_SUCCESS;
+    }
+
+    out = fopen(filepath, "w");
+    if (!out) {
+        LOG("unable to store profile into %s (%s).", filepath, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, PROFILE_HEADER "\n");
+    expr_profile_save_r(out, e);
+
+    if (fclose(out)) {
+        LOG("unable to store profile into %s (%s).", filepath, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Load records from the profile file.
+ *
+ * The records with the same key are merged.
+ *
+ * @param[in] filepath Path of the profile file.
+ * @param[out] recs_p Loaded records.
+ * @param[out] count_p Number of the loaded records.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+profile_load(const char *filepath, struct profile_rec **recs_p, unsigned int *count_p)
+{
+    int ret = EXIT_FAILURE;
+    FILE *in;
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    struct profile_rec *recs = NULL, *new_recs, rec;
+    unsigned int count = 0, i;
+    int pos;
+
+    in = fopen(filepath, "r");
+    if (!in) {
+        LOG("unable to load profile from %s (%s).", filepath, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    while ((len = getline(&line, &line_size, in)) != -1) {
+        if (len && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+        if (!len || line[0] == '#') {
+            continue;
+        }
+
+        if (sscanf(line, "%llu %llu %llu %n", &rec.calls, &rec.trues, &rec.nsec, &pos) != 3 || !line[pos]) {
+            LOG("invalid record \"%s\" in profile %s.", line, filepath);
+            goto cleanup;
+        }
+
+        /* merge with the record of the same key */
+        for (i = 0; i < count; i++) {
+            if (!strcmp(recs[i].key, &line[pos])) {
+                recs[i].calls += rec.calls;
+                recs[i].trues += rec.trues;
+                recs[i].nsec += rec.nsec;
+                break;
+            }
+        }
+        if (i < count) {
+            continue;
+        }
+
+        new_recs = realloc(recs, (count + 1) * sizeof *recs);
+        if (!new_recs) {
+            LOG("%s", strerror(errno));
+            goto cleanup;
+        }
+        recs = new_recs;
+        rec.key = strdup(&line[pos]);
+        if (!rec.key) {
+            LOG("%s", strerror(errno));
+            goto cleanup;
+        }
+        recs[count++] = rec;
+    }
+
+    *recs_p = recs;
+    *count_p = count;
+    recs = NULL;
+    count = 0;
+    ret = EXIT_SUCCESS;
+
+cleanup:
+    for (i = 0; i < count; i++) {
+        free(recs[i].key);
+    }
+    free(recs);
+    free(line);
+    fclose(in);
+    return ret;
+}
+
+/**
+ * @brief Estimate the cost and selectivity of the subexpression according to the profile and
+ * reorder operands of the operators inside the subexpression (bottom-up).
+ *
+ * @param[in,out] e Subexpression to process.
+ * @param[in] recs Profile records.
+ * @param[in] count Number of the profile records.
+ * @param[out] est Estimated properties of the @p e.
+ */
+static void
+profile_reorder(struct expr *e, const struct profile_rec *recs, unsigned int count, struct profile_estimate *est)
+{
+    char label[256];
+    struct profile_estimate est1, est2;
+    struct expr *swap;
+
+    memset(est, 0, sizeof *est);
+
+    if (e->type != EXPR_GROUP) {
+        est->action = (e->type == EXPR_ACT);
+        expr_label(e, label, sizeof label);
+        for (unsigned int i = 0; i < count; i++) {
+            if (!strcmp(recs[i].key, label) && recs[i].calls) {
+                est->known = 1;
+                est->cost = (double)recs[i].nsec / recs[i].calls;
+                est->ptrue = (double)recs[i].trues / recs[i].calls;
+                break;
+            }
+        }
+        return;
+    }
+
+    profile_reorder(e->expr1, recs, count, &est1);
+    if (e->op == EXPR_OP_NOT) {
+        *est = est1;
+        est->ptrue = 1.0 - est1.ptrue;
+        return;
+    }
+    profile_reorder(e->expr2, recs, count, &est2);
+
+    /* the second operand is evaluated only if the first one does not decide the result,
+     * so the expected cost is cost1 + P(undecided by 1) * cost2 */
+    if (est1.known && est2.known && !est1.action && !est2.action) {
+        double p1 = (e->op == EXPR_OP_AND) ? est1.ptrue : 1.0 - est1.ptrue;
+        double p2 = (e->op == EXPR_OP_AND) ? est2.ptrue : 1.0 - est2.ptrue;
+
+        if (est2.cost + p2 * est1.cost < est1.cost + p1 * est2.cost) {
+            swap = e->expr1;
+            e->expr1 = e->expr2;
+            e->expr2 = swap;
+            *est = est1;
+            est1 = est2;
+            est2 = *est;
+        }
+    }
+
+    est->known = est1.known && est2.known;
+    est->action = est1.action || est2.action;
+    if (e->op == EXPR_OP_AND) {
+        est->cost = est1.cost + est1.ptrue * est2.cost;
+        est->ptrue = est1.ptrue * est2.ptrue;
+    } else {
+        est->cost = est1.cost + (1.0 - est1.ptrue) * est2.cost;
+        est->ptrue = 1.0 - (1.0 - est1.ptrue) * (1.0 - est2.ptrue);
+    }
+}
+
+int
+expr_profile_apply(const char *filepath, struct expr *e)
+{
+    struct profile_rec *recs = NULL;
+    unsigned int count = 0;
+    struct profile_estimate est;
+
+    if (!e) {
+        /* no expression to reorder */
+        return EXIT_SUCCESS;
+    }
+
+    if (profile_load(filepath, &recs, &count)) {
+        return EXIT_FAILURE;
+    }
+
+    profile_reorder(e, recs, count, &est);
+
+    for (unsigned int i = 0; i < count; i++) {
+        free(recs[i].key);
+    }
+    free(recs);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,60 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdio.h>
+
+#include "arena.h"
+#include "expressions.h"
+
+/**
+ * @brief Enable profiling of the expression evaluation tree by allocating counters for each record.
+ *
+ * @param[in] arena Arena to allocate the counters from (the arena of the evaluation tree).
+ * @param[in] e Root of the evaluation tree.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int expr_profile_init(struct arena *arena, struct expr *e);
+
+/**
+ * @brief Print the evaluation tree annotated by the profiling counters.
+ *
+ * @param[in] out Output stream.
+ * @param[in] e Root of the profiled evaluation tree.
+ */
+void expr_profile_print(FILE *out, const struct expr *e);
+
+/**
+ * @brief Store the profiling counters of the tests and actions into a profile file.
+ *
+ * The records are identified by the module identifier and its argument, so the profile
+ * can be applied to a different expression containing the same tests.
+ *
+ * @param[in] filepath Path of the profile file to (over)write.
+ * @param[in] e Root of the profiled evaluation tree.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int expr_profile_save(const char *filepath, const struct expr *e);
+
+/**
+ * @brief Load the profile file and reorder operands of -a and -o operators in the evaluation
+ * tree to evaluate the cheaper and the more selective operand first.
+ *
+ * Only the operands without actions are reordered, so the side effects stay the same.
+ * Operands containing tests missing in the profile are not reordered.
+ *
+ * @param[in] filepath Path of the profile file to load.
+ * @param[in,out] e Root of the evaluation tree to reorder.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int expr_profile_apply(const char *filepath, struct expr *e);
+
+#endif /* _PROFILE_H */
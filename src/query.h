@@ -0,0 +1,93 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _QUERY_H
+#define _QUERY_H
+
+#include "action_delete.h"
+#include "arena.h"
+#include "checkpoint.h"
+#include "estimate.h"
+#include "cmdline.h"
+#include "diag.h"
+#include "expressions.h"
+#include "record.h"
+#include "shard.h"
+#include "rfind.h"
+#include "snapshot.h"
+#include "test_path.h"
+
+/**
+ * @brief Query from the query file (--query-file) with its own output.
+ */
+struct query_sub {
+    struct expr *expressions;     /**< evaluation tree of the query */
+    FILE *stream;                 /**< output of the query's actions */
+    struct record_output output;  /**< state of the -print records output (--output other than text) */
+
+    int argc;                     /**< number of the arguments in argv */
+    char **argv;                  /**< arguments from the query's line (output and expression), the expression refers into it */
+};
+
+/**
+ * @brief Compiled query (librfind's internal representation of the struct rfind_query).
+ */
+struct rfind_query {
+    struct find_options options;  /**< options from the command line */
+    const char **paths;           /**< NULL-terminated list of the paths from the command line */
+    struct expr *expressions;     /**< evaluation tree, NULL if everything matches */
+    struct arena arena;           /**< arena of the evaluation tree */
+    int flags;                    /**< compilation flags (RFIND_QUERY_*) */
+    struct record_output output;  /**< state of the -print records output (--output other than text) */
+
+    struct query_sub *subs;       /**< queries from the query file evaluated instead of the expressions */
+    unsigned int subs_count;      /**< number of the subs */
+    unsigned long generation;     /**< number of the files evaluated by the subs, for the shared results (struct expr_memo) */
+    int quit;                     /**< flag set by the -quit action, the scan stops after the current file */
+    struct path_pattern *patterns; /**< the -path/-ipath automata, their state sets are carried by the scan */
+    unsigned int path_words;      /**< size of the state sets of all the patterns in words */
+    struct snapshot *snapshot;    /**< manifest of the matching files and its diff, NULL if not requested */
+    struct deleter *deleter;      /**< threads of the -delete actions started by the scan, NULL without -delete */
+    struct checkpoint *checkpoint; /**< position of the traversal recorded and resumed, NULL if not requested */
+    struct estimate *estimate;    /**< estimate done by the scan instead of the traversal, NULL if not requested */
+    struct shards *shards;        /**< files the actions' output is distributed into (--shard), NULL for stdout */
+    struct diag diag;             /**< errors of the query's scans (--errors, --errors-rate) */
+    struct expr *batch_guard;     /**< part of the expression evaluated on the directories' listings at once, NULL if none */
+    struct expr *batch_rest;      /**< rest of the expression evaluated on the files where the guard is true */
+
+    int argc;                     /**< number of the arguments in argv */
+    char **argv;                  /**< copy of the arguments, the paths and expressions refer into it */
+};
+
+/**
+ * @brief Get the file information needed to evaluate the query.
+ *
+ * @param[in] query Query to evaluate.
+ * @return The file information needed by the expression or by any of the query file's queries.
+ */
+enum expr_need query_need(const struct rfind_query *query);
+
+/**
+ * @brief Check if the subtree to be traversed can be skipped.
+ *
+ * The subtree is given by the patterns' results (struct path_pattern's subtree) set by the scan.
+ *
+ * @param[in] query Query to evaluate.
+ * @return non-zero if no file in the subtree can match the expression or any of the query file's queries.
+ */
+int query_prune(const struct rfind_query *query);
+
+/**
+ * @brief Evaluate the query on the file whose batch_guard result is known (see expr_batch_guard()).
+ *
+ * @param[in] query Query to evaluate.
+ * @param[in] entry File to evaluate.
+ * @param[in] guard Result of the query's batch_guard on the file, -1 if not evaluated (rfind_query_match() is used).
+ * @return non-zero if the file matches the expression.
+ */
+int query_match_guarded(struct rfind_query *query, const struct rfind_entry *entry, int guard);
+
+#endif /* _QUERY_H */
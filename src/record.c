@@ -0,0 +1,573 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _POSIX_C_SOURCE 200809L /* struct stat's st_mtim */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "record.h"
+
+#include "common.h"
+#include "rfind_record.h"
+#include "writer.h"
+
+/**
+ * @brief Fields of the records in the order of their flags (and so in the order in the binary record).
+ */
+static const struct {
+    const char *name;       /**< name in --output-fields and NDJSON */
+    unsigned int flag;      /**< RFIND_FIELD_* flag */
+    unsigned int size;      /**< size of the field in the binary record */
+} record_fields[] = {
+    {"mode", RFIND_FIELD_MODE, 4},
+    {"size", RFIND_FIELD_SIZE, 8},
+    {"mtime", RFIND_FIELD_MTIME, 12},
+    {"atime", RFIND_FIELD_ATIME, 12},
+    {"ctime", RFIND_FIELD_CTIME, 12},
+    {"ino", RFIND_FIELD_INO, 8},
+    {"dev", RFIND_FIELD_DEV, 8},
+    {"nlink", RFIND_FIELD_NLINK, 8},
+    {"uid", RFIND_FIELD_UID, 4},
+    {"gid", RFIND_FIELD_GID, 4},
+    {"blocks", RFIND_FIELD_BLOCKS, 8},
+    {"depth", RFIND_FIELD_DEPTH, 4},
+};
+
+#define RECORD_FIELDS_COUNT (sizeof record_fields / sizeof *record_fields)
+
+/** @brief Size of the binary stream header */
+#define RECORD_HEADER_SIZE 12
+
+int
+record_fields_parse(const char *list, unsigned int *fields)
+{
+    const char *end;
+    size_t len;
+    unsigned int i;
+
+    *fields = 0;
+    do {
+        end = strchr(list, ',');
+        len = end ? (size_t)(end - list) : strlen(list);
+        for (i = 0; i < RECORD_FIELDS_COUNT; i++) {
+            if (strlen(record_fields[i].name) == len && !strncmp(list, record_fields[i].name, len)) {
+                *fields |= record_fields[i].flag;
+                break;
+            }
+        }
+        if (i == RECORD_FIELDS_COUNT) {
+            LOG("unknown output field \"%.*s\".", (int)len, list);
+            return EXIT_FAILURE;
+        }
+        list = end + 1;
+    } while (end);
+
+    return EXIT_SUCCESS;
+}
+
+enum expr_need
+record_fields_need(unsigned int fields)
+{
+    /* the inode number is available from the directory listing, the depth from the traversal */
+    return (fields & ~(RFIND_FIELD_INO | RFIND_FIELD_DEPTH)) ? EXPR_NEED_STAT : EXPR_NEED_TYPE;
+}
+
+/**
+ * @brief Get value of the file's field.
+ *
+ * @param[in] file File to get the value from.
+ * @param[in] flag RFIND_FIELD_* flag of the field.
+ * @param[out] nsec Nanoseconds of the time fields.
+ * @return Value of the field (seconds of the time fields, to be casted to int64_t).
+ */
+static uint64_t
+record_field_value(const struct rfind_entry *file, unsigned int flag, uint32_t *nsec)
+{
+    const struct stat *st = file->st;
+
+    switch (flag) {
+    case RFIND_FIELD_MODE:
+        return st->st_mode;
+    case RFIND_FIELD_SIZE:
+        return st->st_size;
+    case RFIND_FIELD_MTIME:
+        *nsec = st->st_mtim.tv_nsec;
+        return (int64_t)st->st_mtim.tv_sec;
+    case RFIND_FIELD_ATIME:
+        *nsec = st->st_atim.tv_nsec;
+        return (int64_t)st->st_atim.tv_sec;
+    case RFIND_FIELD_CTIME:
+        *nsec = st->st_ctim.tv_nsec;
+        return (int64_t)st->st_ctim.tv_sec;
+    case RFIND_FIELD_INO:
+        return st->st_ino;
+    case RFIND_FIELD_DEV:
+        return st->st_dev;
+    case RFIND_FIELD_NLINK:
+        return st->st_nlink;
+    case RFIND_FIELD_UID:
+        return st->st_uid;
+    case RFIND_FIELD_GID:
+        return st->st_gid;
+    case RFIND_FIELD_BLOCKS:
+        return st->st_blocks;
+    case RFIND_FIELD_DEPTH:
+        return file->depth;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Check that the string is a valid UTF-8 (without overlong forms and surrogates).
+ *
+ * @param[in] str String to check.
+ * @param[in] len Length of the @p str.
+ * @return non-zero for valid UTF-8.
+ */
+static int
+record_utf8_valid(const unsigned char *str, size_t len)
+{
+    size_t i = 0, n;
+    uint32_t c;
+
+    while (i < len) {
+        if (str[i] < 0x80) {
+            i++;
+            continue;
+        } else if ((str[i] & 0xe0) == 0xc0) {
+            n = 1;
+            c = str[i] & 0x1f;
+        } else if ((str[i] & 0xf0) == 0xe0) {
+            n = 2;
+            c = str[i] & 0x0f;
+        } else if ((str[i] & 0xf8) == 0xf0) {
+            n = 3;
+            c = str[i] & 0x07;
+        } else {
+            return 0;
+        }
+        if (len - i <= n) {
+            return 0;
+        }
+        for (size_t j = 1; j <= n; j++) {
+            if ((str[i + j] & 0xc0) != 0x80) {
+                return 0;
+            }
+            c = (c << 6) | (str[i + j] & 0x3f);
+        }
+        if ((n == 1 && c < 0x80) || (n == 2 && c < 0x800) || (n == 3 && c < 0x10000) ||
+                (c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff) {
+            return 0;
+        }
+        i += n + 1;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Write the string as a JSON string (including the quotes).
+ *
+ * @param[in] w Writer to use.
+ * @param[in] str UTF-8 string to write.
+ * @param[in] len Length of the @p str.
+ */
+static void
+record_json_string(struct writer *w, const char *str, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t start = 0;
+
+    writer_putc(w, '"');
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = str[i];
+
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        /* flush the plain part and escape the character */
+        writer_put(w, &str[start], i - start);
+        start = i + 1;
+        writer_putc(w, '\\');
+        switch (c) {
+        case '"':
+        case '\\':
+            writer_putc(w, c);
+            break;
+        case '\b':
+            writer_putc(w, 'b');
+            break;
+        case '\f':
+            writer_putc(w, 'f');
+            break;
+        case '\n':
+            writer_putc(w, 'n');
+            break;
+        case '\r':
+            writer_putc(w, 'r');
+            break;
+        case '\t':
+            writer_putc(w, 't');
+            break;
+        default:
+            writer_put(w, "u00", 3);
+            writer_putc(w, hex[c >> 4]);
+            writer_putc(w, hex[c & 0xf]);
+        }
+    }
+    writer_put(w, &str[start], len - start);
+    writer_putc(w, '"');
+}
+
+/**
+ * @brief Write the data as a base64 JSON string (including the quotes).
+ *
+ * @param[in] w Writer to use.
+ * @param[in] data Data to write.
+ * @param[in] len Length of the @p data.
+ */
+static void
+record_json_base64(struct writer *w, const unsigned char *data, size_t len)
+{
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char quad[4];
+    uint32_t v;
+
+    writer_putc(w, '"');
+    for (size_t i = 0; i < len; i += 3) {
+        v = (uint32_t)data[i] << 16;
+        if (i + 1 < len) {
+            v |= (uint32_t)data[i + 1] << 8;
+        }
+        if (i + 2 < len) {
+            v |= data[i + 2];
+        }
+        quad[0] = b64[(v >> 18) & 0x3f];
+        quad[1] = b64[(v >> 12) & 0x3f];
+        quad[2] = i + 1 < len ? b64[(v >> 6) & 0x3f] : '=';
+        quad[3] = i + 2 < len ? b64[v & 0x3f] : '=';
+        writer_put(w, quad, 4);
+    }
+    writer_putc(w, '"');
+}
+
+void
+record_json_member(struct writer *w, const char *name, const char *str, size_t len)
+{
+    writer_putc(w, '"');
+    writer_put(w, name, strlen(name));
+    if (record_utf8_valid((const unsigned char *)str, len)) {
+        writer_put(w, "\":", 2);
+        record_json_string(w, str, len);
+    } else {
+        writer_put(w, "_b64\":", 6);
+        record_json_base64(w, (const unsigned char *)str, len);
+    }
+}
+
+/**
+ * @brief Write the file's record as a JSON object on a single line.
+ *
+ * The path not being a valid UTF-8 is written as base64 in "path_b64" member instead of "path".
+ *
+ * @param[in] w Writer to use.
+ * @param[in] fields RFIND_FIELD_* flags of the fields to write.
+ * @param[in] file File to write.
+ */
+static void
+record_ndjson(struct writer *w, unsigned int fields, const struct rfind_entry *file)
+{
+    size_t len = strlen(file->path);
+    uint64_t value;
+    uint32_t nsec = 0;
+
+    writer_putc(w, '{');
+    record_json_member(w, "path", file->path, len);
+
+    for (unsigned int i = 0; i < RECORD_FIELDS_COUNT; i++) {
+        if (!(fields & record_fields[i].flag)) {
+            continue;
+        }
+        value = record_field_value(file, record_fields[i].flag, &nsec);
+
+        writer_put(w, ",\"", 2);
+        writer_put(w, record_fields[i].name, strlen(record_fields[i].name));
+        writer_put(w, "\":", 2);
+        if (record_fields[i].size == 12) {
+            /* time as seconds and nanoseconds members */
+            writer_int(w, (int64_t)value);
+            writer_put(w, ",\"", 2);
+            writer_put(w, record_fields[i].name, strlen(record_fields[i].name));
+            writer_put(w, "_nsec\":", 7);
+            writer_uint(w, nsec);
+        } else {
+            writer_uint(w, value);
+        }
+    }
+    writer_put(w, "}\n", 2);
+}
+
+/**
+ * @brief Write the file's binary record.
+ *
+ * @param[in] w Writer to use.
+ * @param[in] fields RFIND_FIELD_* flags of the fields to write.
+ * @param[in] file File to write.
+ */
+static void
+record_binary(struct writer *w, unsigned int fields, const struct rfind_entry *file)
+{
+    size_t len = strlen(file->path);
+    uint64_t value;
+    uint32_t nsec = 0, size = 0;
+
+    for (unsigned int i = 0; i < RECORD_FIELDS_COUNT; i++) {
+        if (fields & record_fields[i].flag) {
+            size += record_fields[i].size;
+        }
+    }
+    writer_le(w, size + len, 4);
+
+    for (unsigned int i = 0; i < RECORD_FIELDS_COUNT; i++) {
+        if (!(fields & record_fields[i].flag)) {
+            continue;
+        }
+        value = record_field_value(file, record_fields[i].flag, &nsec);
+        if (record_fields[i].size == 12) {
+            writer_le(w, value, 8);
+            writer_le(w, nsec, 4);
+        } else {
+            writer_le(w, value, record_fields[i].size);
+        }
+    }
+    writer_put(w, file->path, len);
+}
+
+void
+record_header(struct record_output *output)
+{
+    struct writer out;
+
+    if (output->format != FIND_OUTPUT_BINARY || output->header) {
+        return;
+    }
+
+    writer_init(&out, output->stream);
+    writer_put(&out, RFIND_RECORD_MAGIC, 4);
+    writer_le(&out, RFIND_RECORD_VERSION, 2);
+    writer_le(&out, 0, 2);
+    writer_le(&out, output->fields, 4);
+    writer_flush(&out);
+    output->header = 1;
+}
+
+void
+record_print(struct record_output *output, const struct rfind_entry *file)
+{
+    struct writer out;
+
+    writer_init(&out, output->stream);
+    if (output->format == FIND_OUTPUT_NDJSON) {
+        record_ndjson(&out, output->fields, file);
+    } else {
+        record_header(output);
+        record_binary(&out, output->fields, file);
+    }
+    writer_flush(&out);
+}
+
+/**
+ * @brief Reader of the binary stream (struct rfind_reader).
+ */
+struct rfind_reader {
+    FILE *in;                     /**< input stream */
+    unsigned int fields;          /**< RFIND_FIELD_* flags of the fields in the records */
+    uint32_t fields_size;         /**< size of the fields in each record */
+    unsigned char *buf;           /**< buffer of the current record */
+    size_t size;                  /**< allocated size of the buf */
+    struct rfind_record record;   /**< the current decoded record */
+};
+
+/**
+ * @brief Decode the little-endian number.
+ *
+ * @param[in] data Encoded number.
+ * @param[in] size Size of the number in bytes.
+ * @return Decoded number.
+ */
+static uint64_t
+record_le(const unsigned char *data, unsigned int size)
+{
+    uint64_t num = 0;
+
+    for (unsigned int i = size; i > 0; i--) {
+        num = (num << 8) | data[i - 1];
+    }
+
+    return num;
+}
+
+int
+rfind_reader_open(FILE *in, struct rfind_reader **reader)
+{
+    unsigned char header[RECORD_HEADER_SIZE];
+    struct rfind_reader *r;
+    unsigned int known = 0;
+
+    if (fread(header, 1, sizeof header, in) != sizeof header || memcmp(header, RFIND_RECORD_MAGIC, 4)) {
+        LOG("invalid records stream header.");
+        return EXIT_FAILURE;
+    } else if (record_le(&header[4], 2) != RFIND_RECORD_VERSION) {
+        LOG("unsupported records stream version %u.", (unsigned int)record_le(&header[4], 2));
+        return EXIT_FAILURE;
+    }
+
+    r = calloc(1, sizeof *r);
+    if (!r) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    r->in = in;
+    r->fields = record_le(&header[8], 4);
+    for (unsigned int i = 0; i < RECORD_FIELDS_COUNT; i++) {
+        if (r->fields & record_fields[i].flag) {
+            r->fields_size += record_fields[i].size;
+            known |= record_fields[i].flag;
+        }
+    }
+    if (r->fields != known) {
+        LOG("unknown fields 0x%x in records stream.", r->fields & ~known);
+        free(r);
+        return EXIT_FAILURE;
+    }
+
+    *reader = r;
+    return EXIT_SUCCESS;
+}
+
+unsigned int
+rfind_reader_fields(const struct rfind_reader *reader)
+{
+    return reader->fields;
+}
+
+int
+rfind_reader_next(struct rfind_reader *reader, const struct rfind_record **record)
+{
+    unsigned char lenbuf[4], *data;
+    struct rfind_record *rec = &reader->record;
+    size_t r;
+    uint32_t len;
+    uint64_t value;
+
+    *record = NULL;
+
+    r = fread(lenbuf, 1, sizeof lenbuf, reader->in);
+    if (!r && feof(reader->in)) {
+        /* end of the stream */
+        return EXIT_SUCCESS;
+    } else if (r != sizeof lenbuf) {
+        LOG("truncated record.");
+        return EXIT_FAILURE;
+    }
+    len = record_le(lenbuf, 4);
+    if (len < reader->fields_size) {
+        LOG("invalid record length %u.", len);
+        return EXIT_FAILURE;
+    }
+
+    /* read the record, place for the terminating NUL of the path is added */
+    if (reader->size < (size_t)len + 1) {
+        void *x = realloc(reader->buf, (size_t)len + 1);
+        if (!x) {
+            LOG("%s", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        reader->buf = x;
+        reader->size = (size_t)len + 1;
+    }
+    if (fread(reader->buf, 1, len, reader->in) != len) {
+        LOG("truncated record.");
+        return EXIT_FAILURE;
+    }
+
+    /* decode the fields */
+    memset(rec, 0, sizeof *rec);
+    data = reader->buf;
+    for (unsigned int i = 0; i < RECORD_FIELDS_COUNT; i++) {
+        if (!(reader->fields & record_fields[i].flag)) {
+            continue;
+        }
+        value = record_le(data, record_fields[i].size == 12 ? 8 : record_fields[i].size);
+        switch (record_fields[i].flag) {
+        case RFIND_FIELD_MODE:
+            rec->mode = value;
+            break;
+        case RFIND_FIELD_SIZE:
+            rec->size = value;
+            break;
+        case RFIND_FIELD_MTIME:
+            rec->mtime = (int64_t)value;
+            rec->mtime_nsec = record_le(&data[8], 4);
+            break;
+        case RFIND_FIELD_ATIME:
+            rec->atime = (int64_t)value;
+            rec->atime_nsec = record_le(&data[8], 4);
+            break;
+        case RFIND_FIELD_CTIME:
+            rec->ctime = (int64_t)value;
+            rec->ctime_nsec = record_le(&data[8], 4);
+            break;
+        case RFIND_FIELD_INO:
+            rec->ino = value;
+            break;
+        case RFIND_FIELD_DEV:
+            rec->dev = value;
+            break;
+        case RFIND_FIELD_NLINK:
+            rec->nlink = value;
+            break;
+        case RFIND_FIELD_UID:
+            rec->uid = value;
+            break;
+        case RFIND_FIELD_GID:
+            rec->gid = value;
+            break;
+        case RFIND_FIELD_BLOCKS:
+            rec->blocks = value;
+            break;
+        case RFIND_FIELD_DEPTH:
+            rec->depth = value;
+            break;
+        }
+        data += record_fields[i].size;
+    }
+
+    /* the rest is the path */
+    rec->path_len = len - reader->fields_size;
+    data[rec->path_len] = '\0';
+    rec->path = (const char *)data;
+
+    *record = rec;
+    return EXIT_SUCCESS;
+}
+
+void
+rfind_reader_close(struct rfind_reader *reader)
+{
+    if (!reader) {
+        return;
+    }
+
+    free(reader->buf);
+    free(reader);
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _RECORD_H
+#define _RECORD_H
+
+#include "cmdline.h"
+#include "expressions.h"
+#include "rfind.h"
+#include "rfind_record.h"
+#include "writer.h"
+
+/**
+ * @brief Fields of the records printed by default (--output-fields)
+ */
+#define RECORD_FIELDS_DEFAULT (RFIND_FIELD_MODE | RFIND_FIELD_SIZE | RFIND_FIELD_MTIME)
+
+/**
+ * @brief State of the record output shared by all the -print actions of the query.
+ */
+struct record_output {
+    int format;             /**< one of the FIND_OUTPUT_* values (never FIND_OUTPUT_TEXT) */
+    unsigned int fields;    /**< RFIND_FIELD_* flags of the printed fields */
+    int header;             /**< flag that the binary stream header was already written */
+    FILE *stream;           /**< stream the records are written to */
+};
+
+/**
+ * @brief Parse comma-separated list of the field names.
+ *
+ * @param[in] list List of the fields (e.g. "size,mtime,ino").
+ * @param[out] fields RFIND_FIELD_* flags of the listed fields.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE for unknown field.
+ */
+int record_fields_parse(const char *list, unsigned int *fields);
+
+/**
+ * @brief Get the file information needed to print the fields.
+ *
+ * @param[in] fields RFIND_FIELD_* flags.
+ * @return Needed file information.
+ */
+enum expr_need record_fields_need(unsigned int fields);
+
+/**
+ * @brief Write the binary stream header unless already written.
+ *
+ * @param[in] output Record output state.
+ */
+void record_header(struct record_output *output);
+
+/**
+ * @brief Print the file's record in the output's format.
+ *
+ * @param[in] output Record output state.
+ * @param[in] file File to print.
+ */
+void record_print(struct record_output *output, const struct rfind_entry *file);
+
+/**
+ * @brief Write the JSON object's member with the string (path) value.
+ *
+ * The string not being a valid UTF-8 is written as base64 in the "<name>_b64" member instead of "<name>".
+ *
+ * @param[in] w Writer to use.
+ * @param[in] name Name of the member.
+ * @param[in] str String to write.
+ * @param[in] len Length of the @p str.
+ */
+void record_json_member(struct writer *w, const char *name, const char *str, size_t len);
+
+#endif /* _RECORD_H */
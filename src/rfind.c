@@ -0,0 +1,738 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _POSIX_C_SOURCE 200809L /* strdup(), getline() */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rfind.h"
+
+#include "action_delete.h"
+#include "action_print.h"
+#include "action_quit.h"
+#include "arena.h"
+#include "cmdline.h"
+#include "common.h"
+#include "expressions.h"
+#include "profile.h"
+#include "query.h"
+#include "test_path.h"
+
+/** @brief Size of the arena blocks for the evaluation tree, enough for usual expressions */
+#define QUERY_ARENA_BLOCK 4096
+
+/**
+ * @brief Check if the expression contains any action.
+ *
+ * @param[in] e Expression to check.
+ * @return non-zero if there is an action in the expression.
+ */
+static int
+query_has_action(const struct expr *e)
+{
+    if (!e) {
+        return 0;
+    } else if (e->type == EXPR_GROUP) {
+        return query_has_action(e->expr1) || query_has_action(e->expr2);
+    }
+
+    return e->type == EXPR_ACT;
+}
+
+/**
+ * @brief Check if the expression contains any action printing its result at the end.
+ *
+ * @param[in] e Expression to check.
+ * @return non-zero if there is an aggregating action in the expression.
+ */
+static int
+query_has_report(const struct expr *e)
+{
+    if (!e) {
+        return 0;
+    } else if (e->type == EXPR_GROUP) {
+        return query_has_report(e->expr1) || query_has_report(e->expr2);
+    }
+
+    return (e->type == EXPR_ACT) && e->action_report;
+}
+
+/**
+ * @brief Bind the actions to the query's output and state.
+ *
+ * @param[in] query Query with the state changed by the actions (-quit, -delete).
+ * @param[in] e Expression with the actions to bind.
+ * @param[in] stream Stream of the actions' output.
+ * @param[in] output Records output to be printed by the -print actions, NULL for the text output.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+query_bind_actions(struct rfind_query *query, struct expr *e, FILE *stream, struct record_output *output)
+{
+    if (!e) {
+        return EXIT_SUCCESS;
+    } else if (e->type == EXPR_GROUP) {
+        if (query_bind_actions(query, e->expr1, stream, output)) {
+            return EXIT_FAILURE;
+        }
+        return query_bind_actions(query, e->expr2, stream, output);
+    } else if (e->type == EXPR_ACT) {
+        e->action_stream = stream;
+        if (output && (e->action == expr_action_print_clb)) {
+            e->action_data = output;
+            e->need = record_fields_need(output->fields);
+        } else if (e->action == expr_action_quit_clb) {
+            e->action_data = &query->quit;
+        } else if (e->action == expr_action_delete_clb) {
+            if (!query->deleter && !(query->deleter = calloc(1, sizeof *query->deleter))) {
+                LOG("%s", strerror(errno));
+                return EXIT_FAILURE;
+            }
+            e->action_data = query->deleter;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Bind the actions to the shard's output.
+ *
+ * @param[in] query Query with the shards.
+ * @param[in] shard Index of the shard.
+ */
+static void
+query_bind_shard(struct rfind_query *query, unsigned int shard)
+{
+    struct shards *s = query->shards;
+
+    s->current = shard;
+    /* the action's state is already allocated, the binding cannot fail */
+    query_bind_actions(query, query->expressions, s->streams[shard],
+            (query->options.output == FIND_OUTPUT_TEXT) ? NULL : &s->outputs[shard]);
+}
+
+/**
+ * @brief Collect the -path/-ipath automata of the expression and assign them their state sets' slots.
+ *
+ * @param[in] query Query to collect the patterns into.
+ * @param[in] e Expression with the patterns.
+ */
+static void
+query_patterns(struct rfind_query *query, struct expr *e)
+{
+    struct path_pattern *p;
+
+    if (!e) {
+        return;
+    } else if (e->type == EXPR_GROUP) {
+        query_patterns(query, e->expr1);
+        query_patterns(query, e->expr2);
+    } else if ((e->type == EXPR_TEST) && (e->test == expr_test_path_clb)) {
+        p = e->test_data;
+        if (p->fallback) {
+            return;
+        }
+        p->slot = query->path_words;
+        query->path_words += p->words;
+        p->next = query->patterns;
+        query->patterns = p;
+    }
+}
+
+/**
+ * @brief Prepare the records output of the -print actions according to the --output options.
+ *
+ * @param[in] query Query with the options.
+ * @param[in] stream Stream of the output.
+ * @param[out] output Records output to prepare.
+ * @return The prepared @p output, NULL for the text output.
+ */
+static struct record_output *
+query_output(struct rfind_query *query, FILE *stream, struct record_output *output)
+{
+    if (query->options.output == FIND_OUTPUT_TEXT) {
+        return NULL;
+    }
+
+    output->format = query->options.output;
+    output->fields = query->options.output_fields ? query->options.output_fields : RECORD_FIELDS_DEFAULT;
+    output->stream = stream;
+    return output;
+}
+
+/**
+ * @brief Compile a line of the query file into a new query of the query's subs.
+ *
+ * @param[in] query Query to extend.
+ * @param[in] line Line with the output file and the expression.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+query_sub_compile(struct rfind_query *query, const char *line)
+{
+    struct query_sub *sub;
+    struct find_options options;
+    int argpos = 1;
+    void *x;
+
+    x = realloc(query->subs, (query->subs_count + 1) * sizeof *query->subs);
+    if (!x) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    query->subs = x;
+    sub = &query->subs[query->subs_count++];
+    memset(sub, 0, sizeof *sub);
+
+    if (parse_string(line, &sub->argc, &sub->argv)) {
+        return EXIT_FAILURE;
+    }
+
+    /* the long options in the line do not affect the traversal, only the default -print is added */
+    options = query->options;
+    options.query_file = NULL;
+    if (parse_expressions(sub->argc, sub->argv, &argpos, &options, &query->arena, &sub->expressions)) {
+        return EXIT_FAILURE;
+    }
+
+    if (!strcmp(sub->argv[0], "-")) {
+        sub->stream = stdout;
+    } else {
+        sub->stream = fopen(sub->argv[0], "w");
+        if (!sub->stream) {
+            LOG("unable to open query output %s (%s).", sub->argv[0], strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    return query_bind_actions(query, sub->expressions, sub->stream, query_output(query, sub->stream, &sub->output));
+}
+
+/**
+ * @brief Compile the queries from the query file (--query-file).
+ *
+ * The equal subexpressions of the queries are shared, so they are evaluated once per file.
+ *
+ * @param[in] query Query to extend by the queries from the file.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+query_file_compile(struct rfind_query *query)
+{
+    FILE *f;
+    char *line = NULL, *start;
+    size_t size = 0;
+    ssize_t len;
+    struct expr **trees;
+    int ret = EXIT_SUCCESS;
+
+    f = fopen(query->options.query_file, "r");
+    if (!f) {
+        LOG("unable to open query file %s (%s).", query->options.query_file, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    while ((len = getline(&line, &size, f)) != -1) {
+        if (len && (line[len - 1] == '\n')) {
+            line[len - 1] = '\0';
+        }
+        /* skip empty and comment lines */
+        for (start = line; *start == ' ' || *start == '\t'; start++) {}
+        if (!*start || (*start == '#')) {
+            continue;
+        }
+        if (query_sub_compile(query, start)) {
+            ret = EXIT_FAILURE;
+            break;
+        }
+    }
+    free(line);
+    fclose(f);
+    if (ret || !query->subs_count) {
+        return ret;
+    }
+
+    /* share the equal subexpressions */
+    trees = malloc(query->subs_count * sizeof *trees);
+    if (!trees) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    for (unsigned int i = 0; i < query->subs_count; i++) {
+        trees[i] = query->subs[i].expressions;
+    }
+    ret = expr_memoize(&query->arena, trees, query->subs_count, &query->generation);
+    free(trees);
+
+    return ret;
+}
+
+/**
+ * @brief Process the arguments (already owned by the query) into the query's options, paths and expression.
+ *
+ * @param[in,out] query Query with the arguments to compile.
+ * @param[in] flags Compilation flags (RFIND_QUERY_*).
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+query_compile(struct rfind_query *query, int flags)
+{
+    int argpos = 0;
+
+    /* parse -H, -L, -P options */
+    if (parse_options(query->argc, query->argv, &argpos, &query->options)) {
+        return EXIT_FAILURE;
+    }
+    query->options.noprint = (flags & RFIND_QUERY_NOPRINT) ? 1 : 0;
+    query->flags = flags;
+
+    /* get paths */
+    if (parse_paths(query->argc, query->argv, &argpos, &query->paths)) {
+        return EXIT_FAILURE;
+    }
+
+    /* parse expressions */
+    if (parse_expressions(query->argc, query->argv, &argpos, &query->options, &query->arena, &query->expressions)) {
+        return EXIT_FAILURE;
+    }
+
+    /* records output of -print and the state of -quit and -delete */
+    if (query_bind_actions(query, query->expressions, stdout, query_output(query, stdout, &query->output))) {
+        return EXIT_FAILURE;
+    }
+
+    /* queries from the query file replace the expression */
+    if (query->options.query_file) {
+        if (query->expressions) {
+            LOG("expression cannot be combined with --query-file.");
+            return EXIT_FAILURE;
+        } else if (query->options.limit || query->options.snapshot_out || query->options.diff_against) {
+            /* the files are not matched by the query itself, see rfind_query_match() */
+            LOG("--limit, --snapshot-out and --diff-against cannot be combined with --query-file.");
+            return EXIT_FAILURE;
+        } else if (query->options.profile || query->options.profile_use) {
+            /* the profile describes a single expression */
+            LOG("--profile-expr and --profile-use cannot be combined with --query-file.");
+            return EXIT_FAILURE;
+        } else if (flags & RFIND_QUERY_NOACTIONS) {
+            LOG("--query-file is not allowed.");
+            return EXIT_FAILURE;
+        } else if (query_file_compile(query)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* the long options can follow the paths and the expression, so all of them are known now */
+    diag_init(&query->diag, query->options.errors, query->options.errors_rate);
+
+    /* prepare the expressions profiling */
+    if (query->options.profile_use && expr_profile_apply(query->options.profile_use, query->expressions)) {
+        return EXIT_FAILURE;
+    }
+    if (query->options.profile && expr_profile_init(&query->arena, query->expressions)) {
+        return EXIT_FAILURE;
+    }
+
+    if ((flags & RFIND_QUERY_NOACTIONS) && query_has_action(query->expressions)) {
+        LOG("actions are not allowed in the expression.");
+        return EXIT_FAILURE;
+    }
+
+    /* the files are deleted relatively to their directory, it cannot be a followed symlink */
+    if (query->deleter && (query->options.symlinks == EXPR_FOLLOW_SYMLINKS)) {
+        LOG("-delete cannot be combined with -L.");
+        return EXIT_FAILURE;
+    }
+
+    /* manifest of the matching files, the partial traversal would report the rest of the files as removed */
+    if (query->options.snapshot_out || query->options.diff_against) {
+        if (query->deleter) {
+            /* the manifest is in the order of the directories preceding their files */
+            LOG("--snapshot-out and --diff-against cannot be combined with -delete.");
+            return EXIT_FAILURE;
+        } else if (flags & RFIND_QUERY_NOACTIONS) {
+            LOG("--snapshot-out and --diff-against are not allowed.");
+            return EXIT_FAILURE;
+        } else if (query->options.diff_against && query->options.limit) {
+            LOG("--limit cannot be combined with --diff-against.");
+            return EXIT_FAILURE;
+        } else if (snapshot_open(query->options.snapshot_out, query->options.diff_against, stdout, &query->snapshot)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* position of the traversal, the resumed traversal continues the output of the interrupted one */
+    if (query->options.checkpoint || query->options.resume) {
+        if (flags & RFIND_QUERY_NOACTIONS) {
+            LOG("--checkpoint and --resume are not allowed.");
+            return EXIT_FAILURE;
+        } else if (query->deleter) {
+            /* the directories come after their files */
+            LOG("--checkpoint and --resume cannot be combined with -delete.");
+            return EXIT_FAILURE;
+        } else if (query->options.query_file || query->snapshot) {
+            LOG("--checkpoint and --resume cannot be combined with --query-file, --snapshot-out and --diff-against.");
+            return EXIT_FAILURE;
+        } else if (query_has_report(query->expressions)) {
+            /* the results of the interrupted traversal are not recorded */
+            LOG("--checkpoint and --resume cannot be combined with the aggregating actions.");
+            return EXIT_FAILURE;
+        } else if (checkpoint_open(query->options.checkpoint, query->options.checkpoint_interval, query->options.resume,
+                query->paths, stdout, &query->checkpoint)) {
+            return EXIT_FAILURE;
+        }
+        if (query->checkpoint->offset > 0) {
+            /* the binary stream continues */
+            query->output.header = 1;
+        }
+    }
+
+    /* the matching files are counted by the random probes instead of the traversal */
+    if (query->options.estimate) {
+        if (flags & RFIND_QUERY_NOACTIONS) {
+            LOG("--estimate is not allowed.");
+            return EXIT_FAILURE;
+        } else if (query_has_action(query->expressions)) {
+            LOG("--estimate cannot be combined with actions.");
+            return EXIT_FAILURE;
+        } else if (query->options.query_file || query->snapshot || query->checkpoint || query->options.limit ||
+                query->options.respect_ignore) {
+            LOG("--estimate cannot be combined with --query-file, --snapshot-out, --diff-against, --checkpoint, "
+                    "--resume, --limit and --respect-ignore.");
+            return EXIT_FAILURE;
+        } else if (estimate_open(query->options.estimate, &query->estimate)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* the symlinked subtrees replayed from the memory */
+    if (query->options.link_cache) {
+        if (query->options.symlinks != EXPR_FOLLOW_SYMLINKS) {
+            LOG("--link-cache requires -L.");
+            return EXIT_FAILURE;
+        } else if (query->checkpoint || query->options.respect_ignore) {
+            /* the files skipped by the resumed traversal and the ignore rules of the ancestors differ by the path */
+            LOG("--link-cache cannot be combined with --checkpoint, --resume and --respect-ignore.");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* the devices are traversed concurrently, their files are interleaved */
+    if (query->options.device_threads) {
+        if (query->deleter || query->snapshot || query->checkpoint || query->estimate) {
+            LOG("--device-threads cannot be combined with -delete, --snapshot-out, --diff-against, --checkpoint, "
+                    "--resume and --estimate.");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* the actions write into the shard picked for each file */
+    if (query->options.shard || query->options.shard_output) {
+        if (!query->options.shard || !query->options.shard_output) {
+            LOG("--shard and --shard-output must be specified together.");
+            return EXIT_FAILURE;
+        } else if (flags & RFIND_QUERY_NOACTIONS) {
+            LOG("--shard is not allowed.");
+            return EXIT_FAILURE;
+        } else if (query->options.query_file || query->snapshot || query->checkpoint || query->estimate) {
+            LOG("--shard cannot be combined with --query-file, --snapshot-out, --diff-against, --checkpoint, "
+                    "--resume and --estimate.");
+            return EXIT_FAILURE;
+        } else if (shards_open(query->options.shard, query->options.shard_output, query->options.shard_key,
+                query_output(query, stdout, &query->output), &query->shards)) {
+            return EXIT_FAILURE;
+        }
+        query_bind_shard(query, 0);
+    }
+
+    /* the patterns matched incrementally by the scan */
+    query_patterns(query, query->expressions);
+    for (unsigned int i = 0; i < query->subs_count; i++) {
+        query_patterns(query, query->subs[i].expressions);
+    }
+
+    /* the tests evaluated on the whole listings, the profile and the memos count the evaluations per file */
+    if (!query->subs_count && !query->options.profile && !query->patterns) {
+        query->batch_guard = expr_batch_guard(query->expressions, &query->batch_rest);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int
+rfind_query_compile_argv(int argc, char *argv[], int flags, struct rfind_query **query)
+{
+    struct rfind_query *q;
+
+    q = calloc(1, sizeof *q);
+    if (!q) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    arena_init(&q->arena, QUERY_ARENA_BLOCK);
+
+    /* copy the arguments */
+    q->argv = calloc(argc + 1, sizeof *q->argv);
+    if (!q->argv) {
+        LOG("%s", strerror(errno));
+        goto error;
+    }
+    for (q->argc = 0; q->argc < argc; q->argc++) {
+        q->argv[q->argc] = strdup(argv[q->argc]);
+        if (!q->argv[q->argc]) {
+            LOG("%s", strerror(errno));
+            goto error;
+        }
+    }
+
+    if (query_compile(q, flags)) {
+        goto error;
+    }
+
+    *query = q;
+    return EXIT_SUCCESS;
+
+error:
+    rfind_query_free(q);
+    return EXIT_FAILURE;
+}
+
+int
+rfind_query_compile_string(const char *str, int flags, struct rfind_query **query)
+{
+    struct rfind_query *q;
+
+    q = calloc(1, sizeof *q);
+    if (!q) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    arena_init(&q->arena, QUERY_ARENA_BLOCK);
+
+    if (parse_string(str, &q->argc, &q->argv) || query_compile(q, flags)) {
+        rfind_query_free(q);
+        return EXIT_FAILURE;
+    }
+
+    *query = q;
+    return EXIT_SUCCESS;
+}
+
+const char **
+rfind_query_paths(const struct rfind_query *query)
+{
+    return query->paths;
+}
+
+enum expr_need
+query_need(const struct rfind_query *query)
+{
+    enum expr_need need = expr_need(query->expressions);
+
+    if (query->snapshot) {
+        /* the manifest records */
+        return EXPR_NEED_STAT;
+    }
+
+    for (unsigned int i = 0; i < query->subs_count; i++) {
+        if (expr_need(query->subs[i].expressions) > need) {
+            need = expr_need(query->subs[i].expressions);
+        }
+    }
+
+    return need;
+}
+
+int
+query_prune(const struct rfind_query *query)
+{
+    if (!query->patterns) {
+        /* nothing is known about the subtree */
+        return 0;
+    } else if (query->subs_count) {
+        for (unsigned int i = 0; i < query->subs_count; i++) {
+            if (query->subs[i].expressions && !expr_prune(query->subs[i].expressions)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    return expr_prune(query->expressions);
+}
+
+/**
+ * @brief Evaluate the expression (or its part) on the file, the actions write into the file's shard.
+ *
+ * @param[in] query Query to evaluate.
+ * @param[in] entry File to evaluate.
+ * @param[in] expr The query's expression or its part.
+ * @return non-zero if the file matches the @p expr.
+ */
+static int
+query_eval(struct rfind_query *query, const struct rfind_entry *entry, struct expr *expr)
+{
+    unsigned int shard;
+    int match;
+
+    if (query->shards) {
+        shard = shards_pick(query->shards, entry);
+        if (shard != query->shards->current) {
+            query_bind_shard(query, shard);
+        }
+        match = expr_eval(entry, expr);
+        if (match) {
+            shards_matched(query->shards);
+        }
+        return match;
+    }
+
+    return expr_eval(entry, expr);
+}
+
+int
+rfind_query_match(struct rfind_query *query, const struct rfind_entry *entry)
+{
+    if (query->subs_count) {
+        /* the queries from the query file do their actions, the file is not matched by the query itself */
+        query->generation++;
+        for (unsigned int i = 0; i < query->subs_count; i++) {
+            if (query->subs[i].expressions) {
+                expr_eval(entry, query->subs[i].expressions);
+            }
+        }
+        return 0;
+    } else if (!query->expressions) {
+        return 1;
+    }
+
+    return query_eval(query, entry, query->expressions);
+}
+
+int
+query_match_guarded(struct rfind_query *query, const struct rfind_entry *entry, int guard)
+{
+    if (guard < 0) {
+        return rfind_query_match(query, entry);
+    } else if (!guard) {
+        /* the expression is false without executing any action */
+        return 0;
+    } else if (!query->batch_rest) {
+        return 1;
+    }
+
+    return query_eval(query, entry, query->batch_rest);
+}
+
+int
+rfind_query_report(struct rfind_query *query)
+{
+    struct query_sub *sub;
+    int ret = EXIT_SUCCESS;
+
+    if (query->shards) {
+        /* the aggregating actions print their results to the standard output */
+        if (shards_close(query->shards)) {
+            ret = EXIT_FAILURE;
+        }
+        query->shards = NULL;
+        query_bind_actions(query, query->expressions, stdout, query_output(query, stdout, &query->output));
+        /* no records stream on the standard output */
+        query->output.header = 1;
+    }
+
+    /* results of the aggregating actions, the binary stream is valid even without any record */
+    if (expr_report(query->expressions)) {
+        ret = EXIT_FAILURE;
+    }
+    record_header(&query->output);
+    for (unsigned int i = 0; i < query->subs_count; i++) {
+        sub = &query->subs[i];
+        if (expr_report(sub->expressions)) {
+            ret = EXIT_FAILURE;
+        }
+        record_header(&sub->output);
+        if (sub->stream && (sub->stream != stdout)) {
+            if (fclose(sub->stream)) {
+                LOG("unable to write query output %s (%s).", sub->argv[0], strerror(errno));
+                ret = EXIT_FAILURE;
+            }
+            sub->stream = NULL;
+        }
+    }
+
+    if (query->estimate) {
+        estimate_report(query->estimate, stdout);
+    }
+
+    diag_report(&query->diag);
+
+    if (query->snapshot) {
+        if (snapshot_close(query->snapshot)) {
+            ret = EXIT_FAILURE;
+        }
+        query->snapshot = NULL;
+    }
+
+    if (query->options.profile) {
+        expr_profile_print(stderr, query->expressions);
+        if (query->options.profile_out && expr_profile_save(query->options.profile_out, query->expressions)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return ret;
+}
+
+unsigned long
+rfind_query_errors(const struct rfind_query *query)
+{
+    return query->diag.errors;
+}
+
+void
+rfind_query_free(struct rfind_query *query)
+{
+    if (!query) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < query->subs_count; i++) {
+        if (query->subs[i].stream && (query->subs[i].stream != stdout)) {
+            fclose(query->subs[i].stream);
+        }
+        for (int j = 0; j < query->subs[i].argc; j++) {
+            free(query->subs[i].argv[j]);
+        }
+        free(query->subs[i].argv);
+    }
+    free(query->subs);
+    if (query->snapshot) {
+        /* not finished by rfind_query_report() */
+        query->snapshot->failed = 1;
+        snapshot_close(query->snapshot);
+    }
+
+    checkpoint_free(query->checkpoint);
+    shards_close(query->shards);
+    estimate_free(query->estimate);
+    diag_clean(&query->diag);
+    free(query->deleter);
+    arena_free(&query->arena);
+    free(query->paths);
+    if (query->argv) {
+        for (int i = 0; i < query->argc; i++) {
+            free(query->argv[i]);
+        }
+        free(query->argv);
+    }
+    free(query);
+}
@@ -0,0 +1,239 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _RFIND_H
+#define _RFIND_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief librfind - embeddable rfind(1) engine.
+ *
+ * The expression (in the form of the rfind(1)'s command line) is compiled into a reusable query
+ * handle. The query is then used to open any number of (sequential) scans over the paths.
+ * The scan is an iterator providing the files matching the expression.
+ *
+ * @code
+ * struct rfind_query *query;
+ * struct rfind_scan *scan;
+ * const struct rfind_entry *entry;
+ *
+ * rfind_query_compile_string("-name '*.log'", RFIND_QUERY_NOPRINT, &query);
+ * rfind_scan_open(query, paths, &scan);
+ * while (!rfind_scan_next(scan, &entry) && entry) {
+ *     ... entry->path, entry->st->st_size ...
+ * }
+ * rfind_scan_close(scan);
+ * rfind_query_free(query);
+ * @endcode
+ */
+
+/**
+ * @brief Compiled query - options, paths and expression.
+ */
+struct rfind_query;
+
+/**
+ * @brief Running scan over the paths.
+ */
+struct rfind_scan;
+
+/**
+ * @brief File matching the query's expression, provided by rfind_scan_next().
+ *
+ * All the members are valid only until the next rfind_scan_next() or rfind_scan_close() call.
+ */
+struct rfind_entry {
+    const char *path;        /**< path of the file (including the starting path) */
+    const char *name;        /**< name (basename) of the file */
+    const struct stat *st;   /**< file information */
+    unsigned int depth;      /**< depth of the file in the tree, starting paths have depth 0 */
+    size_t root_len;         /**< length of the starting path the file was found under (prefix of the path) */
+};
+
+/**
+ * @brief rfind_query_compile_* flag: do not add the default -print action to the expression without actions.
+ *
+ * Suitable for the library usage, where the matching files are processed via rfind_scan_next().
+ */
+#define RFIND_QUERY_NOPRINT 0x01
+
+/**
+ * @brief rfind_query_compile_* flag: refuse the expression containing actions.
+ *
+ * Suitable for the evaluation via rfind_query_match(), where the actions would be executed
+ * in the context of the evaluating process.
+ */
+#define RFIND_QUERY_NOACTIONS 0x02
+
+/**
+ * @brief rfind_query_compile_* flag: get only the file information needed by the expression.
+ *
+ * If the expression's tests and actions do not need the complete stat information, the stat(2) call
+ * is avoided for the non-directory files whose type is provided by the directory listing. The
+ * entry's st then contains only the file type (in st_mode) and the inode number.
+ */
+#define RFIND_QUERY_LAZYSTAT 0x04
+
+/**
+ * @brief Compile the query from the command line arguments.
+ *
+ * The arguments have the same format as rfind(1)'s command line: [-H] [-L] [-P] [--OPTION...]
+ * [path...] [expression]. The arguments are copied, so the @p argv is not needed after the call.
+ *
+ * @param[in] argc Number of arguments in @p argv.
+ * @param[in] argv Arguments (without the program name).
+ * @param[in] flags Compilation flags (RFIND_QUERY_*).
+ * @param[out] query Compiled query, to be freed by rfind_query_free().
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int rfind_query_compile_argv(int argc, char *argv[], int flags, struct rfind_query **query);
+
+/**
+ * @brief Compile the query from the string.
+ *
+ * The string is split into arguments the same way the shell would do it, supporting single and
+ * double quotes and backslash escaping, and the arguments are processed as in rfind_query_compile_argv().
+ *
+ * @param[in] str String with the arguments.
+ * @param[in] flags Compilation flags (RFIND_QUERY_*).
+ * @param[out] query Compiled query, to be freed by rfind_query_free().
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int rfind_query_compile_string(const char *str, int flags, struct rfind_query **query);
+
+/**
+ * @brief Get the starting paths of the query.
+ *
+ * @param[in] query Compiled query.
+ * @return NULL-terminated list of paths, the default path (".") is used when no path was specified.
+ */
+const char **rfind_query_paths(const struct rfind_query *query);
+
+/**
+ * @brief Evaluate the query's expression on a file provided by the caller instead of the scan.
+ *
+ * Allows to evaluate the query on the files from another source (e.g. a cache of the file system).
+ * The same query can be evaluated concurrently from several threads unless the expression profiling
+ * is enabled.
+ *
+ * @param[in] query Compiled query.
+ * @param[in] entry File to evaluate.
+ * @return non-zero if the file matches the expression.
+ */
+int rfind_query_match(struct rfind_query *query, const struct rfind_entry *entry);
+
+/**
+ * @brief Print the reports requested by the query's options (such as --profile-expr).
+ *
+ * Supposed to be called after the last scan of the query was closed.
+ *
+ * @param[in] query Query to report.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int rfind_query_report(struct rfind_query *query);
+
+/**
+ * @brief Get the number of the errors of the query's scans.
+ *
+ * The files that cannot be read (their information or the directory's content) are reported according to
+ * the --errors option and skipped, the scan continues.
+ *
+ * @param[in] query Query to check.
+ * @return Number of the errors reported so far.
+ */
+unsigned long rfind_query_errors(const struct rfind_query *query);
+
+/**
+ * @brief Free the compiled query.
+ *
+ * @param[in] query Query to free.
+ */
+void rfind_query_free(struct rfind_query *query);
+
+/**
+ * @brief Open a new scan.
+ *
+ * The query must not be freed before the scan is closed and it must not be shared by
+ * concurrently running scans.
+ *
+ * @param[in] query Compiled query to evaluate.
+ * @param[in] paths NULL-terminated list of the starting paths, NULL to use the paths from the query.
+ * The list is not copied, it must be available until the scan is closed.
+ * @param[out] scan Opened scan, to be closed by rfind_scan_close().
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int rfind_scan_open(struct rfind_query *query, const char **paths, struct rfind_scan **scan);
+
+/**
+ * @brief Get the next file matching the query's expression.
+ *
+ * The actions in the expression are executed as the files are visited.
+ *
+ * @param[in] scan Scan to continue.
+ * @param[out] entry Matching file, NULL when the scan is finished (or stopped, see rfind_scan_status()).
+ * The record is not copied, it is valid only until the next call of rfind_scan_next() or rfind_scan_close().
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE on a fatal error, the scan cannot continue.
+ */
+int rfind_scan_next(struct rfind_scan *scan, const struct rfind_entry **entry);
+
+/**
+ * @brief State of the scan, see rfind_scan_status().
+ */
+enum rfind_scan_status {
+    RFIND_SCAN_RUNNING = 0,   /**< the scan is not finished yet */
+    RFIND_SCAN_COMPLETE,      /**< all the files were traversed */
+    RFIND_SCAN_QUIT,          /**< stopped by the -quit action */
+    RFIND_SCAN_LIMIT,         /**< stopped after the number of matching files given by --limit */
+    RFIND_SCAN_DEADLINE,      /**< stopped when the time given by --deadline elapsed */
+    RFIND_SCAN_CANCELLED,     /**< stopped by rfind_scan_cancel() */
+    RFIND_SCAN_FAILED         /**< stopped by a fatal error */
+};
+
+/**
+ * @brief Get the state of the scan.
+ *
+ * Allows to distinguish the complete scan from the scan stopped early (and so providing partial results)
+ * after rfind_scan_next() finished the scan.
+ *
+ * @param[in] scan Scan to check.
+ * @return The scan's state.
+ */
+enum rfind_scan_status rfind_scan_status(const struct rfind_scan *scan);
+
+/**
+ * @brief Cancel the scan, the following rfind_scan_next() finishes the scan.
+ *
+ * The function can be called from another thread or from a signal handler.
+ *
+ * @param[in] scan Scan to cancel.
+ */
+void rfind_scan_cancel(struct rfind_scan *scan);
+
+/**
+ * @brief Close the scan.
+ *
+ * @param[in] scan Scan to close.
+ * @return EXIT_SUCCESS when the scan was finished with no fatal error.
+ * @return EXIT_FAILURE
+ */
+int rfind_scan_close(struct rfind_scan *scan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RFIND_H */
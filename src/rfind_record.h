@@ -0,0 +1,123 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _RFIND_RECORD_H
+#define _RFIND_RECORD_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Records of the files written by rfind --output=binary and the reader of the stream.
+ *
+ * The stream starts with the header:
+ *
+ *     magic    4 bytes  "RFND"
+ *     version  u16      RFIND_RECORD_VERSION
+ *     reserved u16      0
+ *     fields   u32      RFIND_FIELD_* flags of the fields present in each record
+ *
+ * Each record follows as:
+ *
+ *     length   u32      number of the record's bytes following the length
+ *     fields   ...      the present fields in the order of their RFIND_FIELD_* values
+ *     path     ...      the rest of the record, not NUL-terminated
+ *
+ * All the numbers are fixed-width little-endian. The times are stored as i64 seconds followed
+ * by u32 nanoseconds. A new field or a change of the layout increases the version.
+ */
+
+/** @brief Magic bytes starting the binary stream */
+#define RFIND_RECORD_MAGIC "RFND"
+
+/** @brief Version of the binary stream format */
+#define RFIND_RECORD_VERSION 1
+
+#define RFIND_FIELD_MODE   0x0001 /**< u32 st_mode (file type and permissions) */
+#define RFIND_FIELD_SIZE   0x0002 /**< u64 st_size */
+#define RFIND_FIELD_MTIME  0x0004 /**< i64 + u32 modification time */
+#define RFIND_FIELD_ATIME  0x0008 /**< i64 + u32 access time */
+#define RFIND_FIELD_CTIME  0x0010 /**< i64 + u32 status change time */
+#define RFIND_FIELD_INO    0x0020 /**< u64 st_ino */
+#define RFIND_FIELD_DEV    0x0040 /**< u64 st_dev */
+#define RFIND_FIELD_NLINK  0x0080 /**< u64 st_nlink */
+#define RFIND_FIELD_UID    0x0100 /**< u32 st_uid */
+#define RFIND_FIELD_GID    0x0200 /**< u32 st_gid */
+#define RFIND_FIELD_BLOCKS 0x0400 /**< u64 st_blocks (512-byte blocks) */
+#define RFIND_FIELD_DEPTH  0x0800 /**< u32 depth in the tree */
+
+/**
+ * @brief Decoded record, the members of the fields missing in the stream are zero.
+ */
+struct rfind_record {
+    const char *path;        /**< path of the file, NUL-terminated (the stream may contain NUL in the path) */
+    uint32_t path_len;       /**< length of the path */
+    uint32_t mode;           /**< RFIND_FIELD_MODE */
+    uint64_t size;           /**< RFIND_FIELD_SIZE */
+    int64_t mtime;           /**< RFIND_FIELD_MTIME seconds */
+    uint32_t mtime_nsec;     /**< RFIND_FIELD_MTIME nanoseconds */
+    int64_t atime;           /**< RFIND_FIELD_ATIME seconds */
+    uint32_t atime_nsec;     /**< RFIND_FIELD_ATIME nanoseconds */
+    int64_t ctime;           /**< RFIND_FIELD_CTIME seconds */
+    uint32_t ctime_nsec;     /**< RFIND_FIELD_CTIME nanoseconds */
+    uint64_t ino;            /**< RFIND_FIELD_INO */
+    uint64_t dev;            /**< RFIND_FIELD_DEV */
+    uint64_t nlink;          /**< RFIND_FIELD_NLINK */
+    uint32_t uid;            /**< RFIND_FIELD_UID */
+    uint32_t gid;            /**< RFIND_FIELD_GID */
+    uint64_t blocks;         /**< RFIND_FIELD_BLOCKS */
+    uint32_t depth;          /**< RFIND_FIELD_DEPTH */
+};
+
+/**
+ * @brief Reader of the binary stream.
+ */
+struct rfind_reader;
+
+/**
+ * @brief Open the reader and read the stream header.
+ *
+ * @param[in] in Input stream, it is not closed by the reader.
+ * @param[out] reader Created reader.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE for invalid or unsupported stream.
+ */
+int rfind_reader_open(FILE *in, struct rfind_reader **reader);
+
+/**
+ * @brief Get the fields present in the records of the stream.
+ *
+ * @param[in] reader Reader of the stream.
+ * @return RFIND_FIELD_* flags.
+ */
+unsigned int rfind_reader_fields(const struct rfind_reader *reader);
+
+/**
+ * @brief Read the next record.
+ *
+ * @param[in] reader Reader of the stream.
+ * @param[out] record The decoded record, valid until the next call. NULL at the end of the stream.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE for truncated or invalid record.
+ */
+int rfind_reader_next(struct rfind_reader *reader, const struct rfind_record **record);
+
+/**
+ * @brief Free the reader.
+ *
+ * @param[in] reader Reader to free, NULL is accepted.
+ */
+void rfind_reader_close(struct rfind_reader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RFIND_RECORD_H */
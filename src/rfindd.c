@@ -0,0 +1,660 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _GNU_SOURCE /* realpath(), MSG_NOSIGNAL */
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rfind.h"
+
+#include "common.h"
+#include "tree.h"
+
+#undef FIND_ID
+#define FIND_ID "rfindd"
+
+/** @brief Default interval (in seconds) of rescanning the roots */
+#define RESCAN_INTERVAL 60
+/** @brief Size of the buffer for sending the matching files to the client */
+#define SEND_BUFFER_SIZE 65536
+/** @brief Maximum length of the query */
+#define QUERY_MAX 65536
+
+/**
+ * @brief The current snapshot of the tree, replaced by the rescan thread.
+ */
+static struct tree *tree_current;
+
+/**
+ * @brief Number of the readers getting the reference to the tree_current.
+ *
+ * When replacing the snapshot, the writer waits for the counter to drop to zero to be sure that
+ * all the readers which have seen the old snapshot have already got its reference.
+ */
+static unsigned int tree_readers;
+
+/** @brief Interval (in seconds) of rescanning the roots */
+static unsigned int rescan_interval = RESCAN_INTERVAL;
+
+/**
+ * @brief The long options (without the leading '--') accepted in the client's query.
+ *
+ * Only the options tuning the traversal, which has no effect on the tree, so the same arguments work with rfind(1).
+ * The other options read or write files as the daemon's user (--profile-use, --snapshot-out, ...) or are not
+ * applicable to the tree.
+ */
+static const char *client_options[] = {
+    "fd-budget", "stat-order", "prefetch", "stat-threads", "max-iops", "max-stat-rate", "throttle-latency", NULL
+};
+
+/** @brief Flag to stop the daemon (SIGINT, SIGTERM) */
+static volatile sig_atomic_t daemon_stop;
+/** @brief Flag to rescan the roots immediately (SIGHUP) */
+static volatile sig_atomic_t daemon_rescan;
+
+/**
+ * @brief Context of the connected client.
+ */
+struct client {
+    int fd;                          /**< client's socket */
+    size_t len;                      /**< used part of the buffer */
+    char buf[SEND_BUFFER_SIZE];      /**< output buffer */
+};
+
+/**
+ * @brief Get the reference of the current tree snapshot, lock-free.
+ *
+ * @return The tree to be released by tree_release().
+ */
+static struct tree *
+tree_acquire(void)
+{
+    struct tree *tree;
+
+    __atomic_add_fetch(&tree_readers, 1, __ATOMIC_SEQ_CST);
+    tree = __atomic_load_n(&tree_current, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&tree->refs, 1, __ATOMIC_SEQ_CST);
+    __atomic_sub_fetch(&tree_readers, 1, __ATOMIC_SEQ_CST);
+
+    return tree;
+}
+
+/**
+ * @brief Release the reference of the tree snapshot, the last reference frees the tree.
+ *
+ * @param[in] tree Tree to release.
+ */
+static void
+tree_release(struct tree *tree)
+{
+    if (tree && !__atomic_sub_fetch(&tree->refs, 1, __ATOMIC_SEQ_CST)) {
+        tree_free(tree);
+    }
+}
+
+/**
+ * @brief Replace the current tree snapshot.
+ *
+ * @param[in] tree New tree (with a single reference taken over by the daemon).
+ */
+static void
+tree_publish(struct tree *tree)
+{
+    struct tree *old;
+
+    old = __atomic_exchange_n(&tree_current, tree, __ATOMIC_SEQ_CST);
+
+    /* wait for the readers which could have seen the old snapshot */
+    while (__atomic_load_n(&tree_readers, __ATOMIC_SEQ_CST)) {
+        sched_yield();
+    }
+    tree_release(old);
+}
+
+/**
+ * @brief Write the whole buffer into the socket.
+ *
+ * @param[in] fd Socket.
+ * @param[in] buf Data to write.
+ * @param[in] len Length of the data.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+write_all(int fd, const char *buf, size_t len)
+{
+    ssize_t rc;
+
+    while (len) {
+        rc = send(fd, buf, len, MSG_NOSIGNAL);
+        if (rc == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return EXIT_FAILURE;
+        }
+        buf += rc;
+        len -= rc;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief tree_match_clb implementation sending the NUL-terminated path to the client.
+ */
+static int
+client_match(const char *path, size_t path_len, void *data)
+{
+    struct client *c = data;
+
+    if (c->len + path_len + 1 > SEND_BUFFER_SIZE) {
+        if (write_all(c->fd, c->buf, c->len)) {
+            return EXIT_FAILURE;
+        }
+        c->len = 0;
+        if (path_len + 1 > SEND_BUFFER_SIZE) {
+            return write_all(c->fd, path, path_len + 1);
+        }
+    }
+    memcpy(&c->buf[c->len], path, path_len + 1);
+    c->len += path_len + 1;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Check the client's arguments contain only the allowed long options (client_options).
+ *
+ * The arguments of the tests cannot start with '-', so any argument starting with '--' is a long option.
+ *
+ * @param[in] argc Number of the arguments.
+ * @param[in] argv The client's arguments.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE if some of the options is not allowed.
+ */
+static int
+client_check_options(int argc, char *argv[])
+{
+    const char *name;
+    size_t len;
+    unsigned int i;
+
+    for (int a = 0; a < argc; a++) {
+        if (strncmp(argv[a], "--", 2)) {
+            continue;
+        }
+        name = &argv[a][2];
+        len = strcspn(name, "=");
+        for (i = 0; client_options[i]; i++) {
+            if (strlen(client_options[i]) == len && !strncmp(name, client_options[i], len)) {
+                break;
+            }
+        }
+        if (!client_options[i]) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Client thread - read the query, evaluate it on the current tree snapshot and send the matches.
+ *
+ * The request is the rfind(1)'s arguments (paths and expression), each of them NUL-terminated (so they can
+ * contain any other character, including newlines), up to the client's shutdown of its writing. The response
+ * is a line "OK" or "ERR message", followed by the NUL-terminated paths of the matching files.
+ *
+ * @param[in] arg Client context.
+ * @return NULL
+ */
+static void *
+client_thread(void *arg)
+{
+    struct client *c = arg;
+    struct rfind_query *query = NULL;
+    struct tree *tree;
+    char *request, **args = NULL;
+    size_t len = 0, pos;
+    ssize_t rc;
+    int count = 0;
+
+    request = malloc(QUERY_MAX + 1);
+    if (!request) {
+        goto cleanup;
+    }
+
+    /* read the request up to the end of the client's data, the byte over QUERY_MAX marks a too long request */
+    while (len <= QUERY_MAX && (rc = read(c->fd, &request[len], QUERY_MAX + 1 - len)) != 0) {
+        if (rc == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            goto cleanup;
+        }
+        len += rc;
+    }
+    if (len > QUERY_MAX || (len && request[len - 1])) {
+        write_all(c->fd, "ERR invalid request\n", 20);
+        goto cleanup;
+    }
+
+    /* split the NUL-terminated arguments */
+    for (pos = 0; pos < len; pos += strlen(&request[pos]) + 1) {
+        count++;
+    }
+    args = malloc((count + 1) * sizeof *args);
+    if (!args) {
+        goto cleanup;
+    }
+    for (pos = 0, count = 0; pos < len; pos += strlen(&request[pos]) + 1) {
+        args[count++] = &request[pos];
+    }
+    args[count] = NULL;
+
+    if (client_check_options(count, args)) {
+        write_all(c->fd, "ERR option not allowed\n", 23);
+        goto cleanup;
+    }
+    if (rfind_query_compile_argv(count, args, RFIND_QUERY_NOPRINT | RFIND_QUERY_NOACTIONS, &query)) {
+        write_all(c->fd, "ERR invalid query\n", 18);
+        goto cleanup;
+    }
+
+    if (write_all(c->fd, "OK\n", 3)) {
+        goto cleanup;
+    }
+    tree = tree_acquire();
+    if (!tree_query(tree, query, client_match, c)) {
+        write_all(c->fd, c->buf, c->len);
+    }
+    tree_release(tree);
+
+cleanup:
+    rfind_query_free(query);
+    free(args);
+    free(request);
+    close(c->fd);
+    free(c);
+    return NULL;
+}
+
+/**
+ * @brief Rescan thread - periodically rebuild the tree and replace the current snapshot.
+ *
+ * @param[in] arg NULL-terminated list of arguments for tree_build().
+ * @return NULL
+ */
+static void *
+rescan_thread(void *arg)
+{
+    struct tree *tree;
+    unsigned int elapsed = 0;
+    char **argv = arg;
+
+    while (!daemon_stop) {
+        sleep(1);
+        if (++elapsed < rescan_interval && !daemon_rescan) {
+            continue;
+        }
+        elapsed = 0;
+        daemon_rescan = 0;
+
+        if (tree_build(argv, &tree)) {
+            LOG("rescanning failed, keeping the previous tree.");
+            continue;
+        }
+        tree_publish(tree);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Signal handler for SIGINT, SIGTERM and SIGHUP.
+ *
+ * @param[in] sig Signal number.
+ */
+static void
+signal_handler(int sig)
+{
+    if (sig == SIGHUP) {
+        daemon_rescan = 1;
+    } else {
+        daemon_stop = 1;
+    }
+}
+
+/**
+ * @brief Start a thread with the daemon's signals blocked, so they are delivered to the main
+ * thread and interrupt its accept().
+ *
+ * @param[in] routine Thread's function.
+ * @param[in] arg Thread's argument.
+ * @param[out] thread Created thread.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+thread_start(void *(*routine)(void *), void *arg, pthread_t *thread)
+{
+    sigset_t set, orig;
+    int rc;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &set, &orig);
+    rc = pthread_create(thread, NULL, routine, arg);
+    pthread_sigmask(SIG_SETMASK, &orig, NULL);
+
+    return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Prepare the unix domain socket address.
+ *
+ * @param[in] path Path of the socket.
+ * @param[out] addr Address to fill.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+socket_address(const char *path, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr->sun_path) {
+        LOG("socket path %s is too long.", path);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr->sun_path, path);
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Run the query via the daemon and print the matching files.
+ *
+ * @param[in] socket_path Path of the daemon's socket.
+ * @param[in] argc Number of the query's arguments.
+ * @param[in] argv Query's arguments.
+ * @param[in] sep Separator to print after each path.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+client(const char *socket_path, int argc, char *argv[], char sep)
+{
+    int ret = EXIT_FAILURE, fd = -1, header = 1;
+    struct sockaddr_un addr;
+    char *request = NULL, buf[SEND_BUFFER_SIZE];
+    size_t len = 0, size = 0;
+    ssize_t rc;
+
+    /* the NUL-terminated arguments, the end of the request is marked by shutting down the writing */
+    for (int i = 0; i < argc; i++) {
+        size += strlen(argv[i]) + 1;
+    }
+    request = malloc(size + 1);
+    if (!request) {
+        LOG("%s", strerror(errno));
+        goto cleanup;
+    }
+    for (int i = 0; i < argc; i++) {
+        memcpy(&request[len], argv[i], strlen(argv[i]) + 1);
+        len += strlen(argv[i]) + 1;
+    }
+
+    if (socket_address(socket_path, &addr)) {
+        goto cleanup;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof addr) == -1) {
+        LOG("unable to connect to %s (%s).", socket_path, strerror(errno));
+        goto cleanup;
+    }
+    if (write_all(fd, request, len) || shutdown(fd, SHUT_WR) == -1) {
+        LOG("unable to send the query (%s).", strerror(errno));
+        goto cleanup;
+    }
+
+    /* print the response */
+    len = 0;
+    while (1) {
+        char *start = buf, *end;
+
+        if (len == sizeof buf) {
+            /* the record does not fit the buffer */
+            LOG("too long record in the response.");
+            goto cleanup;
+        }
+        rc = read(fd, &buf[len], sizeof buf - len);
+        if (!rc) {
+            break;
+        } else if (rc == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG("unable to read the response (%s).", strerror(errno));
+            goto cleanup;
+        }
+        len += rc;
+
+        if (header) {
+            end = memchr(buf, '\n', len);
+            if (!end) {
+                continue;
+            }
+            *end = '\0';
+            if (strcmp(buf, "OK")) {
+                LOG("%s", buf);
+                goto cleanup;
+            }
+            header = 0;
+            start = end + 1;
+        }
+
+        while ((end = memchr(start, '\0', len - (start - buf)))) {
+            fwrite(start, 1, end - start, stdout);
+            fputc(sep, stdout);
+            start = end + 1;
+        }
+        len -= start - buf;
+        memmove(buf, start, len);
+    }
+    if (len) {
+        LOG("incomplete record in the response.");
+        goto cleanup;
+    }
+
+    ret = header ? EXIT_FAILURE : EXIT_SUCCESS;
+
+cleanup:
+    if (fd != -1) {
+        close(fd);
+    }
+    free(request);
+    return ret;
+}
+
+/**
+ * @brief Print the usage help.
+ */
+static void
+usage(void)
+{
+    fprintf(stdout, "Usage: " FIND_ID " [-H] [-L] [-P] [-i SECONDS] -s SOCKET ROOT...\n");
+    fprintf(stdout, "       " FIND_ID " -c SOCKET [-0] [path...] [expression]\n\n");
+    fprintf(stdout, "Keep the in-memory tree of the ROOTs and serve the rfind(1) queries via the SOCKET.\n");
+    fprintf(stdout, "  -H, -L, -P   Symbolic links handling as in rfind(1).\n");
+    fprintf(stdout, "  -i SECONDS   Interval of rescanning the ROOTs (default %d), SIGHUP rescans immediately.\n",
+            RESCAN_INTERVAL);
+    fprintf(stdout, "  -s SOCKET    Path of the unix domain socket to listen on.\n");
+    fprintf(stdout, "  -c SOCKET    Client mode - send the query to the daemon and print the matching files.\n");
+    fprintf(stdout, "               The paths in the query must be absolute, no path means all the ROOTs.\n");
+    fprintf(stdout, "  -0           Client mode - separate the printed files by null character.\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    int ret = EXIT_FAILURE, fd = -1, i;
+    const char *socket_path = NULL, *client_socket = NULL, *symlinks = "-P";
+    char **scan_args = NULL, sep = '\n', *end;
+    unsigned long num;
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    struct tree *tree;
+    pthread_t rescan;
+
+    /* process the options */
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-H") || !strcmp(argv[i], "-L") || !strcmp(argv[i], "-P")) {
+            symlinks = argv[i];
+        } else if (!strcmp(argv[i], "-0")) {
+            sep = '\0';
+        } else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            errno = 0;
+            num = strtoul(argv[++i], &end, 10);
+            if (!isdigit(argv[i][0]) || *end || errno || !num || num > UINT_MAX) {
+                LOG("invalid rescan interval %s.", argv[i]);
+                return EXIT_FAILURE;
+            }
+            rescan_interval = num;
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            client_socket = argv[++i];
+            i++;
+            break;
+        } else if (!strcmp(argv[i], "--help")) {
+            usage();
+            return EXIT_SUCCESS;
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (client_socket) {
+        /* -0 can be after the -c SOCKET */
+        if (i < argc && !strcmp(argv[i], "-0")) {
+            sep = '\0';
+            i++;
+        }
+        return client(client_socket, argc - i, &argv[i], sep);
+    } else if (!socket_path || i == argc) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    /* arguments for the scanning: symlinks option and the canonical roots */
+    scan_args = calloc(argc - i + 2, sizeof *scan_args);
+    if (!scan_args) {
+        LOG("%s", strerror(errno));
+        goto cleanup;
+    }
+    scan_args[0] = (char *)symlinks;
+    for (int j = 1; i < argc; i++, j++) {
+        scan_args[j] = realpath(argv[i], NULL);
+        if (!scan_args[j]) {
+            LOG("invalid root %s (%s).", argv[i], strerror(errno));
+            goto cleanup;
+        }
+    }
+
+    /* initial scan */
+    if (tree_build(scan_args, &tree)) {
+        goto cleanup;
+    }
+    tree_current = tree;
+
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = signal_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* listen */
+    if (socket_address(socket_path, &addr)) {
+        goto cleanup;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        LOG("unable to create socket (%s).", strerror(errno));
+        goto cleanup;
+    }
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof addr) == -1 || listen(fd, SOMAXCONN) == -1) {
+        LOG("unable to listen on %s (%s).", socket_path, strerror(errno));
+        goto cleanup;
+    }
+
+    if (thread_start(rescan_thread, scan_args, &rescan)) {
+        LOG("unable to start the rescanning thread.");
+        goto cleanup;
+    }
+
+    while (!daemon_stop) {
+        struct client *c;
+        pthread_t thread;
+        int cfd;
+
+        cfd = accept(fd, NULL, NULL);
+        if (cfd == -1) {
+            if (errno != EINTR) {
+                LOG("accepting client failed (%s).", strerror(errno));
+            }
+            continue;
+        }
+
+        c = malloc(sizeof *c);
+        if (!c) {
+            close(cfd);
+            continue;
+        }
+        c->fd = cfd;
+        c->len = 0;
+        if (thread_start(client_thread, c, &thread)) {
+            close(cfd);
+            free(c);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    pthread_join(rescan, NULL);
+    unlink(socket_path);
+    ret = EXIT_SUCCESS;
+
+cleanup:
+    if (fd != -1) {
+        close(fd);
+    }
+    if (scan_args) {
+        for (i = 1; scan_args[i]; i++) {
+            free(scan_args[i]);
+        }
+        free(scan_args);
+    }
+    /* the running clients keep their references of the tree */
+    tree_release(tree_current);
+    return ret;
+}
@@ -0,0 +1,2309 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _GNU_SOURCE /* basename(), fdopendir(), clock_gettime() */
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rfind.h"
+
+#include "action_delete.h"
+#include "arena.h"
+#include "common.h"
+#include "estimate.h"
+#include "expressions.h"
+#include "ignore.h"
+#include "linkcache.h"
+#include "prefetch.h"
+#include "query.h"
+#include "snapshot.h"
+#include "statpool.h"
+#include "test_path.h"
+#include "throttle.h"
+
+/**
+ * @brief Entry of a directory listing read into memory, see dir_drain().
+ */
+struct scan_name {
+    struct scan_name *next;   /**< next entry in the listing */
+    unsigned int index;       /**< position of the entry in the listing */
+    ino_t ino;                /**< inode number from the directory entry */
+    unsigned char type;       /**< file type from the directory entry (DT_*) */
+    int err;                  /**< errno of the failed stat, 0 if the st is valid */
+    int guard;                /**< result of the query's batch_guard, -1 if not evaluated (see scan_guard()) */
+    struct stat st;           /**< information about the file */
+    char name[];              /**< name of the file */
+};
+
+/**
+ * @brief Record of the stack of the currently visited directories.
+ *
+ * The stack allows to continue the traversal after returning a matching file and
+ * to detect symlinks cycles. The records are allocated from the scan's scratch arena,
+ * which is released back to the record's mark when the directory is finished.
+ *
+ * Only the directories up to the scan's fd budget are kept open. When the budget is
+ * exhausted, the rest of the top directory's listing is read into memory and the directory
+ * is closed before opening its subdirectory, see dir_drain().
+ */
+struct scan_dir {
+    struct scan_dir *parent;  /**< parent directory's record */
+    struct scan_dir *child;   /**< subdirectory's record, NULL for the top of the stack */
+    struct arena_mark mark;   /**< scratch arena position before allocating this record */
+    DIR *dir;                 /**< opened directory, NULL when it was closed after draining its listing */
+    int listed;               /**< flag if the listing was drained into names */
+    struct scan_name *names;  /**< rest of the drained listing */
+    unsigned int names_count; /**< number of the entries drained into the listing */
+    struct scan_name *prefetch_next; /**< next entry of the listing to be prefetched (--prefetch) */
+    const char *name;         /**< name of the directory in the parent directory, the path for starting paths */
+    size_t path_len;          /**< length of the directory's path, which is the prefix of the scan's filepath */
+    dev_t dev;                /**< device of the directory (not the symlink, the directory itself) */
+    ino_t inode;              /**< inode of the directory (not the symlink, the directory itself) */
+    struct ignore_rules *ignore;  /**< rules of the directory's ignore files (--respect-ignore), NULL if none */
+    struct scan_dir *ignore_up;   /**< the closest directory (this or an ancestor) with ignore rules */
+    unsigned long *path_states;   /**< state sets of the -path patterns after the directory's path, NULL without patterns */
+    struct arena_mark chunk_mark; /**< scratch arena position after the record, where the listing's chunks start */
+    struct stat st;               /**< information about the directory, provided after its files in the post-order */
+    struct delete_dir *delete_dir; /**< the directory's record for -delete, NULL without -delete */
+};
+
+/** @brief Size of the scratch arena blocks, enough for the records of several levels */
+#define SCAN_ARENA_BLOCK 16384
+
+/** @brief Default fd budget when the open files limit is not available */
+#define SCAN_FD_BUDGET_FALLBACK 512
+
+/** @brief Number of the entries read from a directory at once with --stat-threads */
+#define SCAN_CHUNK 1024
+
+/** @brief Minimal number of the files stat'ed in parallel, smaller listings are stat'ed by the scan itself */
+#define SCAN_PARALLEL_MIN 64
+
+/** @brief Number of the directories prefetched ahead per device thread (--device-threads without --prefetch) */
+#define SCAN_DEVICE_WINDOW 4
+
+/**
+ * @brief Scan context (librfind's internal representation of the struct rfind_scan).
+ */
+struct rfind_scan {
+    struct rfind_query *query;    /**< query to evaluate */
+    const char **paths;           /**< NULL-terminated list of starting paths */
+    const char **paths_sorted;    /**< the starting paths sorted for the manifest (owned copy of paths), NULL if not sorted */
+    unsigned int paths_next;      /**< index of the next starting path to process */
+    struct rfind_scan **lanes;    /**< scans of the starting paths of each device (--device-threads), NULL for a single device */
+    unsigned int lanes_count;     /**< number of the lanes not finished yet */
+    unsigned int lane;            /**< index of the lane to continue with */
+    const char **lanes_paths;     /**< the starting paths of the lanes, each lane's list is NULL-terminated */
+
+    struct arena scratch;         /**< per-depth scratch arena for the directory stack */
+    struct scan_dir *dir_top;     /**< top of the stack of the currently visited directories */
+    unsigned int dir_stack_count; /**< number of the directories in the stack */
+    unsigned int dir_open;        /**< number of the opened directories in the stack */
+    unsigned int fd_budget;       /**< maximum number of the opened directories */
+    int lazy;                     /**< flag to avoid stat if the file type is enough, see scan_lazy_stat() */
+    int sorted;                   /**< flag to traverse the directories in the order of the names (the manifest order) */
+    struct throttle iops;         /**< limit of the stats and directory opens (--max-iops, --throttle-latency) */
+    struct throttle stats;        /**< limit of the stats (--max-stat-rate) */
+    struct prefetch *prefetch;    /**< directories opened and listed ahead (--prefetch), NULL if disabled */
+    int prefetch_stat;            /**< flags to stat the prefetched listings by the prefetch threads, -1 if not */
+    struct statpool *statpool;    /**< threads getting the files information (--stat-threads), NULL if disabled */
+    int chunked;                  /**< flag to read the directories in chunks (--stat-threads or the batch) */
+    struct expr_batch *batch;     /**< listing's files evaluated by the query's batch_guard at once, NULL if disabled */
+    pthread_mutex_t io_lock;      /**< lock of the I/O limits shared by the stat threads */
+    int throttled;                /**< flag if any of the I/O limits is set */
+
+    char *filepath;               /**< buffer for the path of the current file */
+    size_t filepath_size;         /**< allocated size of the filepath buffer */
+    struct stat st;               /**< information about the current file */
+    struct rfind_entry entry;     /**< the current file provided to the caller */
+    int guard;                    /**< result of the query's batch_guard on the current file, -1 if not known */
+    struct scan_name *current;    /**< entry of the current file in the drained listing, NULL if not listed */
+    int descend;                  /**< flag to descend into the current file (directory) on the next step */
+    int postorder;                /**< flag to provide the directories after their files (-delete) */
+    int finished;                 /**< flag the current file is a directory provided after its files */
+    unsigned long *path_next;     /**< state sets of the -path patterns for the directory to descend into */
+
+    unsigned long errors;         /**< number of the reported errors of the traversal (files skipped) */
+    unsigned char type;           /**< type of the current file from the directory entry (DT_*) */
+    struct linkcache *linkcache;  /**< subtrees reached through the symlinks (--link-cache), NULL if disabled */
+    int link_record;              /**< flag to record the subtree of the directory to descend into */
+    struct scan_dir *link_dir;    /**< directory whose subtree is being recorded, NULL if none */
+    unsigned int link_depth;      /**< depth of the link_dir */
+    unsigned long link_errors;    /**< errors before the recording started, the subtree with errors is not cached */
+    const struct linkcache_tree *replay; /**< cached subtree replayed instead of the traversal, NULL if none */
+    const struct linkcache_entry *replay_entry; /**< the last replayed file */
+    size_t replay_len;            /**< length of the path of the replayed subtree's directory */
+    unsigned int replay_depth;    /**< depth of the replayed subtree's directory */
+    int replayed;                 /**< flag the current file comes from the replayed subtree */
+
+    struct delete_dir *delete_left; /**< -delete record of the directory popped last, held until it is evaluated */
+    int delete_sync;              /**< flag to evaluate a directory after the deletions of its files are finished */
+    int delete_fd;                /**< descriptor of the drained top directory reopened for -delete, -1 if none */
+    struct scan_dir *delete_fd_dir; /**< directory of the delete_fd */
+
+    unsigned int matches;         /**< number of the matching files provided to the caller (--limit) */
+    struct timespec deadline;     /**< monotonic time to stop the scan at (--deadline), zero for no deadline */
+    int cancelled;                /**< flag set by rfind_scan_cancel() */
+    enum rfind_scan_status status; /**< state of the scan, RFIND_SCAN_RUNNING until the scan is finished */
+};
+
+/**
+ * @brief Report the failed operation on the file, the file (directory's content) is skipped.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] op The failed operation.
+ * @param[in] path Path of the file.
+ * @param[in] err errno of the failure.
+ */
+static void
+scan_error(struct rfind_scan *scan, enum diag_op op, const char *path, int err)
+{
+    diag_error(&scan->query->diag, op, path, err);
+    scan->errors++;
+}
+
+/**
+ * @brief Do correct stat according to the given symbolic links handling @p options.
+ *
+ * @param[in] dirfd Directory file descriptor the @p name is relative to (or AT_FDCWD).
+ * @param[in] name Name (path) of the file to stat.
+ * @param[in] options Options for handling symbolic links.
+ * @param[in] explicit Flag if the given filepath was explicitly provided on command line.
+ * @param[out] st Pointer to the stat structure to fill.
+ * @return 0 on success
+ * @return errno value of the failed stat.
+ */
+static int
+find_stat(int dirfd, const char *name, int options, int explicit, struct stat *st)
+{
+    int flags = AT_SYMLINK_NOFOLLOW;
+
+    if ((options == EXPR_FOLLOW_SYMLINKS) ||
+            (explicit && (options & EXPR_FOLLOW_EXPLICIT_SYMLINKS))) {
+        flags = 0;
+    }
+    if (fstatat(dirfd, name, st, flags) == -1) {
+        return errno;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Stat the file within the scan's I/O limits (also from the stat threads), see find_stat().
+ *
+ * @param[in] scan Scan context.
+ * @param[in] dirfd Directory file descriptor the @p name is relative to (or AT_FDCWD).
+ * @param[in] name Name (path) of the file to stat.
+ * @param[in] explicit Flag if the given filepath was explicitly provided on command line.
+ * @param[out] st Pointer to the stat structure to fill.
+ * @return 0 on success
+ * @return errno value of the failed stat.
+ */
+static int
+scan_stat(struct rfind_scan *scan, int dirfd, const char *name, int explicit, struct stat *st)
+{
+    uint64_t start;
+    int err, lock = scan->statpool && scan->throttled;
+
+    /* the buckets are shared by the stat threads */
+    if (lock) {
+        pthread_mutex_lock(&scan->io_lock);
+    }
+    throttle_take(&scan->stats);
+    throttle_take(&scan->iops);
+    start = throttle_start(&scan->iops);
+    if (lock) {
+        pthread_mutex_unlock(&scan->io_lock);
+    }
+
+    err = find_stat(dirfd, name, scan->query->options.symlinks, explicit, st);
+
+    if (lock) {
+        pthread_mutex_lock(&scan->io_lock);
+    }
+    throttle_observe(&scan->iops, start);
+    if (lock) {
+        pthread_mutex_unlock(&scan->io_lock);
+    }
+
+    return err;
+}
+
+/**
+ * @brief Fill the file information from the directory entry, if the complete stat is not needed.
+ *
+ * Directories are always stat'ed, the loop detection needs their device.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] type File type from the directory entry (DT_*).
+ * @param[in] ino Inode number from the directory entry.
+ * @param[out] st Pointer to the stat structure to fill.
+ * @return non-zero if the @p st was filled, zero if the file must be stat'ed.
+ */
+static int
+scan_lazy_stat(struct rfind_scan *scan, unsigned char type, ino_t ino, struct stat *st)
+{
+    if (!scan->lazy || (type == DT_UNKNOWN) || (type == DT_DIR) ||
+            ((type == DT_LNK) && (scan->query->options.symlinks == EXPR_FOLLOW_SYMLINKS))) {
+        return 0;
+    }
+
+    memset(st, 0, sizeof *st);
+    st->st_mode = DTTOIF(type);
+    st->st_ino = ino;
+    return 1;
+}
+
+/**
+ * @brief Get flags to open a directory found in the traversal.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] explicit Flag if the directory is the starting path.
+ * @return Flags for openat().
+ */
+static int
+scan_open_flags(struct rfind_scan *scan, int explicit)
+{
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+
+    /* the symlinks are already resolved by find_stat(), do not follow a symlink replacing the directory */
+    if (!explicit && (scan->query->options.symlinks != EXPR_FOLLOW_SYMLINKS)) {
+        flags |= O_NOFOLLOW;
+    }
+
+    return flags;
+}
+
+/**
+ * @brief Get file descriptor of the directory in the stack.
+ *
+ * Drained directories are reopened relatively to the closest opened ancestor, so the
+ * length of the path does not matter.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] d Directory record.
+ * @param[out] owned Flag if the returned file descriptor was opened and the caller is supposed to close it.
+ * @return File descriptor of the directory.
+ * @return -1 on error (errno is set).
+ */
+static int
+scan_dir_fd(struct rfind_scan *scan, struct scan_dir *d, int *owned)
+{
+    struct scan_dir *a;
+    struct stat st;
+    int fd = AT_FDCWD, pfd;
+
+    *owned = 0;
+    if (d->dir) {
+        return dirfd(d->dir);
+    }
+
+    /* find the closest opened ancestor and open the path from it down to the directory */
+    for (a = d->parent; a && !a->dir; a = a->parent) {}
+    if (a) {
+        fd = dirfd(a->dir);
+        a = a->child;
+    } else {
+        for (a = d; a->parent; a = a->parent) {}
+    }
+    while (1) {
+        pfd = fd;
+        throttle_take(&scan->iops);
+        fd = openat(pfd, a->name, scan_open_flags(scan, !a->parent));
+        if (*owned) {
+            close(pfd);
+        }
+        if (fd == -1) {
+            return -1;
+        }
+        *owned = 1;
+        if (a == d) {
+            break;
+        }
+        a = a->child;
+    }
+
+    /* make sure the directory was not replaced in the meantime */
+    if (fstat(fd, &st) == -1 || st.st_dev != d->dev || st.st_ino != d->inode) {
+        close(fd);
+        errno = ENOENT;
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Compare the directory listing entries by the inode number for qsort().
+ */
+static int
+scan_name_cmp_ino(const void *a, const void *b)
+{
+    const struct scan_name *n1 = *(const struct scan_name **)a, *n2 = *(const struct scan_name **)b;
+
+    return (n1->ino > n2->ino) - (n1->ino < n2->ino);
+}
+
+/**
+ * @brief Compare the directory listing entries by the name for qsort().
+ */
+static int
+scan_name_cmp_name(const void *a, const void *b)
+{
+    const struct scan_name *n1 = *(const struct scan_name **)a, *n2 = *(const struct scan_name **)b;
+
+    return strcmp(n1->name, n2->name);
+}
+
+/**
+ * @brief Compare the starting paths in the manifest order for qsort().
+ */
+static int
+scan_path_cmp(const void *a, const void *b)
+{
+    return snapshot_path_cmp(*(const char **)a, *(const char **)b);
+}
+
+/**
+ * @brief Sort the end of the drained listing by the names.
+ *
+ * The positions of the sorted entries are renumbered, so the listing stays ordered by the index.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] from Link to the first entry to sort, the entries up to the end of the listing are sorted.
+ * @param[in] count Number of the entries from the @p from.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+scan_names_sort(struct rfind_scan *scan, struct scan_name **from, unsigned int count)
+{
+    struct arena_mark mark;
+    struct scan_name **sorted, *n;
+    unsigned int i, index = (*from)->index;
+
+    mark = arena_mark(&scan->scratch);
+    sorted = arena_alloc(&scan->scratch, count * sizeof *sorted);
+    if (!sorted) {
+        return EXIT_FAILURE;
+    }
+    for (i = 0, n = *from; n; n = n->next) {
+        sorted[i++] = n;
+    }
+    qsort(sorted, count, sizeof *sorted, scan_name_cmp_name);
+    for (i = 0; i < count; i++) {
+        sorted[i]->index = index++;
+        sorted[i]->next = (i + 1 < count) ? sorted[i + 1] : NULL;
+    }
+    *from = sorted[0];
+    arena_release(&scan->scratch, mark);
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Make sure the filepath buffer is big enough.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] size Required size of the buffer.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+scan_filepath_reserve(struct rfind_scan *scan, size_t size)
+{
+    void *x;
+
+    if (size > scan->filepath_size) {
+        x = realloc(scan->filepath, size);
+        if (!x) {
+            LOG("unable to compound complete file path (%s).", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        scan->filepath = x;
+        scan->filepath_size = size;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Prepare path of the file in the directory from the top of the stack.
+ *
+ * The filepath buffer always starts with the path of the top directory, so only the name is appended.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] name Name of the file in the directory.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+scan_filepath(struct rfind_scan *scan, const char *name)
+{
+    struct scan_dir *d = scan->dir_top;
+    size_t name_len = strlen(name);
+    int slash = (scan->filepath[d->path_len - 1] == '/') ? 0 : 1;
+
+    if (scan_filepath_reserve(scan, d->path_len + slash + name_len + 1)) {
+        return EXIT_FAILURE;
+    }
+    if (slash) {
+        scan->filepath[d->path_len] = '/';
+    }
+    memcpy(&scan->filepath[d->path_len + slash], name, name_len + 1);
+
+    scan->entry.path = scan->filepath;
+    scan->entry.name = &scan->filepath[d->path_len + slash];
+    scan->entry.depth = scan->dir_stack_count;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Check if the file from the listing of the top directory is ignored by the ignore rules.
+ *
+ * The rules of the directory and its ancestors are matched from the closest one, the closest
+ * directory with a matching rule decides.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] d Directory record of the listing, it must be the top of the stack.
+ * @param[in] n The file from the listing.
+ * @return non-zero if the file is ignored.
+ * @return -1 in case of fatal error.
+ */
+static int
+scan_ignored(struct rfind_scan *scan, struct scan_dir *d, struct scan_name *n)
+{
+    struct stat st;
+    const char *path;
+    int isdir;
+    enum ignore_result r;
+
+    if (n->type == DT_UNKNOWN) {
+        isdir = !fstatat(dirfd(d->dir), n->name, &st, AT_SYMLINK_NOFOLLOW) && S_ISDIR(st.st_mode);
+    } else {
+        isdir = (n->type == DT_DIR);
+    }
+
+    /* the filepath buffer holds the path of the top directory, append the name */
+    if (scan_filepath(scan, n->name)) {
+        return -1;
+    }
+    for (struct scan_dir *a = d->ignore_up; a; a = a->parent ? a->parent->ignore_up : NULL) {
+        path = &scan->filepath[a->path_len];
+        if (*path == '/') {
+            path++;
+        }
+        r = ignore_match(a->ignore, path, n->name, isdir);
+        if (r != IGNORE_NONE) {
+            return r == IGNORE_EXCLUDE;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Apply the ignore files (--respect-ignore) on the directory listing.
+ *
+ * The ignore files are read only if they are present in the listing, so the directories
+ * without them cost nothing. The ignored files are removed from the listing before they are
+ * stat'ed and so the ignored directories are never opened.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] d Directory record of the listing, it must be the top of the stack.
+ * @param[in,out] link Link to the first entry of the listing to check.
+ * @param[in,out] count Number of the entries from the @p link, updated for the removed entries.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+scan_ignore(struct rfind_scan *scan, struct scan_dir *d, struct scan_name **link, unsigned int *count)
+{
+    struct scan_name *n;
+    int gitignore = 0, ignore = 0, r;
+
+    for (n = *link; n; n = n->next) {
+        if (!strcmp(n->name, ".gitignore")) {
+            gitignore = 1;
+        } else if (!strcmp(n->name, ".ignore")) {
+            ignore = 1;
+        }
+    }
+    /* the rules of .ignore take precedence over .gitignore */
+    if ((gitignore && ignore_rules_load(&scan->scratch, dirfd(d->dir), ".gitignore", &d->ignore)) ||
+            (ignore && ignore_rules_load(&scan->scratch, dirfd(d->dir), ".ignore", &d->ignore))) {
+        return EXIT_FAILURE;
+    }
+    if (d->ignore && d->ignore->count) {
+        d->ignore_up = d;
+    }
+    if (!d->ignore_up) {
+        /* no rules in this part of the tree */
+        return EXIT_SUCCESS;
+    }
+
+    while ((n = *link)) {
+        r = scan_ignored(scan, d, n);
+        if (r == -1) {
+            return EXIT_FAILURE;
+        } else if (r) {
+            *link = n->next;
+            (*count)--;
+        } else {
+            link = &n->next;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Append the entry to the directory's drained listing.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] d Directory record.
+ * @param[in,out] tail Link to append the entry to, moved to the new entry's next link.
+ * @param[in] name Name of the file.
+ * @param[in] len Length of the @p name.
+ * @param[in] ino Inode number from the directory entry.
+ * @param[in] type File type from the directory entry (DT_*).
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+dir_name_add(struct rfind_scan *scan, struct scan_dir *d, struct scan_name ***tail, const char *name, size_t len,
+        ino_t ino, unsigned char type)
+{
+    struct scan_name *n;
+
+    n = arena_alloc(&scan->scratch, sizeof *n + len + 1);
+    if (!n) {
+        return EXIT_FAILURE;
+    }
+    memcpy(n->name, name, len + 1);
+    n->index = d->names_count++;
+    n->ino = ino;
+    n->type = type;
+    n->guard = -1;
+    n->next = NULL;
+    **tail = n;
+    *tail = &n->next;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Files of the listing stat'ed in parallel, see scan_stat_names().
+ */
+struct scan_stat_batch {
+    struct rfind_scan *scan;      /**< scan context */
+    int dirfd;                    /**< descriptor of the listed directory */
+    struct scan_name **names;     /**< the entries to stat */
+};
+
+/**
+ * @brief statpool_clb implementation getting the information about the listed file.
+ */
+static void
+scan_stat_clb(void *data, unsigned int index)
+{
+    struct scan_stat_batch *batch = data;
+    struct scan_name *n = batch->names[index];
+
+    n->err = scan_stat(batch->scan, batch->dirfd, n->name, 0, &n->st);
+}
+
+/**
+ * @brief Get the information about the files of the listing.
+ *
+ * With the inode stat order, the files are stat'ed in the order of their inode numbers to
+ * lower the seeks in the inode table, but the listing keeps its order. With --stat-threads,
+ * the stats of a big enough listing are spread over the stat threads.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] d Directory record, it must be opened.
+ * @param[in] first First entry to get the information about, the entries up to the end of the listing are processed.
+ * @param[in] count Number of the entries from the @p first.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+scan_stat_names(struct rfind_scan *scan, struct scan_dir *d, struct scan_name *first, unsigned int count)
+{
+    struct scan_stat_batch batch = {scan, dirfd(d->dir), NULL};
+    struct arena_mark mark;
+    struct scan_name *n;
+    unsigned int i = 0, j;
+    int inode = (scan->query->options.stat_order == FIND_STAT_ORDER_INODE);
+
+    if ((count < 2) || (!inode && (!scan->statpool || (count < SCAN_PARALLEL_MIN)))) {
+        for (n = first; n; n = n->next) {
+            n->err = scan_lazy_stat(scan, n->type, n->ino, &n->st) ? 0 :
+                    scan_stat(scan, batch.dirfd, n->name, 0, &n->st);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    /* the array is needed only for the stats, the rest is filled from the directory entries */
+    mark = arena_mark(&scan->scratch);
+    batch.names = arena_alloc(&scan->scratch, count * sizeof *batch.names);
+    if (!batch.names) {
+        return EXIT_FAILURE;
+    }
+    for (n = first; n; n = n->next) {
+        if (scan_lazy_stat(scan, n->type, n->ino, &n->st)) {
+            n->err = 0;
+        } else {
+            batch.names[i++] = n;
+        }
+    }
+    if (inode) {
+        qsort(batch.names, i, sizeof *batch.names, scan_name_cmp_ino);
+    }
+    if (scan->statpool && (i >= SCAN_PARALLEL_MIN)) {
+        statpool_run(scan->statpool, i, scan_stat_clb, &batch);
+    } else {
+        for (j = 0; j < i; j++) {
+            scan_stat_clb(&batch, j);
+        }
+    }
+    arena_release(&scan->scratch, mark);
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Evaluate the query's batch_guard on the files of the listing at once.
+ *
+ * The files are evaluated in batches of EXPR_BATCH_MAX, the results are stored in the entries
+ * for scan_next_file(). The files with the failed stat are not evaluated.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] d Directory record of the listing, its path is the prefix of the scan's filepath.
+ * @param[in] first First entry to evaluate, the entries up to the end of the listing are processed.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+scan_guard(struct rfind_scan *scan, struct scan_dir *d, struct scan_name *first)
+{
+    struct expr_batch *b = scan->batch;
+    struct scan_name *n = first, *start;
+    uint64_t sel[EXPR_BATCH_WORDS];
+    unsigned int i;
+    void *x;
+
+    b->dir = scan->filepath;
+    b->dir_len = d->path_len;
+    while (n) {
+        start = n;
+        b->name_max = 0;
+        memset(sel, 0, sizeof sel);
+        for (i = 0; n && (i < EXPR_BATCH_MAX); n = n->next, i++) {
+            b->names[i] = n->name;
+            b->name_lens[i] = strlen(n->name);
+            if (b->name_lens[i] > b->name_max) {
+                b->name_max = b->name_lens[i];
+            }
+            b->types[i] = n->type;
+            b->modes[i] = n->st.st_mode;
+            b->sizes[i] = n->st.st_size;
+            b->st[i] = &n->st;
+            if (!n->err) {
+                EXPR_BATCH_SET(sel, i);
+            }
+        }
+        b->count = i;
+        if (b->dir_len + b->name_max + 2 > b->path_size) {
+            /* the paths for the tests without the batch callback */
+            x = realloc(b->path, b->dir_len + b->name_max + 2);
+            if (!x) {
+                LOG("unable to compound complete file path (%s).", strerror(errno));
+                return EXIT_FAILURE;
+            }
+            b->path = x;
+            b->path_size = b->dir_len + b->name_max + 2;
+        }
+        expr_eval_batch(b, scan->query->batch_guard, sel);
+        for (i = 0; start != n; start = start->next, i++) {
+            start->guard = start->err ? -1 : (EXPR_BATCH_ISSET(sel, i) ? 1 : 0);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Read the rest of the directory listing (and the files information) into memory.
+ *
+ * The listing is allocated from the scratch arena, so it is freed together with the directory record.
+ * The files are stat'ed by scan_stat_names().
+ *
+ * @param[in] scan Scan context.
+ * @param[in] d Directory record, it must be the top of the stack.
+ * @param[in] job Prefetched listing of the directory, NULL to read the directory.
+ * @param[in] keep_open Flag to keep the directory open (for opening its subdirectories), otherwise it is closed.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+dir_drain(struct rfind_scan *scan, struct scan_dir *d, const struct prefetch_job *job, int keep_open)
+{
+    struct scan_name **tail = &d->names, **from, **link, *n;
+    const struct prefetch_entry *e = NULL;
+    struct dirent *file;
+    unsigned int count = 0;
+
+    assert(d == scan->dir_top);
+
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    from = tail;
+    while (job && (e = prefetch_entry_next(job, e))) {
+        link = tail;
+        if (dir_name_add(scan, d, &tail, e->name, e->len, e->ino, e->type)) {
+            return EXIT_FAILURE;
+        }
+        if (job->stats) {
+            /* stat'ed by the prefetch thread */
+            (*link)->err = job->stats[count].err;
+            (*link)->st = job->stats[count].st;
+        }
+        count++;
+    }
+    while (!job && (file = readdir(d->dir))) {
+        /* skip . and .. */
+        if (!strcmp(".", file->d_name) || !strcmp("..", file->d_name)) {
+            continue;
+        }
+
+        if (dir_name_add(scan, d, &tail, file->d_name, strlen(file->d_name), file->d_ino, file->d_type)) {
+            return EXIT_FAILURE;
+        }
+        count++;
+    }
+    d->listed = 1;
+
+    /* with --snapshot-out, --diff-against and --checkpoint, the whole listing is drained when the directory is pushed */
+    if (scan->sorted && (count > 1) && scan_names_sort(scan, from, count)) {
+        return EXIT_FAILURE;
+    }
+
+    /* with --respect-ignore, the whole listing is drained when the directory is pushed */
+    if (scan->query->options.respect_ignore && *from && scan_ignore(scan, d, from, &count)) {
+        return EXIT_FAILURE;
+    }
+    if (job && job->stats) {
+        /* only the files whose type is enough were left */
+        for (n = *from; n; n = n->next) {
+            if (n->err == -1) {
+                n->err = scan_lazy_stat(scan, n->type, n->ino, &n->st) ? 0 :
+                        scan_stat(scan, dirfd(d->dir), n->name, 0, &n->st);
+            }
+        }
+    } else if (scan_stat_names(scan, d, *from, count)) {
+        return EXIT_FAILURE;
+    }
+    if (scan->batch && scan_guard(scan, d, *from)) {
+        return EXIT_FAILURE;
+    }
+
+    if (!keep_open) {
+        closedir(d->dir);
+        d->dir = NULL;
+        scan->dir_open--;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Read the next chunk of the directory listing (and the files information) into memory (--stat-threads).
+ *
+ * A directory is read in chunks, so the files of a huge directory are stat'ed in parallel while the memory
+ * of its listing stays bounded. The previous chunk is consumed, its memory is reused for the next one.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] d Directory record, it must be the top of the stack and not drained.
+ * @return EXIT_SUCCESS, the listing stays empty at the end of the directory.
+ * @return EXIT_FAILURE
+ */
+static int
+dir_read_chunk(struct rfind_scan *scan, struct scan_dir *d)
+{
+    struct scan_name **tail = &d->names;
+    struct dirent *file;
+    unsigned int count = 0;
+
+    assert((d == scan->dir_top) && !d->listed && !d->names);
+
+    arena_release(&scan->scratch, d->chunk_mark);
+    while ((count < SCAN_CHUNK) && (file = readdir(d->dir))) {
+        /* skip . and .. */
+        if (!strcmp(".", file->d_name) || !strcmp("..", file->d_name)) {
+            continue;
+        }
+
+        if (dir_name_add(scan, d, &tail, file->d_name, strlen(file->d_name), file->d_ino, file->d_type)) {
+            return EXIT_FAILURE;
+        }
+        count++;
+    }
+
+    if (!count) {
+        return EXIT_SUCCESS;
+    } else if (scan_stat_names(scan, d, d->names, count)) {
+        return EXIT_FAILURE;
+    }
+    if (scan->batch && scan_guard(scan, d, d->names)) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Queue the directories expected to be opened next for the prefetch, up to the prefetch window.
+ *
+ * The queue keeps the order of the traversal: the subdirectories of the top directory come first,
+ * followed by the remaining subdirectories of its ancestors. The jobs pushed out of the window are
+ * dropped and their directories are queued again when there is a room for them.
+ *
+ * @param[in] scan Scan context.
+ */
+static void
+scan_prefetch_refill(struct rfind_scan *scan)
+{
+    struct prefetch *p = scan->prefetch;
+    struct prefetch_job **link, *job, *drop, *rev = NULL;
+    struct scan_dir *d;
+    struct scan_name *n;
+    unsigned int count = 0, added = 0;
+
+    pthread_mutex_lock(&p->lock);
+    link = &p->head;
+    for (d = scan->dir_top; d && (count < p->window); d = d->parent) {
+        /* the directory's jobs already in the queue */
+        for (; *link && ((*link)->level == d) && (count < p->window); link = &(*link)->next) {
+            count++;
+        }
+
+        /* the subdirectories are opened relatively to the directory, the closed one is not prefetched */
+        while (d->dir && (count < p->window) && (n = d->prefetch_next)) {
+            if (!n->err && S_ISDIR(n->st.st_mode)) {
+                job = prefetch_job_new(dirfd(d->dir), n->name, scan_open_flags(scan, 0), d, n->index);
+                if (!job) {
+                    /* out of descriptors, try it later */
+                    break;
+                }
+                job->entry = n;
+                job->stat_flags = scan->prefetch_stat;
+                job->lazy = scan->lazy;
+                job->next = *link;
+                *link = job;
+                link = &job->next;
+                count++;
+                added++;
+            }
+            d->prefetch_next = n->next;
+        }
+    }
+
+    /* drop the rest, the first dropped job of each directory is where its prefetch continues */
+    drop = *link;
+    *link = NULL;
+    while ((job = drop)) {
+        drop = job->next;
+        job->next = rev;
+        rev = job;
+    }
+    while ((job = rev)) {
+        rev = job->next;
+        ((struct scan_dir *)job->level)->prefetch_next = job->entry;
+        prefetch_job_drop(job);
+    }
+
+    if (added > 1) {
+        pthread_cond_broadcast(&p->work);
+    } else if (added) {
+        pthread_cond_signal(&p->work);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+/**
+ * @brief Let the -path patterns match the files of the top directory from its state sets.
+ *
+ * @param[in] scan Scan context.
+ */
+static void
+scan_path_bind(struct rfind_scan *scan)
+{
+    for (struct path_pattern *p = scan->query->patterns; p; p = p->next) {
+        p->base = scan->dir_top ? &scan->dir_top->path_states[p->slot] : NULL;
+    }
+}
+
+/**
+ * @brief Move the -path patterns into the current file (directory) and check if it is worth descending into.
+ *
+ * The state sets for the directory are prepared in the scan's path_next to be taken by dir_stack_push().
+ *
+ * @param[in] scan Scan context.
+ * @return non-zero if no file under the directory can match the query.
+ */
+static int
+scan_path_prune(struct rfind_scan *scan)
+{
+    struct path_pattern *p;
+    unsigned long *state;
+    const char *str = scan->entry.depth ? scan->entry.name : scan->entry.path;
+    size_t len = strlen(str);
+
+    if (!scan->query->patterns) {
+        return 0;
+    }
+
+    for (p = scan->query->patterns; p; p = p->next) {
+        state = &scan->path_next[p->slot];
+        path_pattern_step(p, p->base, str, len, state);
+        /* the path of the files in the directory, see scan_filepath() */
+        if (!len || (str[len - 1] != '/')) {
+            path_pattern_step(p, state, "/", 1, state);
+        }
+        p->subtree = path_pattern_subtree(p, state);
+    }
+
+    return query_prune(scan->query);
+}
+
+/**
+ * @brief Get the prefetched directory to be pushed into the stack.
+ *
+ * @param[in] scan Scan context, the current file is the directory to push.
+ * @return The prefetch job with the opened directory and its listing.
+ * @return NULL if the directory must be opened and read by the scan itself.
+ */
+static struct prefetch_job *
+scan_prefetch_take(struct rfind_scan *scan)
+{
+    struct prefetch_job *job;
+    struct stat st;
+
+    if (!scan->current) {
+        return NULL;
+    }
+
+    job = prefetch_take(scan->prefetch, scan->dir_top, scan->current->index);
+    if (!job) {
+        return NULL;
+    } else if (job->err || (fstat(dirfd(job->dir), &st) == -1) || (st.st_dev != scan->st.st_dev) ||
+            (st.st_ino != scan->st.st_ino)) {
+        /* failed or the directory was replaced after it was prefetched, let the scan report it */
+        prefetch_job_free(job);
+        return NULL;
+    }
+
+    /* account the prefetch's open */
+    throttle_take(&scan->iops);
+    return job;
+}
+
+/**
+ * @brief Drop the prefetch jobs of the directory being popped from the stack.
+ *
+ * @param[in] scan Scan context.
+ * @param[in] d The top directory being popped.
+ */
+static void
+scan_prefetch_pop(struct rfind_scan *scan, struct scan_dir *d)
+{
+    struct prefetch *p = scan->prefetch;
+    struct prefetch_job *job;
+
+    /* the top directory's jobs are at the queue's head */
+    pthread_mutex_lock(&p->lock);
+    while ((job = p->head) && (job->level == d)) {
+        p->head = job->next;
+        prefetch_job_drop(job);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+/**
+ * @brief Open the current file (directory) and push it into the stack.
+ *
+ * @param[in] scan Scan context.
+ * @return EXIT_SUCCESS (also when the directory is not accessible, the scan just continues)
+ * @return EXIT_FAILURE
+ */
+static int
+dir_stack_push(struct rfind_scan *scan)
+{
+    struct scan_dir *top = scan->dir_top, *d;
+    struct arena_mark mark;
+    struct prefetch_job *job = NULL;
+    int fd, pfd = AT_FDCWD, owned = 0, rc;
+    DIR *dir;
+
+    if (top && scan->prefetch) {
+        job = scan_prefetch_take(scan);
+    }
+
+    /* open the directory relatively to its parent */
+    if (job) {
+        fd = dirfd(job->dir);
+    } else {
+        if (top) {
+            pfd = scan_dir_fd(scan, top, &owned);
+        }
+        if (pfd == -1) {
+            fd = -1;
+        } else {
+            throttle_take(&scan->iops);
+            fd = openat(pfd, top ? scan->entry.name : scan->entry.path, scan_open_flags(scan, !top));
+        }
+        if (owned) {
+            close(pfd);
+        }
+        if (fd == -1) {
+            scan_error(scan, DIAG_OPEN, scan->entry.path, errno);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    if (top && top->dir && (scan->dir_open >= scan->fd_budget)) {
+        /* no more directories can be opened, the parent directory is not needed anymore */
+        if (dir_drain(scan, top, NULL, 0)) {
+            goto error;
+        }
+    }
+
+    /* insert new record (after the parent's drained listing) */
+    mark = arena_mark(&scan->scratch);
+    d = arena_calloc(&scan->scratch, sizeof *d);
+    if (!d || (top && !(d->name = arena_strndup(&scan->scratch, scan->entry.name, strlen(scan->entry.name)))) ||
+            (scan->path_next && !(d->path_states = arena_alloc(&scan->scratch,
+            scan->query->path_words * sizeof *d->path_states)))) {
+        arena_release(&scan->scratch, mark);
+        goto error;
+    }
+    d->chunk_mark = arena_mark(&scan->scratch);
+    if (job) {
+        dir = job->dir;
+        job->dir = NULL;
+    } else {
+        dir = fdopendir(fd);
+    }
+    if (!dir) {
+        scan_error(scan, DIAG_OPEN, scan->entry.path, errno);
+        arena_release(&scan->scratch, mark);
+        close(fd);
+        return EXIT_SUCCESS;
+    }
+    if (!top) {
+        d->name = scan->paths[scan->paths_next - 1];
+    }
+    d->parent = top;
+    d->mark = mark;
+    d->path_len = strlen(scan->entry.path);
+    d->dir = dir;
+    d->dev = scan->st.st_dev;
+    d->inode = scan->st.st_ino;
+    if (top) {
+        top->child = d;
+        d->ignore_up = top->ignore_up;
+    }
+    scan->dir_top = d;
+    scan->dir_stack_count++;
+    scan->dir_open++;
+    if (scan->postorder) {
+        d->st = scan->st;
+    }
+    if (scan->query->deleter && !(d->delete_dir = delete_dir_new())) {
+        return EXIT_FAILURE;
+    }
+    if (d->path_states) {
+        memcpy(d->path_states, scan->path_next, scan->query->path_words * sizeof *d->path_states);
+        scan_path_bind(scan);
+    }
+
+    if (job || scan->prefetch || scan->sorted || (scan->query->options.stat_order == FIND_STAT_ORDER_INODE) ||
+            scan->query->options.respect_ignore) {
+        /* get the whole listing to prefetch the subdirectories, to sort it by the names, to stat the files
+         * in the inode order or to apply the ignore files */
+        rc = dir_drain(scan, d, job, 1);
+        prefetch_job_free(job);
+        if (!rc && scan->prefetch) {
+            d->prefetch_next = d->names;
+            scan_prefetch_refill(scan);
+        }
+        return rc;
+    }
+
+    return EXIT_SUCCESS;
+
+error:
+    if (job) {
+        prefetch_job_free(job);
+    } else {
+        close(fd);
+    }
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Pop (throw out) the directory record from the stack.
+ *
+ * @param[in] scan Scan context.
+ */
+static void
+dir_stack_pop(struct rfind_scan *scan)
+{
+    struct scan_dir *d = scan->dir_top;
+
+    assert(d);
+
+    if (scan->prefetch) {
+        scan_prefetch_pop(scan, d);
+    }
+    if (d->dir) {
+        closedir(d->dir);
+        scan->dir_open--;
+    }
+    if (scan->delete_fd_dir == d) {
+        close(scan->delete_fd);
+        scan->delete_fd = -1;
+        scan->delete_fd_dir = NULL;
+    }
+    if (scan->query->deleter) {
+        /* the previous one was evaluated, this one is evaluated next in the post-order */
+        delete_dir_release(scan->query->deleter, scan->delete_left);
+        scan->delete_left = d->delete_dir;
+    }
+    scan->dir_top = d->parent;
+    if (scan->dir_top) {
+        scan->dir_top->child = NULL;
+    }
+    scan->dir_stack_count--;
+    arena_release(&scan->scratch, d->mark);
+    if (d->path_states) {
+        scan_path_bind(scan);
+    }
+
+    if (scan->prefetch && scan->dir_top) {
+        /* room for the parent's next subdirectories */
+        scan_prefetch_refill(scan);
+    }
+}
+
+/**
+ * @brief Pop the finished directory from the stack and make it the current file (post-order).
+ *
+ * @param[in] scan Scan context.
+ */
+static void
+dir_stack_pop_finished(struct rfind_scan *scan)
+{
+    struct scan_dir *d = scan->dir_top;
+    size_t path_len = d->path_len, name_len = d->parent ? strlen(d->name) : 0;
+
+    scan->st = d->st;
+    dir_stack_pop(scan);
+
+    /* the filepath buffer starts with the directory's path */
+    scan->filepath[path_len] = '\0';
+    scan->entry.path = scan->filepath;
+    scan->entry.name = name_len ? &scan->filepath[path_len - name_len] : basename(scan->filepath);
+    scan->entry.depth = scan->dir_stack_count;
+    scan->current = NULL;
+    scan->finished = 1;
+}
+
+/**
+ * @brief Start recording the subtree of the directory just pushed into the stack (--link-cache).
+ *
+ * @param[in] scan Scan context.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+scan_link_start(struct rfind_scan *scan)
+{
+    scan->link_record = 0;
+    if (linkcache_record_start(scan->linkcache, scan->dir_top->dev, scan->dir_top->inode)) {
+        return EXIT_FAILURE;
+    }
+    scan->link_dir = scan->dir_top;
+    scan->link_depth = scan->dir_stack_count - 1;
+    scan->link_errors = scan->errors;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Record the current file into the subtree being recorded (--link-cache).
+ *
+ * @param[in] scan Scan context.
+ */
+static void
+scan_link_add(struct rfind_scan *scan)
+{
+    size_t start = scan->link_dir->path_len;
+
+    /* the path relative to the subtree's directory, see scan_filepath() */
+    if (scan->filepath[start - 1] != '/') {
+        start++;
+    }
+    linkcache_record_add(scan->linkcache, &scan->filepath[start], scan->entry.name - &scan->filepath[start],
+            scan->entry.depth - scan->link_depth, &scan->st);
+}
+
+/**
+ * @brief Replay the cached subtree of the directory to descend into (--link-cache), or record it.
+ *
+ * The subtree is not replayed if any of its directories is an ancestor of the current directory,
+ * the traversal reports such a loop.
+ *
+ * @param[in] scan Scan context, the current file is the directory to descend into.
+ */
+static void
+scan_link_descend(struct rfind_scan *scan)
+{
+    const struct linkcache_tree *tree;
+    struct scan_dir *d;
+
+    tree = linkcache_find(scan->linkcache, scan->st.st_dev, scan->st.st_ino);
+    if (tree) {
+        for (d = scan->dir_top; d && !linkcache_tree_has_dir(tree, d->dev, d->inode); d = d->parent) {}
+        if (!d) {
+            scan->replay = tree;
+            scan->replay_entry = NULL;
+            scan->replay_len = strlen(scan->entry.path);
+            scan->replay_depth = scan->entry.depth;
+            scan->descend = 0;
+        }
+    } else if (!scan->link_dir && (scan->type == DT_LNK)) {
+        scan->link_record = 1;
+    }
+}
+
+/**
+ * @brief Provide the next file of the replayed subtree (--link-cache).
+ *
+ * @param[in] scan Scan context.
+ * @return 1 when the scan->entry is filled with the next file.
+ * @return 0 when the subtree is finished.
+ * @return -1 in case of fatal error.
+ */
+static int
+scan_replay_step(struct rfind_scan *scan)
+{
+    const struct linkcache_entry *e;
+    size_t len = scan->replay_len;
+
+    e = linkcache_entry_next(scan->replay, scan->replay_entry);
+    if (!e) {
+        scan->replay = NULL;
+        scan->replay_entry = NULL;
+        return 0;
+    }
+    scan->replay_entry = e;
+
+    /* the filepath buffer starts with the path of the subtree's directory */
+    if (scan_filepath_reserve(scan, len + 1 + e->len + 1)) {
+        return -1;
+    }
+    if (scan->filepath[len - 1] != '/') {
+        scan->filepath[len++] = '/';
+    }
+    memcpy(&scan->filepath[len], e->path, e->len + 1);
+    scan->entry.path = scan->filepath;
+    scan->entry.name = &scan->filepath[len + e->name];
+    scan->entry.depth = scan->replay_depth + e->depth;
+    scan->st = e->st;
+    scan->type = DT_UNKNOWN;
+    scan->current = NULL;
+    scan->replayed = 1;
+
+    return 1;
+}
+
+/**
+ * @brief Move to the next file in the traversal (the starting paths and files in the directories).
+ *
+ * @param[in] scan Scan context.
+ * @return 1 when the scan->entry is filled with the next file.
+ * @return 0 when there is no more file.
+ * @return -1 in case of fatal error.
+ */
+static int
+scan_step(struct rfind_scan *scan)
+{
+    struct dirent *file;
+    struct scan_name *n;
+    struct scan_dir *d;
+    const char *name;
+    size_t len;
+    unsigned int count;
+    int err, rc;
+
+    scan->guard = -1;
+    if (scan->descend) {
+        /* go into the directory returned in the previous step */
+        scan->descend = 0;
+        count = scan->dir_stack_count;
+        if (dir_stack_push(scan)) {
+            return -1;
+        } else if (scan->link_record && (scan->dir_stack_count > count) && scan_link_start(scan)) {
+            return -1;
+        } else if (scan->postorder && (scan->dir_stack_count == count)) {
+            /* not opened, there are no files to precede the directory */
+            scan->finished = 1;
+            return 1;
+        }
+        scan->link_record = 0;
+    }
+    scan->finished = 0;
+    scan->replayed = 0;
+
+    if (scan->replay) {
+        /* the files of the cached subtree instead of the directory */
+        rc = scan_replay_step(scan);
+        if (rc) {
+            return rc;
+        }
+    }
+
+    while ((d = scan->dir_top)) {
+        n = NULL;
+        file = NULL;
+        if (!d->listed && scan->chunked && !d->names && dir_read_chunk(scan, d)) {
+            return -1;
+        }
+        if (!d->listed && !scan->chunked) {
+            file = readdir(d->dir);
+            name = file ? file->d_name : NULL;
+        } else {
+            n = d->names;
+            name = n ? n->name : NULL;
+            if (n) {
+                d->names = n->next;
+                if (d->prefetch_next == n) {
+                    /* the prefetch cannot be behind the scan */
+                    d->prefetch_next = n->next;
+                }
+            }
+        }
+        scan->current = n;
+        if (!name) {
+            /* directory finished */
+            if (d == scan->link_dir) {
+                linkcache_record_finish(scan->linkcache, scan->errors == scan->link_errors);
+                scan->link_dir = NULL;
+            }
+            if (scan->postorder) {
+                dir_stack_pop_finished(scan);
+                return 1;
+            }
+            dir_stack_pop(scan);
+            continue;
+        }
+
+        /* skip . and .. */
+        if (!strcmp(".", name) || !strcmp("..", name)) {
+            continue;
+        }
+
+        if (scan_filepath(scan, name)) {
+            return -1;
+        }
+        scan->type = n ? n->type : file->d_type;
+        if (n) {
+            err = n->err;
+            scan->st = n->st;
+            scan->guard = n->guard;
+        } else if (scan_lazy_stat(scan, file->d_type, file->d_ino, &scan->st)) {
+            err = 0;
+        } else {
+            err = scan_stat(scan, dirfd(d->dir), scan->entry.name, 0, &scan->st);
+        }
+        if (err) {
+            scan_error(scan, DIAG_STAT, scan->entry.path, err);
+            continue;
+        }
+        return 1;
+    }
+
+    /* no opened directory, continue with the next starting path */
+    while (scan->paths[scan->paths_next]) {
+        name = scan->paths[scan->paths_next++];
+        scan->current = NULL;
+        len = strlen(name);
+        if (scan_filepath_reserve(scan, len + 1)) {
+            return -1;
+        }
+        memcpy(scan->filepath, name, len + 1);
+        scan->entry.path = scan->filepath;
+        scan->entry.name = basename(scan->entry.path);
+        scan->entry.depth = 0;
+        scan->entry.root_len = len;
+        scan->type = DT_UNKNOWN;
+        err = scan_stat(scan, AT_FDCWD, scan->entry.path, 1, &scan->st);
+        if (err) {
+            scan_error(scan, DIAG_STAT, scan->entry.path, err);
+            continue;
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Check if the current file (directory) is a part of the file system loop.
+ *
+ * @param[in] scan Scan context.
+ * @return non-zero if the loop is detected.
+ */
+static int
+scan_loop(struct rfind_scan *scan)
+{
+    for (struct scan_dir *d = scan->dir_top; d; d = d->parent) {
+        if (scan->st.st_ino == d->inode && scan->st.st_dev == d->dev) {
+            /* the directory's path is the prefix of the current file's path */
+            diag_loop(&scan->query->diag, scan->entry.path, d->path_len);
+            scan->errors++;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get the default fd budget, half of the open files limit.
+ *
+ * @return Maximum number of the opened directories.
+ */
+static unsigned int
+scan_default_fd_budget(void)
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1) {
+        return SCAN_FD_BUDGET_FALLBACK;
+    } else if ((limit.rlim_cur == RLIM_INFINITY) || (limit.rlim_cur / 2 > UINT_MAX)) {
+        return UINT_MAX;
+    } else if (limit.rlim_cur < 2) {
+        return 1;
+    }
+
+    return limit.rlim_cur / 2;
+}
+
+/**
+ * @brief Check if the scan's deadline elapsed.
+ *
+ * @param[in] scan Scan context.
+ * @return non-zero if the scan is supposed to stop.
+ */
+static int
+scan_deadline(struct rfind_scan *scan)
+{
+    struct timespec now;
+
+    if (!scan->deadline.tv_sec && !scan->deadline.tv_nsec) {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec > scan->deadline.tv_sec) ||
+            ((now.tv_sec == scan->deadline.tv_sec) && (now.tv_nsec >= scan->deadline.tv_nsec));
+}
+
+/**
+ * @brief Let the -delete actions delete the current file relatively to its directory.
+ *
+ * @param[in] scan Scan context.
+ */
+static void
+scan_delete_bind(struct rfind_scan *scan)
+{
+    struct scan_dir *d = scan->dir_top;
+    int fd = AT_FDCWD, owned;
+
+    if (scan->finished && scan->delete_sync) {
+        /* the directory is tested as it is after deleting its files (-empty) */
+        delete_dir_wait(scan->query->deleter, scan->delete_left);
+    }
+
+    if (d && d->dir) {
+        fd = dirfd(d->dir);
+    } else if (d) {
+        /* the drained directory is reopened once for all its files */
+        if (scan->delete_fd_dir != d) {
+            if (scan->delete_fd != -1) {
+                close(scan->delete_fd);
+            }
+            scan->delete_fd = scan_dir_fd(scan, d, &owned);
+            scan->delete_fd_dir = (scan->delete_fd == -1) ? NULL : d;
+        }
+        fd = scan->delete_fd;
+    }
+
+    delete_bind(scan->query->deleter, d ? d->delete_dir : NULL, fd, scan->finished ? scan->delete_left : NULL);
+}
+
+/**
+ * @brief Evaluate the file read for the estimate and account it in the directory.
+ *
+ * @param[in] scan Scan context with the current file.
+ * @param[in] dir Directory record of the estimate.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+scan_estimate_file(struct rfind_scan *scan, struct estimate_dir *dir)
+{
+    struct estimate *est = scan->query->estimate;
+
+    if (S_ISDIR(scan->st.st_mode) && scan->entry.depth && estimate_dir_loop(dir, scan->st.st_dev, scan->st.st_ino)) {
+        /* skipped as by the traversal */
+        return EXIT_SUCCESS;
+    }
+
+    if (rfind_query_match(scan->query, &scan->entry)) {
+        dir->count++;
+        dir->size += scan->st.st_size;
+    }
+    if (S_ISDIR(scan->st.st_mode) && estimate_dir_add(est, dir, scan->entry.depth ? scan->entry.name : scan->entry.path)) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Read the directory for the estimate, its files are evaluated.
+ *
+ * @param[in] scan Scan context, the filepath buffer holds the directory's path.
+ * @param[in] parent Parent directory's record, NULL to read the starting paths.
+ * @param[in] len Length of the directory's path.
+ * @param[in] depth Depth of the directory.
+ * @param[out] dir Record of the read directory.
+ * @return EXIT_SUCCESS, the unreadable directory has no files
+ * @return EXIT_FAILURE
+ */
+static int
+scan_estimate_read(struct rfind_scan *scan, struct estimate_dir *parent, size_t len, unsigned int depth,
+        struct estimate_dir **dir)
+{
+    struct estimate *est = scan->query->estimate;
+    struct stat st = {0};
+    struct dirent *file;
+    DIR *d;
+    size_t name_len;
+    int fd, err, slash;
+
+    if (!parent) {
+        /* the starting paths */
+        if (!(*dir = estimate_dir_new(est, NULL, 0, 0))) {
+            return EXIT_FAILURE;
+        }
+        for (unsigned int i = 0; scan->paths[i]; i++) {
+            name_len = strlen(scan->paths[i]);
+            if (scan_filepath_reserve(scan, name_len + 1)) {
+                return EXIT_FAILURE;
+            }
+            memcpy(scan->filepath, scan->paths[i], name_len + 1);
+            scan->entry.path = scan->filepath;
+            scan->entry.name = basename(scan->filepath);
+            scan->entry.depth = 0;
+            scan->entry.root_len = name_len;
+            err = scan_stat(scan, AT_FDCWD, scan->filepath, 1, &scan->st);
+            if (err) {
+                scan_error(scan, DIAG_STAT, scan->filepath, err);
+            } else if (scan_estimate_file(scan, *dir)) {
+                return EXIT_FAILURE;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
+    throttle_take(&scan->iops);
+    fd = open(scan->filepath, scan_open_flags(scan, depth == 1));
+    if ((fd != -1) && fstat(fd, &st)) {
+        close(fd);
+        fd = -1;
+    }
+    if (!(*dir = estimate_dir_new(est, parent, st.st_dev, st.st_ino))) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return EXIT_FAILURE;
+    } else if ((fd == -1) || !(d = fdopendir(fd))) {
+        scan_error(scan, DIAG_OPEN, scan->filepath, errno);
+        if (fd != -1) {
+            close(fd);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    slash = (scan->filepath[len - 1] == '/') ? 0 : 1;
+    while ((file = readdir(d))) {
+        if (!strcmp(file->d_name, ".") || !strcmp(file->d_name, "..")) {
+            continue;
+        }
+        name_len = strlen(file->d_name);
+        if (scan_filepath_reserve(scan, len + slash + name_len + 1)) {
+            closedir(d);
+            return EXIT_FAILURE;
+        }
+        if (slash) {
+            scan->filepath[len] = '/';
+        }
+        memcpy(&scan->filepath[len + slash], file->d_name, name_len + 1);
+        scan->entry.path = scan->filepath;
+        scan->entry.name = &scan->filepath[len + slash];
+        scan->entry.depth = depth;
+        err = scan_stat(scan, fd, file->d_name, 0, &scan->st);
+        if (err) {
+            scan_error(scan, DIAG_STAT, scan->filepath, err);
+        } else if (scan_estimate_file(scan, *dir)) {
+            closedir(d);
+            return EXIT_FAILURE;
+        }
+    }
+    closedir(d);
+    scan->filepath[len] = '\0';
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Do a single probe of the estimate (see struct estimate).
+ *
+ * @param[in] scan Scan context.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+scan_estimate_probe(struct rfind_scan *scan)
+{
+    struct estimate *est = scan->query->estimate;
+    struct estimate_dir *dir;
+    struct estimate_sub *sub;
+    double weight = 1, count = 0, size = 0;
+    size_t len = 0, name_len;
+    unsigned int depth = 0;
+    int slash;
+
+    if (!est->root && scan_estimate_read(scan, NULL, 0, 0, &est->root)) {
+        return EXIT_FAILURE;
+    }
+
+    for (dir = est->root; dir; dir = sub->dir) {
+        /* the directory stands for all its siblings on the way */
+        count += weight * dir->count;
+        size += weight * dir->size;
+        if (!dir->subs_count) {
+            break;
+        }
+        sub = &dir->subs[estimate_pick(est, dir)];
+        weight *= dir->subs_count;
+
+        /* path of the subdirectory, the starting path for the root's subdirectories */
+        name_len = strlen(sub->name);
+        slash = (depth && (scan->filepath[len - 1] != '/')) ? 1 : 0;
+        if (scan_filepath_reserve(scan, len + slash + name_len + 1)) {
+            return EXIT_FAILURE;
+        }
+        if (slash) {
+            scan->filepath[len] = '/';
+        }
+        memcpy(&scan->filepath[len + slash], sub->name, name_len + 1);
+        if (!depth) {
+            scan->entry.root_len = name_len;
+        }
+        len += slash + name_len;
+        depth++;
+
+        if (!sub->dir && scan_estimate_read(scan, dir, len, depth, &sub->dir)) {
+            return EXIT_FAILURE;
+        }
+    }
+    estimate_add(est, count, size);
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Start the scan's deadline (--deadline).
+ *
+ * @param[in] scan Scan context.
+ */
+static void
+scan_deadline_start(struct rfind_scan *scan)
+{
+    unsigned long long deadline = scan->query->options.deadline;
+
+    if (!deadline) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &scan->deadline);
+    scan->deadline.tv_sec += deadline / 1000000000ULL;
+    scan->deadline.tv_nsec += deadline % 1000000000ULL;
+    if (scan->deadline.tv_nsec >= 1000000000L) {
+        scan->deadline.tv_sec++;
+        scan->deadline.tv_nsec -= 1000000000L;
+    }
+}
+
+/**
+ * @brief Prepare the scan of the paths, the scan itself or one of its lanes (--device-threads).
+ *
+ * @param[in] s Allocated scan to prepare, it is freed on error.
+ * @param[in] query Compiled query to evaluate.
+ * @param[in] paths NULL-terminated list of the starting paths.
+ * @param[in] fd_budget Maximum number of the opened directories.
+ * @param[in] link_cache Size of the cached subtrees in bytes (--link-cache), 0 to disable.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+scan_init(struct rfind_scan *s, struct rfind_query *query, const char **paths, unsigned int fd_budget,
+        size_t link_cache)
+{
+    unsigned int i, window;
+
+    s->query = query;
+    s->paths = paths;
+    s->fd_budget = fd_budget;
+    s->lazy = (query->flags & RFIND_QUERY_LAZYSTAT) && (query_need(query) == EXPR_NEED_TYPE);
+    s->sorted = (query->snapshot || query->checkpoint) ? 1 : 0;
+    s->postorder = query->deleter ? 1 : 0;
+    s->delete_sync = query->deleter && (query_need(query) == EXPR_NEED_STAT);
+    s->delete_fd = -1;
+    s->prefetch_stat = -1;
+    arena_init(&s->scratch, SCAN_ARENA_BLOCK);
+    s->entry.st = &s->st;
+    scan_deadline_start(s);
+    query->quit = 0;
+    if (query->checkpoint) {
+        /* --limit counts the matches of the interrupted traversal as well */
+        s->matches = query->checkpoint->matches;
+    }
+    if (s->sorted) {
+        /* the manifest order of the starting paths */
+        for (i = 0; s->paths[i]; i++) {}
+        s->paths_sorted = malloc((i + 1) * sizeof *s->paths_sorted);
+        if (!s->paths_sorted) {
+            LOG("%s", strerror(errno));
+            arena_free(&s->scratch);
+            free(s);
+            return EXIT_FAILURE;
+        }
+        memcpy(s->paths_sorted, s->paths, (i + 1) * sizeof *s->paths_sorted);
+        qsort(s->paths_sorted, i, sizeof *s->paths_sorted, scan_path_cmp);
+        s->paths = s->paths_sorted;
+    }
+    if (query->patterns) {
+        s->path_next = malloc(query->path_words * sizeof *s->path_next);
+        if (!s->path_next) {
+            LOG("%s", strerror(errno));
+            free(s->paths_sorted);
+            arena_free(&s->scratch);
+            free(s);
+            return EXIT_FAILURE;
+        }
+        scan_path_bind(s);
+    }
+    throttle_init(&s->iops, query->options.max_iops, query->options.throttle_latency);
+    throttle_init(&s->stats, query->options.max_stat_rate, 0);
+    s->throttled = query->options.max_iops || query->options.max_stat_rate || query->options.throttle_latency;
+
+    if (query->options.stat_threads > 1) {
+        s->statpool = malloc(sizeof *s->statpool);
+        if (!s->statpool || statpool_start(s->statpool, query->options.stat_threads)) {
+            free(s->statpool);
+            free(s->path_next);
+            free(s->paths_sorted);
+            arena_free(&s->scratch);
+            free(s);
+            return EXIT_FAILURE;
+        }
+        pthread_mutex_init(&s->io_lock, NULL);
+    }
+
+    /* with --device-threads, each device's directories are prefetched by its own threads */
+    window = query->options.prefetch;
+    if (!window && query->options.device_threads) {
+        window = SCAN_DEVICE_WINDOW * query->options.device_threads;
+    }
+    if (window) {
+        s->prefetch = malloc(sizeof *s->prefetch);
+        if (!s->prefetch || prefetch_start(s->prefetch, window, query->options.device_threads)) {
+            free(s->prefetch);
+            if (s->statpool) {
+                statpool_stop(s->statpool);
+                pthread_mutex_destroy(&s->io_lock);
+                free(s->statpool);
+            }
+            free(s->path_next);
+            free(s->paths_sorted);
+            arena_free(&s->scratch);
+            free(s);
+            return EXIT_FAILURE;
+        }
+
+        /* each prefetched directory holds its descriptor and the descriptor of its parent */
+        s->fd_budget = (s->fd_budget > 2 * window) ? s->fd_budget - 2 * window : 1;
+
+        /* the prefetch threads stat the files as well, unless the stats are limited or ordered by the scan */
+        if (query->options.device_threads && !s->throttled && (query->options.stat_order != FIND_STAT_ORDER_INODE)) {
+            s->prefetch_stat = (query->options.symlinks == EXPR_FOLLOW_SYMLINKS) ? 0 : AT_SYMLINK_NOFOLLOW;
+        }
+    }
+
+    if (query->deleter) {
+        if (delete_start(query->deleter)) {
+            if (s->prefetch) {
+                prefetch_stop(s->prefetch);
+                free(s->prefetch);
+            }
+            if (s->statpool) {
+                statpool_stop(s->statpool);
+                pthread_mutex_destroy(&s->io_lock);
+                free(s->statpool);
+            }
+            free(s->path_next);
+            free(s->paths_sorted);
+            arena_free(&s->scratch);
+            free(s);
+            return EXIT_FAILURE;
+        }
+
+        /* each unfinished deletion holds the descriptor of its directory */
+        s->fd_budget = (s->fd_budget > DELETE_JOBS_MAX + 1) ? s->fd_budget - DELETE_JOBS_MAX - 1 : 1;
+    }
+
+    if (link_cache && linkcache_open(link_cache, &s->linkcache)) {
+        rfind_scan_close(s);
+        return EXIT_FAILURE;
+    }
+
+    /* the directories are read in chunks evaluated by the guard at once, the post-order evaluates the files
+     * while the deletions of the listed ones are running */
+    if (query->batch_guard && !query->deleter) {
+        s->batch = malloc(sizeof *s->batch);
+        if (!s->batch) {
+            LOG("%s", strerror(errno));
+            rfind_scan_close(s);
+            return EXIT_FAILURE;
+        }
+        s->batch->path = NULL;
+        s->batch->path_size = 0;
+    }
+    s->chunked = s->statpool || s->batch;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Split the starting paths by their devices into the lanes traversed concurrently (--device-threads).
+ *
+ * Each lane is a scan of the paths on a single device with its own prefetch threads, fd budget and I/O limits,
+ * rfind_scan_next() continues with the next lane after each file.
+ *
+ * @param[in] s Allocated scan, it is freed on error.
+ * @param[in] query Compiled query to evaluate.
+ * @param[in] paths NULL-terminated list of the starting paths.
+ * @param[in] fd_budget Maximum number of the opened directories of all the lanes.
+ * @param[in] link_cache Size of the cached subtrees of all the lanes in bytes (--link-cache), 0 to disable.
+ * @return EXIT_SUCCESS, the lanes are not created if all the paths are on the same device.
+ * @return EXIT_FAILURE
+ */
+static int
+scan_lanes_open(struct rfind_scan *s, struct rfind_query *query, const char **paths, unsigned int fd_budget,
+        size_t link_cache)
+{
+    struct stat st;
+    dev_t *devs = NULL;
+    unsigned int *lane_of = NULL, count, lanes = 0, i, j, pos = 0, start;
+
+    for (count = 0; paths[count]; count++) {}
+    devs = malloc(count * sizeof *devs);
+    lane_of = malloc(count * sizeof *lane_of);
+    if (count && (!devs || !lane_of)) {
+        LOG("%s", strerror(errno));
+        goto error;
+    }
+
+    /* the lanes in the order of their first paths */
+    for (i = 0; i < count; i++) {
+        if (find_stat(AT_FDCWD, paths[i], query->options.symlinks, 1, &st)) {
+            /* the error is reported by the lane's scan */
+            st.st_dev = 0;
+        }
+        for (j = 0; (j < lanes) && (devs[j] != st.st_dev); j++) {}
+        if (j == lanes) {
+            devs[lanes++] = st.st_dev;
+        }
+        lane_of[i] = j;
+    }
+    if (lanes < 2) {
+        free(devs);
+        free(lane_of);
+        return EXIT_SUCCESS;
+    }
+
+    s->lanes = calloc(lanes, sizeof *s->lanes);
+    s->lanes_paths = malloc((count + lanes) * sizeof *s->lanes_paths);
+    if (!s->lanes || !s->lanes_paths) {
+        LOG("%s", strerror(errno));
+        goto error;
+    }
+    for (j = 0; j < lanes; j++) {
+        start = pos;
+        for (i = 0; i < count; i++) {
+            if (lane_of[i] == j) {
+                s->lanes_paths[pos++] = paths[i];
+            }
+        }
+        s->lanes_paths[pos++] = NULL;
+
+        s->lanes[j] = calloc(1, sizeof **s->lanes);
+        if (!s->lanes[j]) {
+            LOG("%s", strerror(errno));
+            goto error;
+        } else if (scan_init(s->lanes[j], query, &s->lanes_paths[start], (fd_budget > lanes) ? fd_budget / lanes : 1,
+                link_cache / lanes)) {
+            s->lanes[j] = NULL;
+            goto error;
+        }
+        s->lanes_count++;
+    }
+    free(devs);
+    free(lane_of);
+
+    s->query = query;
+    s->paths = paths;
+    arena_init(&s->scratch, SCAN_ARENA_BLOCK);
+    s->entry.st = &s->st;
+    scan_deadline_start(s);
+    return EXIT_SUCCESS;
+
+error:
+    for (j = 0; j < s->lanes_count; j++) {
+        rfind_scan_close(s->lanes[j]);
+    }
+    free(s->lanes);
+    free(s->lanes_paths);
+    free(devs);
+    free(lane_of);
+    free(s);
+    return EXIT_FAILURE;
+}
+
+int
+rfind_scan_open(struct rfind_query *query, const char **paths, struct rfind_scan **scan)
+{
+    struct rfind_scan *s;
+    unsigned int fd_budget;
+    size_t link_cache = 0;
+
+    s = calloc(1, sizeof *s);
+    if (!s) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    paths = paths ? paths : query->paths;
+    fd_budget = query->options.fd_budget ? query->options.fd_budget : scan_default_fd_budget();
+    if (query->options.link_cache && !query->patterns) {
+        /* the -path patterns prune the subtree depending on its path */
+        link_cache = (size_t)query->options.link_cache * 1024 * 1024;
+    }
+
+    if (query->options.device_threads) {
+        if (scan_lanes_open(s, query, paths, fd_budget, link_cache)) {
+            return EXIT_FAILURE;
+        } else if (s->lanes) {
+            *scan = s;
+            return EXIT_SUCCESS;
+        }
+    }
+    if (scan_init(s, query, paths, fd_budget, link_cache)) {
+        return EXIT_FAILURE;
+    }
+
+    *scan = s;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Move to the next file in the traversal and evaluate it.
+ *
+ * @param[in] scan Scan context.
+ * @param[out] entry Set to the file if it matches the query's expression.
+ * @return 1 when the file was evaluated.
+ * @return 2 when no file was evaluated in the step (e.g. the directory is evaluated after its files).
+ * @return 0 when there is no more file.
+ * @return -1 in case of fatal error.
+ */
+static int
+scan_next_file(struct rfind_scan *scan, const struct rfind_entry **entry)
+{
+    int rc;
+
+    rc = scan_step(scan);
+    if (rc < 1) {
+        return rc;
+    }
+
+    if (scan->link_dir) {
+        scan_link_add(scan);
+    }
+    if (scan->replayed) {
+        /* the files of the replayed subtree's directories are replayed as well */
+        scan->descend = 0;
+    } else if (!scan->finished) {
+        if (scan->entry.depth && S_ISDIR(scan->st.st_mode) && scan_loop(scan)) {
+            return 2;
+        }
+        /* the subtree where no -path pattern can make the query match is not opened at all */
+        scan->descend = S_ISDIR(scan->st.st_mode) && !scan_path_prune(scan);
+        if (scan->descend && scan->linkcache) {
+            scan_link_descend(scan);
+        }
+        if (scan->descend && scan->postorder) {
+            /* the directory is evaluated after its files */
+            return 2;
+        }
+    }
+    if (scan->query->checkpoint && checkpoint_skip(scan->query->checkpoint, scan->entry.path, &scan->descend)) {
+        /* evaluated by the resumed traversal */
+        return 2;
+    }
+    if (scan->query->deleter) {
+        scan_delete_bind(scan);
+    }
+
+    /* apply expressions on the file, the guard may be already evaluated on the directory's listing */
+    if (query_match_guarded(scan->query, &scan->entry, scan->guard)) {
+        *entry = &scan->entry;
+        if (scan->query->snapshot && snapshot_add(scan->query->snapshot, *entry)) {
+            *entry = NULL;
+            return -1;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Move to the next file of the lanes (--device-threads) and evaluate it, see scan_next_file().
+ *
+ * The lanes take turns after each step, so the prefetch threads of all the devices work while the files
+ * of one of them are evaluated. The finished lane is closed right away to release its threads.
+ *
+ * @param[in] scan Scan context with the lanes.
+ * @param[out] entry Set to the file if it matches the query's expression.
+ * @return The result of the lane's scan_next_file(), 0 when all the lanes are finished.
+ */
+static int
+scan_lanes_next(struct rfind_scan *scan, const struct rfind_entry **entry)
+{
+    struct rfind_scan *lane;
+    int rc;
+
+    while (scan->lanes_count) {
+        lane = scan->lanes[scan->lane];
+        if (scan->query->patterns) {
+            /* the patterns' states are carried by the lane's directory stack */
+            scan_path_bind(lane);
+        }
+        rc = scan_next_file(lane, entry);
+        if (rc) {
+            scan->lane = (scan->lane + 1) % scan->lanes_count;
+            return rc;
+        }
+
+        rfind_scan_close(lane);
+        scan->lanes_count--;
+        memmove(&scan->lanes[scan->lane], &scan->lanes[scan->lane + 1],
+                (scan->lanes_count - scan->lane) * sizeof *scan->lanes);
+        if (scan->lane == scan->lanes_count) {
+            scan->lane = 0;
+        }
+    }
+
+    return 0;
+}
+
+int
+rfind_scan_next(struct rfind_scan *scan, const struct rfind_entry **entry)
+{
+    int rc;
+
+    *entry = NULL;
+    if (scan->status == RFIND_SCAN_FAILED) {
+        return EXIT_FAILURE;
+    }
+
+    while (!scan->status) {
+        if (__atomic_load_n(&scan->cancelled, __ATOMIC_RELAXED)) {
+            scan->status = RFIND_SCAN_CANCELLED;
+            break;
+        } else if (scan_deadline(scan)) {
+            scan->status = RFIND_SCAN_DEADLINE;
+            break;
+        }
+
+        if (scan->query->estimate) {
+            /* no file is provided, the estimate is printed by rfind_query_report() */
+            if (scan_estimate_probe(scan)) {
+                goto failed;
+            } else if (scan->query->estimate->probes == scan->query->estimate->probes_max) {
+                scan->status = RFIND_SCAN_COMPLETE;
+            }
+            continue;
+        }
+
+        rc = scan->lanes ? scan_lanes_next(scan, entry) : scan_next_file(scan, entry);
+        if (rc == -1) {
+            goto failed;
+        } else if (!rc) {
+            /* done, the rest of the previous manifest was removed */
+            scan->status = RFIND_SCAN_COMPLETE;
+            if (scan->query->snapshot && snapshot_finish(scan->query->snapshot)) {
+                goto failed;
+            }
+            break;
+        } else if (rc == 2) {
+            continue;
+        }
+
+        /* the scan stopped by the file still provides it */
+        if (scan->query->quit) {
+            scan->status = RFIND_SCAN_QUIT;
+        } else if (*entry && scan->query->options.limit && (++scan->matches == scan->query->options.limit)) {
+            scan->status = RFIND_SCAN_LIMIT;
+        }
+        if (scan->query->checkpoint && checkpoint_tick(scan->query->checkpoint, scan->entry.path, scan->matches)) {
+            *entry = NULL;
+            goto failed;
+        }
+        if (*entry) {
+            return EXIT_SUCCESS;
+        }
+    }
+
+    return EXIT_SUCCESS;
+
+failed:
+    scan->status = RFIND_SCAN_FAILED;
+    if (scan->query->snapshot) {
+        scan->query->snapshot->failed = 1;
+    }
+    return EXIT_FAILURE;
+}
+
+enum rfind_scan_status
+rfind_scan_status(const struct rfind_scan *scan)
+{
+    return scan->status;
+}
+
+void
+rfind_scan_cancel(struct rfind_scan *scan)
+{
+    __atomic_store_n(&scan->cancelled, 1, __ATOMIC_RELAXED);
+}
+
+int
+rfind_scan_close(struct rfind_scan *scan)
+{
+    int ret;
+
+    if (!scan) {
+        return EXIT_SUCCESS;
+    }
+
+    for (unsigned int i = 0; i < scan->lanes_count; i++) {
+        rfind_scan_close(scan->lanes[i]);
+    }
+    free(scan->lanes);
+    free(scan->lanes_paths);
+    if (scan->prefetch) {
+        prefetch_stop(scan->prefetch);
+        free(scan->prefetch);
+        scan->prefetch = NULL;
+    }
+    if (scan->statpool) {
+        statpool_stop(scan->statpool);
+        pthread_mutex_destroy(&scan->io_lock);
+        free(scan->statpool);
+        scan->statpool = NULL;
+    }
+    while (scan->dir_top) {
+        dir_stack_pop(scan);
+    }
+    ret = (scan->status == RFIND_SCAN_FAILED) ? EXIT_FAILURE : EXIT_SUCCESS;
+    if (scan->query->checkpoint) {
+        switch (scan->status) {
+        case RFIND_SCAN_COMPLETE:
+        case RFIND_SCAN_QUIT:
+        case RFIND_SCAN_LIMIT:
+            checkpoint_finish(scan->query->checkpoint);
+            break;
+        case RFIND_SCAN_FAILED:
+            /* the last checkpoint is kept */
+            break;
+        default:
+            /* stopped before the end, the traversal is resumed after the last file */
+            if (checkpoint_save(scan->query->checkpoint, scan->entry.path ? scan->entry.path : "", scan->matches)) {
+                ret = EXIT_FAILURE;
+            }
+            break;
+        }
+    }
+    if (scan->query->deleter) {
+        /* all the queued deletions are finished */
+        delete_dir_release(scan->query->deleter, scan->delete_left);
+        if (delete_stop(scan->query->deleter)) {
+            ret = EXIT_FAILURE;
+        }
+    }
+    linkcache_free(scan->linkcache);
+    if (scan->batch) {
+        free(scan->batch->path);
+    }
+    free(scan->batch);
+    arena_free(&scan->scratch);
+    free(scan->path_next);
+    free(scan->paths_sorted);
+    free(scan->filepath);
+    free(scan);
+
+    return ret;
+}
@@ -0,0 +1,199 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "shard.h"
+
+#include "cmdline.h"
+#include "common.h"
+#include "record.h"
+
+int
+shard_pattern_check(const char *pattern)
+{
+    unsigned int count = 0;
+
+    for (const char *s = pattern; (s = strchr(s, '%')); s += 2) {
+        if (s[1] == 'd') {
+            count++;
+        } else if (s[1] != '%') {
+            LOG("--shard-output pattern \"%s\" contains invalid %% sequence (only %%d and %%%% are allowed).", pattern);
+            return EXIT_FAILURE;
+        }
+    }
+    if (count != 1) {
+        LOG("--shard-output pattern \"%s\" must contain exactly one %%d.", pattern);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Get the path of the shard's file.
+ *
+ * @param[in] pattern Path pattern with the single %d placeholder and %% for the % character.
+ * @param[in] index Number of the shard.
+ * @return The path to be freed by the caller, NULL on error.
+ */
+static char *
+shards_path(const char *pattern, unsigned int index)
+{
+    char num[16], *path, *p;
+    size_t num_len;
+    const char *s;
+
+    num_len = sprintf(num, "%u", index);
+    path = malloc(strlen(pattern) + num_len + 1);
+    if (!path) {
+        LOG("%s", strerror(errno));
+        return NULL;
+    }
+    for (s = pattern, p = path; *s; ) {
+        if ((s[0] == '%') && (s[1] == 'd')) {
+            memcpy(p, num, num_len);
+            p += num_len;
+            s += 2;
+        } else if ((s[0] == '%') && (s[1] == '%')) {
+            *p++ = '%';
+            s += 2;
+        } else {
+            *p++ = *s++;
+        }
+    }
+    *p = '\0';
+
+    return path;
+}
+
+int
+shards_open(unsigned int count, const char *pattern, int key, const struct record_output *output,
+        struct shards **shards)
+{
+    struct shards *s;
+
+    s = calloc(1, sizeof *s);
+    if (!s) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    *shards = s;
+    s->key = key;
+    s->streams = calloc(count, sizeof *s->streams);
+    s->paths = calloc(count, sizeof *s->paths);
+    s->outputs = calloc(count, sizeof *s->outputs);
+    if (!s->streams || !s->paths || !s->outputs) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    for (; s->count < count; s->count++) {
+        s->paths[s->count] = shards_path(pattern, s->count);
+        if (!s->paths[s->count]) {
+            return EXIT_FAILURE;
+        }
+        /* a FIFO blocks until its consumer opens it */
+        s->streams[s->count] = fopen(s->paths[s->count], "w");
+        if (!s->streams[s->count]) {
+            LOG("unable to open shard %s (%s).", s->paths[s->count], strerror(errno));
+            free(s->paths[s->count]);
+            s->paths[s->count] = NULL;
+            return EXIT_FAILURE;
+        }
+        setvbuf(s->streams[s->count], NULL, _IOFBF, SHARD_BUFSIZE);
+        if (output) {
+            s->outputs[s->count].format = output->format;
+            s->outputs[s->count].fields = output->fields;
+            s->outputs[s->count].stream = s->streams[s->count];
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Hash the string (FNV-1a).
+ *
+ * @param[in] str String to hash.
+ * @param[in] len Length of the @p str.
+ * @return The hash.
+ */
+static uint64_t
+shards_hash(const char *str, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)str[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+unsigned int
+shards_pick(const struct shards *shards, const struct rfind_entry *file)
+{
+    uint64_t h;
+
+    switch (shards->key) {
+    case FIND_SHARD_KEY_PATH:
+        h = shards_hash(file->path, strlen(file->path));
+        break;
+    case FIND_SHARD_KEY_DIR:
+        /* the starting paths are in their own directory */
+        h = file->depth ? shards_hash(file->path, file->name - file->path) : shards_hash(file->path, strlen(file->path));
+        break;
+    case FIND_SHARD_KEY_INODE:
+        h = (uint64_t)file->st->st_ino * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 32;
+        break;
+    default:
+        return shards->next;
+    }
+
+    return h % shards->count;
+}
+
+void
+shards_matched(struct shards *shards)
+{
+    if ((shards->key == FIND_SHARD_KEY_ROUNDROBIN) && (++shards->next == shards->count)) {
+        shards->next = 0;
+    }
+}
+
+int
+shards_close(struct shards *shards)
+{
+    int ret = EXIT_SUCCESS;
+
+    if (!shards) {
+        return EXIT_SUCCESS;
+    }
+
+    for (unsigned int i = 0; i < shards->count; i++) {
+        /* the binary stream is valid even without any record */
+        record_header(&shards->outputs[i]);
+        if (ferror(shards->streams[i]) | fclose(shards->streams[i])) {
+            LOG("unable to write shard %s (%s).", shards->paths[i], strerror(errno));
+            ret = EXIT_FAILURE;
+        }
+        free(shards->paths[i]);
+    }
+    free(shards->streams);
+    free(shards->paths);
+    free(shards->outputs);
+    free(shards);
+
+    return ret;
+}
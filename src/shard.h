@@ -0,0 +1,86 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _SHARD_H
+#define _SHARD_H
+
+#include <stdio.h>
+
+#include "record.h"
+#include "rfind.h"
+
+/** @brief Size of the output buffer of each shard */
+#define SHARD_BUFSIZE (64 * 1024)
+
+/**
+ * @brief Outputs of the actions distributed into several files (--shard).
+ *
+ * The query binds its actions to the shard picked for each file, so the actions write the file's output
+ * (text or records) into the shard's own buffered stream. The shards are complete streams, the binary header
+ * is written into each of them.
+ */
+struct shards {
+    unsigned int count;           /**< number of the shards */
+    int key;                      /**< distribution of the files, one of the FIND_SHARD_KEY_* values */
+    unsigned int current;         /**< shard the actions are bound to */
+    unsigned int next;            /**< next shard of the round-robin distribution */
+    FILE **streams;               /**< the shards' streams */
+    char **paths;                 /**< the shards' file paths */
+    struct record_output *outputs; /**< the shards' records output state (--output other than text) */
+};
+
+/**
+ * @brief Check the path pattern of the shards' files (--shard-output).
+ *
+ * The pattern must contain exactly one %d (the shard's number), the % character is written as %%.
+ *
+ * @param[in] pattern Path pattern to check.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int shard_pattern_check(const char *pattern);
+
+/**
+ * @brief Open the shards' files.
+ *
+ * @param[in] count Number of the shards.
+ * @param[in] pattern Path pattern of the shards' files checked by shard_pattern_check(), %d is replaced by the
+ * shard's number (from 0) and %% by %.
+ * @param[in] key Distribution of the files, one of the FIND_SHARD_KEY_* values.
+ * @param[in] output Records output of the query used as the template of the shards' outputs, NULL for the text output.
+ * @param[out] shards Created shards to be closed by shards_close() (even on error).
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int shards_open(unsigned int count, const char *pattern, int key, const struct record_output *output,
+        struct shards **shards);
+
+/**
+ * @brief Pick the shard of the file.
+ *
+ * @param[in] shards The shards.
+ * @param[in] file The file to be evaluated.
+ * @return Index of the shard.
+ */
+unsigned int shards_pick(const struct shards *shards, const struct rfind_entry *file);
+
+/**
+ * @brief Move the round-robin distribution after the matching file.
+ *
+ * @param[in] shards The shards.
+ */
+void shards_matched(struct shards *shards);
+
+/**
+ * @brief Flush and close the shards' files.
+ *
+ * @param[in] shards Shards to close, NULL is accepted.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE if any of the files was not written completely.
+ */
+int shards_close(struct shards *shards);
+
+#endif /* _SHARD_H */
@@ -0,0 +1,252 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _POSIX_C_SOURCE 200809L /* struct stat's st_mtim */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+#include "cmdline.h"
+#include "common.h"
+#include "record.h"
+#include "rfind_record.h"
+#include "writer.h"
+
+int
+snapshot_path_cmp(const char *p1, const char *p2)
+{
+    int c1, c2;
+
+    for (; *p1 && (*p1 == *p2); p1++, p2++) {}
+
+    /* the end of the string first, then the slash and all the other characters */
+    c1 = (*p1 == '/') ? 1 : (*p1 ? (unsigned char)*p1 + 1 : 0);
+    c2 = (*p2 == '/') ? 1 : (*p2 ? (unsigned char)*p2 + 1 : 0);
+    return c1 - c2;
+}
+
+/**
+ * @brief Print the line of the diff output.
+ *
+ * @param[in] snapshot Snapshot context.
+ * @param[in] status Status of the file: A (added), D (removed) or M (changed).
+ * @param[in] path Path of the file.
+ */
+static void
+snapshot_print(struct snapshot *snapshot, char status, const char *path)
+{
+    struct writer out;
+
+    writer_init(&out, snapshot->stream);
+    writer_putc(&out, status);
+    writer_putc(&out, '\t');
+    writer_put(&out, path, strlen(path));
+    writer_putc(&out, '\n');
+    writer_flush(&out);
+}
+
+/**
+ * @brief Move to the next record of the previous manifest.
+ *
+ * @param[in] snapshot Snapshot context.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+snapshot_next(struct snapshot *snapshot)
+{
+    size_t len;
+    void *x;
+
+    if (snapshot->old) {
+        /* remember the merged path to check the order of the next one */
+        len = snapshot->old->path_len;
+        if (len + 1 > snapshot->prev_size) {
+            x = realloc(snapshot->prev, len + 1);
+            if (!x) {
+                LOG("%s", strerror(errno));
+                return EXIT_FAILURE;
+            }
+            snapshot->prev = x;
+            snapshot->prev_size = len + 1;
+        }
+        memcpy(snapshot->prev, snapshot->old->path, len + 1);
+    }
+
+    if (rfind_reader_next(snapshot->reader, &snapshot->old)) {
+        LOG("unable to read manifest %s.", snapshot->in_path);
+        return EXIT_FAILURE;
+    } else if (snapshot->old && snapshot->prev && (snapshot_path_cmp(snapshot->prev, snapshot->old->path) >= 0)) {
+        LOG("manifest %s is not sorted (%s after %s).", snapshot->in_path, snapshot->old->path, snapshot->prev);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int
+snapshot_open(const char *out_path, const char *in_path, FILE *stream, struct snapshot **snapshot)
+{
+    struct snapshot *s;
+    int fd;
+
+    s = calloc(1, sizeof *s);
+    if (!s) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    *snapshot = s;
+    s->stream = stream;
+
+    if (in_path) {
+        s->in_path = in_path;
+        s->in = fopen(in_path, "r");
+        if (!s->in) {
+            LOG("unable to open manifest %s (%s).", in_path, strerror(errno));
+            return EXIT_FAILURE;
+        } else if (rfind_reader_open(s->in, &s->reader)) {
+            LOG("invalid manifest %s.", in_path);
+            return EXIT_FAILURE;
+        }
+        s->fields = rfind_reader_fields(s->reader) & SNAPSHOT_FIELDS;
+        if (snapshot_next(s)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (out_path) {
+        s->out_path = out_path;
+        s->out_tmp = malloc(strlen(out_path) + 24);
+        if (!s->out_tmp) {
+            LOG("%s", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        sprintf(s->out_tmp, "%s.%ld.tmp", out_path, (long)getpid());
+        fd = open(s->out_tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if ((fd == -1) || !(s->out = fdopen(fd, "w"))) {
+            LOG("unable to create manifest %s (%s).", out_path, strerror(errno));
+            if (fd != -1) {
+                close(fd);
+                unlink(s->out_tmp);
+            }
+            free(s->out_tmp);
+            s->out_tmp = NULL;
+            return EXIT_FAILURE;
+        }
+        s->output.format = FIND_OUTPUT_BINARY;
+        s->output.fields = SNAPSHOT_FIELDS;
+        s->output.stream = s->out;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Check if the file differs from its record in the previous manifest.
+ *
+ * @param[in] snapshot Snapshot context.
+ * @param[in] st Information about the file.
+ * @return non-zero if any of the compared fields differs.
+ */
+static int
+snapshot_changed(const struct snapshot *snapshot, const struct stat *st)
+{
+    const struct rfind_record *old = snapshot->old;
+
+    return ((snapshot->fields & RFIND_FIELD_MODE) && (old->mode != (uint32_t)st->st_mode)) ||
+            ((snapshot->fields & RFIND_FIELD_SIZE) && (old->size != (uint64_t)st->st_size)) ||
+            ((snapshot->fields & RFIND_FIELD_MTIME) && ((old->mtime != (int64_t)st->st_mtim.tv_sec) ||
+            (old->mtime_nsec != (uint32_t)st->st_mtim.tv_nsec))) ||
+            ((snapshot->fields & RFIND_FIELD_INO) && (old->ino != (uint64_t)st->st_ino));
+}
+
+int
+snapshot_add(struct snapshot *snapshot, const struct rfind_entry *file)
+{
+    int cmp = 1;
+
+    if (snapshot->out) {
+        record_print(&snapshot->output, file);
+    }
+    if (!snapshot->reader) {
+        return EXIT_SUCCESS;
+    }
+
+    /* the files of the previous manifest not found in the traversal */
+    while (snapshot->old && ((cmp = snapshot_path_cmp(snapshot->old->path, file->path)) < 0)) {
+        snapshot_print(snapshot, 'D', snapshot->old->path);
+        if (snapshot_next(snapshot)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (snapshot->old && !cmp) {
+        if (snapshot_changed(snapshot, file->st)) {
+            snapshot_print(snapshot, 'M', file->path);
+        }
+        return snapshot_next(snapshot);
+    }
+
+    snapshot_print(snapshot, 'A', file->path);
+    return EXIT_SUCCESS;
+}
+
+int
+snapshot_finish(struct snapshot *snapshot)
+{
+    if (!snapshot->reader) {
+        return EXIT_SUCCESS;
+    }
+
+    while (snapshot->old) {
+        snapshot_print(snapshot, 'D', snapshot->old->path);
+        if (snapshot_next(snapshot)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int
+snapshot_close(struct snapshot *snapshot)
+{
+    int ret = EXIT_SUCCESS;
+
+    if (!snapshot) {
+        return EXIT_SUCCESS;
+    }
+
+    if (snapshot->out) {
+        /* the header makes even the empty manifest valid */
+        record_header(&snapshot->output);
+        if (ferror(snapshot->out) | fclose(snapshot->out)) {
+            LOG("unable to write manifest %s (%s).", snapshot->out_path, strerror(errno));
+            ret = EXIT_FAILURE;
+        } else if (!snapshot->failed && (rename(snapshot->out_tmp, snapshot->out_path) == -1)) {
+            LOG("unable to write manifest %s (%s).", snapshot->out_path, strerror(errno));
+            ret = EXIT_FAILURE;
+        }
+        if (ret || snapshot->failed) {
+            unlink(snapshot->out_tmp);
+        }
+    }
+    free(snapshot->out_tmp);
+    rfind_reader_close(snapshot->reader);
+    if (snapshot->in) {
+        fclose(snapshot->in);
+    }
+    free(snapshot->prev);
+    free(snapshot);
+
+    return ret;
+}
@@ -0,0 +1,103 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <stdio.h>
+
+#include "record.h"
+#include "rfind.h"
+#include "rfind_record.h"
+
+/**
+ * @brief Fields of the manifest records, compared by the diff
+ */
+#define SNAPSHOT_FIELDS (RFIND_FIELD_MODE | RFIND_FIELD_SIZE | RFIND_FIELD_MTIME | RFIND_FIELD_INO)
+
+/**
+ * @brief Manifest of the traversed files (--snapshot-out) and its diff against a previous manifest (--diff-against).
+ *
+ * The manifest is the binary records stream (rfind_record.h) in the order of the traversal with the directories
+ * listed by names (see snapshot_path_cmp()). The live files come in the same order, so they are merged with the
+ * previous manifest in a single pass, holding only the current record of the manifest. The new manifest is written
+ * into a temporary file replacing the manifest at the end, so it can be the previous manifest as well.
+ */
+struct snapshot {
+    const char *out_path;         /**< path of the written manifest, NULL if not written */
+    char *out_tmp;                /**< path of the temporary file renamed to out_path when the manifest is complete */
+    FILE *out;                    /**< stream of the written manifest */
+    int failed;                   /**< flag the traversal failed, the written manifest is discarded */
+    struct record_output output;  /**< records output of the written manifest */
+
+    const char *in_path;          /**< path of the previous manifest, NULL if not compared */
+    FILE *in;                     /**< stream of the previous manifest */
+    struct rfind_reader *reader;  /**< reader of the previous manifest */
+    unsigned int fields;          /**< fields of the previous manifest compared with the live files */
+    const struct rfind_record *old; /**< the first record of the previous manifest not merged yet, NULL at the end */
+    char *prev;                   /**< path of the preceding record of the previous manifest, to check the order */
+    size_t prev_size;             /**< allocated size of the prev buffer */
+    FILE *stream;                 /**< stream of the diff output */
+};
+
+/**
+ * @brief Compare the paths in the order of the manifest.
+ *
+ * The paths are compared as strings with the slash lower than any other character, so a directory's subtree
+ * precedes its siblings as in the traversal of the directories listed by names (e.g. a, a/b, a.txt).
+ *
+ * @param[in] p1 First path.
+ * @param[in] p2 Second path.
+ * @return Negative, zero or positive value as strcmp().
+ */
+int snapshot_path_cmp(const char *p1, const char *p2);
+
+/**
+ * @brief Open the written manifest and the previous manifest.
+ *
+ * @param[in] out_path Path of the manifest to write, NULL to not write it.
+ * @param[in] in_path Path of the previous manifest to compare the files with, NULL to not compare.
+ * @param[in] stream Stream of the diff output.
+ * @param[out] snapshot Opened snapshot, to be closed by snapshot_close().
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int snapshot_open(const char *out_path, const char *in_path, FILE *stream, struct snapshot **snapshot);
+
+/**
+ * @brief Write the file into the manifest and merge it with the previous manifest.
+ *
+ * The files of the previous manifest preceding the @p file are printed as removed, the @p file
+ * itself as added or changed (if its mode, size, mtime or inode differs).
+ *
+ * @param[in] snapshot Snapshot context.
+ * @param[in] file The traversed file, in the order of snapshot_path_cmp().
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int snapshot_add(struct snapshot *snapshot, const struct rfind_entry *file);
+
+/**
+ * @brief Print the rest of the previous manifest as removed, the traversal is complete.
+ *
+ * @param[in] snapshot Snapshot context.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int snapshot_finish(struct snapshot *snapshot);
+
+/**
+ * @brief Finish the written manifest and close the manifests.
+ *
+ * The written manifest replaces the file at its path unless the traversal failed.
+ *
+ * @param[in] snapshot Snapshot context to free, NULL is accepted.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE if the manifest was not written completely.
+ */
+int snapshot_close(struct snapshot *snapshot);
+
+#endif /* _SNAPSHOT_H */
@@ -0,0 +1,139 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _POSIX_C_SOURCE 200809L /* pthread_sigmask() */
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "statpool.h"
+
+#include "common.h"
+
+/**
+ * @brief Process the slices of the current batch until no item is left to claim.
+ *
+ * @param[in] p The pool, the lock is held.
+ */
+static void
+statpool_process(struct statpool *p)
+{
+    unsigned int from, to;
+
+    while (p->next < p->count) {
+        from = p->next;
+        to = (p->count - from > STATPOOL_SLICE) ? from + STATPOOL_SLICE : p->count;
+        p->next = to;
+
+        pthread_mutex_unlock(&p->lock);
+        for (unsigned int i = from; i < to; i++) {
+            p->clb(p->data, i);
+        }
+        pthread_mutex_lock(&p->lock);
+
+        p->finished += to - from;
+        if (p->finished == p->count) {
+            pthread_cond_signal(&p->done);
+        }
+    }
+}
+
+/**
+ * @brief Worker thread: help with the current batch.
+ *
+ * @param[in] arg The pool.
+ * @return NULL
+ */
+static void *
+statpool_worker(void *arg)
+{
+    struct statpool *p = arg;
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop) {
+        if (p->next < p->count) {
+            statpool_process(p);
+        } else {
+            pthread_cond_wait(&p->work, &p->lock);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+int
+statpool_start(struct statpool *p, unsigned int threads)
+{
+    sigset_t set, orig;
+    unsigned int count;
+
+    memset(p, 0, sizeof *p);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+
+    /* the signals are delivered to the application's threads */
+    count = ((threads < STATPOOL_THREADS_MAX) ? threads : STATPOOL_THREADS_MAX) - 1;
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &orig);
+    for (; p->threads_count < count; p->threads_count++) {
+        if (pthread_create(&p->threads[p->threads_count], NULL, statpool_worker, p)) {
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &orig, NULL);
+
+    if (!p->threads_count) {
+        LOG("unable to start the stat threads.");
+        statpool_stop(p);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void
+statpool_stop(struct statpool *p)
+{
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    for (unsigned int i = 0; i < p->threads_count; i++) {
+        pthread_join(p->threads[i], NULL);
+    }
+    p->threads_count = 0;
+
+    pthread_cond_destroy(&p->done);
+    pthread_cond_destroy(&p->work);
+    pthread_mutex_destroy(&p->lock);
+}
+
+void
+statpool_run(struct statpool *p, unsigned int count, statpool_clb clb, void *data)
+{
+    pthread_mutex_lock(&p->lock);
+    p->clb = clb;
+    p->data = data;
+    p->count = count;
+    p->next = 0;
+    p->finished = 0;
+    if (count > STATPOOL_SLICE) {
+        pthread_cond_broadcast(&p->work);
+    }
+
+    statpool_process(p);
+    while (p->finished < p->count) {
+        pthread_cond_wait(&p->done, &p->lock);
+    }
+
+    /* the workers cannot claim anything until the next batch */
+    p->count = 0;
+    p->next = 0;
+    pthread_mutex_unlock(&p->lock);
+}
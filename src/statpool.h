@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _STATPOOL_H
+#define _STATPOOL_H
+
+#include <pthread.h>
+
+/** @brief Maximum number of the threads getting the files information, including the caller */
+#define STATPOOL_THREADS_MAX 64
+
+/** @brief Number of the items claimed by a thread at once */
+#define STATPOOL_SLICE 16
+
+/**
+ * @brief Callback processing a single item of the batch.
+ *
+ * @param[in] data Batch's data given to statpool_run().
+ * @param[in] index Index of the item in the batch.
+ */
+typedef void (*statpool_clb)(void *data, unsigned int index);
+
+/**
+ * @brief Pool of the threads processing the items of a batch (the stats of a directory's listing) in parallel.
+ *
+ * The batch is run by its owner, which takes part in the processing and returns when all the items
+ * are finished, so there is at most one batch at a time. The threads claim the items in slices
+ * of STATPOOL_SLICE items, so the lock is taken once per slice.
+ */
+struct statpool {
+    pthread_mutex_t lock;         /**< lock of the batch */
+    pthread_cond_t work;          /**< signal for the workers that a batch was started */
+    pthread_cond_t done;          /**< signal for the owner that the batch was finished */
+    statpool_clb clb;             /**< callback of the current batch */
+    void *data;                   /**< data of the current batch */
+    unsigned int count;           /**< number of the items of the current batch */
+    unsigned int next;            /**< the first item not claimed yet */
+    unsigned int finished;        /**< number of the processed items */
+    int stop;                     /**< flag for the workers to terminate */
+
+    unsigned int threads_count;   /**< number of the running workers */
+    pthread_t threads[STATPOOL_THREADS_MAX - 1]; /**< the workers */
+};
+
+/**
+ * @brief Start the worker threads.
+ *
+ * @param[out] p Pool to initiate.
+ * @param[in] threads Number of the threads processing the batches including the caller, at least 2.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int statpool_start(struct statpool *p, unsigned int threads);
+
+/**
+ * @brief Stop the worker threads and free the pool's resources.
+ *
+ * @param[in] p Pool to stop, no batch is running.
+ */
+void statpool_stop(struct statpool *p);
+
+/**
+ * @brief Process all the items of the batch by the worker threads and the caller.
+ *
+ * @param[in] p The pool.
+ * @param[in] count Number of the items.
+ * @param[in] clb Callback called for each item, the items are processed in any order and the callback
+ * must not touch any data shared by the items.
+ * @param[in] data Data passed to the @p clb.
+ */
+void statpool_run(struct statpool *p, unsigned int count, statpool_clb clb, void *data);
+
+#endif /* _STATPOOL_H */
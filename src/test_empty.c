@@ -6,6 +6,7 @@
 
 #define _GNU_SOURCE /* S_IFDIR */
 #include <dirent.h>
+#include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -16,7 +17,8 @@
 #include "common.h"
 
 enum expr_result
-expr_test_empty_clb(const char *path, const char *UNUSED(name), const struct stat *st, const char *UNUSED(arg))
+expr_test_empty_clb(const char *path, const char *UNUSED(name), const struct stat *st, const char *UNUSED(arg),
+        void *UNUSED(data))
 {
     if (st->st_mode & S_IFDIR) {
         DIR *dir;
@@ -44,3 +46,24 @@ expr_test_empty_clb(const char *path, const char *UNUSED(name), const struct sta
 
     return EXPR_TRUE;
 }
+
+void
+expr_test_empty_batch(const struct expr_batch *batch, const char *UNUSED(arg), void *UNUSED(data), uint64_t *sel)
+{
+    uint64_t word;
+    unsigned int i;
+
+    for (unsigned int w = 0; w < EXPR_BATCH_WORDS; w++) {
+        for (word = sel[w]; word; word &= word - 1) {
+            i = w * 64 + __builtin_ctzll(word);
+            if (batch->modes[i] & S_IFDIR) {
+                /* only the directories are read */
+                if (!expr_test_empty_clb(expr_batch_path(batch, i), batch->names[i], batch->st[i], NULL, NULL)) {
+                    EXPR_BATCH_CLR(sel, i);
+                }
+            } else if (batch->sizes[i]) {
+                EXPR_BATCH_CLR(sel, i);
+            }
+        }
+    }
+}
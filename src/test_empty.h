@@ -19,6 +19,9 @@
 /**
  * @brief expr_test_clb implementation for -empty test.
  */
-enum expr_result expr_test_empty_clb(const char *path, const char *name, const struct stat *st, const char *arg);
+enum expr_result expr_test_empty_clb(const char *path, const char *name, const struct stat *st, const char *arg,
+        void *data);
+
+void expr_test_empty_batch(const struct expr_batch *batch, const char *arg, void *data, uint64_t *sel);
 
 #endif /* _TEST_EMPTY_H */
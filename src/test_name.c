@@ -5,7 +5,9 @@
  */
 
 #include <fnmatch.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "test_name.h"
 
@@ -39,13 +41,77 @@ expr_test_name_common(const char *action, const char *name, const char *pattern,
 }
 
 enum expr_result
-expr_test_name_clb(const char *UNUSED(path), const char *name, const struct stat *UNUSED(st), const char *arg)
+expr_test_name_clb(const char *UNUSED(path), const char *name, const struct stat *UNUSED(st), const char *arg,
+        void *UNUSED(data))
 {
     return expr_test_name_common("name", name, arg, 0);
 }
 
 enum expr_result
-expr_test_iname_clb(const char *UNUSED(path), const char *name, const struct stat *UNUSED(st), const char *arg)
+expr_test_iname_clb(const char *UNUSED(path), const char *name, const struct stat *UNUSED(st), const char *arg,
+        void *UNUSED(data))
 {
     return expr_test_name_common("iname", name, arg, FNM_CASEFOLD);
 }
+
+/**
+ * @brief Common code for the name tests of the batch.
+ *
+ * The pattern is analyzed once for the whole batch: the patterns without metacharacters except a leading
+ * or trailing `*' are matched by comparing the names' prefix or suffix of the known length, the rest is
+ * matched by fnmatch().
+ *
+ * @param[in] action Name of the action for logging.
+ * @param[in] batch The files being tested.
+ * @param[in] pattern Pattern string to evaluate.
+ * @param[in] flags Flags for fnmatch().
+ * @param[in,out] sel Selection bitmap of the files, the files not matching the pattern are deselected.
+ */
+static void
+expr_test_name_batch_common(const char *action, const struct expr_batch *batch, const char *pattern, int flags,
+        uint64_t *sel)
+{
+    size_t len = strlen(pattern), lit_len;
+    const char *lit = pattern;
+    int prefix = 0, suffix = 0, fast;
+    uint64_t word;
+    unsigned int i;
+
+    if (len && (pattern[0] == '*')) {
+        /* *literal */
+        suffix = 1;
+        lit++;
+    } else if (len && (pattern[len - 1] == '*')) {
+        /* literal* */
+        prefix = 1;
+    }
+    lit_len = len - suffix - prefix;
+    fast = !(flags & FNM_CASEFOLD) && !memchr(lit, '*', lit_len) && !memchr(lit, '?', lit_len) &&
+            !memchr(lit, '[', lit_len) && !memchr(lit, '\\', lit_len);
+
+    for (unsigned int w = 0; w < EXPR_BATCH_WORDS; w++) {
+        for (word = sel[w]; word; word &= word - 1) {
+            i = w * 64 + __builtin_ctzll(word);
+            if (!fast) {
+                if (!expr_test_name_common(action, batch->names[i], pattern, flags)) {
+                    EXPR_BATCH_CLR(sel, i);
+                }
+            } else if ((batch->name_lens[i] < lit_len) || (!prefix && !suffix && (batch->name_lens[i] != lit_len)) ||
+                    memcmp(suffix ? &batch->names[i][batch->name_lens[i] - lit_len] : batch->names[i], lit, lit_len)) {
+                EXPR_BATCH_CLR(sel, i);
+            }
+        }
+    }
+}
+
+void
+expr_test_name_batch(const struct expr_batch *batch, const char *arg, void *UNUSED(data), uint64_t *sel)
+{
+    expr_test_name_batch_common("name", batch, arg, 0, sel);
+}
+
+void
+expr_test_iname_batch(const struct expr_batch *batch, const char *arg, void *UNUSED(data), uint64_t *sel)
+{
+    expr_test_name_batch_common("iname", batch, arg, FNM_CASEFOLD, sel);
+}
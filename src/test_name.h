@@ -29,11 +29,17 @@
 /**
  * @brief expr_test_clb implementation for -name test.
  */
-enum expr_result expr_test_name_clb(const char *path, const char *name, const struct stat *st, const char *arg);
+enum expr_result expr_test_name_clb(const char *path, const char *name, const struct stat *st, const char *arg,
+        void *data);
 
 /**
  * @brief expr_test_clb implementation for -iname test.
  */
-enum expr_result expr_test_iname_clb(const char *path, const char *name, const struct stat *st, const char *arg);
+enum expr_result expr_test_iname_clb(const char *path, const char *name, const struct stat *st, const char *arg,
+        void *data);
+
+void expr_test_name_batch(const struct expr_batch *batch, const char *arg, void *data, uint64_t *sel);
+
+void expr_test_iname_batch(const struct expr_batch *batch, const char *arg, void *data, uint64_t *sel);
 
 #endif /* _TEST_NAME_H */
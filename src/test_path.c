@@ -0,0 +1,368 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_path.h"
+
+#include "arena.h"
+#include "common.h"
+
+/** @brief Number of bits in a word of the state sets and character bitmaps */
+#define PATH_WORD_BITS (sizeof(unsigned long) * CHAR_BIT)
+
+/** @brief Number of words of the character bitmap */
+#define PATH_SET_WORDS ((UCHAR_MAX + 1) / PATH_WORD_BITS)
+
+/** @brief Set the bit in the bitmap */
+#define PATH_BIT_SET(MAP, BIT) ((MAP)[(BIT) / PATH_WORD_BITS] |= 1UL << ((BIT) % PATH_WORD_BITS))
+
+/** @brief Check the bit in the bitmap */
+#define PATH_BIT_ISSET(MAP, BIT) ((MAP)[(BIT) / PATH_WORD_BITS] & (1UL << ((BIT) % PATH_WORD_BITS)))
+
+/**
+ * @brief Character classes accepted in the bracket expressions.
+ */
+static const struct {
+    const char *name;
+    int (*isclass)(int c);
+} path_classes[] = {
+    {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank}, {"cntrl", iscntrl},
+    {"digit", isdigit}, {"graph", isgraph}, {"lower", islower}, {"print", isprint},
+    {"punct", ispunct}, {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit}
+};
+
+/**
+ * @brief Compile the bracket expression.
+ *
+ * @param[in] p Pattern being compiled.
+ * @param[in] str The bracket expression, just after the opening bracket.
+ * @param[out] set Bitmap of the matching characters (not folded for -ipath).
+ * @return Pointer after the closing bracket.
+ * @return NULL if the bracket expression is not terminated, the bracket is a literal.
+ * @return str if the bracket expression is not supported by the automaton.
+ */
+static const char *
+path_compile_class(const struct path_pattern *p, const char *str, unsigned long *set)
+{
+    const char *s = str, *end;
+    unsigned long chars[PATH_SET_WORDS] = {0};
+    int negate = 0, first = 1, lo, hi;
+    size_t len;
+    unsigned int i;
+
+    if ((*s == '!') || (*s == '^')) {
+        negate = 1;
+        s++;
+    }
+
+    for (; *s != ']' || first; first = 0) {
+        if (!*s) {
+            return NULL;
+        } else if ((s[0] == '[') && ((s[1] == '.') || (s[1] == '='))) {
+            /* collating symbols and equivalence classes */
+            return str;
+        } else if ((s[0] == '[') && (s[1] == ':')) {
+            end = strstr(&s[2], ":]");
+            if (!end) {
+                return str;
+            }
+            len = end - &s[2];
+            for (i = 0; i < sizeof path_classes / sizeof *path_classes; i++) {
+                if ((strlen(path_classes[i].name) == len) && !strncmp(path_classes[i].name, &s[2], len)) {
+                    break;
+                }
+            }
+            if (i == sizeof path_classes / sizeof *path_classes) {
+                return str;
+            }
+            /* as in fnmatch(), the classes match the character as it is, not folded */
+            for (int c = 1; c <= UCHAR_MAX; c++) {
+                if (path_classes[i].isclass(c)) {
+                    PATH_BIT_SET(set, c);
+                }
+            }
+            s = end + 2;
+            continue;
+        }
+
+        if (*s == '\\') {
+            s++;
+            if (!*s) {
+                return str;
+            }
+        }
+        lo = (unsigned char)*s++;
+        if ((s[0] == '-') && s[1] && (s[1] != ']')) {
+            s++;
+            if ((s[0] == '[') && ((s[1] == '.') || (s[1] == '=') || (s[1] == ':'))) {
+                return str;
+            } else if (*s == '\\') {
+                s++;
+                if (!*s) {
+                    return str;
+                }
+            }
+            hi = (unsigned char)*s++;
+            if (p->casefold) {
+                lo = tolower(lo);
+                hi = tolower(hi);
+            }
+            for (int c = lo; c <= hi; c++) {
+                PATH_BIT_SET(chars, c);
+            }
+        } else {
+            PATH_BIT_SET(chars, p->casefold ? tolower(lo) : lo);
+        }
+    }
+
+    /* the characters and ranges match the folded character */
+    for (int c = 1; c <= UCHAR_MAX; c++) {
+        if (PATH_BIT_ISSET(chars, p->casefold ? tolower(c) : c)) {
+            PATH_BIT_SET(set, c);
+        }
+    }
+    if (negate) {
+        for (i = 0; i < PATH_SET_WORDS; i++) {
+            set[i] = ~set[i];
+        }
+    }
+
+    return s + 1;
+}
+
+/**
+ * @brief Compile the pattern into the automaton, see struct path_pattern.
+ *
+ * @param[in] arena Arena to allocate the pattern from.
+ * @param[in] arg The pattern.
+ * @param[in] casefold Flag of the case insensitive matching.
+ * @param[out] data The compiled pattern.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+path_compile(struct arena *arena, const char *arg, int casefold, void **data)
+{
+    struct path_pattern *p;
+    struct path_token *t;
+    const char *s, *end;
+    unsigned long *set;
+    int wildcards = 0;
+
+    p = arena_calloc(arena, sizeof *p);
+    if (!p || !(p->tokens = arena_alloc(arena, (strlen(arg) + 1) * sizeof *p->tokens))) {
+        return EXIT_FAILURE;
+    }
+    p->pattern = arg;
+    p->casefold = casefold;
+    *data = p;
+
+    for (s = arg; *s; ) {
+        t = &p->tokens[p->count];
+        switch (*s) {
+        case '*':
+            /* the adjacent stars are the same as a single one */
+            if (!p->count || (t[-1].type != PATH_TOKEN_STAR)) {
+                t->type = PATH_TOKEN_STAR;
+                p->count++;
+            }
+            s++;
+            continue;
+        case '?':
+            t->type = PATH_TOKEN_ANY;
+            wildcards = 1;
+            s++;
+            break;
+        case '[':
+            set = arena_calloc(arena, PATH_SET_WORDS * sizeof *set);
+            if (!set) {
+                return EXIT_FAILURE;
+            }
+            end = path_compile_class(p, s + 1, set);
+            if (end == s + 1) {
+                p->fallback = 1;
+                return EXIT_SUCCESS;
+            } else if (!end) {
+                /* not a bracket expression */
+                t->type = PATH_TOKEN_LITERAL;
+                t->c = '[';
+                s++;
+            } else {
+                t->type = PATH_TOKEN_CLASS;
+                t->set = set;
+                wildcards = 1;
+                s = end;
+            }
+            break;
+        case '\\':
+            if (!s[1]) {
+                p->fallback = 1;
+                return EXIT_SUCCESS;
+            }
+            s++;
+            /* fallthrough */
+        default:
+            t->type = PATH_TOKEN_LITERAL;
+            t->c = casefold ? tolower((unsigned char)*s) : (unsigned char)*s;
+            s++;
+            break;
+        }
+        p->count++;
+    }
+
+    if ((MB_CUR_MAX > 1) && (wildcards || casefold)) {
+        /* the automaton matches bytes, not the multibyte characters */
+        p->fallback = 1;
+        return EXIT_SUCCESS;
+    }
+
+    for (p->tail = p->count; p->tail && (p->tokens[p->tail - 1].type == PATH_TOKEN_STAR); p->tail--) {}
+    p->words = p->count / PATH_WORD_BITS + 1;
+
+    return EXIT_SUCCESS;
+}
+
+int
+expr_test_path_compile(struct arena *arena, const char *arg, void **data)
+{
+    return path_compile(arena, arg, 0, data);
+}
+
+int
+expr_test_ipath_compile(struct arena *arena, const char *arg, void **data)
+{
+    return path_compile(arena, arg, 1, data);
+}
+
+/**
+ * @brief Add the positions reachable by the stars (without consuming any character) into the state set.
+ */
+static void
+path_state_closure(const struct path_pattern *p, unsigned long *state)
+{
+    /* the stars are never adjacent, so a single pass is enough */
+    for (unsigned int i = 0; i < p->count; i++) {
+        if ((p->tokens[i].type == PATH_TOKEN_STAR) && PATH_BIT_ISSET(state, i)) {
+            PATH_BIT_SET(state, i + 1);
+        }
+    }
+}
+
+void
+path_pattern_step(const struct path_pattern *p, const unsigned long *from, const char *str, size_t len,
+        unsigned long *to)
+{
+    unsigned long next[p->words], w;
+    const struct path_token *t;
+    unsigned int i, j, live;
+    int raw, c;
+
+    if (from) {
+        memmove(to, from, p->words * sizeof *to);
+    } else {
+        memset(to, 0, p->words * sizeof *to);
+        PATH_BIT_SET(to, 0);
+        path_state_closure(p, to);
+    }
+
+    for (size_t k = 0; k < len; k++) {
+        raw = (unsigned char)str[k];
+        c = p->casefold ? tolower(raw) : raw;
+        memset(next, 0, sizeof next);
+        live = 0;
+        for (j = 0; j < p->words; j++) {
+            for (w = to[j]; w; w &= w - 1) {
+                i = j * PATH_WORD_BITS + __builtin_ctzl(w);
+                if (i == p->count) {
+                    /* the end of the pattern, nothing more can be consumed */
+                    continue;
+                }
+                t = &p->tokens[i];
+                if (t->type == PATH_TOKEN_STAR) {
+                    PATH_BIT_SET(next, i);
+                } else if ((t->type == PATH_TOKEN_ANY) || ((t->type == PATH_TOKEN_LITERAL) && (t->c == c)) ||
+                        ((t->type == PATH_TOKEN_CLASS) && PATH_BIT_ISSET(t->set, raw))) {
+                    PATH_BIT_SET(next, i + 1);
+                } else {
+                    continue;
+                }
+                live = 1;
+            }
+        }
+        path_state_closure(p, next);
+        memcpy(to, next, sizeof next);
+        if (!live) {
+            /* dead state */
+            break;
+        }
+    }
+}
+
+enum expr_subtree
+path_pattern_subtree(const struct path_pattern *p, const unsigned long *state)
+{
+    unsigned int i, empty = 1;
+
+    for (i = 0; i < p->words; i++) {
+        if (state[i]) {
+            empty = 0;
+            break;
+        }
+    }
+    if (empty) {
+        return EXPR_SUBTREE_FALSE;
+    }
+
+    /* the trailing stars match any suffix */
+    for (i = p->tail; i < p->count; i++) {
+        if (PATH_BIT_ISSET(state, i)) {
+            return EXPR_SUBTREE_TRUE;
+        }
+    }
+
+    return EXPR_SUBTREE_UNKNOWN;
+}
+
+enum expr_result
+expr_test_path_clb(const char *path, const char *name, const struct stat *UNUSED(st), const char *arg, void *data)
+{
+    struct path_pattern *p = data;
+    int rc;
+
+    if (p->fallback) {
+        rc = fnmatch(arg, path, p->casefold ? FNM_CASEFOLD : 0);
+        if (!rc) {
+            return EXPR_TRUE;
+        } else if (rc != FNM_NOMATCH) {
+            LOG("invalid pattern (%s) for -%s test.", arg, p->casefold ? "ipath" : "path");
+        }
+        return EXPR_FALSE;
+    }
+
+    unsigned long state[p->words];
+
+    /* only the name is consumed from the state set of the file's directory */
+    if (p->base) {
+        path_pattern_step(p, p->base, name, strlen(name), state);
+    } else {
+        path_pattern_step(p, NULL, path, strlen(path), state);
+    }
+
+    return PATH_BIT_ISSET(state, p->count) ? EXPR_TRUE : EXPR_FALSE;
+}
+
+enum expr_subtree
+expr_test_path_subtree(const void *data)
+{
+    const struct path_pattern *p = data;
+
+    return p->fallback ? EXPR_SUBTREE_UNKNOWN : p->subtree;
+}
@@ -0,0 +1,120 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _TEST_PATH_H
+#define _TEST_PATH_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "expressions.h"
+
+/**
+ * @brief help string for -path
+ */
+#define expr_test_path_help \
+    "    -path PATTERN\n" \
+    "            Filter files by their path matching the shell PATTERN. The\n" \
+    "            metacharacters `*' and `?' match also `/'. The directories where\n" \
+    "            the PATTERN cannot match anymore are not traversed when the files\n" \
+    "            under them cannot match the whole expression.\n"
+
+/**
+ * @brief help string for -ipath
+ */
+#define expr_test_ipath_help \
+    "    -ipath PATTERN\n" \
+    "            Same as -path, but the match is case insensitive.\n"
+
+/**
+ * @brief Type of the pattern token.
+ */
+enum path_token_type {
+    PATH_TOKEN_LITERAL,       /**< the given character */
+    PATH_TOKEN_ANY,           /**< any character (?) */
+    PATH_TOKEN_CLASS,         /**< character from the set ([...]) */
+    PATH_TOKEN_STAR           /**< any string (*) */
+};
+
+/**
+ * @brief Token of the compiled pattern.
+ */
+struct path_token {
+    enum path_token_type type;    /**< type of the token */
+    unsigned char c;              /**< the character of PATH_TOKEN_LITERAL (folded for -ipath) */
+    unsigned long *set;           /**< bitmap of the (not folded) characters of PATH_TOKEN_CLASS */
+};
+
+/**
+ * @brief Compiled -path/-ipath pattern.
+ *
+ * The pattern is a nondeterministic automaton with a state for each position between the tokens,
+ * its state set is a bitmap of the positions (words of unsigned long). The state set is carried
+ * down the traversal as the path components are appended, so a file is matched only by its name
+ * from the state set of its directory (the base). The subtree is skipped when the state set is
+ * empty (no path under the directory can match) or it reached the trailing stars (any path matches).
+ *
+ * The patterns not supported by the automaton are matched by fnmatch() on the whole path.
+ */
+struct path_pattern {
+    struct path_pattern *next;    /**< next pattern of the query, see query_patterns() */
+    const char *pattern;          /**< the source pattern */
+    int casefold;                 /**< flag of -ipath */
+    int fallback;                 /**< flag to match the pattern by fnmatch(), no automaton is available */
+
+    struct path_token *tokens;    /**< the tokens */
+    unsigned int count;           /**< number of the tokens */
+    unsigned int tail;            /**< position of the trailing stars (count if the pattern does not end with a star) */
+    unsigned int words;           /**< size of the state set in words */
+
+    unsigned int slot;            /**< offset of the pattern's state set in the traversal's state sets */
+    const unsigned long *base;    /**< state set of the directory of the evaluated files, NULL to match the whole path */
+    enum expr_subtree subtree;    /**< result for the subtree to be traversed, set by the traversal */
+};
+
+/**
+ * @brief Move the state set of the pattern by the string.
+ *
+ * @param[in] p Compiled pattern (not the fallback).
+ * @param[in] from State set to start from, NULL for the initial state set.
+ * @param[in] str String to consume.
+ * @param[in] len Length of the @p str.
+ * @param[out] to Resulting state set, it can be the same as @p from.
+ */
+void path_pattern_step(const struct path_pattern *p, const unsigned long *from, const char *str, size_t len,
+        unsigned long *to);
+
+/**
+ * @brief Get the pattern's result for all the paths prefixed by the string the state set was moved by.
+ *
+ * @param[in] p Compiled pattern (not the fallback).
+ * @param[in] state State set of the pattern.
+ * @return The result for all the paths with the prefix (without the prefix itself).
+ */
+enum expr_subtree path_pattern_subtree(const struct path_pattern *p, const unsigned long *state);
+
+/**
+ * @brief expr_test_compile_clb implementation for -path test.
+ */
+int expr_test_path_compile(struct arena *arena, const char *arg, void **data);
+
+/**
+ * @brief expr_test_compile_clb implementation for -ipath test.
+ */
+int expr_test_ipath_compile(struct arena *arena, const char *arg, void **data);
+
+/**
+ * @brief expr_test_clb implementation for -path and -ipath tests.
+ */
+enum expr_result expr_test_path_clb(const char *path, const char *name, const struct stat *st, const char *arg,
+        void *data);
+
+/**
+ * @brief expr_test_subtree_clb implementation for -path and -ipath tests.
+ */
+enum expr_subtree expr_test_path_subtree(const void *data);
+
+#endif /* _TEST_PATH_H */
@@ -0,0 +1,135 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define _POSIX_C_SOURCE 199309L /* clock_gettime(), nanosleep() */
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "throttle.h"
+
+/** @brief Interval of the rate adjustments in nanoseconds, also the size of the burst the bucket holds */
+#define THROTTLE_INTERVAL 100000000ULL
+
+/** @brief Initial rate of the adaptive bucket without the maximum rate */
+#define THROTTLE_RATE_START 1000.0
+
+/** @brief Minimal rate of the adaptive bucket, the scan never stops completely */
+#define THROTTLE_RATE_MIN 10.0
+
+/**
+ * @brief Get the monotonic time in nanoseconds.
+ */
+static uint64_t
+throttle_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+throttle_init(struct throttle *t, unsigned int rate, uint64_t latency_limit)
+{
+    memset(t, 0, sizeof *t);
+    if (!rate && !latency_limit) {
+        return;
+    }
+
+    t->max_rate = rate;
+    t->rate = (rate || !latency_limit) ? rate : THROTTLE_RATE_START;
+    t->tokens = 1;
+    t->latency_limit = latency_limit;
+    t->refilled = t->adjusted = throttle_now();
+}
+
+/**
+ * @brief Add the tokens for the time elapsed since the last refill, up to the burst of a single interval.
+ *
+ * @param[in] t Token bucket.
+ * @param[in] now Current time.
+ */
+static void
+throttle_refill(struct throttle *t, uint64_t now)
+{
+    double burst = t->rate * THROTTLE_INTERVAL / 1e9;
+
+    if (burst < 1) {
+        burst = 1;
+    }
+    t->tokens += (now - t->refilled) * t->rate / 1e9;
+    if (t->tokens > burst) {
+        t->tokens = burst;
+    }
+    t->refilled = now;
+}
+
+void
+throttle_take(struct throttle *t)
+{
+    struct timespec ts;
+    uint64_t wait;
+
+    if (!t->rate) {
+        return;
+    }
+
+    throttle_refill(t, throttle_now());
+    if (t->tokens < 1) {
+        /* sleep until the missing part of the token is refilled */
+        wait = (1 - t->tokens) * 1e9 / t->rate;
+        ts.tv_sec = wait / 1000000000ULL;
+        ts.tv_nsec = wait % 1000000000ULL;
+        while ((nanosleep(&ts, &ts) == -1) && (errno == EINTR)) {}
+        throttle_refill(t, throttle_now());
+        t->limited = 1;
+    }
+    t->tokens -= 1;
+}
+
+uint64_t
+throttle_start(const struct throttle *t)
+{
+    return t->latency_limit ? throttle_now() : 0;
+}
+
+void
+throttle_observe(struct throttle *t, uint64_t start)
+{
+    uint64_t now, latency;
+
+    if (!t->latency_limit) {
+        return;
+    }
+
+    now = throttle_now();
+    t->latency_sum += now - start;
+    t->latency_count++;
+    if (now - t->adjusted < THROTTLE_INTERVAL) {
+        return;
+    }
+
+    latency = t->latency_sum / t->latency_count;
+    if (latency > t->latency_limit) {
+        /* the device is busy, back off */
+        t->rate /= 2;
+        if (t->rate < THROTTLE_RATE_MIN) {
+            t->rate = THROTTLE_RATE_MIN;
+        }
+    } else if (t->limited) {
+        /* the device keeps up and the bucket slows the scan down, speed up (faster on an idle device) */
+        t->rate *= (latency < t->latency_limit / 2) ? 2 : 1.25;
+        if (t->max_rate && (t->rate > t->max_rate)) {
+            t->rate = t->max_rate;
+        }
+    }
+    t->latency_sum = 0;
+    t->latency_count = 0;
+    t->limited = 0;
+    t->adjusted = now;
+}
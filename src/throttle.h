@@ -0,0 +1,65 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _THROTTLE_H
+#define _THROTTLE_H
+
+#include <stdint.h>
+
+/**
+ * @brief Token bucket limiting the rate of the I/O operations of the scan (--max-iops, --max-stat-rate).
+ *
+ * In the adaptive mode (--throttle-latency), the rate is adjusted in each interval according to
+ * the observed latency of the operations: it is halved when the average latency exceeds the limit
+ * and raised when the latency is fine and the bucket was the bottleneck of the scan, so the scan
+ * takes only the capacity the device has to spare.
+ */
+struct throttle {
+    double rate;              /**< current rate in operations per second, 0 for no limit */
+    double max_rate;          /**< upper limit of the adapted rate, 0 for no limit */
+    double tokens;            /**< operations available without waiting */
+    uint64_t refilled;        /**< time of the last refill of the tokens */
+
+    uint64_t latency_limit;   /**< limit of the average latency in nanoseconds, 0 for the fixed rate */
+    uint64_t latency_sum;     /**< sum of the latencies observed in the current interval */
+    unsigned long latency_count; /**< number of the latencies observed in the current interval */
+    uint64_t adjusted;        /**< time of the last rate adjustment (start of the current interval) */
+    int limited;              /**< flag if any operation waited for a token in the current interval */
+};
+
+/**
+ * @brief Initiate the token bucket.
+ *
+ * @param[out] t Token bucket to initiate.
+ * @param[in] rate Maximum rate in operations per second, 0 for no limit.
+ * @param[in] latency_limit Limit of the average latency in nanoseconds to adapt the rate to, 0 for the fixed rate.
+ */
+void throttle_init(struct throttle *t, unsigned int rate, uint64_t latency_limit);
+
+/**
+ * @brief Take a token for an operation, wait for it if the bucket is empty.
+ *
+ * @param[in] t Token bucket.
+ */
+void throttle_take(struct throttle *t);
+
+/**
+ * @brief Get the start time of the operation to observe its latency.
+ *
+ * @param[in] t Token bucket.
+ * @return Current time in nanoseconds, 0 if the bucket does not adapt the rate.
+ */
+uint64_t throttle_start(const struct throttle *t);
+
+/**
+ * @brief Account the latency of the finished operation and adjust the rate at the end of the interval.
+ *
+ * @param[in] t Token bucket.
+ * @param[in] start Start time of the operation from throttle_start().
+ */
+void throttle_observe(struct throttle *t, uint64_t start);
+
+#endif /* _THROTTLE_H */
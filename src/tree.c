@@ -0,0 +1,291 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "tree.h"
+
+#include "common.h"
+#include "rfind.h"
+
+/** @brief Step for reallocating the tree records */
+#define TREE_NODES_STEP 4096
+/** @brief Step for reallocating the names pool */
+#define TREE_NAMES_STEP 65536
+
+/**
+ * @brief Add a record of the file into the tree.
+ *
+ * @param[in] tree Tree being built.
+ * @param[in] entry File to add.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+static int
+tree_add(struct tree *tree, const struct rfind_entry *entry)
+{
+    struct tree_node *node;
+    const char *name = entry->depth ? entry->name : entry->path;
+    size_t name_len = strlen(name);
+
+    if (tree->count == UINT32_MAX) {
+        LOG("too many files for the in-memory tree.");
+        return EXIT_FAILURE;
+    }
+
+    if (tree->count == tree->size) {
+        void *x = realloc(tree->nodes, (tree->size + TREE_NODES_STEP) * sizeof *tree->nodes);
+        if (!x) {
+            LOG("%s", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        tree->nodes = x;
+        tree->size += TREE_NODES_STEP;
+    }
+    if (tree->names_len + name_len > tree->names_size) {
+        void *x = realloc(tree->names, tree->names_size + name_len + TREE_NAMES_STEP);
+        if (!x) {
+            LOG("%s", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        tree->names = x;
+        tree->names_size += name_len + TREE_NAMES_STEP;
+    }
+
+    node = &tree->nodes[tree->count++];
+    node->name = tree->names_len;
+    node->name_len = name_len;
+    node->next = tree->count;
+    node->depth = entry->depth;
+    node->mode = entry->st->st_mode;
+    node->nlink = entry->st->st_nlink;
+    node->uid = entry->st->st_uid;
+    node->gid = entry->st->st_gid;
+    node->dev = entry->st->st_dev;
+    node->ino = entry->st->st_ino;
+    node->size = entry->st->st_size;
+    node->blocks = entry->st->st_blocks;
+    node->atime = entry->st->st_atime;
+    node->mtime = entry->st->st_mtime;
+    node->ctime = entry->st->st_ctime;
+
+    memcpy(&tree->names[tree->names_len], name, name_len);
+    tree->names_len += name_len;
+
+    return EXIT_SUCCESS;
+}
+
+int
+tree_build(char **argv, struct tree **tree)
+{
+    int ret = EXIT_FAILURE;
+    struct rfind_query *query = NULL;
+    struct rfind_scan *scan = NULL;
+    const struct rfind_entry *entry;
+    struct tree *t;
+    uint32_t *open = NULL, open_count = 0, open_size = 0;
+    int argc;
+
+    t = calloc(1, sizeof *t);
+    if (!t) {
+        LOG("%s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    t->refs = 1;
+
+    for (argc = 0; argv[argc]; argc++) {}
+    if (rfind_query_compile_argv(argc, argv, RFIND_QUERY_NOPRINT, &query) || rfind_scan_open(query, NULL, &scan)) {
+        goto cleanup;
+    }
+
+    while (1) {
+        if (rfind_scan_next(scan, &entry)) {
+            goto cleanup;
+        } else if (!entry) {
+            break;
+        }
+
+        /* the subtrees of the directories at the same or deeper level are finished */
+        while (open_count && t->nodes[open[open_count - 1]].depth >= entry->depth) {
+            t->nodes[open[--open_count]].next = t->count;
+        }
+
+        if (tree_add(t, entry)) {
+            goto cleanup;
+        }
+
+        if (S_ISDIR(entry->st->st_mode)) {
+            if (open_count == open_size) {
+                void *x = realloc(open, (open_size + 64) * sizeof *open);
+                if (!x) {
+                    LOG("%s", strerror(errno));
+                    goto cleanup;
+                }
+                open = x;
+                open_size += 64;
+            }
+            open[open_count++] = t->count - 1;
+        }
+    }
+    while (open_count) {
+        t->nodes[open[--open_count]].next = t->count;
+    }
+
+    *tree = t;
+    t = NULL;
+    ret = EXIT_SUCCESS;
+
+cleanup:
+    free(open);
+    if (rfind_scan_close(scan)) {
+        ret = EXIT_FAILURE;
+    }
+    rfind_query_free(query);
+    tree_free(t);
+    return ret;
+}
+
+/**
+ * @brief Check the relation of the path to the query's path.
+ *
+ * @param[in] path Path of the file.
+ * @param[in] path_len Length of the @p path.
+ * @param[in] qpath Query's path (without trailing slashes).
+ * @param[in] qpath_len Length of the @p qpath.
+ * @return 1 if the @p path is the @p qpath or it is inside it.
+ * @return 0 if the @p path is a parent directory of the @p qpath.
+ * @return -1 if the paths are not related.
+ */
+static int
+tree_path_relation(const char *path, size_t path_len, const char *qpath, size_t qpath_len)
+{
+    if (path_len >= qpath_len && !strncmp(path, qpath, qpath_len) &&
+            (path_len == qpath_len || path[qpath_len] == '/' || qpath[qpath_len - 1] == '/')) {
+        return 1;
+    } else if (path_len < qpath_len && !strncmp(path, qpath, path_len) &&
+            (qpath[path_len] == '/' || path[path_len - 1] == '/')) {
+        return 0;
+    }
+
+    return -1;
+}
+
+int
+tree_query(const struct tree *tree, struct rfind_query *query, tree_match_clb match_clb, void *data)
+{
+    int ret = EXIT_FAILURE;
+    const char **qpaths = rfind_query_paths(query);
+    const struct tree_node *node;
+    struct rfind_entry entry;
+    struct stat st;
+    char *path = NULL;
+    size_t path_size = 0, *lens = NULL, lens_size = 0, len, qlen;
+    int all, rel;
+
+    /* the default path means the whole tree */
+    all = !strcmp(qpaths[0], ".") && !qpaths[1];
+
+    memset(&st, 0, sizeof st);
+    entry.st = &st;
+
+    for (unsigned int q = 0; qpaths[q]; q++) {
+        qlen = strlen(qpaths[q]);
+        while (qlen > 1 && qpaths[q][qlen - 1] == '/') {
+            qlen--;
+        }
+
+        for (uint32_t i = 0; i < tree->count; ) {
+            node = &tree->nodes[i];
+
+            /* compound the path from the parent's path and the node's name */
+            if (node->depth >= lens_size) {
+                void *x = realloc(lens, (node->depth + 64) * sizeof *lens);
+                if (!x) {
+                    LOG("%s", strerror(errno));
+                    goto cleanup;
+                }
+                lens = x;
+                lens_size = node->depth + 64;
+            }
+            len = node->depth ? lens[node->depth - 1] : 0;
+            if (node->depth && path[len - 1] != '/') {
+                path[len++] = '/';
+            }
+            if (len + node->name_len + 1 > path_size) {
+                void *x = realloc(path, len + node->name_len + 4096);
+                if (!x) {
+                    LOG("%s", strerror(errno));
+                    goto cleanup;
+                }
+                path = x;
+                path_size = len + node->name_len + 4096;
+            }
+            memcpy(&path[len], &tree->names[node->name], node->name_len);
+            len += node->name_len;
+            path[len] = '\0';
+            lens[node->depth] = len;
+
+            rel = all ? 1 : tree_path_relation(path, len, qpaths[q], qlen);
+            if (rel == -1) {
+                /* skip the whole subtree */
+                i = node->next;
+                continue;
+            } else if (rel == 1) {
+                /* evaluate the expression */
+                entry.path = path;
+                entry.name = node->depth ? &path[len - node->name_len] : path;
+                if (!node->depth && strrchr(path, '/') && strrchr(path, '/')[1]) {
+                    entry.name = strrchr(path, '/') + 1;
+                }
+                entry.depth = node->depth;
+                entry.root_len = lens[0];
+                st.st_mode = node->mode;
+                st.st_nlink = node->nlink;
+                st.st_uid = node->uid;
+                st.st_gid = node->gid;
+                st.st_dev = node->dev;
+                st.st_ino = node->ino;
+                st.st_size = node->size;
+                st.st_blocks = node->blocks;
+                st.st_atime = node->atime;
+                st.st_mtime = node->mtime;
+                st.st_ctime = node->ctime;
+
+                if (rfind_query_match(query, &entry) && match_clb(path, len, data)) {
+                    goto cleanup;
+                }
+            }
+            i++;
+        }
+
+        if (all) {
+            break;
+        }
+    }
+    ret = EXIT_SUCCESS;
+
+cleanup:
+    free(lens);
+    free(path);
+    return ret;
+}
+
+void
+tree_free(struct tree *tree)
+{
+    if (!tree) {
+        return;
+    }
+
+    free(tree->nodes);
+    free(tree->names);
+    free(tree);
+}
@@ -0,0 +1,97 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _TREE_H
+#define _TREE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "rfind.h"
+
+/**
+ * @brief Compact record of a file in the in-memory tree.
+ *
+ * The records are stored in the order of the traversal (pre-order), so the subtree of
+ * a directory is the continuous range of records following the directory's record.
+ */
+struct tree_node {
+    uint32_t name;       /**< offset of the name in the names pool (the whole path for the roots) */
+    uint32_t name_len;   /**< length of the name */
+    uint32_t next;       /**< index of the first record following the node's subtree */
+    uint32_t depth;      /**< depth of the file, roots have depth 0 */
+
+    uint32_t mode;       /**< st_mode */
+    uint32_t nlink;      /**< st_nlink */
+    uint32_t uid;        /**< st_uid */
+    uint32_t gid;        /**< st_gid */
+    uint64_t dev;        /**< st_dev */
+    uint64_t ino;        /**< st_ino */
+    int64_t size;        /**< st_size */
+    int64_t blocks;      /**< st_blocks */
+    int64_t atime;       /**< st_atime (seconds) */
+    int64_t mtime;       /**< st_mtime (seconds) */
+    int64_t ctime;       /**< st_ctime (seconds) */
+};
+
+/**
+ * @brief Immutable snapshot of the file system tree.
+ */
+struct tree {
+    struct tree_node *nodes;  /**< records of the files */
+    uint32_t count;           /**< number of the records */
+    uint32_t size;            /**< allocated number of the records */
+    char *names;              /**< pool of the names */
+    size_t names_len;         /**< used size of the names pool */
+    size_t names_size;        /**< allocated size of the names pool */
+
+    unsigned int refs;        /**< reference counter, the tree is freed when it drops to zero */
+};
+
+/**
+ * @brief Callback for the matching files found by tree_query().
+ *
+ * @param[in] path Path of the matching file.
+ * @param[in] path_len Length of the @p path.
+ * @param[in] data Caller's data provided to tree_query().
+ * @return EXIT_SUCCESS to continue.
+ * @return EXIT_FAILURE to stop the query.
+ */
+typedef int (*tree_match_clb)(const char *path, size_t path_len, void *data);
+
+/**
+ * @brief Scan the roots and build the in-memory tree.
+ *
+ * @param[in] argv NULL-terminated list of the arguments for the scan (symlinks options and roots).
+ * @param[out] tree Created tree with a single reference.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int tree_build(char **argv, struct tree **tree);
+
+/**
+ * @brief Evaluate the query on the files in the tree.
+ *
+ * The query's paths select the subtrees to evaluate, the default path (".") means the whole tree.
+ * The tree is only read, so the queries can run concurrently.
+ *
+ * @param[in] tree Tree to query.
+ * @param[in] query Query to evaluate.
+ * @param[in] match_clb Callback for the matching files.
+ * @param[in] data Caller's data for the @p match_clb.
+ * @return EXIT_SUCCESS
+ * @return EXIT_FAILURE
+ */
+int tree_query(const struct tree *tree, struct rfind_query *query, tree_match_clb match_clb, void *data);
+
+/**
+ * @brief Free the tree.
+ *
+ * @param[in] tree Tree to free.
+ */
+void tree_free(struct tree *tree);
+
+#endif /* _TREE_H */
@@ -0,0 +1,103 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "writer.h"
+
+void
+writer_init(struct writer *w, FILE *stream)
+{
+    w->stream = stream;
+    w->len = 0;
+}
+
+void
+writer_flush(struct writer *w)
+{
+    if (w->len) {
+        fwrite(w->buf, 1, w->len, w->stream);
+        w->len = 0;
+    }
+}
+
+void
+writer_put(struct writer *w, const void *data, size_t len)
+{
+    if (w->len + len > WRITER_BUFSIZE) {
+        writer_flush(w);
+        if (len > WRITER_BUFSIZE) {
+            fwrite(data, 1, len, w->stream);
+            return;
+        }
+    }
+    memcpy(&w->buf[w->len], data, len);
+    w->len += len;
+}
+
+void
+writer_putc(struct writer *w, char c)
+{
+    if (w->len == WRITER_BUFSIZE) {
+        writer_flush(w);
+    }
+    w->buf[w->len++] = c;
+}
+
+void
+writer_pad(struct writer *w, char c, int count)
+{
+    char pad[64];
+
+    memset(pad, c, sizeof pad);
+    for (; count > 0; count -= sizeof pad) {
+        writer_put(w, pad, count < (int)sizeof pad ? (size_t)count : sizeof pad);
+    }
+}
+
+char *
+writer_uint_str(char *end, unsigned long long num, unsigned int base)
+{
+    do {
+        *(--end) = '0' + num % base;
+        num /= base;
+    } while (num);
+
+    return end;
+}
+
+void
+writer_uint(struct writer *w, unsigned long long num)
+{
+    char buf[24], *start;
+
+    start = writer_uint_str(&buf[sizeof buf], num, 10);
+    writer_put(w, start, &buf[sizeof buf] - start);
+}
+
+void
+writer_int(struct writer *w, long long num)
+{
+    if (num < 0) {
+        writer_putc(w, '-');
+        writer_uint(w, -(unsigned long long)num);
+    } else {
+        writer_uint(w, num);
+    }
+}
+
+void
+writer_le(struct writer *w, uint64_t num, unsigned int size)
+{
+    unsigned char buf[8];
+
+    for (unsigned int i = 0; i < size; i++) {
+        buf[i] = (num >> (8 * i)) & 0xff;
+    }
+    writer_put(w, buf, size);
+}
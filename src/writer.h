@@ -0,0 +1,108 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _WRITER_H
+#define _WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** @brief Size of the writer's buffer */
+#define WRITER_BUFSIZE 4096
+
+/**
+ * @brief Buffered writer of the actions' output.
+ *
+ * The output of a single action call is collected in the buffer (usually on the stack) and
+ * written to the action's stream by a single fwrite(3) in writer_flush(), so the output of the
+ * different actions keeps its order. The numbers are formatted without the printf(3) family.
+ */
+struct writer {
+    FILE *stream;                /**< stream to write the data to */
+    size_t len;                  /**< used part of the buf */
+    char buf[WRITER_BUFSIZE];    /**< buffered data */
+};
+
+/**
+ * @brief Initiate the (empty) writer.
+ *
+ * @param[in] w Writer to initiate.
+ * @param[in] stream Stream to write the data to.
+ */
+void writer_init(struct writer *w, FILE *stream);
+
+/**
+ * @brief Write the buffered data to the writer's stream.
+ *
+ * @param[in] w Writer to flush.
+ */
+void writer_flush(struct writer *w);
+
+/**
+ * @brief Append data into the writer's buffer, it is flushed when full.
+ *
+ * @param[in] w Writer to use.
+ * @param[in] data Data to write.
+ * @param[in] len Length of the @p data.
+ */
+void writer_put(struct writer *w, const void *data, size_t len);
+
+/**
+ * @brief Append a single character into the writer's buffer.
+ *
+ * @param[in] w Writer to use.
+ * @param[in] c Character to write.
+ */
+void writer_putc(struct writer *w, char c);
+
+/**
+ * @brief Append the character repeatedly into the writer's buffer.
+ *
+ * @param[in] w Writer to use.
+ * @param[in] c Padding character.
+ * @param[in] count Number of the padding characters, nothing is written for non-positive values.
+ */
+void writer_pad(struct writer *w, char c, int count);
+
+/**
+ * @brief Convert the unsigned number into its textual representation.
+ *
+ * The digits are written backwards from the end of the buffer.
+ *
+ * @param[in] end Pointer behind the end of the buffer (at least 22 characters for the octal numbers).
+ * @param[in] num Number to convert.
+ * @param[in] base Base of the number (8 or 10).
+ * @return Pointer to the first digit.
+ */
+char *writer_uint_str(char *end, unsigned long long num, unsigned int base);
+
+/**
+ * @brief Append the decimal representation of the unsigned number.
+ *
+ * @param[in] w Writer to use.
+ * @param[in] num Number to write.
+ */
+void writer_uint(struct writer *w, unsigned long long num);
+
+/**
+ * @brief Append the decimal representation of the signed number.
+ *
+ * @param[in] w Writer to use.
+ * @param[in] num Number to write.
+ */
+void writer_int(struct writer *w, long long num);
+
+/**
+ * @brief Append the number in the little-endian binary representation.
+ *
+ * @param[in] w Writer to use.
+ * @param[in] num Number to write.
+ * @param[in] size Number of the bytes to write (4 or 8).
+ */
+void writer_le(struct writer *w, uint64_t num, unsigned int size);
+
+#endif /* _WRITER_H */
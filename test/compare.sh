@@ -34,6 +34,26 @@ compare_finds() {
 	fi
 }
 
+# same as compare_finds, but the first argument are additional options
+# (space separated) passed only to rfind
+compare_finds_opts() {
+	OPTS=$1
+	shift
+
+	$FIND $* > test_find.out
+	$RFIND $OPTS $* > test_rfind.out
+
+	if [ `diff test_find.out test_rfind.out | wc -l` -eq 0 ]; then
+		echo "TEST OK ($OPTS $PATHS $*)"
+		return 0
+	else
+		echo "TEST FAILED ($OPTS $PATHS $*)"
+		diff test_find.out test_rfind.out
+		RESULT=1
+		return 1
+	fi
+}
+
 # create symbolic link in test directory
 if [ ! -L ${TESTDIR1}/link ]; then
 	ln -s ${TESTDIR2} ${TESTDIR1}/link
@@ -77,5 +97,404 @@ compare_finds ${TESTDIR1} ! -empty
 compare_finds ${TESTDIR1} ! \( -empty -and -print \)
 compare_finds ${TESTDIR1} ! \( -empty -or -print \)
 compare_finds ${TESTDIR1} \( -empty -o -name "*.txt" \) -a -print0
+compare_finds ${TESTDIR1} -printf "%p|%f|%h|%P|%H|%d|%y|%Y|%l\n"
+compare_finds ${TESTDIR1}/ -printf "%s|%k|%b|%m|%M|%U|%G|%n|%i|%T@|%A@|%T+|%TY-%Tm-%Td|%Ta,%Tb,%Te\n"
+compare_finds -L ${TESTDIR1} ${TESTDIR2} -printf "[%10f][%-10y][%.3p][%+d]\t\101\\\0"
+compare_finds ${TESTDIR1} -name "*.txt" -a -printf "(%p)100%%\n" -o -printf "%f\cignored"
+
+# expression profiling, the profile must not change the result
+compare_finds_opts "--profile-expr=test_profile.out" ${TESTDIR1} -empty -o -name "*.txt"
+compare_finds_opts "--profile-use=test_profile.out" ${TESTDIR1} -empty -o -name "*.txt"
+
+# limited number of opened directories, the rest of the listings is kept in memory
+compare_finds_opts "--fd-budget=1" ${TESTDIR1}
+compare_finds_opts "--fd-budget 1" -L ${TESTDIR1} ${TESTDIR2}
+compare_finds_opts "--fd-budget=2" ${TESTDIR1} -empty -o -name "*.txt"
+
+# stat in the inode order, the order of results is kept
+compare_finds_opts "--stat-order=inode" ${TESTDIR1} ${TESTDIR2}
+compare_finds_opts "--stat-order inode --fd-budget=1" -L ${TESTDIR1} -empty -o -name "*.txt"
+
+# directories prefetched ahead of the traversal, the order of results is kept
+compare_finds_opts "--prefetch=4" ${TESTDIR1} ${TESTDIR2}
+compare_finds_opts "--prefetch 1 --fd-budget=1" -L ${TESTDIR1} ${TESTDIR2}
+compare_finds_opts "--prefetch=8 --stat-order=inode" ${TESTDIR1} -empty -o -name "*.txt"
+compare_finds_opts "--stat-threads=4" ${TESTDIR1} ${TESTDIR2} -empty
+
+# path patterns matched by the automaton carried down the traversal (no pathname expansion of the patterns)
+set -f
+compare_finds ${TESTDIR1} ${TESTDIR2} -path "*/testdir1/*"
+compare_finds ${TESTDIR1} ${TESTDIR2} -path "*testdir[0-9]" -o -path "*/e*"
+compare_finds -L ${TESTDIR1} ${TESTDIR2} -ipath "*/LINK/*.TXT"
+compare_finds ${TESTDIR1}/ ! -path "*/[!e]*"
+compare_finds ${TESTDIR1} -path "${TESTDIR1}/?i*" -a -printf "%p\n"
+compare_finds ${TESTDIR1} -name "*.txt" -a -path "*[[:upper:]]*" -o -ipath "*[[:upper:]]*txt"
+compare_finds_opts "--prefetch=2" ${TESTDIR1} ${TESTDIR2} -path "*/emptydir" -o -path "*link/d*"
+set +f
+
+# early termination by -quit, find(1) exits with 0 as well
+compare_finds ${TESTDIR1} ${TESTDIR2} -print -a -quit
+compare_finds ${TESTDIR1} -name "file.txt" -a -print -a -quit
+compare_finds ${TESTDIR1} -quit
+
+# early termination by --limit and --deadline, the exit status tells if the traversal was stopped
+check_stop() {
+	NAME=$1
+	STATUS=$2
+	LINES=$3
+	shift 3
+
+	$RFIND $* > test_rfind.out
+	RC=$?
+	if [ ${RC} -eq ${STATUS} ] && [ `wc -l < test_rfind.out` -eq ${LINES} ]; then
+		echo "TEST OK (${NAME})"
+	else
+		echo "TEST FAILED (${NAME}: status ${RC}, `wc -l < test_rfind.out` lines)"
+		RESULT=1
+	fi
+}
+check_stop "--limit 3" 2 3 --limit 3 ${TESTDIR1} ${TESTDIR2}
+check_stop "--limit 100" 0 `$FIND ${TESTDIR1} ${TESTDIR2} | wc -l` --limit=100 ${TESTDIR1} ${TESTDIR2}
+check_stop "--limit 1 -print -a -quit" 0 1 --limit 1 ${TESTDIR1} -print -a -quit
+check_stop "--deadline 1h" 0 `$FIND ${TESTDIR1} ${TESTDIR2} | wc -l` --deadline 1h ${TESTDIR1} ${TESTDIR2}
+
+# the skipped files fail the traversal (as in find), the errors are summarized per errno and directory
+check_errors() {
+	NAME=$1
+	ERRORS=$2
+	BEFORE=$3
+	AFTER=$4
+
+	$FIND ${TESTDIR1} > test_find.out
+	$RFIND ${BEFORE} ${TESTDIR1} ${TESTDIR1}/none1 ${TESTDIR1}/none2 ${TESTDIR1}/none3/x ${AFTER} > test_rfind.out 2> test_rfind.err
+	RC=$?
+	if [ ${RC} -eq 1 ] && [ `diff test_find.out test_rfind.out | wc -l` -eq 0 ] &&
+			[ "`cat test_rfind.err`" = "${ERRORS}" ]; then
+		echo "TEST OK (${NAME})"
+	else
+		echo "TEST FAILED (${NAME}: status ${RC})"
+		cat test_rfind.err
+		RESULT=1
+	fi
+	rm -f test_rfind.err
+}
+ENOENT="No such file or directory"
+check_errors "--errors=summary" "rfind: skipped 3 entries under ${TESTDIR1}: ${ENOENT} (ENOENT)." --errors=summary ""
+check_errors "--errors-rate=1" "rfind: unable to get file ${TESTDIR1}/none1 information (${ENOENT}).
+rfind: 2 error messages suppressed by --errors-rate.
+rfind: skipped 3 entries under ${TESTDIR1}: ${ENOENT} (ENOENT)." --errors-rate=1 ""
+check_errors "--errors=json" "{\"error\":\"stat\",\"path\":\"${TESTDIR1}/none1\",\"errno\":\"ENOENT\",\"message\":\"${ENOENT}\"}
+{\"suppressed\":2}
+{\"skipped\":3,\"dir\":\"${TESTDIR1}\",\"errno\":\"ENOENT\",\"message\":\"${ENOENT}\"}" "--errors=json --errors-rate=1" ""
+# the long options after the paths
+check_errors "--errors=summary after the paths" "rfind: skipped 3 entries under ${TESTDIR1}: ${ENOENT} (ENOENT)." \
+	"" --errors=summary
+
+# throttled I/O, the result is the same, only slower (6 stats and opens at 10 per second)
+compare_finds_opts "--max-iops=100000 --max-stat-rate=100000" ${TESTDIR1} ${TESTDIR2}
+compare_finds_opts "--throttle-latency=1ms" -L ${TESTDIR1} ${TESTDIR2}
+START=`date +%s%N`
+compare_finds_opts "--max-iops=10" ${TESTDIR1} ${TESTDIR2}
+if [ $(( (`date +%s%N` - START) / 1000000 )) -lt 400 ]; then
+	echo "TEST FAILED (--max-iops=10 was not throttled)"
+	RESULT=1
+fi
+
+# aggregating actions compared with the GNU find's output processed by the usual tools
+compare_aggregate() {
+	NAME=$1
+	EXPECTED=$2
+	shift 2
+
+	set -f
+	$RFIND ${TESTDIR1} ${TESTDIR2} $* > test_rfind.out
+	set +f
+	if [ "`cat test_rfind.out`" = "${EXPECTED}" ]; then
+		echo "TEST OK (aggregate ${NAME})"
+	else
+		echo "TEST FAILED (aggregate ${NAME})"
+		echo "expected: ${EXPECTED}"
+		echo "got: `cat test_rfind.out`"
+		RESULT=1
+	fi
+}
+compare_aggregate count "`$FIND ${TESTDIR1} ${TESTDIR2} | wc -l`" -count
+compare_aggregate sum-size "`$FIND ${TESTDIR1} ${TESTDIR2} -printf '%s\n' | awk '{s += $1} END {print s}'`" -sum-size
+compare_aggregate group-by-depth "`$FIND ${TESTDIR1} ${TESTDIR2} -printf '%d\n' | sort -n | uniq -c | awk '{print $1, $2}'`" \
+	-group-by depth
+compare_aggregate group-by-dir "`$FIND ${TESTDIR1} ${TESTDIR2} -printf '%h\n' | LC_ALL=C sort | uniq -c | awk '{print $1, $2}'`" \
+	-group-by dir
+compare_aggregate group-by-ext "`$FIND ${TESTDIR1} ${TESTDIR2} -printf '%f\n' | sed -n 's/^..*\.\([^.]*\)$/\1/p' | LC_ALL=C sort | uniq -c | awk '{print $1, $2}'`" \
+	-name "?*.*" -a -group-by ext
+compare_aggregate count-and-group "`$FIND ${TESTDIR1} ${TESTDIR2} -empty | wc -l`
+`$FIND ${TESTDIR1} ${TESTDIR2} -empty -printf '%U\n' | sort -n | uniq -c | awk '{print $1, $2}'`" -empty -a -count -a -group-by uid
+
+# several queries in a single traversal, the equal subexpressions are shared
+compare_query_file() {
+	QUERY=$1
+	OUT=$2
+	shift 2
+
+	# no pathname expansion of the patterns
+	set -f
+	$FIND ${TESTDIR1} ${TESTDIR2} $* > test_find.out
+	set +f
+	if [ `diff test_find.out ${OUT} | wc -l` -eq 0 ]; then
+		echo "TEST OK (--query-file ${QUERY})"
+	else
+		echo "TEST FAILED (--query-file ${QUERY})"
+		diff test_find.out ${OUT}
+		RESULT=1
+	fi
+}
+cat > test_queries.txt << EOF
+# output expression
+test_query1.out -name "*.txt"
+test_query2.out -name "*.txt" -o -empty
+
+test_query3.out ! -name "*.txt" -a -printf "%f|%d\n"
+- -empty -a -name "*.txt"
+test_query4.out
+EOF
+$RFIND --query-file test_queries.txt ${TESTDIR1} ${TESTDIR2} > test_query5.out
+compare_query_file 1 test_query1.out -name "*.txt"
+compare_query_file 2 test_query2.out -name "*.txt" -o -empty
+compare_query_file 3 test_query3.out ! -name "*.txt" -a -printf "%f|%d\n"
+compare_query_file stdout test_query5.out -empty -a -name "*.txt"
+compare_query_file 4 test_query4.out
+# the profile of a single expression
+$RFIND --query-file test_queries.txt --profile-use test_profile.out ${TESTDIR1} 2>/dev/null
+if [ $? -eq 1 ]; then
+	echo "TEST OK (--query-file --profile-use refused)"
+else
+	echo "TEST FAILED (--query-file --profile-use refused)"
+	RESULT=1
+fi
+rm -f test_queries.txt test_query*.out
+
+# manifest of the tree and its diff against the changed tree (merged in the order of names)
+SNAPDIR=`mktemp -d`
+mkdir ${SNAPDIR}/a ${SNAPDIR}/a/b ${SNAPDIR}/a.d && echo x > ${SNAPDIR}/a/f && touch ${SNAPDIR}/a/b/c ${SNAPDIR}/a.txt ${SNAPDIR}/z
+check_diff() {
+	NAME=$1
+	EXPECTED=$2
+	shift 2
+
+	$RFIND $* > test_rfind.out
+	if [ $? -eq 0 ] && [ "`cat test_rfind.out`" = "${EXPECTED}" ]; then
+		echo "TEST OK (${NAME})"
+	else
+		echo "TEST FAILED (${NAME})"
+		echo "expected: ${EXPECTED}"
+		echo "got: `cat test_rfind.out`"
+		RESULT=1
+	fi
+}
+check_diff "--snapshot-out" "" ${SNAPDIR} --snapshot-out test_snapshot.m
+check_diff "--diff-against unchanged" "" --prefetch=2 ${SNAPDIR} --diff-against test_snapshot.m
+# no expression tree to profile
+check_diff "--diff-against --profile-expr" "" ${SNAPDIR} --diff-against test_snapshot.m --profile-expr=test_profile.out
+check_diff "--diff-against --profile-use" "" ${SNAPDIR} --diff-against test_snapshot.m --profile-use=test_profile.out
+echo y >> ${SNAPDIR}/a/f && rm ${SNAPDIR}/z && mkdir ${SNAPDIR}/a/new && touch ${SNAPDIR}/a/new/g ${SNAPDIR}/0
+check_diff "--diff-against changed" "`printf 'M\t%s\nA\t%s\nM\t%s\nM\t%s\nA\t%s\nA\t%s\nD\t%s' ${SNAPDIR} ${SNAPDIR}/0 \
+	${SNAPDIR}/a ${SNAPDIR}/a/f ${SNAPDIR}/a/new ${SNAPDIR}/a/new/g ${SNAPDIR}/z`" \
+	${SNAPDIR} --diff-against test_snapshot.m --snapshot-out test_snapshot.m
+check_diff "--diff-against replaced manifest" "" --fd-budget=1 ${SNAPDIR} --diff-against test_snapshot.m
+check_diff "--diff-against -name" "`printf 'D\t%s' ${SNAPDIR}/a/f`" ${SNAPDIR} ! -name f --diff-against test_snapshot.m
+rm -rf ${SNAPDIR} test_snapshot.m
+
+# -delete evaluates the directories after their files and deletes them by the worker threads,
+# both finds get the same tree and their outputs and the remaining trees are compared
+DELDIR=`mktemp -d`
+check_delete() {
+	OPTS=$1
+	PATHS=$2
+	shift 2
+	rm -rf ${DELDIR}/find ${DELDIR}/rfind
+	for d in find rfind; do
+		mkdir -p ${DELDIR}/$d/a/b/c ${DELDIR}/$d/e/f/g
+		(cd ${DELDIR}/$d && touch a/x a/b/y a/b/c/z e/keep && echo x > a/b/data && ln -s ../../e a/b/link)
+	done
+	(cd ${DELDIR}/find && $FIND $PATHS "$@" && echo "--" && $FIND . | sort) > test_find.out
+	(cd ${DELDIR}/rfind && $RFIND $OPTS $PATHS "$@" && echo "--" && $FIND . | sort) > test_rfind.out
+	if [ `diff test_find.out test_rfind.out | wc -l` -eq 0 ]; then
+		echo "TEST OK ($OPTS $PATHS $*)"
+	else
+		echo "TEST FAILED ($OPTS $PATHS $*)"
+		diff test_find.out test_rfind.out
+		RESULT=1
+	fi
+}
+set -f
+check_delete "" "a e" \( -name "[xz]" -o -name link -o -name c \) -a -delete -o -print
+check_delete "--fd-budget=1" "a e" -empty -a -delete
+check_delete "--stat-threads=2 --prefetch=2" "a e" -name "*" -a -delete
+check_delete "" . -delete
+set +f
+rm -rf ${DELDIR}
+
+# the resumed traversal continues the output of the interrupted one from the checkpoint,
+# the checkpoints in the middle of the traversal are written by hand
+CKDIR=`mktemp -d`
+mkdir -p ${CKDIR}/a/b ${CKDIR}/a.d ${CKDIR}/c && (cd ${CKDIR} && touch a/b/x a/b/y a/f a.d/g z 0 && echo x > c/h && \
+	seq 1 20 | sed 's|^|c/|' | xargs touch)
+$RFIND ${CKDIR} --checkpoint test_checkpoint -printf "%p %s\n" > test_rfind.full
+check_resume() {
+	LAST=$1
+	shift
+	LINE=`grep -n "^${LAST} " test_rfind.full | cut -d: -f1`
+	head -n ${LINE} test_rfind.full > test_rfind.out
+	printf "rfind-checkpoint 1\npaths 1\n%d %s\nmatches 0\noffset %d\nlast %d %s\n" ${#CKDIR} ${CKDIR} \
+		`wc -c < test_rfind.out` ${#LAST} ${LAST} > test_checkpoint
+	# the output written after the checkpoint is dropped
+	echo "after checkpoint" >> test_rfind.out
+	$RFIND ${CKDIR} --checkpoint test_checkpoint --resume test_checkpoint "$@" -printf "%p %s\n" >> test_rfind.out
+	if [ ! -e test_checkpoint ] && cmp -s test_rfind.out test_rfind.full; then
+		echo "TEST OK (--resume after ${LAST} $*)"
+	else
+		echo "TEST FAILED (--resume after ${LAST} $*)"
+		diff test_rfind.full test_rfind.out
+		RESULT=1
+	fi
+}
+check_resume ${CKDIR}
+check_resume ${CKDIR}/a --prefetch=2
+check_resume ${CKDIR}/a/b/x --stat-threads=2
+check_resume ${CKDIR}/c/19 --fd-budget=1
+check_resume ${CKDIR}/z
+# the traversal stopped by --deadline records its position
+$RFIND ${CKDIR} --max-iops=50 --deadline=100ms --checkpoint test_checkpoint -printf "%p %s\n" > test_rfind.out
+RC=$?
+$RFIND ${CKDIR} --checkpoint test_checkpoint --resume test_checkpoint -printf "%p %s\n" >> test_rfind.out
+if [ ${RC} -eq 2 ] && [ ! -e test_checkpoint ] && cmp -s test_rfind.out test_rfind.full; then
+	echo "TEST OK (--checkpoint with --deadline)"
+else
+	echo "TEST FAILED (--checkpoint with --deadline: status ${RC})"
+	diff test_rfind.full test_rfind.out
+	RESULT=1
+fi
+rm -rf ${CKDIR} test_rfind.full test_checkpoint
+
+# the probes of the tree with the same shape in all the subtrees give the exact estimate
+ESTDIR=`mktemp -d`
+mkest() {
+	mkdir -p $1 && echo data > $1/f.log && touch $1/g.log $1/h
+	[ $2 -eq 0 ] || for s in a b c; do mkest $1/$s $(($2 - 1)); done
+}
+mkest ${ESTDIR} 3
+set -f
+$RFIND ${ESTDIR} --estimate=20 -name "*.log" | grep -v directories > test_rfind.out
+printf "probes 20\nmatches %d +- 0\nsize %d +- 0\n" `$FIND ${ESTDIR} -name "*.log" | wc -l` \
+	`$FIND ${ESTDIR} -name "*.log" -printf "%s\n" | awk '{ s += $1 } END { print s }'` > test_find.out
+set +f
+if cmp -s test_find.out test_rfind.out; then
+	echo "TEST OK (--estimate)"
+else
+	echo "TEST FAILED (--estimate)"
+	diff test_find.out test_rfind.out
+	RESULT=1
+fi
+rm -rf ${ESTDIR}
+
+# the shards together hold the whole output, the dir key keeps each directory in a single shard
+check_shards() {
+	NAME=$1
+	shift
+	$RFIND $* --shard-output test_shard.%d ${TESTDIR1} ${TESTDIR2} > test_rfind.out
+	cat test_shard.0 test_shard.1 test_shard.2 test_rfind.out | sort > test_shard.out
+	$FIND ${TESTDIR1} ${TESTDIR2} | sort > test_find.out
+	if cmp -s test_find.out test_shard.out && \
+			[ `for i in 0 1 2; do grep -v "^${TESTDIR1}$\|^${TESTDIR2}$" test_shard.$i | sed 's|/[^/]*$||' | sort -u; done | \
+			sort | uniq -d | wc -l` -eq 0 -o "${NAME}" != "dir" ]; then
+		echo "TEST OK (--shard ${NAME})"
+	else
+		echo "TEST FAILED (--shard ${NAME})"
+		RESULT=1
+	fi
+	rm -f test_shard.0 test_shard.1 test_shard.2 test_shard.out
+}
+check_shards round-robin --shard 3
+check_shards dir --shard 3 --shard-key dir
+check_shards inode --shard 3 --shard-key=inode
+# %% escapes the % character, other % sequences are refused
+$RFIND --shard 2 --shard-output "test_shard%%.%d" ${TESTDIR1} > /dev/null
+if [ -f "test_shard%.0" ] && [ -f "test_shard%.1" ] && ! $RFIND --shard 2 --shard-output "test_shard%s.%d" ${TESTDIR1} 2> /dev/null; then
+	echo "TEST OK (--shard-output %%)"
+else
+	echo "TEST FAILED (--shard-output %%)"
+	RESULT=1
+fi
+rm -f "test_shard%.0" "test_shard%.1"
+
+# the subtree reached through several symlinks is replayed from the link cache, the 1 MiB cache keeps only
+# some of the subtrees
+LINKDIR=`mktemp -d`
+(cd ${LINKDIR} && for t in t1 t2; do mkdir -p $t/d && (cd $t/d && seq 1 2000 | xargs touch) && echo x > $t/d/1; done)
+(cd ${LINKDIR} && mkdir -p l/sub && for i in 1 2 3; do ln -s t1 t1.$i && ln -s ../../t2 l/sub/t2.$i; done)
+compare_finds_opts "--link-cache=64" -L ${LINKDIR}
+compare_finds_opts "--link-cache=1" -L ${LINKDIR} ! -empty
+rm -rf ${LINKDIR}
+
+# the paths on the same device are a single lane with the device's prefetch threads, the order is kept
+compare_finds_opts "--device-threads=2" ${TESTDIR1} ${TESTDIR2} -empty
+# the lanes of two devices (if /dev/shm is another one) are traversed concurrently, their files are interleaved
+SHMDIR=`mktemp -d -p /dev/shm 2>/dev/null`
+if [ -n "${SHMDIR}" ] && [ `stat -c %d ${SHMDIR}` != `stat -c %d ${TESTDIR1}` ]; then
+	(cd ${SHMDIR} && mkdir -p a/b c && touch a/1 a/b/2 c/3 && echo x > c/4)
+	$FIND ${TESTDIR1} ${SHMDIR} ${TESTDIR2} ! -empty | sort > test_find.out
+	$RFIND --device-threads=2 ${TESTDIR1} ${SHMDIR} ${TESTDIR2} ! -empty | sort > test_rfind.out
+	if cmp -s test_find.out test_rfind.out; then
+		echo "TEST OK (--device-threads with 2 devices)"
+	else
+		echo "TEST FAILED (--device-threads with 2 devices)"
+		diff test_find.out test_rfind.out
+		RESULT=1
+	fi
+fi
+rm -rf ${SHMDIR}
+
+# wide directory read in chunks with the files stat'ed by the stat threads
+WIDEDIR=`mktemp -d`
+(cd ${WIDEDIR} && seq 1 3000 | xargs touch && echo x > 1500 && echo x > 2999)
+compare_finds_opts "--stat-threads=4" ${WIDEDIR} ! -empty
+compare_finds_opts "--stat-threads=3 --stat-order=inode" ${WIDEDIR} -empty -a -name "2*"
+compare_finds_opts "--stat-threads=2 --max-stat-rate=1000000" ${WIDEDIR} -empty -a -name "*99*"
+# the listing's chunks evaluated at once by the tests preceding the actions
+compare_finds ${WIDEDIR} -name "1*" -o -empty
+compare_finds ${WIDEDIR} ! -name "*5" -a -name "1*" -a -print
+compare_finds ${WIDEDIR} \( -iname "2?9*" -o -name "15*" \) -a -print
+compare_finds_opts "--fd-budget=1" ${WIDEDIR} -name "299*" -o -path "*/1[0-1]0\\"
+rm -rf ${WIDEDIR}
+
+# deep tree with paths longer than PATH_MAX (built in two halves, the shell cannot enter such a path)
+DEEPDIR=`mktemp -d`
+mkdeep() {
+	for i in `seq 1 100`; do mkdir d_________________$i f_$i && touch f_$i/x && cd d_________________$i || return 1; done
+}
+(cd ${DEEPDIR} && mkdir half && cd half && mkdeep)
+(cd ${DEEPDIR} && mkdeep && mv ${DEEPDIR}/half .)
+compare_finds_opts "--fd-budget=3" ${DEEPDIR}
+compare_finds ${DEEPDIR} -name "x"
+compare_finds_opts "--stat-order=inode --fd-budget=2" ${DEEPDIR}
+compare_finds_opts "--prefetch=16 --fd-budget=40" ${DEEPDIR}
+compare_finds_opts "--prefetch=3" ${DEEPDIR} -name "x"
+# the subtrees where the pattern cannot match are not opened (about 800 stats and opens without it)
+START=`date +%s%N`
+compare_finds_opts "--max-iops=100" ${DEEPDIR} -path "${DEEPDIR}/f_1/*"
+if [ $(( (`date +%s%N` - START) / 1000000 )) -gt 2000 ]; then
+	echo "TEST FAILED (-path did not prune the traversal)"
+	RESULT=1
+fi
+compare_finds ${DEEPDIR} -path "${DEEPDIR}/half/d*_1/d*_2/f_3/*"
+# the deadline elapses long before the traversal ends, the results are partial
+$RFIND --deadline=0.001ms ${DEEPDIR} > test_rfind.out
+RC=$?
+if [ ${RC} -eq 2 ] && [ `wc -l < test_rfind.out` -lt `$FIND ${DEEPDIR} | wc -l` ]; then
+	echo "TEST OK (--deadline 0.001ms)"
+else
+	echo "TEST FAILED (--deadline 0.001ms: status ${RC})"
+	RESULT=1
+fi
+rm -rf ${DEEPDIR}
 
 exit ${RESULT}
@@ -0,0 +1,94 @@
+#!/bin/sh
+#
+# Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Usage: daemon.sh PATH/TO/EXECUTE/rfind PATH/TO/EXECUTE/rfindd
+
+RFIND=$1
+RFINDD=$2
+
+TESTDIR=`cd \`dirname $0\` && pwd`
+SOCKDIR=`mktemp -d`
+SOCKET=${SOCKDIR}/rfindd.sock
+
+# final return value - run all tests, but if any of them fails,
+# return non-zero at the end
+RESULT=0
+
+compare_daemon() {
+	$RFIND $* > test_rfind.out
+	$RFINDD -c ${SOCKET} $* > test_rfindd.out
+
+	if [ `diff test_rfind.out test_rfindd.out | wc -l` -eq 0 ]; then
+		echo "TEST OK ($*)"
+		return 0
+	else
+		echo "TEST FAILED ($*)"
+		diff test_rfind.out test_rfindd.out
+		RESULT=1
+		return 1
+	fi
+}
+
+$RFINDD -s ${SOCKET} ${TESTDIR}/testdir1 ${TESTDIR}/testdir2 &
+DAEMON=$!
+# wait for the initial scan
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	[ -S ${SOCKET} ] && break
+	sleep 1
+done
+
+#
+# list of tests comparing the result of rfind and the query via rfindd
+#
+# ADD NEW TESTS HERE
+
+compare_daemon ${TESTDIR}/testdir1 ${TESTDIR}/testdir2
+compare_daemon ${TESTDIR}/testdir1 -name "*.txt"
+compare_daemon ${TESTDIR}/testdir2 ! -empty
+compare_daemon ${TESTDIR}/testdir1/emptydir ${TESTDIR}/testdir2 -empty -o -iname "FILE"
+
+# the arguments are passed intact, including the newlines
+NL='
+'
+$RFIND ${TESTDIR}/testdir1 -name "*${NL}*" -o -name "file*" > test_rfind.out
+if $RFINDD -c ${SOCKET} ${TESTDIR}/testdir1 -name "*${NL}*" -o -name "file*" > test_rfindd.out &&
+		[ `diff test_rfind.out test_rfindd.out | wc -l` -eq 0 ]; then
+	echo "TEST OK (newline in the query)"
+else
+	echo "TEST FAILED (newline in the query)"
+	RESULT=1
+fi
+
+# actions are refused by the daemon
+if $RFINDD -c ${SOCKET} ${TESTDIR}/testdir1 -print 2>/dev/null; then
+	echo "TEST FAILED (action refused)"
+	RESULT=1
+else
+	echo "TEST OK (action refused)"
+fi
+
+# the options accessing files are refused, the daemon keeps serving
+if $RFINDD -c ${SOCKET} --profile-use ${SOCKET} ${TESTDIR}/testdir1 2>/dev/null; then
+	echo "TEST FAILED (option refused)"
+	RESULT=1
+else
+	echo "TEST OK (option refused)"
+fi
+compare_daemon --fd-budget=2 ${TESTDIR}/testdir1
+
+# invalid rescan interval
+if $RFINDD -i 5x -s ${SOCKDIR}/invalid.sock ${TESTDIR}/testdir1 2>/dev/null; then
+	echo "TEST FAILED (invalid interval refused)"
+	RESULT=1
+else
+	echo "TEST OK (invalid interval refused)"
+fi
+
+kill ${DAEMON}
+wait ${DAEMON}
+rm -rf ${SOCKDIR}
+
+exit ${RESULT}
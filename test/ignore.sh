@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Usage: ignore.sh PATH/TO/EXECUTE/rfind
+#
+# Compare the files found with --respect-ignore with the files not ignored by git(1).
+
+RFIND=$1
+
+if ! git --version > /dev/null 2>&1; then
+	echo "TEST SKIPPED (git is not available)"
+	exit 0
+fi
+
+# final return value - run all tests, but if any of them fails,
+# return non-zero at the end
+RESULT=0
+
+REPO=`mktemp -d`
+
+# the files listed by rfind and git, only the regular files (git does not list directories)
+compare_git() {
+	(cd ${REPO} && $RFIND --respect-ignore . -printf "%y%P\n" | sed -n 's/^f//p' | grep -v "^\.git/" | sort) > test_rfind.out
+	(cd ${REPO} && git ls-files --cached --others --exclude-standard | sort) > test_git.out
+
+	if [ `diff test_git.out test_rfind.out | wc -l` -eq 0 ]; then
+		echo "TEST OK ($1)"
+	else
+		echo "TEST FAILED ($1)"
+		diff test_git.out test_rfind.out
+		RESULT=1
+	fi
+}
+
+mkfiles() {
+	for f in "$@"; do
+		mkdir -p "${REPO}/`dirname "$f"`" && touch "${REPO}/$f"
+	done
+}
+
+(cd ${REPO} && git init -q .)
+mkfiles a.o a.c b.log keep.log build/x.c build/sub/y.c src/build/z.c src/main.c src/gen/out.c \
+	doc/a.txt doc/sub/b.txt doc/c.md lib/x.tmp lib/deep/y.tmp lib/deep/keep.tmp \
+	"sp ace" "hash#" "#lead" logs/a/debug.log logs/b/c/debug.log root.only sub/root.only \
+	"br[x].c" brx.c bry.c a/b/c/d/e.txt a/q.txt
+
+cat > ${REPO}/.gitignore << EOF
+# comment
+*.o
+*.log
+!keep.log
+/build/
+doc/**/*.txt
+lib/**
+!lib/deep/
+!lib/deep/keep.tmp
+\#lead
+/root.only
+logs/**/debug.log
+br[xy].c
+a/**/e.txt
+EOF
+cat > ${REPO}/src/.gitignore << EOF
+gen
+/build
+EOF
+compare_git "gitignore rules"
+
+# negation of a file in an excluded directory has no effect
+cat > ${REPO}/doc/.gitignore << EOF
+sub/
+!sub/b.txt
+!a.txt
+EOF
+compare_git "nested gitignore"
+
+# .ignore is applied by rfind only
+(cd ${REPO} && printf 'src/\n' > .ignore && $RFIND --respect-ignore . -name main.c) > test_rfind.out
+if [ -s test_rfind.out ]; then
+	echo "TEST FAILED (.ignore)"
+	cat test_rfind.out
+	RESULT=1
+else
+	echo "TEST OK (.ignore)"
+fi
+
+rm -rf ${REPO}
+rm -f test_git.out
+exit ${RESULT}
@@ -0,0 +1,113 @@
+/**
+ * Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Usage: test_reader < RECORDS
+ *
+ * Decode the rfind --output=binary stream and print each record as a line with the path
+ * followed by the present fields:
+ *
+ *     PATH type=T perm=OOO size=N mtime=S.NNNNNNNNN ...
+ *
+ * The type and perm (from the mode field) and the other field values are formatted as the
+ * GNU find's -printf %y, %m, %s, %T@ ... directives.
+ */
+
+#define _XOPEN_SOURCE 700 /* S_IF* file type constants */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "rfind_record.h"
+
+static char
+mode_type(uint32_t mode)
+{
+    switch (mode & S_IFMT) {
+    case S_IFREG:
+        return 'f';
+    case S_IFDIR:
+        return 'd';
+    case S_IFLNK:
+        return 'l';
+    case S_IFBLK:
+        return 'b';
+    case S_IFCHR:
+        return 'c';
+    case S_IFIFO:
+        return 'p';
+    case S_IFSOCK:
+        return 's';
+    }
+
+    return 'U';
+}
+
+int
+main(void)
+{
+    struct rfind_reader *reader;
+    const struct rfind_record *rec;
+    unsigned int fields;
+    int ret = EXIT_SUCCESS;
+
+    if (rfind_reader_open(stdin, &reader)) {
+        return EXIT_FAILURE;
+    }
+    fields = rfind_reader_fields(reader);
+
+    while (1) {
+        if (rfind_reader_next(reader, &rec)) {
+            ret = EXIT_FAILURE;
+            break;
+        } else if (!rec) {
+            break;
+        }
+
+        fwrite(rec->path, 1, rec->path_len, stdout);
+        if (fields & RFIND_FIELD_MODE) {
+            printf(" type=%c perm=%o", mode_type(rec->mode), (unsigned int)(rec->mode & 07777));
+        }
+        if (fields & RFIND_FIELD_SIZE) {
+            printf(" size=%" PRIu64, rec->size);
+        }
+        if (fields & RFIND_FIELD_MTIME) {
+            printf(" mtime=%" PRId64 ".%09" PRIu32, rec->mtime, rec->mtime_nsec);
+        }
+        if (fields & RFIND_FIELD_ATIME) {
+            printf(" atime=%" PRId64 ".%09" PRIu32, rec->atime, rec->atime_nsec);
+        }
+        if (fields & RFIND_FIELD_CTIME) {
+            printf(" ctime=%" PRId64 ".%09" PRIu32, rec->ctime, rec->ctime_nsec);
+        }
+        if (fields & RFIND_FIELD_INO) {
+            printf(" ino=%" PRIu64, rec->ino);
+        }
+        if (fields & RFIND_FIELD_DEV) {
+            printf(" dev=%" PRIu64, rec->dev);
+        }
+        if (fields & RFIND_FIELD_NLINK) {
+            printf(" nlink=%" PRIu64, rec->nlink);
+        }
+        if (fields & RFIND_FIELD_UID) {
+            printf(" uid=%" PRIu32, rec->uid);
+        }
+        if (fields & RFIND_FIELD_GID) {
+            printf(" gid=%" PRIu32, rec->gid);
+        }
+        if (fields & RFIND_FIELD_BLOCKS) {
+            printf(" blocks=%" PRIu64, rec->blocks);
+        }
+        if (fields & RFIND_FIELD_DEPTH) {
+            printf(" depth=%" PRIu32, rec->depth);
+        }
+        putchar('\n');
+    }
+
+    rfind_reader_close(reader);
+    return ret;
+}
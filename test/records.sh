@@ -0,0 +1,93 @@
+#!/bin/sh
+#
+# Copyright (C) 2021 Radek Krejci <radek.krejci@gmail.com>
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Usage: records.sh PATH/TO/EXECUTE/rfind PATH/TO/EXECUTE/test_reader
+
+FIND=find
+RFIND=$1
+READER=$2
+
+TESTDIR=`cd \`dirname $0\` && pwd`
+VECTORS=${TESTDIR}/vectors
+
+# final return value - run all tests, but if any of them fails,
+# return non-zero at the end
+RESULT=0
+
+check_diff() {
+	if [ `diff $2 $3 | wc -l` -eq 0 ]; then
+		echo "TEST OK ($1)"
+		return 0
+	else
+		echo "TEST FAILED ($1)"
+		diff $2 $3
+		RESULT=1
+		return 1
+	fi
+}
+
+check_fail() {
+	if $2 > /dev/null 2>&1 < $3; then
+		echo "TEST FAILED ($1 is expected to fail)"
+		RESULT=1
+		return 1
+	fi
+	echo "TEST OK ($1)"
+}
+
+# the reader decodes the test vectors
+${READER} < ${VECTORS}/records-v1.bin > test_reader.out
+check_diff "vector records-v1" ${VECTORS}/records-v1.txt test_reader.out
+${READER} < ${VECTORS}/records-empty.bin > test_reader.out
+check_diff "vector records-empty" /dev/null test_reader.out
+check_fail "vector records-truncated" ${READER} ${VECTORS}/records-truncated.bin
+check_fail "invalid stream" ${READER} ${VECTORS}/records-v1.txt
+
+# binary records compared with the GNU find's -printf, GNU find prints 10 digits of the fraction of seconds
+compare_binary() {
+	FIELDS=$1
+	FORMAT=$2
+	shift 2
+
+	$FIND $* -printf "%p${FORMAT}\n" | sed 's/\(time=-*[0-9]*\.[0-9]\{9\}\)[0-9]/\1/g' > test_find.out
+	$RFIND --output=binary --output-fields=${FIELDS} $* | ${READER} > test_rfind.out
+	check_diff "--output=binary --output-fields=${FIELDS} $*" test_find.out test_rfind.out
+}
+compare_binary "mode,size,mtime" " type=%y perm=%m size=%s mtime=%T@" ${TESTDIR}/testdir1 ${TESTDIR}/testdir2
+# the access time is left out, it is changed by the reading of the files
+compare_binary "ctime,ino,dev,nlink,uid,gid,blocks,depth" \
+	" ctime=%C@ ino=%i dev=%D nlink=%n uid=%U gid=%G blocks=%b depth=%d" -L ${TESTDIR}/testdir1
+compare_binary "ino,depth" " ino=%i depth=%d" ${TESTDIR}/testdir1 -name "*.txt"
+
+# no file matches, the stream consists of the header only
+$RFIND --output=binary ${TESTDIR}/testdir1 -name nothing | ${READER} > test_rfind.out
+check_diff "--output=binary with no record" /dev/null test_rfind.out
+
+# binary shards are complete streams, together they hold all the records
+$RFIND --shard 3 --shard-output test_shard.%d --output=binary --output-fields=ino ${TESTDIR}/testdir1 > test_rfind.out
+check_diff "--shard --output=binary stdout" /dev/null test_rfind.out
+for i in 0 1 2; do ${READER} < test_shard.$i; done | sort > test_rfind.out
+$RFIND --output=binary --output-fields=ino ${TESTDIR}/testdir1 | ${READER} | sort > test_find.out
+check_diff "--shard --output=binary" test_find.out test_rfind.out
+rm -f test_shard.0 test_shard.1 test_shard.2
+
+# NDJSON records
+$FIND ${TESTDIR}/testdir1 ${TESTDIR}/testdir2 -printf '{"path":"%p","size":%s,"ino":%i,"depth":%d}\n' > test_find.out
+$RFIND --output=ndjson --output-fields=size,ino,depth ${TESTDIR}/testdir1 ${TESTDIR}/testdir2 > test_rfind.out
+check_diff "--output=ndjson" test_find.out test_rfind.out
+
+# NDJSON escapes the special characters and encodes invalid UTF-8 paths in base64
+SPECIALDIR=`mktemp -d`
+touch "${SPECIALDIR}/new
+line" "${SPECIALDIR}/q\"uote" "${SPECIALDIR}/`printf '\377'`"
+(cd ${SPECIALDIR} && $RFIND --output=ndjson --output-fields=depth . -name "*[!.]*") | sort > test_rfind.out
+printf '%s\n' '{"path":"./new\nline","depth":1}' '{"path":"./q\"uote","depth":1}' '{"path_b64":"Li//","depth":1}' \
+	| sort > test_find.out
+check_diff "--output=ndjson escapes" test_find.out test_rfind.out
+rm -rf ${SPECIALDIR}
+
+rm -f test_reader.out
+exit ${RESULT}